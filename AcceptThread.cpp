@@ -220,17 +220,32 @@ void CAcceptThread::AddToSelectThread(CClient *client)
 	{
 		if( SelectThreads[i]->FreeClients()>0 )
 		{
-			SelectThreads[i]->AddClient( client );
+			if(!SelectThreads[i]->AddClient( client ))
+			{
+				RemoveFailedClient(client);
+			}
 			return;
 		}
 	}
 
 	CSelectThread *nt=new CSelectThread(WorkerThreadsPerMaster);
-	nt->AddClient( client );
+	bool added=nt->AddClient( client );
 
 	SelectThreads.push_back( nt );
 
 	Server->createThread(nt, "fastcgi: accept");
+
+	if(!added)
+	{
+		RemoveFailedClient(client);
+	}
+}
+
+void CAcceptThread::RemoveFailedClient(CClient *client)
+{
+	Server->Log("Could not add new connection to select thread. Closing it.", LL_ERROR);
+	client->remove();
+	delete client;
 }
 
 bool CAcceptThread::has_error(void)
@@ -19,6 +19,7 @@ public:
 
 private:
 	void AddToSelectThread(CClient *client);
+	void RemoveFailedClient(CClient *client);
 
 	std::vector<CSelectThread*> SelectThreads;
 
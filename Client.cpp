@@ -28,6 +28,7 @@ CClient::CClient()
 	mutex=Server->createMutex();
 	m_lock=NULL;
 	processing=false;
+	select_thread=NULL;
 }
 
 CClient::~CClient()
@@ -50,6 +51,16 @@ FCGIProtocolDriver * CClient::getFCGIProtocolDriver()
 	return driver;
 }
 
+CSelectThread* CClient::getSelectThread()
+{
+	return select_thread;
+}
+
+void CClient::setSelectThread(CSelectThread* pselect_thread)
+{
+	select_thread=pselect_thread;
+}
+
 #ifndef TCP_CORK
 #define TCP_CORK TCP_NOPUSH
 #endif
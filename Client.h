@@ -5,6 +5,7 @@
 class FCGIProtocolDriver;
 class OutputCallback;
 class FCGIRequest;
+class CSelectThread;
 
 class CClient
 {
@@ -27,6 +28,9 @@ public:
 
 	void set(SOCKET ps, OutputCallback *poutput, FCGIProtocolDriver * pdriver );
 
+	CSelectThread* getSelectThread();
+	void setSelectThread(CSelectThread* pselect_thread);
+
 	void lock();
 	void unlock();
 	void remove();
@@ -35,6 +39,7 @@ private:
 	OutputCallback * output;
 	FCGIProtocolDriver * driver;
 	bool processing;
+	CSelectThread* select_thread;
 	IMutex * mutex;
 	IScopedLock *m_lock;
 	std::deque<FCGIRequest*> requests;
@@ -27,6 +27,10 @@
 #include "Server.h"
 #include "stringtools.h"
 #include <errno.h>
+#ifdef SELECT_THREAD_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
 
 std::vector<CWorkerThread*> workers;
 IMutex* workers_mutex=NULL;
@@ -54,6 +58,18 @@ CSelectThread::CSelectThread(_u32 pWorkerThreadsPerMaster)
 	stop_mutex=Server->createMutex();
 	cond=Server->createCondition();
 	stop_cond=Server->createCondition();
+
+#ifdef SELECT_THREAD_EPOLL
+	epoll_fd=-1;
+	if(Server->getServerParameter("fastcgi_selector")!="select")
+	{
+		epoll_fd=epoll_create1(EPOLL_CLOEXEC);
+		if(epoll_fd==-1)
+		{
+			Server->Log("Creating epoll instance failed (errno "+convert(errno)+"). Using select.", LL_WARNING);
+		}
+	}
+#endif
 	
 	IScopedLock lock(workers_mutex);
 	if( workers.size()==0 )
@@ -92,10 +108,25 @@ CSelectThread::~CSelectThread()
 	Server->destroy(stop_mutex);
 	Server->destroy(cond);
 	Server->destroy(stop_cond);
+
+#ifdef SELECT_THREAD_EPOLL
+	if(epoll_fd!=-1)
+	{
+		close(epoll_fd);
+	}
+#endif
 }
 
 void CSelectThread::operator()()
 {
+#ifdef SELECT_THREAD_EPOLL
+	if(epoll_fd!=-1)
+	{
+		EpollLoop();
+		return;
+	}
+#endif
+
 #ifdef _WIN32
 	_i32 max;
 	fd_set fdset;
@@ -239,7 +270,21 @@ bool CSelectThread::AddClient(CClient *client)
 	if( FreeClients()>0 )
 	{
 		IScopedLock lock(mutex);
+		client->setSelectThread(this);
 		clients.push_back(client);
+#ifdef SELECT_THREAD_EPOLL
+		if(epoll_fd!=-1)
+		{
+			if(!ArmClient(client, EPOLL_CTL_ADD))
+			{
+				//Never polled. The caller still owns the client.
+				clients.pop_back();
+				client->setSelectThread(NULL);
+				return false;
+			}
+			return true;
+		}
+#endif
 		WakeUp();
 		return true;
 	}
@@ -249,6 +294,12 @@ bool CSelectThread::AddClient(CClient *client)
 size_t CSelectThread::FreeClients(void)
 {
 	IScopedLock lock(mutex);
+#ifdef SELECT_THREAD_EPOLL
+	if(epoll_fd!=-1)
+	{
+		return max_clients_epoll-clients.size();
+	}
+#endif
 	return max_clients-clients.size();
 }
 
@@ -260,6 +311,12 @@ bool CSelectThread::RemoveClient(CClient *client)
 		if( clients[i]==client )
 		{
 			clients.erase( clients.begin()+i );
+#ifdef SELECT_THREAD_EPOLL
+			if(epoll_fd!=-1)
+			{
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->getSocket(), NULL);
+			}
+#endif
 			client->remove();
 			delete client;
 			return true;
@@ -283,3 +340,79 @@ void CSelectThread::WakeUp(void)
 {
 	cond->notify_one();
 }
+
+void CSelectThread::ReleaseClient(CClient *client)
+{
+	client->setProcessing(false);
+#ifdef SELECT_THREAD_EPOLL
+	if(epoll_fd!=-1)
+	{
+		ArmClient(client, EPOLL_CTL_MOD);
+		return;
+	}
+#endif
+	WakeUp();
+}
+
+#ifdef SELECT_THREAD_EPOLL
+bool CSelectThread::ArmClient(CClient *client, int op)
+{
+	//Edge triggered and one shot: the socket is reported once and then
+	//disabled till the worker has read from it and re-armed it. Re-arming
+	//reports the socket again if there is unread data left.
+	epoll_event ev;
+	ev.events=EPOLLIN|EPOLLET|EPOLLONESHOT;
+	ev.data.ptr=client;
+	if(epoll_ctl(epoll_fd, op, client->getSocket(), &ev)!=0)
+	{
+		Server->Log("Error adding socket to epoll set. Errno: "+convert(errno), LL_ERROR);
+		return false;
+	}
+	return true;
+}
+
+void CSelectThread::EpollLoop()
+{
+	std::vector<epoll_event> events(64);
+	std::vector<CClient*> ready;
+	while(run)
+	{
+		int rc=epoll_wait(epoll_fd, &events[0], static_cast<int>(events.size()), 500);
+
+		if(rc>0)
+		{
+			ready.clear();
+			for(int i=0;i<rc;++i)
+			{
+				CClient *client=reinterpret_cast<CClient*>(events[i].data.ptr);
+				if( client->setProcessing(true) == false )
+				{
+					ready.push_back(client);
+				}
+			}
+
+			if(!ready.empty())
+			{
+				//Hand over all ready clients with one lock of the queue
+				IScopedLock lock(clients_mutex);
+				client_queue.insert(client_queue.end(), ready.begin(), ready.end());
+				if(ready.size()==1)
+				{
+					clients_cond->notify_one();
+				}
+				else
+				{
+					clients_cond->notify_all();
+				}
+			}
+		}
+		else if(rc==-1 && errno!=EINTR)
+		{
+			Server->Log("epoll_wait error: "+convert(errno), LL_ERROR);
+			Server->wait(100);
+		}
+	}
+	IScopedLock slock(stop_mutex);
+	stop_cond->notify_one();
+}
+#endif //SELECT_THREAD_EPOLL
@@ -13,6 +13,13 @@ class CWorkerThread;
 
 const size_t max_clients=60;
 
+#ifdef __linux__
+#define SELECT_THREAD_EPOLL
+//epoll does not have the FD_SETSIZE limit and its cost does not grow
+//with the number of idle connections
+const size_t max_clients_epoll=10000;
+#endif
+
 class CSelectThread : public IThread
 {
 public:
@@ -24,12 +31,23 @@ public:
 	bool AddClient(CClient *client);
 	bool RemoveClient(CClient *client);
 
+	//Called by the worker after it has processed the input of client
+	void ReleaseClient(CClient *client);
+
 	size_t FreeClients(void);
 
 	void WakeUp(void);
 private:
 	void FindWorker(CClient *client);
 
+#ifdef SELECT_THREAD_EPOLL
+	void EpollLoop();
+
+	bool ArmClient(CClient *client, int op);
+
+	int epoll_fd;
+#endif
+
 	std::deque<CClient*> clients;
 
 	IMutex *mutex;
@@ -94,7 +94,7 @@ void CWorkerThread::operator()()
 				{
 					keep_alive=true;
 					//Server->Log("Client disconnected", LL_INFO);
-					Master->RemoveClient( client );
+					client->getSelectThread()->RemoveClient( client );
 					lock.relock(clients_mutex);
 				}
 				else
@@ -117,7 +117,7 @@ void CWorkerThread::operator()()
 					}catch(...)
 					{
 						client->unlock();
-						Master->RemoveClient(client);
+						client->getSelectThread()->RemoveClient(client);
 						lock.relock(clients_mutex);
 						continue;
 					}
@@ -129,7 +129,7 @@ void CWorkerThread::operator()()
 					}catch(...)
 					{
 						client->unlock();
-						Master->RemoveClient(client);
+						client->getSelectThread()->RemoveClient(client);
 						lock.relock(clients_mutex);
 						continue;
 					}
@@ -151,12 +151,11 @@ void CWorkerThread::operator()()
 					{
 						keep_alive=true;
 						//Server->Log("Client disconnected", LL_INFO);
-						Master->RemoveClient( client );
+						client->getSelectThread()->RemoveClient( client );
 					}
 					else
 					{
-						client->setProcessing(false);
-						Master->WakeUp();
+						client->getSelectThread()->ReleaseClient(client);
 					}
 
 					lock.relock(clients_mutex);
@@ -31,6 +31,21 @@ adler32.c -- compute the Adler-32 checksum of a data stream
 
 /* @(#) $Id$ */
 
+#include "adler32.h"
+#include <stddef.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) \
+	&& (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define ADLER32_X86_SIMD
+#define ADLER32_TARGET(x) __attribute__((target(x)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && _MSC_VER >= 1700 && (defined(_M_X64) || defined(_M_IX86))
+#define ADLER32_X86_SIMD
+#define ADLER32_TARGET(x)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
 #define BASE 65521      /* largest prime smaller than 65536 */
 #define NMAX 5552
 /* NMAX is the largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1 */
@@ -47,7 +62,7 @@ adler32.c -- compute the Adler-32 checksum of a data stream
 #  define MOD63(a) a %= BASE
 
 /* ========================================================================= */
-unsigned int urb_adler32(unsigned int adler, const char* pbuf, unsigned int len)
+unsigned int urb_adler32_scalar(unsigned int adler, const char* pbuf, unsigned int len)
 {
 	const unsigned char* buf = reinterpret_cast<const unsigned char*>(pbuf);
     unsigned int sum2;
@@ -134,4 +149,225 @@ unsigned int urb_adler32_combine(unsigned int adler1, unsigned int adler2, unsig
 	if (sum2 >= (BASE << 1)) sum2 -= (BASE << 1);
 	if (sum2 >= BASE) sum2 -= BASE;
 	return sum1 | (sum2 << 16);
-}
\ No newline at end of file
+}
+
+#ifdef ADLER32_X86_SIMD
+
+/*
+ Vectorized versions based on the approach in Chromium's zlib
+ (adler32_simd.c). Blocks of 32 bytes are summed with SAD/multiply-add
+ instructions. s2 gets the weighted byte sum of each block plus 32 times
+ the s1 value before each block (v_ps).
+ Short lengths and the tail go through the scalar version.
+*/
+
+#define BLOCK_SIZE 32
+
+namespace
+{
+	unsigned int adler32_tail(unsigned int s1, unsigned int s2, const unsigned char* buf, unsigned int len)
+	{
+		return urb_adler32_scalar(s1 | (s2 << 16), reinterpret_cast<const char*>(buf), len);
+	}
+}
+
+static ADLER32_TARGET("ssse3")
+unsigned int urb_adler32_ssse3(unsigned int adler, const char* pbuf, unsigned int len)
+{
+	if (pbuf == NULL || len < 64)
+	{
+		return urb_adler32_scalar(adler, pbuf, len);
+	}
+
+	const unsigned char* buf = reinterpret_cast<const unsigned char*>(pbuf);
+	unsigned int s1 = adler & 0xffff;
+	unsigned int s2 = (adler >> 16) & 0xffff;
+
+	unsigned int blocks = len / BLOCK_SIZE;
+	len -= blocks * BLOCK_SIZE;
+
+	const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+	const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16(1);
+
+	while (blocks)
+	{
+		unsigned int n = NMAX / BLOCK_SIZE;
+		if (n > blocks)
+			n = blocks;
+		blocks -= n;
+
+		__m128i v_ps = _mm_set_epi32(0, 0, 0, s1 * n);
+		__m128i v_s2 = _mm_set_epi32(0, 0, 0, s2);
+		__m128i v_s1 = _mm_setzero_si128();
+
+		do
+		{
+			const __m128i bytes1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+			const __m128i bytes2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 16));
+
+			v_ps = _mm_add_epi32(v_ps, v_s1);
+
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+
+			buf += BLOCK_SIZE;
+		} while (--n);
+
+		v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+		s1 += _mm_cvtsi128_si32(v_s1);
+
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+		s2 = _mm_cvtsi128_si32(v_s2);
+
+		MOD(s1);
+		MOD(s2);
+	}
+
+	return adler32_tail(s1, s2, buf, len);
+}
+
+static ADLER32_TARGET("avx2")
+unsigned int urb_adler32_avx2(unsigned int adler, const char* pbuf, unsigned int len)
+{
+	if (pbuf == NULL || len < 64)
+	{
+		return urb_adler32_scalar(adler, pbuf, len);
+	}
+
+	const unsigned char* buf = reinterpret_cast<const unsigned char*>(pbuf);
+	unsigned int s1 = adler & 0xffff;
+	unsigned int s2 = (adler >> 16) & 0xffff;
+
+	unsigned int blocks = len / BLOCK_SIZE;
+	len -= blocks * BLOCK_SIZE;
+
+	const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+		16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi16(1);
+
+	while (blocks)
+	{
+		unsigned int n = NMAX / BLOCK_SIZE;
+		if (n > blocks)
+			n = blocks;
+		blocks -= n;
+
+		__m256i v_ps = _mm256_setr_epi32(s1 * n, 0, 0, 0, 0, 0, 0, 0);
+		__m256i v_s2 = _mm256_setr_epi32(s2, 0, 0, 0, 0, 0, 0, 0);
+		__m256i v_s1 = _mm256_setzero_si256();
+
+		do
+		{
+			const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf));
+
+			v_ps = _mm256_add_epi32(v_ps, v_s1);
+			v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+			v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, tap), ones));
+
+			buf += BLOCK_SIZE;
+		} while (--n);
+
+		v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 5));
+
+		__m128i s1_128 = _mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1));
+		s1_128 = _mm_add_epi32(s1_128, _mm_shuffle_epi32(s1_128, _MM_SHUFFLE(2, 3, 0, 1)));
+		s1_128 = _mm_add_epi32(s1_128, _mm_shuffle_epi32(s1_128, _MM_SHUFFLE(1, 0, 3, 2)));
+		s1 += _mm_cvtsi128_si32(s1_128);
+
+		__m128i s2_128 = _mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1));
+		s2_128 = _mm_add_epi32(s2_128, _mm_shuffle_epi32(s2_128, _MM_SHUFFLE(2, 3, 0, 1)));
+		s2_128 = _mm_add_epi32(s2_128, _mm_shuffle_epi32(s2_128, _MM_SHUFFLE(1, 0, 3, 2)));
+		s2 = _mm_cvtsi128_si32(s2_128);
+
+		MOD(s1);
+		MOD(s2);
+	}
+
+	return adler32_tail(s1, s2, buf, len);
+}
+
+namespace
+{
+	enum EAdler32Impl
+	{
+		EAdler32Impl_Scalar,
+		EAdler32Impl_Ssse3,
+		EAdler32Impl_Avx2
+	};
+
+	EAdler32Impl select_adler32_impl()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int max_leaf = info[0];
+		__cpuid(info, 1);
+		bool has_ssse3 = (info[2] & (1 << 9)) != 0;
+		bool has_avx = (info[2] & (1 << 27)) != 0 /* OSXSAVE */
+			&& (info[2] & (1 << 28)) != 0
+			&& (_xgetbv(0) & 6) == 6;
+		bool has_avx2 = false;
+		if (has_avx && max_leaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			has_avx2 = (info[1] & (1 << 5)) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		bool has_ssse3 = __builtin_cpu_supports("ssse3") != 0;
+		bool has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+		if (has_avx2)
+			return EAdler32Impl_Avx2;
+		else if (has_ssse3)
+			return EAdler32Impl_Ssse3;
+		else
+			return EAdler32Impl_Scalar;
+	}
+
+	EAdler32Impl adler32_impl = select_adler32_impl();
+}
+
+unsigned int urb_adler32(unsigned int adler, const char* pbuf, unsigned int len)
+{
+	switch (adler32_impl)
+	{
+	case EAdler32Impl_Avx2: return urb_adler32_avx2(adler, pbuf, len);
+	case EAdler32Impl_Ssse3: return urb_adler32_ssse3(adler, pbuf, len);
+	default: return urb_adler32_scalar(adler, pbuf, len);
+	}
+}
+
+const char* urb_adler32_impl_name()
+{
+	switch (adler32_impl)
+	{
+	case EAdler32Impl_Avx2: return "avx2";
+	case EAdler32Impl_Ssse3: return "ssse3";
+	default: return "scalar";
+	}
+}
+
+#else //ADLER32_X86_SIMD
+
+unsigned int urb_adler32(unsigned int adler, const char* pbuf, unsigned int len)
+{
+	return urb_adler32_scalar(adler, pbuf, len);
+}
+
+const char* urb_adler32_impl_name()
+{
+	return "scalar";
+}
+
+#endif //ADLER32_X86_SIMD
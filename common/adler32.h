@@ -2,4 +2,10 @@
 
 unsigned int urb_adler32(unsigned int adler, const char *pbuf, unsigned int len);
 
-unsigned int urb_adler32_combine(unsigned int adler1, unsigned int adler2, unsigned int len2);
\ No newline at end of file
+unsigned int urb_adler32_combine(unsigned int adler1, unsigned int adler2, unsigned int len2);
+
+//Portable version. urb_adler32 uses SSSE3/AVX2 versions if the CPU supports them.
+unsigned int urb_adler32_scalar(unsigned int adler, const char *pbuf, unsigned int len);
+
+//Name of the implementation urb_adler32 uses
+const char* urb_adler32_impl_name();
@@ -87,6 +87,13 @@
 #define CHECK_BASE_PATH
 #define SEND_TIMEOUT 300000
 
+namespace
+{
+	const size_t c_sendfile_bsize=1024*1024;
+	//Files up to this size are sent together with their header in one write
+	const int64 c_small_file_size=64*1024;
+}
+
 
 CClientThread::CClientThread(SOCKET pSocket, CTCPFileServ* pParent)
 	: extra_buffer(NULL), waiting_for_chunk(false)
@@ -121,6 +128,15 @@ CClientThread::CClientThread(SOCKET pSocket, CTCPFileServ* pParent)
 	cond=NULL;
 	state=CS_NONE;
 	chunk_send_thread_ticket=ILLEGAL_THREADPOOL_TICKET;
+	uring_reader=NULL;
+	uring_unavailable=false;
+#ifndef _WIN32
+	zero_copy=Server->getServerParameter("fileserv_zero_copy")!="false";
+#else
+	zero_copy=false;
+#endif
+	zero_copy_bytes=0;
+	small_files_sent=0;
 }
 
 CClientThread::CClientThread(IPipe *pClientpipe, CTCPFileServ* pParent, std::vector<char>* extra_buffer)
@@ -143,6 +159,11 @@ CClientThread::CClientThread(IPipe *pClientpipe, CTCPFileServ* pParent, std::vec
 	mutex=NULL;
 	cond=NULL;
 	chunk_send_thread_ticket=ILLEGAL_THREADPOOL_TICKET;
+	uring_reader=NULL;
+	uring_unavailable=false;
+	zero_copy=false;
+	zero_copy_bytes=0;
+	small_files_sent=0;
 
 	stack.setAddChecksum(true);
 }
@@ -150,6 +171,9 @@ CClientThread::CClientThread(IPipe *pClientpipe, CTCPFileServ* pParent, std::vec
 CClientThread::~CClientThread()
 {
 	delete bufmgr;
+#ifdef HAS_URING_READER
+	delete uring_reader;
+#endif
 	if(mutex!=NULL)
 	{
 		Server->destroy(mutex);
@@ -179,6 +203,18 @@ void CClientThread::operator()(void)
 	}
 	ReleaseMemory();
 
+	FileServ::addTransferStats(zero_copy_bytes, clientpipe->getTransferedBytes());
+
+	if(zero_copy_bytes>0)
+	{
+		Log("Connection closed. Sent "+PrettyPrintBytes(zero_copy_bytes)+" via sendfile, "+PrettyPrintBytes(clientpipe->getTransferedBytes())+" through the socket.", LL_DEBUG);
+	}
+
+	if(small_files_sent>0)
+	{
+		Log("Sent "+convert(small_files_sent)+" small files in one write each.", LL_DEBUG);
+	}
+
 	if( hFile!=INVALID_HANDLE_VALUE )
 	{
 		CloseHandle( hFile );
@@ -319,6 +355,115 @@ bool CClientThread::FlushInt()
 	return clientpipe->Flush(CLIENT_TIMEOUT * 1000);
 }
 
+#ifndef _WIN32
+int64 CClientThread::SendFileZeroCopy(HANDLE hFile, int64 offset, size_t count, bool& unsupported)
+{
+	unsupported=false;
+	size_t sent=0;
+	while(sent<count)
+	{
+#if defined(__APPLE__) || defined(__FreeBSD__)
+		off_t len=count-sent;
+		int rc=sendfile64(hFile, int_socket, offset, len, &len);
+		if(rc==0 && len==0)
+		{
+			break;
+		}
+		if(rc==0 || (errno==EAGAIN && len>0) )
+		{
+			rc=static_cast<int>(len);
+		}
+#else
+		off64_t off=offset;
+		ssize_t rc=sendfile64(int_socket, hFile, &off, count-sent);
+		if(rc==0)
+		{
+			break;
+		}
+#endif
+		if(rc<0)
+		{
+			if(errno==EINTR)
+			{
+				continue;
+			}
+			else if(errno==EAGAIN || errno==EWOULDBLOCK)
+			{
+				if(!clientpipe->isWritable(SEND_TIMEOUT))
+				{
+					return -1;
+				}
+				continue;
+			}
+			else if(errno==EINVAL || errno==ENOSYS || errno==EOPNOTSUPP)
+			{
+				//File system or socket does not support sendfile. Caller continues with read()/send()
+				unsupported=true;
+				break;
+			}
+			return -1;
+		}
+
+		sent+=rc;
+		offset+=rc;
+	}
+
+	zero_copy_bytes+=sent;
+
+	return static_cast<int64>(sent);
+}
+
+bool CClientThread::sendSmallFile(HANDLE hFile, CWData& header, int64 filesize, bool with_hashes,
+	const std::string& o_filename, const std::string& filename)
+{
+	std::vector<char> buf;
+	buf.resize(header.getDataSize() + static_cast<size_t>(filesize) + (with_hashes ? 16 : 0));
+	memcpy(buf.data(), header.getDataPtr(), header.getDataSize());
+
+	char* data = buf.data() + header.getDataSize();
+	size_t read_bytes = 0;
+	while (read_bytes < static_cast<size_t>(filesize))
+	{
+		ssize_t rc = read(hFile, data + read_bytes, static_cast<size_t>(filesize) - read_bytes);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			Log("Error: Reading from file failed. Errno: " + convert(errno), LL_DEBUG);
+			FileServ::callErrorCallback(o_filename, filename, read_bytes, "code: " + convert(errno));
+			return false;
+		}
+		else if (rc == 0) //other process made the file smaller
+		{
+			memset(data + read_bytes, 0, static_cast<size_t>(filesize) - read_bytes);
+			break;
+		}
+		read_bytes += rc;
+	}
+
+	if (with_hashes)
+	{
+		hash_func.init();
+		hash_func.update(reinterpret_cast<unsigned char*>(data), static_cast<unsigned int>(filesize));
+		hash_func.finalize();
+		memcpy(data + filesize, hash_func.raw_digest_int(), 16);
+		hash_func.init();
+	}
+
+	if (SendInt(buf.data(), buf.size()) == SOCKET_ERROR)
+	{
+		Log("Error: Sending small file failed", LL_DEBUG);
+		return false;
+	}
+
+	++small_files_sent;
+
+	return true;
+}
+#endif
+
 bool CClientThread::ProcessPacket(CRData *data)
 {
 	uchar id;
@@ -1039,6 +1184,20 @@ bool CClientThread::ProcessPacket(CRData *data)
 					data.addInt64(n_sparse_extents);
 				}
 
+				if (!has_file_extents && start_offset == 0
+					&& send_filesize == filesize && filesize>0 && filesize <= c_small_file_size
+					&& id != ID_GET_FILE_METADATA_ONLY)
+				{
+					bool b = sendSmallFile(hFile, data, filesize, with_hashes, o_filename, filename);
+					CloseHandle(hFile);
+					hFile = INVALID_HANDLE_VALUE;
+					if (!b)
+					{
+						return false;
+					}
+					break;
+				}
+
 				int rc=SendInt(data.getDataPtr(), data.getDataSize() );	
 				if(rc==SOCKET_ERROR)
 				{
@@ -1070,6 +1229,10 @@ bool CClientThread::ProcessPacket(CRData *data)
 
 				unsigned int s_bsize=8192;
 
+				//Send directly from the page cache if the data does not need
+				//to pass through a hashing, compressing or encrypting pipe
+				bool use_sendfile = zero_copy && !with_hashes;
+
 				if( !with_hashes )
 				{
 					s_bsize=32768;
@@ -1082,7 +1245,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 					    next_checkpoint=curr_filesize;
 				}
 
-				if((clientpipe!=NULL || with_hashes) && foffset>0)
+				if(!use_sendfile && foffset>0)
 				{
 					if(lseek64(hFile, foffset, SEEK_SET)!=foffset)
 					{
@@ -1095,6 +1258,18 @@ bool CClientThread::ProcessPacket(CRData *data)
 				std::vector<char> buf;
 				buf.resize(s_bsize);
 
+#ifdef HAS_URING_READER
+				UringReader* file_reader = NULL;
+				if (!use_sendfile)
+				{
+					file_reader = getUringReader();
+					if (file_reader != NULL)
+					{
+						file_reader->reset(hFile, foffset, filesize);
+					}
+				}
+#endif
+
 				bool has_error=false;
 				size_t extent_pos = 0;
 
@@ -1123,7 +1298,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 							if (next_checkpoint>curr_filesize)
 								next_checkpoint = curr_filesize;
 
-							if (clientpipe != NULL || with_hashes)
+							if (!use_sendfile)
 							{
 								off64_t rc = lseek64(hFile, foffset, SEEK_SET);
 
@@ -1150,7 +1325,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 						}
 					}
 				
-					size_t count=(std::min)((size_t)s_bsize, (size_t)(next_checkpoint-foffset));
+					size_t count=(std::min)(use_sendfile ? c_sendfile_bsize : (size_t)s_bsize, (size_t)(next_checkpoint-foffset));
 
 					if (has_file_extents)
 					{
@@ -1160,18 +1335,10 @@ bool CClientThread::ProcessPacket(CRData *data)
 						}
 					}
 
-					if( clientpipe==NULL && !with_hashes && count>0 )
+					if( use_sendfile && count>0 )
 					{
-						#if defined(__APPLE__) || defined(__FreeBSD__)
-						ssize_t rc=sendfile64(int_socket, hFile, foffset, count, reinterpret_cast<off_t*>(&count));
-						if(rc==0)
-						{
-							foffset+=count;
-							rc=count;
-						}
-						#else			
-						ssize_t rc=sendfile64(int_socket, hFile, &foffset, count);
-						#endif
+						bool sendfile_unsupported;
+						int64 rc=SendFileZeroCopy(hFile, foffset, count, sendfile_unsupported);
 						if(rc<0)
 						{
 							Log("Error: Reading and sending from file failed. Errno: "+convert(errno), LL_DEBUG);
@@ -1179,18 +1346,42 @@ bool CClientThread::ProcessPacket(CRData *data)
 							CloseHandle(hFile);
 							return false;
 						}
-						else if(rc==0 && foffset<filesize && errno == 0) //other process made the file smaller
+
+						foffset+=rc;
+
+						if(sendfile_unsupported)
+						{
+							Log("sendfile not supported for file \""+filename+"\" (errno "+convert(errno)+"). Continuing at offset "+convert(static_cast<int64>(foffset))+" with read/send.", LL_DEBUG);
+
+							use_sendfile=false;
+
+							if(lseek64(hFile, foffset, SEEK_SET)!=foffset)
+							{
+								Log("Error: Seeking in file failed (5045)", LL_ERROR);
+								CloseHandle(hFile);
+								return false;
+							}
+#ifdef HAS_URING_READER
+							file_reader = getUringReader();
+							if (file_reader != NULL)
+							{
+								file_reader->reset(hFile, foffset, filesize);
+							}
+#endif
+						}
+						else if(static_cast<size_t>(rc)<count) //other process made the file smaller
 						{
 							memset(buf.data(), 0, s_bsize);
 							while(foffset<filesize)
 							{
-								rc=SendInt(buf.data(), (std::min)((size_t)s_bsize, (size_t)(next_checkpoint-foffset)));
-								if(rc==SOCKET_ERROR)
+								size_t zcount=(std::min)((size_t)s_bsize, (size_t)(filesize-foffset));
+								if(SendInt(buf.data(), zcount)==SOCKET_ERROR)
 								{
 									Log("Error: Sending data failed");
 									CloseHandle(hFile);
 									return false;
 								}
+								foffset+=zcount;
 							}
 						}
 					}
@@ -1198,10 +1389,22 @@ bool CClientThread::ProcessPacket(CRData *data)
 					{
 						if (count > 0)
 						{
-							ssize_t rc = read(hFile, buf.data(), count);
+							char* data = buf.data();
+							ssize_t rc;
+#ifdef HAS_URING_READER
+							if (file_reader != NULL)
+							{
+								rc = file_reader->read(foffset, count, data);
+							}
+							else
+#endif
+							{
+								rc = read(hFile, buf.data(), count);
+							}
 
 							if (rc == 0 && rc < count && errno == 0)  //other process made the file smaller
 							{
+								data = buf.data();
 								memset(buf.data() + rc, 0, count - rc);
 								rc = count;
 							}
@@ -1213,7 +1416,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 								return false;
 							}
 
-							rc = SendInt(buf.data(), rc);
+							rc = SendInt(data, rc);
 							if (rc == SOCKET_ERROR)
 							{
 								Log("Error: Sending data failed");
@@ -1222,7 +1425,7 @@ bool CClientThread::ProcessPacket(CRData *data)
 							}
 							else if (with_hashes)
 							{
-								hash_func.update((unsigned char*)buf.data(), rc);
+								hash_func.update((unsigned char*)data, rc);
 							}
 
 							foffset += rc;
@@ -2801,3 +3004,32 @@ bool CClientThread::sendSparseExtents(const std::vector<SExtent>& file_extents)
 }
 
 
+
+UringReader* CClientThread::getUringReader()
+{
+#ifdef HAS_URING_READER
+	if (uring_reader != NULL || uring_unavailable)
+	{
+		return uring_reader;
+	}
+
+	unsigned int queue_depth = UringReader::getQueueDepth();
+	if (queue_depth == 0)
+	{
+		uring_unavailable = true;
+		return NULL;
+	}
+
+	uring_reader = new UringReader(queue_depth, READSIZE);
+	if (!uring_reader->isOk())
+	{
+		delete uring_reader;
+		uring_reader = NULL;
+		uring_unavailable = true;
+	}
+
+	return uring_reader;
+#else
+	return NULL;
+#endif
+}
@@ -17,6 +17,7 @@
 #include "../Interface/Thread.h"
 #include "../Interface/ThreadPool.h"
 #include "bufmgr.h"
+#include "UringReader.h"
 #include "../urbackupcommon/fileclient/tcpstack.h"
 #include "../common/data.h"
 #include "types.h"
@@ -27,6 +28,7 @@
 class CTCPFileServ;
 class IPipe;
 class IFile;
+class UringReader;
 class IFsFile;
 class IMutex;
 class ICondition;
@@ -114,6 +116,19 @@ public:
 
     int SendInt(const char *buf, size_t bsize, bool flush=false);
 	bool FlushInt();
+
+#ifndef _WIN32
+	//Sends count bytes of hFile at offset from the page cache directly to
+	//the socket. Returns the number of bytes sent (less than count if the file
+	//got smaller) or -1 on error
+	int64 SendFileZeroCopy(HANDLE hFile, int64 offset, size_t count, bool& unsupported);
+
+	//Sends the file size header, the whole (small) file and its hash in one
+	//write, so that pipelined requests for many small files do not need
+	//several writes per file
+	bool sendSmallFile(HANDLE hFile, CWData& header, int64 filesize, bool with_hashes,
+		const std::string& o_filename, const std::string& filename);
+#endif
 	bool getNextChunk(SChunk *chunk, bool has_error);
 
 	static std::string getDummyMetadata(std::string output_fn, int64 folder_items, int64 metadata_id, bool is_dir);
@@ -164,6 +179,8 @@ private:
 
 	bool sendSparseExtents(const std::vector<SExtent>& file_extents);
 
+	UringReader* getUringReader();
+
 	volatile bool stopped;
 	volatile bool killable;
 
@@ -171,6 +188,8 @@ private:
 	int sendfilepart;
 
 	fileserv::CBufMgr* bufmgr;
+	UringReader* uring_reader;
+	bool uring_unavailable;
 	CTCPStack stack;
 	char buffer[BUFFERSIZE];
 
@@ -205,5 +224,9 @@ private:
 	SOCKET int_socket;
 	bool has_socket;
 
+	bool zero_copy;
+	int64 zero_copy_bytes;
+	int64 small_files_sent;
+
 	std::vector<char>* extra_buffer;
 };
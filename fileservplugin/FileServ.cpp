@@ -37,6 +37,8 @@ std::map<std::string, size_t> FileServ::active_shares;
 FileServ::IReadErrorCallback* FileServ::read_error_callback = NULL;
 std::vector<std::string> FileServ::read_error_files;
 std::map<std::pair<std::string, std::string>, IFileServ::CbtHashFileInfo> FileServ::cbt_hash_files;
+int64 FileServ::stat_zero_copy_bytes = 0;
+int64 FileServ::stat_buffered_bytes = 0;
 
 
 FileServ::FileServ(bool *pDostop, const std::string &pServername, THREADPOOL_TICKET serverticket, bool use_fqdn)
@@ -367,6 +369,20 @@ void FileServ::clearReadErrors()
 	read_error_files.clear();
 }
 
+void FileServ::addTransferStats(int64 zero_copy_bytes, int64 buffered_bytes)
+{
+	IScopedLock lock(mutex);
+	stat_zero_copy_bytes += zero_copy_bytes;
+	stat_buffered_bytes += buffered_bytes;
+}
+
+void FileServ::getTransferStats(int64& zero_copy_bytes, int64& buffered_bytes)
+{
+	IScopedLock lock(mutex);
+	zero_copy_bytes = stat_zero_copy_bytes;
+	buffered_bytes = stat_buffered_bytes;
+}
+
 void FileServ::clearReadErrorFile(const std::string & filepath)
 {
 	IScopedLock lock(mutex);
@@ -63,6 +63,10 @@ public:
 
 	static void clearReadErrorFile(const std::string& filepath);
 
+	static void addTransferStats(int64 zero_copy_bytes, int64 buffered_bytes);
+
+	void getTransferStats(int64& zero_copy_bytes, int64& buffered_bytes);
+
 	void setCbtHashFile(const std::string& sharename, const std::string& identity, CbtHashFileInfo hash_file_info);
 
 	static CbtHashFileInfo getCbtHashFile(const std::string& sharename, const std::string& identity);
@@ -112,6 +116,9 @@ private:
 	static std::vector<std::string> read_error_files;
 
 	static std::map<std::pair<std::string, std::string>, CbtHashFileInfo> cbt_hash_files;
+
+	static int64 stat_zero_copy_bytes;
+	static int64 stat_buffered_bytes;
 };
 
 
@@ -62,6 +62,7 @@ public:
 	virtual void registerScriptPipeFile(const std::string& script_fn, IPipeFileExt* pipe_file) = 0;
 	virtual void deregisterScriptPipeFile(const std::string& script_fn) = 0;
 	virtual void clearReadErrors() = 0;
+	virtual void getTransferStats(int64& zero_copy_bytes, int64& buffered_bytes) = 0;
 
 	struct CbtHashFileInfo
 	{
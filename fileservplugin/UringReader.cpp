@@ -0,0 +1,454 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "UringReader.h"
+
+#ifdef HAS_URING_READER
+
+#include "../Interface/Server.h"
+#include "../stringtools.h"
+#include "log.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+namespace
+{
+	const unsigned int c_default_queue_depth = 8;
+
+	int sys_io_uring_setup(unsigned int entries, io_uring_params* params)
+	{
+#ifdef __NR_io_uring_setup
+		return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+#else
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+
+	int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+	{
+#ifdef __NR_io_uring_enter
+		return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0));
+#else
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+
+	int sys_io_uring_register(int fd, unsigned int opcode, void* arg, unsigned int nr_args)
+	{
+#ifdef __NR_io_uring_register
+		return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+#else
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+}
+
+UringReader::UringReader(unsigned int queue_depth, unsigned int bsize)
+	: ring_fd(-1), queue_depth(queue_depth), bsize(bsize), fixed_buffers(false),
+	sq_ptr(MAP_FAILED), sq_ptr_size(0), cq_ptr(MAP_FAILED), cq_ptr_size(0),
+	sqes(NULL), sqes_size(0), bufmgr(NULL), n_inflight(0),
+	fd(-1), next_offset(0), end_offset(0)
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	ring_fd = sys_io_uring_setup(queue_depth, &params);
+	if (ring_fd < 0)
+	{
+		Log("io_uring not available (errno " + convert(errno) + "). Using synchronous reads.", LL_DEBUG);
+		return;
+	}
+
+	sq_ptr_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cq_ptr_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	bool single_mmap = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		single_mmap = true;
+		sq_ptr_size = (std::max)(sq_ptr_size, cq_ptr_size);
+	}
+#endif
+
+	sq_ptr = mmap(NULL, sq_ptr_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (sq_ptr == MAP_FAILED)
+	{
+		Log("Error mapping io_uring submission queue. Errno: " + convert(errno), LL_ERROR);
+		close(ring_fd);
+		ring_fd = -1;
+		return;
+	}
+
+	if (single_mmap)
+	{
+		cq_ptr = sq_ptr;
+	}
+	else
+	{
+		cq_ptr = mmap(NULL, cq_ptr_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		if (cq_ptr == MAP_FAILED)
+		{
+			Log("Error mapping io_uring completion queue. Errno: " + convert(errno), LL_ERROR);
+			munmap(sq_ptr, sq_ptr_size);
+			sq_ptr = MAP_FAILED;
+			close(ring_fd);
+			ring_fd = -1;
+			return;
+		}
+	}
+
+	sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqes_ptr = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sqes_ptr == MAP_FAILED)
+	{
+		Log("Error mapping io_uring submission queue entries. Errno: " + convert(errno), LL_ERROR);
+		if (cq_ptr != sq_ptr)
+		{
+			munmap(cq_ptr, cq_ptr_size);
+		}
+		munmap(sq_ptr, sq_ptr_size);
+		sq_ptr = MAP_FAILED;
+		cq_ptr = MAP_FAILED;
+		close(ring_fd);
+		ring_fd = -1;
+		return;
+	}
+	sqes = reinterpret_cast<io_uring_sqe*>(sqes_ptr);
+
+	char* sq = reinterpret_cast<char*>(sq_ptr);
+	sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+	sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+	sq_mask = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+	sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+
+	char* cq = reinterpret_cast<char*>(cq_ptr);
+	cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+	cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+	cq_mask = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+	bufmgr = new fileserv::CBufMgr(queue_depth, bsize);
+
+	std::vector<char*> buffers;
+	std::vector<iovec> iovecs;
+	char* buffer;
+	while ((buffer = bufmgr->getBuffer()) != NULL)
+	{
+		buffer_idx[buffer] = static_cast<unsigned int>(buffers.size());
+		buffers.push_back(buffer);
+		iovec iov;
+		iov.iov_base = buffer;
+		iov.iov_len = bsize;
+		iovecs.push_back(iov);
+	}
+
+	//Fails e.g. if the locked memory limit is too low. Reads still work then,
+	//but the kernel has to map the buffers for every read
+	fixed_buffers = sys_io_uring_register(ring_fd, IORING_REGISTER_BUFFERS,
+		iovecs.data(), static_cast<unsigned int>(iovecs.size())) == 0;
+
+	if (!fixed_buffers)
+	{
+		Log("Registering io_uring read buffers failed. Errno: " + convert(errno), LL_DEBUG);
+	}
+
+	for (size_t i = 0; i < buffers.size(); ++i)
+	{
+		bufmgr->releaseBuffer(buffers[i]);
+	}
+}
+
+UringReader::~UringReader()
+{
+	drain();
+
+	for (size_t i = 0; i < free_reads.size(); ++i)
+	{
+		delete free_reads[i];
+	}
+
+	if (ring_fd != -1)
+	{
+		munmap(sqes, sqes_size);
+		if (cq_ptr != sq_ptr)
+		{
+			munmap(cq_ptr, cq_ptr_size);
+		}
+		munmap(sq_ptr, sq_ptr_size);
+		close(ring_fd);
+	}
+
+	delete bufmgr;
+}
+
+bool UringReader::isOk()
+{
+	return ring_fd != -1;
+}
+
+unsigned int UringReader::getQueueDepth()
+{
+	std::string depth = Server->getServerParameter("fileserv_io_uring_depth");
+	if (depth.empty())
+	{
+		return c_default_queue_depth;
+	}
+
+	return static_cast<unsigned int>((std::max)(0, watoi(depth)));
+}
+
+void UringReader::reset(int pfd, int64 offset, int64 pend_offset)
+{
+	drain();
+
+	fd = pfd;
+	next_offset = offset;
+	end_offset = pend_offset;
+}
+
+ssize_t UringReader::read(int64 offset, size_t count, char*& data)
+{
+	if (ring_fd == -1 || fd == -1)
+	{
+		errno = EBADF;
+		return -1;
+	}
+
+	while (!reads.empty()
+		&& reads.front()->offset + bsize <= offset)
+	{
+		if (!waitFront())
+		{
+			return -1;
+		}
+		releaseFront();
+	}
+
+	if (reads.empty()
+		|| reads.front()->offset > offset)
+	{
+		drain();
+		next_offset = offset;
+	}
+
+	unsigned int to_submit = 0;
+	while (reads.size() < queue_depth
+		&& next_offset < end_offset)
+	{
+		if (!submitRead())
+		{
+			break;
+		}
+		++to_submit;
+	}
+
+	while (to_submit > 0)
+	{
+		int rc = sys_io_uring_enter(ring_fd, to_submit, 0, 0);
+		if (rc < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+			{
+				reapCompletions();
+				continue;
+			}
+
+			Log("Submitting io_uring reads failed. Errno: " + convert(errno), LL_ERROR);
+			return -1;
+		}
+		to_submit -= rc;
+	}
+
+	if (reads.empty())
+	{
+		errno = 0;
+		return 0;
+	}
+
+	if (!waitFront())
+	{
+		return -1;
+	}
+
+	SRead* front = reads.front();
+	if (front->rc < 0)
+	{
+		errno = static_cast<int>(-front->rc);
+		return -1;
+	}
+
+	int64 pos = offset - front->offset;
+	if (pos >= front->rc)
+	{
+		//Short read. File got smaller
+		errno = 0;
+		return 0;
+	}
+
+	data = front->buffer + pos;
+	return static_cast<ssize_t>((std::min)(static_cast<int64>(count), front->rc - pos));
+}
+
+bool UringReader::submitRead()
+{
+	char* buffer = bufmgr->getBuffer();
+	if (buffer == NULL)
+	{
+		return false;
+	}
+
+	SRead* read;
+	if (!free_reads.empty())
+	{
+		read = free_reads.back();
+		free_reads.pop_back();
+	}
+	else
+	{
+		read = new SRead;
+	}
+
+	unsigned int len = static_cast<unsigned int>((std::min)(static_cast<int64>(bsize), end_offset - next_offset));
+
+	read->offset = next_offset;
+	read->buffer = buffer;
+	read->rc = 0;
+	read->done = false;
+
+	unsigned int tail = *sq_tail;
+	unsigned int idx = tail & *sq_mask;
+	io_uring_sqe* sqe = &sqes[idx];
+	memset(sqe, 0, sizeof(io_uring_sqe));
+
+	if (fixed_buffers)
+	{
+		sqe->opcode = IORING_OP_READ_FIXED;
+		sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+		sqe->len = len;
+		sqe->buf_index = static_cast<__u16>(buffer_idx[buffer]);
+	}
+	else
+	{
+		read->iov.iov_base = buffer;
+		read->iov.iov_len = len;
+		sqe->opcode = IORING_OP_READV;
+		sqe->addr = reinterpret_cast<uintptr_t>(&read->iov);
+		sqe->len = 1;
+	}
+
+	sqe->fd = fd;
+	sqe->off = static_cast<__u64>(next_offset);
+	sqe->user_data = reinterpret_cast<uintptr_t>(read);
+
+	sq_array[idx] = idx;
+	__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	reads.push_back(read);
+	++n_inflight;
+	next_offset += len;
+
+	return true;
+}
+
+void UringReader::reapCompletions()
+{
+	unsigned int head = *cq_head;
+	unsigned int tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail)
+	{
+		io_uring_cqe* cqe = &cqes[head & *cq_mask];
+		SRead* read = reinterpret_cast<SRead*>(static_cast<uintptr_t>(cqe->user_data));
+		read->rc = cqe->res;
+		read->done = true;
+		--n_inflight;
+		++head;
+	}
+
+	__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+bool UringReader::waitFront()
+{
+	SRead* front = reads.front();
+
+	reapCompletions();
+
+	while (!front->done)
+	{
+		int rc = sys_io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+		if (rc < 0 && errno != EINTR)
+		{
+			Log("Waiting for io_uring reads failed. Errno: " + convert(errno), LL_ERROR);
+			return false;
+		}
+
+		reapCompletions();
+	}
+
+	return true;
+}
+
+void UringReader::releaseFront()
+{
+	SRead* front = reads.front();
+	reads.pop_front();
+	bufmgr->releaseBuffer(front->buffer);
+	free_reads.push_back(front);
+}
+
+void UringReader::drain()
+{
+	if (ring_fd == -1)
+	{
+		return;
+	}
+
+	reapCompletions();
+
+	while (n_inflight > 0)
+	{
+		int rc = sys_io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+		if (rc < 0 && errno != EINTR)
+		{
+			//Buffers could still be written to by the kernel. Leak them.
+			Log("Waiting for io_uring reads failed. Errno: " + convert(errno), LL_ERROR);
+			reads.clear();
+			return;
+		}
+
+		reapCompletions();
+	}
+
+	while (!reads.empty())
+	{
+		releaseFront();
+	}
+}
+
+#endif //HAS_URING_READER
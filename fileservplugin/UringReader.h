@@ -0,0 +1,105 @@
+#pragma once
+
+#include "../Interface/Types.h"
+#include "bufmgr.h"
+#include <deque>
+#include <vector>
+#include <map>
+
+#ifndef _WIN32
+#ifndef VERSION
+#include "../config.h"
+#endif
+#endif
+
+#if defined(__linux__) && defined(HAVE_LINUX_IO_URING_H)
+#define HAS_URING_READER
+#endif
+
+#ifdef HAS_URING_READER
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//Reads a file sequentially via io_uring, keeping up to queue_depth reads
+//of bsize bytes in flight ahead of the current position. The read buffers
+//come from a CBufMgr and are registered with the kernel as fixed buffers
+//(if possible), so they do not have to be pinned for every read.
+class UringReader
+{
+public:
+	UringReader(unsigned int queue_depth, unsigned int bsize);
+	~UringReader();
+
+	//Returns false if io_uring is not available (old kernel, seccomp
+	//filters, ...). Use synchronous reads then.
+	bool isOk();
+
+	//Start reading file fd from offset up to end_offset. Cancels reads of
+	//a previous file.
+	void reset(int fd, int64 offset, int64 end_offset);
+
+	//Returns a pointer to up to count bytes of file data at offset in data.
+	//The pointer stays valid until the next call. Returns the number of
+	//bytes read (0 at end of file) or -1 with errno set on error.
+	//Reading from an offset not following the previous read restarts the
+	//read ahead at that offset.
+	ssize_t read(int64 offset, size_t count, char*& data);
+
+	//Wait for all in flight reads
+	void drain();
+
+	static unsigned int getQueueDepth();
+
+private:
+	struct SRead
+	{
+		int64 offset;
+		char* buffer;
+		ssize_t rc;
+		bool done;
+		struct iovec iov;
+	};
+
+	bool submitRead();
+	bool waitFront();
+	void reapCompletions();
+	void releaseFront();
+
+	int ring_fd;
+	unsigned int queue_depth;
+	unsigned int bsize;
+	bool fixed_buffers;
+
+	void* sq_ptr;
+	size_t sq_ptr_size;
+	void* cq_ptr;
+	size_t cq_ptr_size;
+	io_uring_sqe* sqes;
+	size_t sqes_size;
+
+	unsigned int* sq_head;
+	unsigned int* sq_tail;
+	unsigned int* sq_mask;
+	unsigned int* sq_array;
+	unsigned int* cq_head;
+	unsigned int* cq_tail;
+	unsigned int* cq_mask;
+	io_uring_cqe* cqes;
+
+	fileserv::CBufMgr* bufmgr;
+	std::map<char*, unsigned int> buffer_idx;
+
+	std::deque<SRead*> reads;
+	std::vector<SRead*> free_reads;
+	size_t n_inflight;
+
+	int fd;
+	int64 next_offset;
+	int64 end_offset;
+};
+
+#endif //HAS_URING_READER
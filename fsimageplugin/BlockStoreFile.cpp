@@ -0,0 +1,1149 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "BlockStoreFile.h"
+#include "../Interface/Server.h"
+#include "../Interface/Mutex.h"
+#include "../stringtools.h"
+#include "../urbackupcommon/os_functions.h"
+#include "../urbackupcommon/sha2/sha2.h"
+#include "FileWrapper.h"
+#include "ClientBitmap.h"
+#include "fs/ntfs.h"
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+	//Same as the block size of the image hash file
+	const unsigned int block_size = 512*1024;
+	const unsigned int sector_size = 512;
+	const size_t hash_size = 32;
+	const size_t header_size = 4096;
+	const size_t header_magic_size = 32;
+	const char header_magic[] = "URBACKUP BLOCK STORE IMAGE#1.0";
+	const size_t header_fields_size = header_magic_size + sizeof(uint64) + 3*sizeof(unsigned int);
+	const char store_folder[] = ".image_blocks";
+
+	const unsigned char empty_entry[hash_size] = {};
+	unsigned char unused_entry[hash_size];
+	unsigned char zero_block_hash[hash_size];
+
+	bool buf_is_zero(const char* buf, size_t bsize)
+	{
+		for (size_t i = 0; i < bsize; ++i)
+		{
+			if (buf[i] != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+IMutex* ImageBlockStore::mutexes[ImageBlockStore::n_mutexes] = {};
+
+ImageBlockStore::ImageBlockStore(const std::string& path)
+	: path(path)
+{
+}
+
+void ImageBlockStore::init()
+{
+	for (size_t i = 0; i < n_mutexes; ++i)
+	{
+		mutexes[i] = Server->createMutex();
+	}
+
+	memset(unused_entry, 0xFF, hash_size);
+
+	std::vector<unsigned char> zero_block(block_size);
+	sha256_ctx shactx;
+	sha256_init(&shactx);
+	sha256_update(&shactx, zero_block.data(), block_size);
+	sha256_final(&shactx, zero_block_hash);
+}
+
+std::string ImageBlockStore::chunkFn(const unsigned char* hash)
+{
+	std::string hex = bytesToHex(hash, hash_size);
+	return path + os_file_sep() + hex.substr(0, 2) + os_file_sep() + hex;
+}
+
+IMutex* ImageBlockStore::chunkMutex(const unsigned char* hash)
+{
+	return mutexes[hash[0] % n_mutexes];
+}
+
+bool ImageBlockStore::incrementRefcount(const std::string& fn, bool& not_found)
+{
+	std::auto_ptr<IFile> chunk(Server->openFile(os_file_prefix(fn), MODE_RW));
+	if (chunk.get() == NULL)
+	{
+		not_found = true;
+		return false;
+	}
+
+	int64 refcount;
+	if (chunk->Read(0, reinterpret_cast<char*>(&refcount), sizeof(refcount)) != sizeof(refcount))
+	{
+		Server->Log("Error reading reference count of image block \"" + fn + "\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	refcount = little_endian(little_endian(refcount) + 1);
+
+	if (chunk->Write(0, reinterpret_cast<char*>(&refcount), sizeof(refcount)) != sizeof(refcount))
+	{
+		Server->Log("Error writing reference count of image block \"" + fn + "\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	return true;
+}
+
+bool ImageBlockStore::addReference(const unsigned char* hash, const char* data, size_t data_size)
+{
+	std::string fn = chunkFn(hash);
+
+	{
+		IScopedLock lock(chunkMutex(hash));
+
+		bool not_found = false;
+		if (incrementRefcount(fn, not_found))
+		{
+			return true;
+		}
+		else if (!not_found)
+		{
+			return false;
+		}
+	}
+
+	if (data == NULL)
+	{
+		Server->Log("Image block \"" + fn + "\" not found", LL_ERROR);
+		return false;
+	}
+
+	//Write the new chunk without holding the lock. Another thread may
+	//write the same chunk concurrently, so the temporary file name has
+	//to be unique.
+	std::string chunk_dir = ExtractFilePath(fn);
+	if (!os_directory_exists(os_file_prefix(chunk_dir))
+		&& !os_create_dir_recursive(os_file_prefix(chunk_dir))
+		&& !os_directory_exists(os_file_prefix(chunk_dir)))
+	{
+		Server->Log("Error creating image block folder \"" + chunk_dir + "\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	std::string tmp_fn = fn + "." + convert(Server->getRandomNumber()) + ".new";
+	std::auto_ptr<IFile> chunk(Server->openFile(os_file_prefix(tmp_fn), MODE_WRITE));
+	if (chunk.get() == NULL)
+	{
+		Server->Log("Error creating image block \"" + tmp_fn + "\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	int64 refcount = little_endian(static_cast<int64>(1));
+	if (chunk->Write(reinterpret_cast<char*>(&refcount), sizeof(refcount)) != sizeof(refcount)
+		|| chunk->Write(data, static_cast<_u32>(data_size)) != data_size)
+	{
+		Server->Log("Error writing image block \"" + tmp_fn + "\". " + os_last_error_str(), LL_ERROR);
+		chunk.reset();
+		Server->deleteFile(os_file_prefix(tmp_fn));
+		return false;
+	}
+
+	chunk.reset();
+
+	IScopedLock lock(chunkMutex(hash));
+
+	bool not_found = false;
+	if (incrementRefcount(fn, not_found))
+	{
+		//Created by another thread in the meantime
+		Server->deleteFile(os_file_prefix(tmp_fn));
+		return true;
+	}
+	else if (!not_found)
+	{
+		Server->deleteFile(os_file_prefix(tmp_fn));
+		return false;
+	}
+
+	if (!os_rename_file(os_file_prefix(tmp_fn), os_file_prefix(fn)))
+	{
+		Server->Log("Error renaming image block \"" + tmp_fn + "\" to \"" + fn + "\". " + os_last_error_str(), LL_ERROR);
+		Server->deleteFile(os_file_prefix(tmp_fn));
+		return false;
+	}
+
+	return true;
+}
+
+bool ImageBlockStore::removeReference(const unsigned char* hash)
+{
+	if (curr_chunk.get() != NULL
+		&& curr_chunk_hash == std::string(reinterpret_cast<const char*>(hash), hash_size))
+	{
+		curr_chunk.reset();
+		curr_chunk_hash.clear();
+	}
+
+	std::string fn = chunkFn(hash);
+
+	IScopedLock lock(chunkMutex(hash));
+
+	std::auto_ptr<IFile> chunk(Server->openFile(os_file_prefix(fn), MODE_RW));
+	if (chunk.get() == NULL)
+	{
+		Server->Log("Image block \"" + fn + "\" not found while removing reference", LL_WARNING);
+		return false;
+	}
+
+	int64 refcount;
+	if (chunk->Read(0, reinterpret_cast<char*>(&refcount), sizeof(refcount)) != sizeof(refcount))
+	{
+		Server->Log("Error reading reference count of image block \"" + fn + "\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	refcount = little_endian(refcount) - 1;
+
+	if (refcount <= 0)
+	{
+		chunk.reset();
+		if (!Server->deleteFile(os_file_prefix(fn)))
+		{
+			Server->Log("Error deleting image block \"" + fn + "\". " + os_last_error_str(), LL_ERROR);
+			return false;
+		}
+		return true;
+	}
+
+	refcount = little_endian(refcount);
+
+	if (chunk->Write(0, reinterpret_cast<char*>(&refcount), sizeof(refcount)) != sizeof(refcount))
+	{
+		Server->Log("Error writing reference count of image block \"" + fn + "\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	return true;
+}
+
+size_t ImageBlockStore::read(const unsigned char* hash, size_t offset, char* buffer, size_t bsize, bool& has_error)
+{
+	std::string hash_str(reinterpret_cast<const char*>(hash), hash_size);
+
+	if (curr_chunk.get() == NULL
+		|| curr_chunk_hash != hash_str)
+	{
+		curr_chunk_hash.clear();
+		curr_chunk.reset(Server->openFile(os_file_prefix(chunkFn(hash)), MODE_READ));
+
+		if (curr_chunk.get() == NULL)
+		{
+			Server->Log("Error opening image block \"" + chunkFn(hash) + "\". " + os_last_error_str(), LL_ERROR);
+			has_error = true;
+			return 0;
+		}
+
+		curr_chunk_hash = hash_str;
+	}
+
+	return curr_chunk->Read(static_cast<int64>(sizeof(int64) + offset), buffer, static_cast<_u32>(bsize), &has_error);
+}
+
+const std::string& ImageBlockStore::getPath()
+{
+	return path;
+}
+
+BlockStoreFile::BlockStoreFile(const std::string &fn, bool pRead_only, uint64 pDstsize)
+	: filename(fn), read_only(pRead_only), is_open(false), finished(false),
+	header_dirty(false), table_dirty(false), filesize(0), curr_offset(0),
+	curr_block(-1), curr_block_dirty(false)
+{
+	open(std::string(), pDstsize, true);
+}
+
+BlockStoreFile::BlockStoreFile(const std::string &fn, const std::string &parent_fn, bool pRead_only, uint64 pDstsize)
+	: filename(fn), read_only(pRead_only), is_open(false), finished(false),
+	header_dirty(false), table_dirty(false), filesize(0), curr_offset(0),
+	curr_block(-1), curr_block_dirty(false)
+{
+	open(parent_fn, pDstsize, true);
+}
+
+BlockStoreFile::BlockStoreFile(const std::string &fn)
+	: filename(fn), read_only(false), is_open(false), finished(false),
+	header_dirty(false), table_dirty(false), filesize(0), curr_offset(0),
+	curr_block(-1), curr_block_dirty(false)
+{
+	open(std::string(), 0, false);
+}
+
+BlockStoreFile::~BlockStoreFile()
+{
+	if (is_open && !read_only && !finished)
+	{
+		flushBlock();
+		if (table_dirty)
+		{
+			writeTable();
+		}
+		if (header_dirty)
+		{
+			writeHeader();
+		}
+	}
+}
+
+void BlockStoreFile::open(const std::string& pParent_fn, uint64 pDstsize, bool open_parent)
+{
+	block_buf.resize(block_size);
+	block_sectors.resize(block_size / sector_size);
+
+	if (FileExists(filename))
+	{
+		index_file.reset(Server->openFile(os_file_prefix(filename), read_only ? MODE_READ : MODE_RW));
+		if (index_file.get() == NULL)
+		{
+			Server->Log("Error opening block store image \"" + filename + "\". " + os_last_error_str(), LL_ERROR);
+			return;
+		}
+
+		if (!readHeader())
+		{
+			return;
+		}
+
+		if (!read_only && pDstsize > filesize)
+		{
+			filesize = pDstsize;
+			header_dirty = true;
+		}
+	}
+	else if (!read_only)
+	{
+		index_file.reset(Server->openFile(os_file_prefix(filename), MODE_RW_CREATE));
+		if (index_file.get() == NULL)
+		{
+			Server->Log("Error creating block store image \"" + filename + "\". " + os_last_error_str(), LL_ERROR);
+			return;
+		}
+
+		parent_fn = pParent_fn;
+		store_path = std::string("..") + os_file_sep() + ".." + os_file_sep() + store_folder;
+		filesize = pDstsize;
+		header_dirty = true;
+	}
+	else
+	{
+		return;
+	}
+
+	if (open_parent && !parent_fn.empty())
+	{
+		parent.reset(new BlockStoreFile(parent_fn, true, 0));
+		if (!parent->isOpen())
+		{
+			Server->Log("Error opening parent image \"" + parent_fn + "\" of block store image \"" + filename + "\"", LL_ERROR);
+			return;
+		}
+
+		if (filesize == 0)
+		{
+			filesize = parent->getSize();
+		}
+	}
+
+	resizeTable();
+
+	store.reset(new ImageBlockStore(ExtractFilePath(filename) + os_file_sep() + store_path));
+
+	if (header_dirty && !writeHeader())
+	{
+		return;
+	}
+
+	is_open = true;
+}
+
+bool BlockStoreFile::readHeader()
+{
+	std::vector<char> header(header_size);
+	if (index_file->Read(0, header.data(), static_cast<_u32>(header_size)) != header_size)
+	{
+		Server->Log("Error reading header of block store image \"" + filename + "\"", LL_ERROR);
+		return false;
+	}
+
+	if (memcmp(header.data(), header_magic, sizeof(header_magic)) != 0)
+	{
+		Server->Log("Block store image \"" + filename + "\" has wrong magic", LL_ERROR);
+		return false;
+	}
+
+	size_t pos = header_magic_size;
+	memcpy(&filesize, &header[pos], sizeof(filesize));
+	filesize = little_endian(filesize);
+	pos += sizeof(filesize);
+
+	unsigned int hdr_blocksize;
+	memcpy(&hdr_blocksize, &header[pos], sizeof(hdr_blocksize));
+	hdr_blocksize = little_endian(hdr_blocksize);
+	pos += sizeof(hdr_blocksize);
+
+	unsigned int parent_len;
+	memcpy(&parent_len, &header[pos], sizeof(parent_len));
+	parent_len = little_endian(parent_len);
+	pos += sizeof(parent_len);
+
+	unsigned int store_len;
+	memcpy(&store_len, &header[pos], sizeof(store_len));
+	store_len = little_endian(store_len);
+	pos += sizeof(store_len);
+
+	if (hdr_blocksize != block_size
+		|| pos + parent_len + store_len > header_size)
+	{
+		Server->Log("Header of block store image \"" + filename + "\" is invalid", LL_ERROR);
+		return false;
+	}
+
+	parent_fn.assign(&header[pos], parent_len);
+	pos += parent_len;
+	store_path.assign(&header[pos], store_len);
+
+	resizeTable();
+
+	if (!table.empty())
+	{
+		bool has_error = false;
+		_u32 read = index_file->Read(static_cast<int64>(header_size), reinterpret_cast<char*>(table.data()),
+			static_cast<_u32>(table.size()), &has_error);
+		if (has_error)
+		{
+			Server->Log("Error reading block table of block store image \"" + filename + "\"", LL_ERROR);
+			return false;
+		}
+
+		//Table entries past the end are not in this image
+		std::fill(table.begin() + read, table.end(), 0);
+	}
+
+	return true;
+}
+
+bool BlockStoreFile::writeHeader()
+{
+	if (parent_fn.size() + store_path.size() + header_fields_size > header_size)
+	{
+		Server->Log("Parent path of block store image \"" + filename + "\" is too long", LL_ERROR);
+		return false;
+	}
+
+	std::vector<char> header(header_size);
+	memcpy(header.data(), header_magic, sizeof(header_magic));
+
+	size_t pos = header_magic_size;
+	uint64 hdr_filesize = little_endian(filesize);
+	memcpy(&header[pos], &hdr_filesize, sizeof(hdr_filesize));
+	pos += sizeof(hdr_filesize);
+
+	unsigned int hdr_blocksize = little_endian(block_size);
+	memcpy(&header[pos], &hdr_blocksize, sizeof(hdr_blocksize));
+	pos += sizeof(hdr_blocksize);
+
+	unsigned int parent_len = little_endian(static_cast<unsigned int>(parent_fn.size()));
+	memcpy(&header[pos], &parent_len, sizeof(parent_len));
+	pos += sizeof(parent_len);
+
+	unsigned int store_len = little_endian(static_cast<unsigned int>(store_path.size()));
+	memcpy(&header[pos], &store_len, sizeof(store_len));
+	pos += sizeof(store_len);
+
+	memcpy(&header[pos], parent_fn.data(), parent_fn.size());
+	pos += parent_fn.size();
+	memcpy(&header[pos], store_path.data(), store_path.size());
+
+	if (index_file->Write(0, header.data(), static_cast<_u32>(header_size)) != header_size)
+	{
+		Server->Log("Error writing header of block store image \"" + filename + "\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	header_dirty = false;
+	return true;
+}
+
+bool BlockStoreFile::writeTable()
+{
+	if (!table.empty()
+		&& index_file->Write(static_cast<int64>(header_size), reinterpret_cast<char*>(table.data()),
+			static_cast<_u32>(table.size())) != table.size())
+	{
+		Server->Log("Error writing block table of block store image \"" + filename + "\". " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	table_dirty = false;
+	return true;
+}
+
+void BlockStoreFile::resizeTable()
+{
+	size_t n_blocks = static_cast<size_t>((filesize + block_size - 1) / block_size);
+	if (n_blocks*hash_size > table.size())
+	{
+		table.resize(n_blocks*hash_size);
+	}
+}
+
+const unsigned char* BlockStoreFile::getEntry(int64 block)
+{
+	if (block < 0
+		|| static_cast<size_t>(block + 1)*hash_size > table.size())
+	{
+		return NULL;
+	}
+
+	const unsigned char* entry = &table[static_cast<size_t>(block)*hash_size];
+
+	if (memcmp(entry, empty_entry, hash_size) == 0)
+	{
+		return NULL;
+	}
+
+	return entry;
+}
+
+const unsigned char* BlockStoreFile::getChainEntry(int64 block)
+{
+	const unsigned char* entry = getEntry(block);
+	if (entry == NULL
+		&& parent.get() != NULL)
+	{
+		return parent->getChainEntry(block);
+	}
+	return entry;
+}
+
+bool BlockStoreFile::isDataEntry(const unsigned char* entry)
+{
+	return entry != NULL
+		&& memcmp(entry, unused_entry, hash_size) != 0;
+}
+
+bool BlockStoreFile::hasChunk(const unsigned char* entry)
+{
+	return isDataEntry(entry)
+		&& memcmp(entry, zero_block_hash, hash_size) != 0;
+}
+
+size_t BlockStoreFile::blockLength(int64 block)
+{
+	return static_cast<size_t>((std::min)(static_cast<uint64>(block_size),
+		filesize - static_cast<uint64>(block)*block_size));
+}
+
+bool BlockStoreFile::readBlockData(int64 block, size_t offset, char* buffer, size_t bsize)
+{
+	const unsigned char* entry = getChainEntry(block);
+
+	if (!hasChunk(entry))
+	{
+		memset(buffer, 0, bsize);
+		return true;
+	}
+
+	bool has_error = false;
+	size_t read = store->read(entry, offset, buffer, bsize, has_error);
+
+	if (has_error)
+	{
+		Server->Log("Error reading block " + convert(block) + " of block store image \"" + filename + "\"", LL_ERROR);
+		return false;
+	}
+
+	if (read < bsize)
+	{
+		memset(buffer + read, 0, bsize - read);
+	}
+
+	return true;
+}
+
+bool BlockStoreFile::switchBlock(int64 block)
+{
+	if (block == curr_block)
+	{
+		return true;
+	}
+
+	if (!flushBlock())
+	{
+		return false;
+	}
+
+	curr_block = block;
+	curr_block_dirty = false;
+	std::fill(block_sectors.begin(), block_sectors.end(), 0);
+
+	return true;
+}
+
+bool BlockStoreFile::fillSectors(size_t start, size_t end)
+{
+	size_t sector = start / sector_size;
+	size_t end_sector = (end + sector_size - 1) / sector_size;
+
+	while (sector < end_sector)
+	{
+		if (block_sectors[sector])
+		{
+			++sector;
+			continue;
+		}
+
+		size_t run_end = sector + 1;
+		while (run_end < end_sector
+			&& !block_sectors[run_end])
+		{
+			++run_end;
+		}
+
+		if (!readBlockData(curr_block, sector*sector_size, &block_buf[sector*sector_size],
+			(run_end - sector)*sector_size))
+		{
+			return false;
+		}
+
+		std::fill(block_sectors.begin() + sector, block_sectors.begin() + run_end, 1);
+
+		sector = run_end;
+	}
+
+	return true;
+}
+
+bool BlockStoreFile::flushBlock()
+{
+	if (curr_block < 0
+		|| !curr_block_dirty)
+	{
+		return true;
+	}
+
+	size_t len = blockLength(curr_block);
+
+	if (!fillSectors(0, len))
+	{
+		return false;
+	}
+
+	unsigned char hash[hash_size];
+	bool is_zero = buf_is_zero(block_buf.data(), len);
+	if (is_zero)
+	{
+		memcpy(hash, zero_block_hash, hash_size);
+	}
+	else
+	{
+		sha256_ctx shactx;
+		sha256_init(&shactx);
+		sha256_update(&shactx, reinterpret_cast<unsigned char*>(block_buf.data()), static_cast<unsigned int>(len));
+		sha256_final(&shactx, hash);
+	}
+
+	const unsigned char* old_entry = getEntry(curr_block);
+
+	if (old_entry == NULL
+		&& parent.get() != NULL)
+	{
+		//Unchanged compared to parent image
+		const unsigned char* parent_entry = parent->getChainEntry(curr_block);
+		if (parent_entry != NULL
+			&& memcmp(parent_entry, hash, hash_size) == 0)
+		{
+			curr_block_dirty = false;
+			return true;
+		}
+	}
+
+	if (old_entry != NULL
+		&& memcmp(old_entry, hash, hash_size) == 0)
+	{
+		curr_block_dirty = false;
+		return true;
+	}
+
+	if (!is_zero
+		&& !store->addReference(hash, block_buf.data(), len))
+	{
+		return false;
+	}
+
+	if (hasChunk(old_entry))
+	{
+		store->removeReference(old_entry);
+	}
+
+	memcpy(&table[static_cast<size_t>(curr_block)*hash_size], hash, hash_size);
+	table_dirty = true;
+	curr_block_dirty = false;
+
+	return true;
+}
+
+bool BlockStoreFile::Seek(_i64 offset)
+{
+	curr_offset = offset;
+	return true;
+}
+
+bool BlockStoreFile::Read(char* buffer, size_t bsize, size_t &read_bytes)
+{
+	read_bytes = 0;
+
+	while (read_bytes < bsize
+		&& static_cast<uint64>(curr_offset) < filesize)
+	{
+		int64 block = curr_offset / block_size;
+		size_t block_offset = static_cast<size_t>(curr_offset % block_size);
+		size_t toread = (std::min)(bsize - read_bytes, static_cast<size_t>(block_size) - block_offset);
+		toread = static_cast<size_t>((std::min)(static_cast<uint64>(toread), filesize - curr_offset));
+
+		if (block == curr_block
+			&& curr_block_dirty)
+		{
+			if (!fillSectors(block_offset, block_offset + toread))
+			{
+				return false;
+			}
+			memcpy(buffer + read_bytes, &block_buf[block_offset], toread);
+		}
+		else if (!readBlockData(block, block_offset, buffer + read_bytes, toread))
+		{
+			return false;
+		}
+
+		read_bytes += toread;
+		curr_offset += toread;
+	}
+
+	return true;
+}
+
+_u32 BlockStoreFile::Write(const char *buffer, _u32 bsize, bool *has_error)
+{
+	if (read_only)
+	{
+		if (has_error) *has_error = true;
+		return 0;
+	}
+
+	if (static_cast<uint64>(curr_offset) + bsize > filesize)
+	{
+		filesize = curr_offset + bsize;
+		resizeTable();
+		header_dirty = true;
+	}
+
+	_u32 written = 0;
+	while (written < bsize)
+	{
+		int64 block = curr_offset / block_size;
+		size_t block_offset = static_cast<size_t>(curr_offset % block_size);
+		size_t towrite = (std::min)(static_cast<size_t>(bsize - written), static_cast<size_t>(block_size) - block_offset);
+
+		if (!switchBlock(block))
+		{
+			if (has_error) *has_error = true;
+			return written;
+		}
+
+		//Partially written sectors need the previous data
+		if (block_offset%sector_size != 0
+			&& !fillSectors(block_offset, block_offset + 1))
+		{
+			if (has_error) *has_error = true;
+			return written;
+		}
+
+		if ((block_offset + towrite) % sector_size != 0
+			&& !fillSectors(block_offset + towrite - 1, block_offset + towrite))
+		{
+			if (has_error) *has_error = true;
+			return written;
+		}
+
+		memcpy(&block_buf[block_offset], buffer + written, towrite);
+
+		std::fill(block_sectors.begin() + block_offset / sector_size,
+			block_sectors.begin() + (block_offset + towrite + sector_size - 1) / sector_size, 1);
+		curr_block_dirty = true;
+
+		written += static_cast<_u32>(towrite);
+		curr_offset += towrite;
+	}
+
+	return written;
+}
+
+bool BlockStoreFile::isOpen(void)
+{
+	return is_open;
+}
+
+uint64 BlockStoreFile::getSize(void)
+{
+	return filesize;
+}
+
+uint64 BlockStoreFile::usedSize(void)
+{
+	uint64 used = 0;
+	for (size_t i = 0; i*hash_size < table.size(); ++i)
+	{
+		if (isDataEntry(getEntry(i)))
+		{
+			used += block_size;
+		}
+	}
+	return used;
+}
+
+std::string BlockStoreFile::getFilename(void)
+{
+	return filename;
+}
+
+bool BlockStoreFile::has_sector(_i64 sector_size)
+{
+	int64 end_block = (curr_offset + (std::max)(sector_size, static_cast<_i64>(1)) - 1) / block_size;
+	for (int64 block = curr_offset / block_size; block <= end_block; ++block)
+	{
+		if ( (block == curr_block && curr_block_dirty)
+			|| isDataEntry(getChainEntry(block)) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool BlockStoreFile::this_has_sector(_i64 sector_size)
+{
+	int64 end_block = (curr_offset + (std::max)(sector_size, static_cast<_i64>(1)) - 1) / block_size;
+	for (int64 block = curr_offset / block_size; block <= end_block; ++block)
+	{
+		if ( (block == curr_block && curr_block_dirty)
+			|| isDataEntry(getEntry(block)) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+unsigned int BlockStoreFile::getBlocksize()
+{
+	return block_size;
+}
+
+bool BlockStoreFile::finish()
+{
+	if (read_only)
+	{
+		return true;
+	}
+
+	if (!flushBlock())
+	{
+		return false;
+	}
+
+	//References have to be on disk before the table referencing them
+	if (!os_sync(store->getPath()))
+	{
+		Server->Log("Syncing image block store \"" + store->getPath() + "\" failed", LL_WARNING);
+	}
+
+	if (table_dirty && !writeTable())
+	{
+		return false;
+	}
+
+	if (header_dirty && !writeHeader())
+	{
+		return false;
+	}
+
+	if (!index_file->Sync())
+	{
+		Server->Log("Syncing block store image \"" + filename + "\" failed. " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	finished = true;
+	return true;
+}
+
+bool BlockStoreFile::trimRange(_i64 fs_offset, uint64 unused_start, uint64 unused_end, ITrimCallback* trim_callback)
+{
+	//Only whole blocks can be dropped
+	if (unused_start%block_size != 0)
+	{
+		unused_start = (unused_start / block_size + 1)*block_size;
+	}
+
+	if (unused_end > filesize)
+	{
+		unused_end = filesize;
+	}
+	else if (unused_end != filesize)
+	{
+		unused_end = (unused_end / block_size)*block_size;
+	}
+
+	if (unused_start >= unused_end)
+	{
+		return true;
+	}
+
+	if (!setUnused(unused_start, unused_end))
+	{
+		return false;
+	}
+
+	if (trim_callback != NULL)
+	{
+		trim_callback->trimmed(unused_start - fs_offset, unused_end - fs_offset);
+	}
+
+	return true;
+}
+
+bool BlockStoreFile::trimUnused(_i64 fs_offset, _i64 trim_blocksize, ITrimCallback* trim_callback)
+{
+	if (fs_offset%block_size != 0)
+	{
+		Server->Log("Filesystem offset " + convert(fs_offset) + " is not aligned to the image block size. Cannot trim.", LL_WARNING);
+		return false;
+	}
+
+	FileWrapper devfile(this, fs_offset);
+	std::auto_ptr<IReadOnlyBitmap> bitmap_source;
+
+	bitmap_source.reset(new ClientBitmap(filename + ".cbitmap"));
+
+	if (bitmap_source->hasError())
+	{
+		Server->Log("Error reading client bitmap. Falling back to reading bitmap from NTFS", LL_WARNING);
+
+		bitmap_source.reset(new FSNTFS(&devfile, IFSImageFactory::EReadaheadMode_None, false, NULL));
+	}
+
+	if (bitmap_source->hasError())
+	{
+		Server->Log("Error opening NTFS bitmap. Cannot trim.", LL_WARNING);
+		return false;
+	}
+
+	unsigned int bitmap_blocksize = static_cast<unsigned int>(bitmap_source->getBlocksize());
+
+	int64 unused_start_block = -1;
+
+	for (int64 ntfs_block = 0, n_ntfs_blocks = devfile.Size() / bitmap_blocksize;
+		ntfs_block<n_ntfs_blocks; ++ntfs_block)
+	{
+		if (!bitmap_source->hasBlock(ntfs_block))
+		{
+			if (unused_start_block == -1)
+			{
+				unused_start_block = ntfs_block;
+			}
+		}
+		else if (unused_start_block != -1)
+		{
+			uint64 unused_start = fs_offset + unused_start_block*bitmap_blocksize;
+			uint64 unused_end = fs_offset + ntfs_block*bitmap_blocksize;
+
+			if (unused_start >= filesize)
+			{
+				return true;
+			}
+
+			if (!trimRange(fs_offset, unused_start, unused_end, trim_callback))
+			{
+				Server->Log("Trimming failed. Stopping trimming.", LL_WARNING);
+				return false;
+			}
+
+			unused_start_block = -1;
+		}
+	}
+
+	if (unused_start_block != -1)
+	{
+		uint64 unused_start = fs_offset + unused_start_block*bitmap_blocksize;
+
+		if (!trimRange(fs_offset, unused_start, filesize, trim_callback))
+		{
+			Server->Log("Trimming failed. Stopping trimming (end).", LL_WARNING);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool BlockStoreFile::syncBitmap(_i64 fs_offset)
+{
+	//Used blocks are tracked by the block table
+	return true;
+}
+
+bool BlockStoreFile::makeFull(_i64 fs_offset, IVHDWriteCallback* write_callback)
+{
+	if (parent.get() == NULL)
+	{
+		return true;
+	}
+
+	//Reference the parent's blocks. The data does not change, so the hash
+	//file does not have to be updated
+	for (size_t i = 0; i*hash_size < table.size(); ++i)
+	{
+		if (getEntry(i) != NULL)
+		{
+			continue;
+		}
+
+		const unsigned char* parent_entry = parent->getChainEntry(i);
+		if (parent_entry == NULL)
+		{
+			continue;
+		}
+
+		if (hasChunk(parent_entry)
+			&& !store->addReference(parent_entry, NULL, 0))
+		{
+			Server->Log("Error referencing block " + convert(i) + " of parent image \"" + parent_fn + "\"", LL_ERROR);
+			return false;
+		}
+
+		memcpy(&table[i*hash_size], parent_entry, hash_size);
+		table_dirty = true;
+	}
+
+	parent.reset();
+	parent_fn.clear();
+	header_dirty = true;
+
+	return true;
+}
+
+bool BlockStoreFile::setUnused(_i64 unused_start, _i64 unused_end)
+{
+	if (static_cast<uint64>(unused_end) > filesize)
+	{
+		unused_end = filesize;
+	}
+
+	int64 start_block = (unused_start + block_size - 1) / block_size;
+	int64 end_block = unused_end / block_size;
+	if (static_cast<uint64>(unused_end) == filesize)
+	{
+		end_block = (unused_end + block_size - 1) / block_size;
+	}
+
+	for (int64 block = start_block; block < end_block; ++block)
+	{
+		if (block == curr_block)
+		{
+			curr_block = -1;
+			curr_block_dirty = false;
+		}
+
+		const unsigned char* old_entry = getEntry(block);
+		if (hasChunk(old_entry))
+		{
+			store->removeReference(old_entry);
+		}
+
+		memcpy(&table[static_cast<size_t>(block)*hash_size], unused_entry, hash_size);
+		table_dirty = true;
+	}
+
+	return true;
+}
+
+bool BlockStoreFile::setBackingFileSize(_i64 fsize)
+{
+	return false;
+}
+
+bool BlockStoreFile::removeReferences(const std::string& fn)
+{
+	if (!FileExists(fn))
+	{
+		return true;
+	}
+
+	BlockStoreFile image(fn);
+
+	if (!image.isOpen())
+	{
+		return false;
+	}
+
+	std::vector<unsigned char> image_table;
+	image_table.swap(image.table);
+
+	//Empty the image first, so references are not removed twice if
+	//deleting the image file fails
+	image.filesize = 0;
+	if (!image.writeHeader()
+		|| !image.index_file->Sync())
+	{
+		return false;
+	}
+
+	image.finished = true;
+
+	bool ret = true;
+	for (size_t i = 0; i*hash_size < image_table.size(); ++i)
+	{
+		const unsigned char* entry = &image_table[i*hash_size];
+		if (memcmp(entry, empty_entry, hash_size) != 0
+			&& image.hasChunk(entry)
+			&& !image.store->removeReference(entry))
+		{
+			ret = false;
+		}
+	}
+
+	return ret;
+}
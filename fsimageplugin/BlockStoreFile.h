@@ -0,0 +1,121 @@
+#pragma once
+
+#include "IVHDFile.h"
+#include "../Interface/File.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+class IMutex;
+
+//Content addressed store of image blocks shared by all block store images
+//of a backup folder. Each chunk is named after the sha256 of its content
+//and starts with a reference count.
+class ImageBlockStore
+{
+public:
+	ImageBlockStore(const std::string& path);
+
+	static void init();
+
+	//Adds a reference to the chunk with hash, creating it with data if
+	//it does not exist yet
+	bool addReference(const unsigned char* hash, const char* data, size_t data_size);
+	//Drops a reference. Deletes the chunk if it is not referenced anymore
+	bool removeReference(const unsigned char* hash);
+
+	//Returns the number of bytes read. Keeps the last chunk open
+	size_t read(const unsigned char* hash, size_t offset, char* buffer, size_t bsize, bool& has_error);
+
+	const std::string& getPath();
+
+private:
+	std::string chunkFn(const unsigned char* hash);
+	//Reference count updates of a chunk are serialized by the lock
+	//of its hash stripe. Chunk data is written without a lock.
+	static IMutex* chunkMutex(const unsigned char* hash);
+	bool incrementRefcount(const std::string& fn, bool& not_found);
+
+	std::string path;
+	std::string curr_chunk_hash;
+	std::auto_ptr<IFile> curr_chunk;
+
+	static const size_t n_mutexes = 64;
+	static IMutex* mutexes[n_mutexes];
+};
+
+//Image file which only stores the sha256 of each 512KiB block. The block
+//data is deduplicated in an ImageBlockStore in the .image_blocks folder of
+//the backup folder. Incremental images reference their parent image for
+//blocks they do not contain.
+class BlockStoreFile : public IVHDFile
+{
+public:
+	BlockStoreFile(const std::string &fn, bool pRead_only, uint64 pDstsize);
+	BlockStoreFile(const std::string &fn, const std::string &parent_fn, bool pRead_only, uint64 pDstsize);
+	~BlockStoreFile();
+
+	virtual bool Seek(_i64 offset);
+	virtual bool Read(char* buffer, size_t bsize, size_t &read_bytes);
+	virtual _u32 Write(const char *buffer, _u32 bsize, bool *has_error);
+	virtual bool isOpen(void);
+	virtual uint64 getSize(void);
+	virtual uint64 usedSize(void);
+	virtual std::string getFilename(void);
+	virtual bool has_sector(_i64 sector_size=-1);
+	virtual bool this_has_sector(_i64 sector_size=-1);
+	virtual unsigned int getBlocksize();
+	virtual bool finish();
+	virtual bool trimUnused(_i64 fs_offset, _i64 trim_blocksize, ITrimCallback* trim_callback);
+	virtual bool syncBitmap(_i64 fs_offset);
+	virtual bool makeFull(_i64 fs_offset, IVHDWriteCallback* write_callback);
+	virtual bool setUnused(_i64 unused_start, _i64 unused_end);
+	virtual bool setBackingFileSize(_i64 fsize);
+
+	//Drops the references of the image file fn to the chunks in the block
+	//store. Call before deleting the image file.
+	static bool removeReferences(const std::string& fn);
+
+private:
+	//Opens the image without its parent for removing references
+	BlockStoreFile(const std::string &fn);
+
+	void open(const std::string& parent_fn, uint64 pDstsize, bool open_parent);
+	bool readHeader();
+	bool writeHeader();
+	bool writeTable();
+	void resizeTable();
+	const unsigned char* getEntry(int64 block);
+	const unsigned char* getChainEntry(int64 block);
+	bool isDataEntry(const unsigned char* entry);
+	bool hasChunk(const unsigned char* entry);
+	size_t blockLength(int64 block);
+	bool readBlockData(int64 block, size_t offset, char* buffer, size_t bsize);
+	bool switchBlock(int64 block);
+	bool fillSectors(size_t start, size_t end);
+	bool flushBlock();
+	bool trimRange(_i64 fs_offset, uint64 unused_start, uint64 unused_end, ITrimCallback* trim_callback);
+
+	std::string filename;
+	std::string parent_fn;
+	std::string store_path;
+	std::auto_ptr<IFile> index_file;
+	std::auto_ptr<BlockStoreFile> parent;
+	std::auto_ptr<ImageBlockStore> store;
+
+	bool read_only;
+	bool is_open;
+	bool finished;
+	bool header_dirty;
+	bool table_dirty;
+
+	uint64 filesize;
+	_i64 curr_offset;
+
+	std::vector<unsigned char> table;
+
+	int64 curr_block;
+	bool curr_block_dirty;
+	std::vector<char> block_buf;
+	std::vector<char> block_sectors;
+};
@@ -22,22 +22,115 @@
 #include <memory>
 #include <algorithm>
 #include <memory.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
 #include "../common/miniz.h"
 
+#ifndef _WIN32
+#include "../config.h"
+#endif
+
+#if defined(HAVE_ZSTD_H) && defined(HAVE_LIBZSTD)
+#define WITH_ZSTD_COMPRESSION
+#include <zstd.h>
+#endif
+
 const size_t c_cacheBuffersize = 2*1024*1024;
 const size_t c_ncacheItems = 5;
 const char headerMagic[] = "URBACKUP COMPRESSED FILE#1.0";
+//Files with zstd compressed blocks. Older versions do not recognize them.
+const char headerMagicV2[] = "URBACKUP COMPRESSED FILE#2.0";
 const _u32 mode_none = 0;
 const _u32 mode_zlib = 1;
+const _u32 mode_zstd = 2;
 const size_t c_header_size = sizeof(headerMagic) + sizeof(__int64) + sizeof(__int64) + sizeof(_u32);
+const size_t c_maxCompressionThreads = 4;
+
+namespace
+{
+	size_t getCompressionThreads()
+	{
+		std::string threads = Server->getServerParameter("image_compression_threads");
+		if(!threads.empty())
+		{
+			return static_cast<size_t>((std::max)(1, watoi(threads)));
+		}
 
+#ifdef _WIN32
+		SYSTEM_INFO system_info;
+		GetSystemInfo(&system_info);
+		long ncpus = static_cast<long>(system_info.dwNumberOfProcessors);
+#else
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if(ncpus<1)
+		{
+			return 1;
+		}
 
-CompressedFile::CompressedFile( std::string pFilename, int pMode )
-	: hotCache(NULL), error(false), currentPosition(0),
-	  finished(false), filesize(0), noMagic(false)
+		return (std::min)(static_cast<size_t>(ncpus), c_maxCompressionThreads);
+	}
+
+	_u32 getCompressionMode(CompressedFile::ECompressionMethod compressionMethod)
+	{
+#ifdef WITH_ZSTD_COMPRESSION
+		if(compressionMethod==CompressedFile::CompressionMethod_Zstd)
+		{
+			return mode_zstd;
+		}
+#endif
+		return mode_zlib;
+	}
+
+	bool isCompressionMethodSupported(CompressedFile::ECompressionMethod compressionMethod)
+	{
+#ifndef WITH_ZSTD_COMPRESSION
+		if(compressionMethod==CompressedFile::CompressionMethod_Zstd)
+		{
+			Server->Log("Zstandard compression is not supported by this build", LL_ERROR);
+			return false;
+		}
+#endif
+		return true;
+	}
+
+#ifdef WITH_ZSTD_COMPRESSION
+	int getZstdCompressionLevel()
+	{
+		std::string level = Server->getServerParameter("image_compression_level_zstd");
+		if(!level.empty())
+		{
+			return watoi(level);
+		}
+		return 3;
+	}
+#endif
+}
+
+
+CompressedFile::CompressedFile( std::string pFilename, int pMode, ECompressionMethod compressionMethod )
+	: filesize(0), compressionMode(getCompressionMode(compressionMethod)), currentPosition(0),
+	  hotCache(NULL), error(false), finished(false), noMagic(false),
+	  n_workers(getCompressionThreads()), jobs_mutex(Server->createMutex()),
+	  jobs_cond(Server->createCondition()), jobs_done_cond(Server->createCondition()),
+	  workers_quit(false), last_read_block(std::string::npos)
 {
+	if(pMode != MODE_READ
+		&& pMode != MODE_RW
+		&& !isCompressionMethodSupported(compressionMethod))
+	{
+		uncompressedFile=NULL;
+		readOnly=true;
+		error=true;
+		finished=true;
+		return;
+	}
+
 	uncompressedFile = Server->openFile(pFilename, pMode);
 
 	if(uncompressedFile==NULL)
@@ -68,15 +161,22 @@ CompressedFile::CompressedFile( std::string pFilename, int pMode )
 	}
 }
 
-CompressedFile::CompressedFile(IFile* file, bool openExisting, bool readOnly)
-	: hotCache(NULL), error(false), currentPosition(0),
-	finished(false), uncompressedFile(file), filesize(0), readOnly(readOnly),
-	noMagic(false)
+CompressedFile::CompressedFile(IFile* file, bool openExisting, bool readOnly, ECompressionMethod compressionMethod)
+	: filesize(0), compressionMode(getCompressionMode(compressionMethod)), currentPosition(0),
+	uncompressedFile(file), hotCache(NULL), error(false), finished(false), readOnly(readOnly),
+	noMagic(false), n_workers(getCompressionThreads()), jobs_mutex(Server->createMutex()),
+	jobs_cond(Server->createCondition()), jobs_done_cond(Server->createCondition()),
+	workers_quit(false), last_read_block(std::string::npos)
 {
 	if(openExisting)
 	{
 		readHeader(&error);
 	}
+	else if(!isCompressionMethodSupported(compressionMethod))
+	{
+		error=true;
+		finished=true;
+	}
 	else
 	{
 		blocksize = c_cacheBuffersize;
@@ -97,6 +197,13 @@ CompressedFile::~CompressedFile()
 		finish();
 	}
 
+	stopWorkers();
+
+	for(size_t i=0;i<free_jobs.size();++i)
+	{
+		delete free_jobs[i];
+	}
+
 	delete uncompressedFile;
 }
 
@@ -122,7 +229,15 @@ void CompressedFile::readHeader(bool *has_error)
 		return;
 	}
 
-	if(!next(header, 0, headerMagic))
+	if(next(header, 0, headerMagic))
+	{
+		compressionMode = mode_zlib;
+	}
+	else if(next(header, 0, headerMagicV2))
+	{
+		compressionMode = mode_zstd;
+	}
+	else
 	{
 		Server->Log("Magic in header not found for compressed file", LL_ERROR);
 		error=true;
@@ -276,6 +391,11 @@ bool CompressedFile::fillCache( __int64 offset, bool errorMsg, bool *has_error)
 {
 	size_t block = static_cast<size_t>(offset/blocksize);
 
+	if(!readOnly)
+	{
+		waitForPendingBlock(block);
+	}
+
 	if(block>=blockOffsets.size())
 	{
 		if(errorMsg)
@@ -298,7 +418,59 @@ bool CompressedFile::fillCache( __int64 offset, bool errorMsg, bool *has_error)
 		return true;
 	}
 
-	const __int64 blockDataOffset = blockOffsets[block];	
+	bool sequential = block==last_read_block+1;
+	last_read_block = block;
+
+	if(readOnly && n_workers>1)
+	{
+		std::map<size_t, SCompressionJob*>::iterator it = readahead_jobs.find(block);
+		if(it!=readahead_jobs.end())
+		{
+			SCompressionJob* job = it->second;
+			readahead_jobs.erase(it);
+			bool ret = readAheadResult(job, buf);
+			startReadAhead(block);
+			return ret;
+		}
+		else if(!sequential)
+		{
+			clearReadAhead();
+		}
+	}
+
+	_u32 compressedSize;
+	_u32 mode;
+	if(!readCompressedBlock(block, compressedBuffer, compressedSize, mode, buf, has_error))
+	{
+		return false;
+	}
+
+	if(mode!=mode_none)
+	{
+		_u32 rdecomp;
+		if(!decompressBlock(compressedBuffer.data(), compressedSize, mode, buf, rdecomp))
+		{
+			return false;
+		}
+
+		if(rdecomp!=blocksize && offset+blocksize<filesize)
+		{
+			Server->Log("Did not receive enough bytes from compressed stream. Expected "+convert(blocksize)+" received "+convert(rdecomp), LL_ERROR);
+			return false;
+		}
+	}
+
+	if(readOnly && n_workers>1 && sequential)
+	{
+		startReadAhead(block);
+	}
+
+	return true;
+}
+
+bool CompressedFile::readCompressedBlock(size_t block, std::vector<char>& compressed, _u32& compressedSize, _u32& mode, char* buf, bool *has_error)
+{
+	const __int64 blockDataOffset = blockOffsets[block];
 
 	if(!uncompressedFile->Seek(blockDataOffset))
 	{
@@ -314,11 +486,10 @@ bool CompressedFile::fillCache( __int64 offset, bool errorMsg, bool *has_error)
 		return false;
 	}
 
-	_u32 compressedSize;
 	memcpy(&compressedSize, blockheaderBuf, sizeof(compressedSize));
 	compressedSize = little_endian(compressedSize);
-	_u32 mode;
 	memcpy(&mode, blockheaderBuf + sizeof(compressedSize), sizeof(mode));
+	mode = little_endian(mode);
 			
 	if(mode==mode_none)
 	{
@@ -336,41 +507,61 @@ bool CompressedFile::fillCache( __int64 offset, bool errorMsg, bool *has_error)
 
 		return true;
 	}
-	else
+	else if(mode!=mode_zlib
+#ifdef WITH_ZSTD_COMPRESSION
+		&& mode!=mode_zstd
+#endif
+		)
 	{
-		if(compressedBuffer.size()<compressedSize)
-		{
-			compressedBuffer.resize(compressedSize);
-		}	
+		Server->Log("Unknown compression mode "+convert(mode)+" at offset "+convert(blockDataOffset), LL_ERROR);
+		return false;
+	}
 
-		if(readFromFile(&compressedBuffer[0], compressedSize, has_error)!=compressedSize)
-		{
-			Server->Log("Error while reading compressed data from "+convert(blockDataOffset)+" ("+convert(compressedSize)+" bytes)", LL_ERROR);
-			return false;
-		}
+	if(compressed.size()<compressedSize)
+	{
+		compressed.resize(compressedSize);
+	}	
+
+	if(readFromFile(&compressed[0], compressedSize, has_error)!=compressedSize)
+	{
+		Server->Log("Error while reading compressed data from "+convert(blockDataOffset)+" ("+convert(compressedSize)+" bytes)", LL_ERROR);
+		return false;
 	}
-	
-	mz_ulong rdecomp=0;
-	if(mode==mode_zlib)
+
+	return true;
+}
+
+bool CompressedFile::decompressBlock(const char* compressed, _u32 compressedSize, _u32 mode, char* buf, _u32& dataSize)
+{
+#ifdef WITH_ZSTD_COMPRESSION
+	if(mode==mode_zstd)
 	{
-		rdecomp = blocksize;
-		int rc = mz_uncompress(reinterpret_cast<unsigned char*>(buf), &rdecomp,
-			reinterpret_cast<const unsigned char*>(compressedBuffer.data()), static_cast<mz_ulong>(compressedSize));
+		size_t rc = ZSTD_decompress(buf, blocksize, compressed, compressedSize);
 
-		if(rc != MZ_OK)
+		if(ZSTD_isError(rc))
 		{
-			Server->Log("Error while decompressing file. Error code "+convert(rc), LL_ERROR);
+			Server->Log("Error while decompressing file. "+std::string(ZSTD_getErrorName(rc)), LL_ERROR);
 			return false;
 		}
+
+		dataSize = static_cast<_u32>(rc);
+
+		return true;
 	}
-	
+#endif
 
-	if(rdecomp!=blocksize && offset+blocksize<filesize)
+	mz_ulong rdecomp = blocksize;
+	int rc = mz_uncompress(reinterpret_cast<unsigned char*>(buf), &rdecomp,
+		reinterpret_cast<const unsigned char*>(compressed), static_cast<mz_ulong>(compressedSize));
+
+	if(rc != MZ_OK)
 	{
-		Server->Log("Did not receive enough bytes from compressed stream. Expected "+convert(blocksize)+" received "+convert((size_t)rdecomp), LL_ERROR);
+		Server->Log("Error while decompressing file. Error code "+convert(rc), LL_ERROR);
 		return false;
 	}
 
+	dataSize = static_cast<_u32>(rdecomp);
+
 	return true;
 }
 
@@ -447,29 +638,94 @@ void CompressedFile::evictFromLruCache( const SCacheItem& item )
 	if(readOnly)
 		return;
 
-	__int64 blockOffset = uncompressedFile->Size();
-	if(!uncompressedFile->Seek(blockOffset))
+	size_t blockIdx = static_cast<size_t>(item.offset/blocksize);
+
+	if(n_workers>1)
+	{
+		if(workers.empty())
+		{
+			startWorkers();
+		}
+
+		SCompressionJob* job = getFreeJob();
+		job->block = blockIdx;
+		job->decompress = false;
+		memcpy(&job->data[0], item.buffer, blocksize);
+		queueJob(job);
+		pending_writes.push_back(job);
+
+		writeFinishedJobs(pending_writes.size()>=2*n_workers);
+		return;
+	}
+
+	_u32 compBytes;
+	if(!compressBlock(item.buffer, compressedBuffer, compBytes))
 	{
 		error=true;
-		Server->Log("Error while seeking to end of file while before writing compressed data", LL_ERROR);
 		return;
 	}
 
-	mz_ulong compBytes = static_cast<mz_ulong>(compressedBuffer.size());
-	int rc = mz_compress(reinterpret_cast<unsigned char*>(compressedBuffer.data()), &compBytes,
-		reinterpret_cast<const unsigned char*>(item.buffer), blocksize);
+	writeCompressedBlock(blockIdx, compressedBuffer.data(), compBytes);
+}
+
+bool CompressedFile::compressBlock(const char* buf, std::vector<char>& compressed, _u32& compressedSize)
+{
+#ifdef WITH_ZSTD_COMPRESSION
+	if(compressionMode==mode_zstd)
+	{
+		size_t bound = ZSTD_compressBound(blocksize);
+		if(compressed.size()<bound)
+		{
+			compressed.resize(bound);
+		}
+
+		size_t rc = ZSTD_compress(&compressed[0], compressed.size(), buf, blocksize, getZstdCompressionLevel());
+
+		if(ZSTD_isError(rc))
+		{
+			Server->Log("Error while compressing data. "+std::string(ZSTD_getErrorName(rc)), LL_ERROR);
+			return false;
+		}
+
+		compressedSize = static_cast<_u32>(rc);
+
+		return true;
+	}
+#endif
+
+	mz_ulong compBytes = mz_compressBound(static_cast<mz_ulong>(blocksize));
+	if(compressed.size()<compBytes)
+	{
+		compressed.resize(compBytes);
+	}
+
+	int rc = mz_compress(reinterpret_cast<unsigned char*>(&compressed[0]), &compBytes,
+		reinterpret_cast<const unsigned char*>(buf), blocksize);
 
 	if(rc!=MZ_OK)
 	{
-		error=true;
 		Server->Log("Error while compressing data. Error code: "+convert(rc), LL_ERROR);
-		return;
+		return false;
+	}
+
+	compressedSize = static_cast<_u32>(compBytes);
+
+	return true;
+}
+
+bool CompressedFile::writeCompressedBlock(size_t blockIdx, const char* compressed, _u32 compressedSize)
+{
+	__int64 blockOffset = uncompressedFile->Size();
+	if(!uncompressedFile->Seek(blockOffset))
+	{
+		error=true;
+		Server->Log("Error while seeking to end of file while before writing compressed data", LL_ERROR);
+		return false;
 	}
 
 	char blockheaderBuf[2*sizeof(_u32)];
-	_u32 compBytesEndian = little_endian(static_cast<_u32>(compBytes));
-	_u32 mode = mode_zlib;
-	_u32 modeEndian = little_endian(mode);
+	_u32 compBytesEndian = little_endian(compressedSize);
+	_u32 modeEndian = little_endian(compressionMode);
 
 	memcpy(blockheaderBuf, &compBytesEndian, sizeof(compBytesEndian));
 	memcpy(blockheaderBuf+sizeof(compBytesEndian), &modeEndian, sizeof(modeEndian));
@@ -478,18 +734,16 @@ void CompressedFile::evictFromLruCache( const SCacheItem& item )
 	{
 		error=true;
 		Server->Log("Error while writing blockheader to compressed file", LL_ERROR);
-		return;
+		return false;
 	}
 
-	if(writeToFile(compressedBuffer.data(), static_cast<_u32>(compBytes))!=static_cast<_u32>(compBytes))
+	if(writeToFile(compressed, compressedSize)!=compressedSize)
 	{
 		error=true;
 		Server->Log("Error while writing compressed data to file", LL_ERROR);
-		return;
+		return false;
 	}
 
-	size_t blockIdx = static_cast<size_t>(item.offset/blocksize);
-
 	const size_t numBlockOffsets = blockOffsets.size();
 	if(blockOffsets.size()<=blockIdx)
 	{
@@ -502,13 +756,15 @@ void CompressedFile::evictFromLruCache( const SCacheItem& item )
 	}
 
 	blockOffsets[blockIdx] = blockOffset;
+
+	return true;
 }
 
 void CompressedFile::writeHeader()
 {
 	char header[c_header_size];
 	char* cptr = header;
-	memcpy(cptr, headerMagic, sizeof(headerMagic));
+	memcpy(cptr, compressionMode==mode_zstd ? headerMagicV2 : headerMagic, sizeof(headerMagic));
 	cptr+=sizeof(headerMagic);
 	__int64 indexOffsetEndian = little_endian(index_offset);
 	memcpy(cptr, &indexOffsetEndian, sizeof(indexOffsetEndian));
@@ -561,6 +817,13 @@ bool CompressedFile::finish()
 		hotCache->clear();
 	}
 
+	clearReadAhead();
+
+	while(!pending_writes.empty())
+	{
+		writeFinishedJobs(true);
+	}
+
 	if(!readOnly)
 	{
 		writeIndex();
@@ -638,6 +901,11 @@ bool CompressedFile::hasNoMagic()
 	return noMagic;
 }
 
+CompressedFile::ECompressionMethod CompressedFile::getCompressionMethod()
+{
+	return compressionMode==mode_zstd ? CompressionMethod_Zstd : CompressionMethod_Zlib;
+}
+
 bool CompressedFile::PunchHole( _i64 spos, _i64 size )
 {
 	return false;
@@ -647,3 +915,252 @@ bool CompressedFile::Sync()
 {
 	return finish();
 }
+
+void CompressedFile::startWorkers()
+{
+	for(size_t i=0;i<n_workers;++i)
+	{
+		workers.push_back(new CompressionWorker(*this));
+		worker_tickets.push_back(Server->getThreadPool()->execute(workers[i], "image compression"));
+	}
+}
+
+void CompressedFile::stopWorkers()
+{
+	if(workers.empty())
+	{
+		return;
+	}
+
+	{
+		IScopedLock lock(jobs_mutex.get());
+		workers_quit = true;
+		jobs_cond->notify_all();
+	}
+
+	Server->getThreadPool()->waitFor(worker_tickets);
+
+	for(size_t i=0;i<workers.size();++i)
+	{
+		delete workers[i];
+	}
+	workers.clear();
+	worker_tickets.clear();
+}
+
+void CompressedFile::runWorker()
+{
+	IScopedLock lock(jobs_mutex.get());
+
+	while(true)
+	{
+		while(jobs_todo.empty()
+			&& !workers_quit)
+		{
+			jobs_cond->wait(&lock);
+		}
+
+		if(workers_quit)
+		{
+			return;
+		}
+
+		SCompressionJob* job = jobs_todo.front();
+		jobs_todo.pop_front();
+
+		lock.relock(NULL);
+
+		bool ok;
+		if(job->decompress)
+		{
+			ok = decompressBlock(job->compressed.data(), job->compressedSize, job->mode, &job->data[0], job->dataSize);
+		}
+		else
+		{
+			ok = compressBlock(job->data.data(), job->compressed, job->compressedSize);
+		}
+
+		lock.relock(jobs_mutex.get());
+
+		job->ok = ok;
+		job->done = true;
+		jobs_done_cond->notify_all();
+	}
+}
+
+CompressedFile::SCompressionJob* CompressedFile::getFreeJob()
+{
+	SCompressionJob* job;
+	if(!free_jobs.empty())
+	{
+		job = free_jobs.back();
+		free_jobs.pop_back();
+	}
+	else
+	{
+		job = new SCompressionJob;
+		job->data.resize(blocksize);
+	}
+
+	job->done = false;
+	job->ok = false;
+	job->mode = mode_zlib;
+	job->dataSize = 0;
+	job->compressedSize = 0;
+	return job;
+}
+
+void CompressedFile::queueJob(SCompressionJob* job)
+{
+	IScopedLock lock(jobs_mutex.get());
+	jobs_todo.push_back(job);
+	jobs_cond->notify_one();
+}
+
+void CompressedFile::writeFinishedJobs(bool wait)
+{
+	while(!pending_writes.empty())
+	{
+		SCompressionJob* job = pending_writes.front();
+
+		{
+			IScopedLock lock(jobs_mutex.get());
+			while(wait && !job->done)
+			{
+				jobs_done_cond->wait(&lock);
+			}
+
+			if(!job->done)
+			{
+				return;
+			}
+		}
+
+		pending_writes.pop_front();
+
+		if(!job->ok)
+		{
+			error=true;
+		}
+		else
+		{
+			writeCompressedBlock(job->block, job->compressed.data(), job->compressedSize);
+		}
+
+		free_jobs.push_back(job);
+
+		//Only wait for the oldest block. Write the others if they happen to be done
+		wait=false;
+	}
+}
+
+void CompressedFile::waitForPendingBlock(size_t block)
+{
+	bool pending;
+	do
+	{
+		pending=false;
+		for(size_t i=0;i<pending_writes.size();++i)
+		{
+			if(pending_writes[i]->block==block)
+			{
+				pending=true;
+				break;
+			}
+		}
+
+		if(pending)
+		{
+			writeFinishedJobs(true);
+		}
+	} while(pending);
+}
+
+bool CompressedFile::readAheadResult(SCompressionJob* job, char* buf)
+{
+	{
+		IScopedLock lock(jobs_mutex.get());
+		while(!job->done)
+		{
+			jobs_done_cond->wait(&lock);
+		}
+	}
+
+	bool ret = job->ok;
+
+	if(ret && job->mode!=mode_none
+		&& job->dataSize!=blocksize
+		&& static_cast<__int64>(job->block)*blocksize+blocksize<filesize)
+	{
+		Server->Log("Did not receive enough bytes from compressed stream. Expected "+convert(blocksize)+" received "+convert(job->dataSize), LL_ERROR);
+		ret = false;
+	}
+
+	if(ret)
+	{
+		memcpy(buf, job->data.data(), job->mode==mode_none ? job->compressedSize : job->dataSize);
+	}
+
+	free_jobs.push_back(job);
+
+	return ret;
+}
+
+void CompressedFile::startReadAhead(size_t block)
+{
+	//The compressed data is read on this thread, so the file does not need
+	//to be shared. Only decompression runs on the workers.
+	for(size_t i=block+1;i<blockOffsets.size() && i<=block+2*n_workers;++i)
+	{
+		size_t cacheSize;
+		if(readahead_jobs.find(i)!=readahead_jobs.end()
+			|| blockOffsets[i]==-1
+			|| hotCache->get(static_cast<__int64>(i)*blocksize, cacheSize)!=NULL)
+		{
+			continue;
+		}
+
+		if(workers.empty())
+		{
+			startWorkers();
+		}
+
+		SCompressionJob* job = getFreeJob();
+		job->block = i;
+		job->decompress = true;
+
+		if(!readCompressedBlock(i, job->compressed, job->compressedSize, job->mode, &job->data[0], NULL))
+		{
+			free_jobs.push_back(job);
+			return;
+		}
+
+		readahead_jobs[i] = job;
+
+		if(job->mode==mode_none)
+		{
+			job->ok = true;
+			job->done = true;
+		}
+		else
+		{
+			queueJob(job);
+		}
+	}
+}
+
+void CompressedFile::clearReadAhead()
+{
+	IScopedLock lock(jobs_mutex.get());
+
+	for(std::map<size_t, SCompressionJob*>::iterator it=readahead_jobs.begin();
+		it!=readahead_jobs.end();++it)
+	{
+		while(!it->second->done)
+		{
+			jobs_done_cond->wait(&lock);
+		}
+		free_jobs.push_back(it->second);
+	}
+	readahead_jobs.clear();
+}
@@ -2,17 +2,31 @@
 
 #include <string>
 #include <memory>
+#include <deque>
+#include <map>
 
 #include "../Interface/Server.h"
 #include "../Interface/File.h"
+#include "../Interface/Thread.h"
+#include "../Interface/ThreadPool.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
 #include "LRUMemCache.h"
 
 
 class CompressedFile : public IFile, public ICacheEvictionCallback
 {
 public:
-	CompressedFile(std::string pFilename, int pMode);
-	CompressedFile(IFile* file, bool openExisting, bool readOnly);
+	enum ECompressionMethod
+	{
+		CompressionMethod_Zlib,
+		CompressionMethod_Zstd
+	};
+
+	//The compression method is only used for new files. Existing files
+	//keep the method they were created with.
+	CompressedFile(std::string pFilename, int pMode, ECompressionMethod compressionMethod=CompressionMethod_Zlib);
+	CompressedFile(IFile* file, bool openExisting, bool readOnly, ECompressionMethod compressionMethod=CompressionMethod_Zlib);
 	~CompressedFile();
 
 	virtual std::string Read(_u32 tr, bool *has_error=NULL);
@@ -38,21 +52,70 @@ public:
 
 	bool hasNoMagic();
 
+	ECompressionMethod getCompressionMethod();
+
 private:
+	struct SCompressionJob
+	{
+		size_t block;
+		bool decompress;
+		bool done;
+		bool ok;
+		_u32 mode;
+		std::vector<char> data;
+		_u32 dataSize;
+		std::vector<char> compressed;
+		_u32 compressedSize;
+	};
+
+	class CompressionWorker : public IThread
+	{
+	public:
+		CompressionWorker(CompressedFile& compFile)
+			: compFile(compFile)
+		{}
+
+		virtual ~CompressionWorker() {}
+
+		void operator()()
+		{
+			compFile.runWorker();
+		}
+
+	private:
+		CompressedFile& compFile;
+	};
+
 	void readHeader(bool *has_error);
 	void readIndex(bool *has_error);
 	bool fillCache(__int64 offset, bool errorMsg, bool *has_error);
+	bool readCompressedBlock(size_t block, std::vector<char>& compressed, _u32& compressedSize, _u32& mode, char* buf, bool *has_error);
+	bool decompressBlock(const char* compressed, _u32 compressedSize, _u32 mode, char* buf, _u32& dataSize);
+	bool compressBlock(const char* buf, std::vector<char>& compressed, _u32& compressedSize);
+	bool writeCompressedBlock(size_t blockIdx, const char* compressed, _u32 compressedSize);
 	virtual void evictFromLruCache(const SCacheItem& item);
 	void writeHeader();
 	void writeIndex();
 
 	_u32 readFromFile(char* buffer, _u32 bsize, bool *has_error);
 	_u32 writeToFile(const char* buffer, _u32 bsize);
+
+	void startWorkers();
+	void stopWorkers();
+	void runWorker();
+	SCompressionJob* getFreeJob();
+	void queueJob(SCompressionJob* job);
+	void writeFinishedJobs(bool wait);
+	void waitForPendingBlock(size_t block);
+	bool readAheadResult(SCompressionJob* job, char* buf);
+	void startReadAhead(size_t block);
+	void clearReadAhead();
 	
 
 	__int64 filesize;
 	__int64 index_offset;
 	_u32 blocksize;
+	_u32 compressionMode;
 
 	__int64 currentPosition;
 
@@ -71,4 +134,18 @@ private:
 	bool readOnly;
 
 	bool noMagic;
+
+	size_t n_workers;
+	std::vector<CompressionWorker*> workers;
+	std::vector<THREADPOOL_TICKET> worker_tickets;
+	std::auto_ptr<IMutex> jobs_mutex;
+	std::auto_ptr<ICondition> jobs_cond;
+	std::auto_ptr<ICondition> jobs_done_cond;
+	bool workers_quit;
+	std::deque<SCompressionJob*> jobs_todo;
+	//Compressed blocks to write, in eviction order
+	std::deque<SCompressionJob*> pending_writes;
+	std::map<size_t, SCompressionJob*> readahead_jobs;
+	std::vector<SCompressionJob*> free_jobs;
+	size_t last_read_block;
 };
@@ -39,6 +39,7 @@
 #include "ClientBitmap.h"
 #include <stdlib.h>
 #include "FileWrapper.h"
+#include "BlockStoreFile.h"
 
 #ifdef _WIN32
 namespace
@@ -362,13 +363,16 @@ IVHDFile *FSImageFactory::createVHDFile(const std::string &fn, bool pRead_only,
 	{
 	case ImageFormat_VHD:
 	case ImageFormat_CompressedVHD:
-		return new VHDFile(fn, pRead_only, pDstsize, pBlocksize, fast_mode, format!=ImageFormat_VHD);
+	case ImageFormat_CompressedVHDZstd:
+		return new VHDFile(fn, pRead_only, pDstsize, pBlocksize, fast_mode, format);
 	case ImageFormat_RawCowFile:
 #if !defined(_WIN32) && !defined(__APPLE__)
 		return new CowFile(fn, pRead_only, pDstsize);
 #else
 		return NULL;
 #endif
+	case ImageFormat_BlockStore:
+		return new BlockStoreFile(fn, pRead_only, pDstsize);
 	}
 	return NULL;
 }
@@ -380,13 +384,16 @@ IVHDFile *FSImageFactory::createVHDFile(const std::string &fn, const std::string
 	{
 	case ImageFormat_VHD:
 	case ImageFormat_CompressedVHD:
-		return new VHDFile(fn, parent_fn, pRead_only, fast_mode, format!=ImageFormat_VHD, pDstsize);
+	case ImageFormat_CompressedVHDZstd:
+		return new VHDFile(fn, parent_fn, pRead_only, fast_mode, format, pDstsize);
 	case ImageFormat_RawCowFile:
 #if !defined(_WIN32) && !defined(__APPLE__)
 		return new CowFile(fn, parent_fn, pRead_only, pDstsize);
 #else
 		return NULL;
 #endif
+	case ImageFormat_BlockStore:
+		return new BlockStoreFile(fn, parent_fn, pRead_only, pDstsize);
 	}
 
 	return NULL;
@@ -452,3 +459,8 @@ std::vector<IFSImageFactory::SPartition> FSImageFactory::readPartitions(IVHDFile
 
 	return std::vector<IFSImageFactory::SPartition>();
 }
+
+bool FSImageFactory::removeImageBlockReferences(const std::string& fn)
+{
+	return BlockStoreFile::removeReferences(fn);
+}
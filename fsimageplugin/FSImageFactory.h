@@ -24,6 +24,8 @@ public:
 
 	virtual std::vector<SPartition> readPartitions(IVHDFile *vhd, int64 offset, bool& gpt_style);
 
+	virtual bool removeImageBlockReferences(const std::string& fn);
+
 private:
 	bool isNTFS(char *buffer);
 };
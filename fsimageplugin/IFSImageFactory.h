@@ -35,7 +35,9 @@ public:
 	{
 		ImageFormat_VHD=0,
 		ImageFormat_CompressedVHD=1,
-		ImageFormat_RawCowFile=2
+		ImageFormat_RawCowFile=2,
+		ImageFormat_CompressedVHDZstd=3,
+		ImageFormat_BlockStore=4
 	};
 
 	virtual IVHDFile *createVHDFile(const std::string &fn, bool pRead_only, uint64 pDstsize,
@@ -53,4 +55,8 @@ public:
 	virtual bool initializeImageMounting() = 0;
 
 	virtual std::vector<SPartition> readPartitions(IVHDFile *vhd, int64 offset, bool& gpt_style) = 0;
+
+	//Drops the references of a block store image to the shared image blocks.
+	//Call before deleting the image file.
+	virtual bool removeImageBlockReferences(const std::string& fn) = 0;
 };
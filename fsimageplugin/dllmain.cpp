@@ -62,6 +62,7 @@ extern IServer* Server;
 #include "pluginmgr.h"
 
 #include "CompressedFile.h"
+#include "BlockStoreFile.h"
 
 #ifdef _WIN32
 #include "win_dialog.h"
@@ -186,6 +187,92 @@ namespace
 	}
 
 
+	bool recompress_file(const std::string& fn, CompressedFile::ECompressionMethod compressionMethod)
+	{
+		CompressedFile compFile(fn, MODE_READ);
+
+		if(compFile.hasError())
+		{
+			if(compFile.hasNoMagic())
+			{
+				Server->Log("File is not compressed. Cannot recompress it.", LL_ERROR);
+			}
+			else
+			{
+				Server->Log("Error while reading compressed file header", LL_ERROR);
+			}
+			return false;
+		}
+
+		if(compFile.getCompressionMethod()==compressionMethod)
+		{
+			Server->Log("File is already compressed with the selected method", LL_WARNING);
+			return true;
+		}
+
+		std::string tmp_output = fn+".tmp";
+		IFile* out = Server->openFile(tmp_output, MODE_WRITE);
+		if(out==NULL)
+		{
+			Server->Log("Error opening output file \""+tmp_output+"\"", LL_ERROR);
+			return false;
+		}
+
+		{
+			CompressedFile outFile(out, false, false, compressionMethod);
+
+			if(outFile.hasError())
+			{
+				Server->Log("Error initializing output file", LL_ERROR);
+				return false;
+			}
+
+			int pcdone = -1;
+			__int64 recompressed = 0;
+			std::vector<char> buffer(512*1024);
+			_u32 read;
+			do
+			{
+				read = compFile.Read(buffer.data(), static_cast<_u32>(buffer.size()));
+				if(read>0)
+				{
+					if(outFile.Write(buffer.data(), read)!=read)
+					{
+						Server->Log("Error writing to output file", LL_ERROR);
+						return false;
+					}
+				}
+				recompressed+=read;
+				int currentpc = static_cast<int>(static_cast<float>(recompressed)/compFile.Size()*100.f+0.5f);
+				if(currentpc!=pcdone)
+				{
+					pcdone=currentpc;
+					Server->Log("Recompressing \""+fn+"\"... "+convert(pcdone)+"%", LL_INFO);
+				}
+			} while (read>0);
+
+			if(recompressed!=compFile.Size())
+			{
+				Server->Log("Error reading from compressed file", LL_ERROR);
+				return false;
+			}
+
+			if(!outFile.finish())
+			{
+				Server->Log("Error finishing output file", LL_ERROR);
+				return false;
+			}
+		}
+
+		compFile.finish();
+
+#ifdef _WIN32
+		return MoveFileExW(Server->ConvertToWchar(tmp_output).c_str(), Server->ConvertToWchar(fn).c_str(), MOVEFILE_REPLACE_EXISTING)==TRUE;
+#else
+		return rename(tmp_output.c_str(), fn.c_str())==0;
+#endif
+	}
+
 	IVHDFile* open_device_file(std::string device_verify)
 	{
 		std::string ext = strlower(findextension(device_verify));
@@ -199,6 +286,10 @@ namespace
 			return new CowFile(device_verify, true,0);
 		}
 #endif
+		else if(ext=="blocks")
+		{
+			return new BlockStoreFile(device_verify, true, 0);
+		}
 		else
 		{
 			Server->Log("Unknown image file extension \""+ext+"\"", LL_ERROR);
@@ -344,7 +435,7 @@ namespace
 			total_size = (std::max)(total_size, cpart->start_sector*c_sector_size + cpart->nr_sector*c_sector_size);
 		}
 
-		VHDFile vhdout(output, false, total_size, 2*1024*1024, true, false);
+		VHDFile vhdout(output, false, total_size, 2*1024*1024, true, IFSImageFactory::ImageFormat_VHD);
 		if(!vhdout.isOpen())
 		{
 			Server->Log("Error opening output VHD-File \""+output+"\"", LL_ERROR);
@@ -561,6 +652,8 @@ DLLEXPORT void LoadActions(IServer* pServer)
 {
 	Server=pServer;
 
+	ImageBlockStore::init();
+
 	std::string compress_file = Server->getServerParameter("compress");
 	if(!compress_file.empty())
 	{
@@ -656,6 +749,26 @@ DLLEXPORT void LoadActions(IServer* pServer)
 		exit(b?0:3);
 	}
 
+	std::string recompress = Server->getServerParameter("recompress");
+	if(!recompress.empty())
+	{
+		std::string compression_method = Server->getServerParameter("compression_method");
+		CompressedFile::ECompressionMethod compressionMethod = CompressedFile::CompressionMethod_Zstd;
+		if(compression_method=="zlib")
+		{
+			compressionMethod = CompressedFile::CompressionMethod_Zlib;
+		}
+		else if(!compression_method.empty() && compression_method!="zstd")
+		{
+			Server->Log("Unknown compression method: "+compression_method, LL_ERROR);
+			exit(1);
+		}
+
+		bool b = recompress_file(recompress, compressionMethod);
+
+		exit(b?0:3);
+	}
+
 	std::string assemble = Server->getServerParameter("assemble");
 	if(!assemble.empty())
 	{
@@ -41,8 +41,28 @@ const uint64 def_bat_offset_parent=2*1024;
 const int64 unixtime_offset=946684800;
 
 const unsigned int sector_size=512;
+const size_t max_cached_bitmaps=4096;
 
-VHDFile::VHDFile(const std::string &fn, bool pRead_only, uint64 pDstsize, unsigned int pBlocksize, bool fast_mode, bool compress)
+namespace
+{
+	enum EBitmapState
+	{
+		BitmapState_Unknown=0,
+		BitmapState_Full=1,
+		BitmapState_Empty=2,
+		BitmapState_Partial=3
+	};
+}
+
+namespace
+{
+	CompressedFile::ECompressionMethod getCompressionMethod(IFSImageFactory::ImageFormat format)
+	{
+		return format==IFSImageFactory::ImageFormat_CompressedVHDZstd ? CompressedFile::CompressionMethod_Zstd : CompressedFile::CompressionMethod_Zlib;
+	}
+}
+
+VHDFile::VHDFile(const std::string &fn, bool pRead_only, uint64 pDstsize, unsigned int pBlocksize, bool fast_mode, IFSImageFactory::ImageFormat format)
 	: dstsize(pDstsize), blocksize(pBlocksize), fast_mode(fast_mode), bitmap_offset(0), bitmap_dirty(false), volume_offset(0), finished(false),
 	file(NULL)
 {
@@ -71,9 +91,9 @@ VHDFile::VHDFile(const std::string &fn, bool pRead_only, uint64 pDstsize, unsign
 		}
 	}
 
-	if(check_if_compressed() || compress)
+	if(check_if_compressed() || format!=IFSImageFactory::ImageFormat_VHD)
 	{
-		compressed_file = new CompressedFile(backing_file, openedExisting, read_only);
+		compressed_file = new CompressedFile(backing_file, openedExisting, read_only, getCompressionMethod(format));
 		file = compressed_file;
 
 		if(compressed_file->hasError())
@@ -137,7 +157,7 @@ VHDFile::VHDFile(const std::string &fn, bool pRead_only, uint64 pDstsize, unsign
 	}
 }
 
-VHDFile::VHDFile(const std::string &fn, const std::string &parent_fn, bool pRead_only, bool fast_mode, bool compress, uint64 pDstsize)
+VHDFile::VHDFile(const std::string &fn, const std::string &parent_fn, bool pRead_only, bool fast_mode, IFSImageFactory::ImageFormat format, uint64 pDstsize)
 	: fast_mode(fast_mode), bitmap_offset(0), bitmap_dirty(false), volume_offset(0), finished(false), file(NULL)
 {
 	compressed_file=NULL;
@@ -164,9 +184,9 @@ VHDFile::VHDFile(const std::string &fn, const std::string &parent_fn, bool pRead
 		}
 	}
 
-	if(check_if_compressed() || compress)
+	if(check_if_compressed() || format!=IFSImageFactory::ImageFormat_VHD)
 	{
-		file = new CompressedFile(backing_file, openedExisting, read_only);
+		file = new CompressedFile(backing_file, openedExisting, read_only, getCompressionMethod(format));
 	}
 	else
 	{
@@ -734,7 +754,6 @@ bool VHDFile::Read(char* buffer, size_t bsize, size_t &read)
 	size_t blockoffset=curr_offset%blocksize;
 	size_t remaining=blocksize-blockoffset;
 	size_t toread=bsize;
-	bool firstr=true;
 	read=0;
 
 	if(curr_offset>=dstsize)
@@ -782,48 +801,41 @@ bool VHDFile::Read(char* buffer, size_t bsize, size_t &read)
 		{
 			switchBitmap(dataoffset);
 
-			file->Seek(dataoffset);
-
 			if(dataoffset+bitmap_size+blockoffset+bsize>(uint64)file->Size() )
 			{
 				Server->Log("Wrong dataoffset: "+convert(dataoffset), LL_ERROR);
 				return false;
 			}
 
-			if(file->Read(reinterpret_cast<char*>(bitmap.data()), bitmap_size)!=bitmap_size)
+			if(!loadBitmap(block, dataoffset))
 			{
-				Server->Log("Error reading bitmap", LL_ERROR);
 				return false;
 			}
-			currblock=block;
 		}
 
-		bool b=file->Seek(dataoffset+bitmap_size+blockoffset);
-		if(!b)
-			Server->Log("Seeking failed!- 1", LL_ERROR);
-
 		while( blockoffset<blocksize )
 		{
-			size_t wantread=(std::min)((size_t)sector_size, toread);
-			if(remaining<wantread)
-				wantread=remaining;
-			if(firstr && blockoffset%sector_size!=0 && wantread>sector_size-blockoffset%sector_size )
-			{
-				wantread=sector_size-blockoffset%sector_size;
-				firstr=false;
-			}
-			else
-			{
-				firstr=false;
-			}
+			size_t wantread=(std::min)(remaining, toread);
 
 			if( curr_offset+wantread>dstsize )
 			{
-				return true;
+				uint64 read_end=dstsize-dstsize%sector_size;
+				if(curr_offset>=read_end)
+				{
+					return true;
+				}
+				wantread=(size_t)(read_end-curr_offset);
 			}
 
-			if( isBitmapSet((unsigned int)blockoffset) )
+			bool is_set;
+			wantread=bitmapRun(blockoffset, wantread, is_set);
+
+			if( is_set )
 			{
+				bool b=file->Seek(dataoffset+bitmap_size+blockoffset);
+				if(!b)
+					Server->Log("Seeking failed!- 1", LL_ERROR);
+
 				_u32 curr_tread = (_u32)wantread;
 				bool has_read_error = false;
 				wantread=(size_t)file->Read(&buffer[read], curr_tread, &has_read_error);
@@ -850,7 +862,6 @@ bool VHDFile::Read(char* buffer, size_t bsize, size_t &read)
 				{
 					memset(&buffer[read], 0, wantread );
 				}
-				file->Seek(dataoffset+bitmap_size+blockoffset+wantread);
 			}
 			read+=wantread;
 			curr_offset+=wantread;
@@ -1087,20 +1098,16 @@ bool VHDFile::has_block(bool use_parent)
 	{
 		switchBitmap(dataoffset);
 
-		file->Seek(dataoffset);
-
 		if(dataoffset+bitmap_size+blockoffset>(uint64)file->Size() )
 		{
 			Server->Log("Wrong dataoffset: "+convert(dataoffset), LL_ERROR);
 			return false;
 		}
 
-		if(file->Read(reinterpret_cast<char*>(bitmap.data()), bitmap_size)!=bitmap_size)
+		if(!loadBitmap(block, dataoffset))
 		{
-			Server->Log("Error reading bitmap", LL_ERROR);
 			return false;
 		}
-		currblock=block;
 	}
 
 	if( isBitmapSet((unsigned int)blockoffset) )
@@ -1139,6 +1146,129 @@ void VHDFile::switchBitmap(uint64 new_offset)
 	bitmap_dirty=false;
 }
 
+bool VHDFile::loadBitmap(unsigned int block, uint64 dataoffset)
+{
+	if(read_only)
+	{
+		if(bitmap_state.empty())
+		{
+			bitmap_state.resize(batsize, BitmapState_Unknown);
+		}
+
+		switch(bitmap_state[block])
+		{
+		case BitmapState_Full:
+			memset(bitmap.data(), 0xFF, bitmap_size);
+			currblock=block;
+			return true;
+		case BitmapState_Empty:
+			memset(bitmap.data(), 0, bitmap_size);
+			currblock=block;
+			return true;
+		case BitmapState_Partial:
+			{
+				size_t* slot=bitmap_cache_lru.get(block);
+				if(slot!=NULL)
+				{
+					memcpy(bitmap.data(), &bitmap_cache[(*slot)*bitmap_size], bitmap_size);
+					currblock=block;
+					return true;
+				}
+			}break;
+		}
+	}
+
+	file->Seek(dataoffset);
+
+	if(file->Read(reinterpret_cast<char*>(bitmap.data()), bitmap_size)!=bitmap_size)
+	{
+		Server->Log("Error reading bitmap", LL_ERROR);
+		return false;
+	}
+	currblock=block;
+
+	if(read_only)
+	{
+		cacheBitmap(block);
+	}
+
+	return true;
+}
+
+void VHDFile::cacheBitmap(unsigned int block)
+{
+	size_t block_sectors=blocksize/sector_size;
+	size_t full_bytes=block_sectors/8;
+	bool all_set=true;
+	bool all_unset=true;
+	for(size_t i=0;i<full_bytes && (all_set || all_unset);++i)
+	{
+		if(bitmap[i]!=0xFF) all_set=false;
+		if(bitmap[i]!=0) all_unset=false;
+	}
+	for(size_t i=full_bytes*8;i<block_sectors && (all_set || all_unset);++i)
+	{
+		if(isBitmapSet((unsigned int)(i*sector_size))) all_unset=false;
+		else all_set=false;
+	}
+
+	if(all_set)
+	{
+		bitmap_state[block]=BitmapState_Full;
+		return;
+	}
+	else if(all_unset)
+	{
+		bitmap_state[block]=BitmapState_Empty;
+		return;
+	}
+
+	size_t slot;
+	if(bitmap_cache_lru.size()>=max_cached_bitmaps)
+	{
+		std::pair<unsigned int, size_t> evicted=bitmap_cache_lru.evict_one();
+		bitmap_state[evicted.first]=BitmapState_Unknown;
+		slot=evicted.second;
+	}
+	else
+	{
+		slot=bitmap_cache_lru.size();
+		bitmap_cache.resize((slot+1)*bitmap_size);
+	}
+
+	memcpy(&bitmap_cache[slot*bitmap_size], bitmap.data(), bitmap_size);
+	bitmap_cache_lru.put(block, slot);
+	bitmap_state[block]=BitmapState_Partial;
+}
+
+size_t VHDFile::bitmapRun(size_t blockoffset, size_t max_len, bool& is_set)
+{
+	is_set=isBitmapSet((unsigned int)blockoffset);
+
+	size_t end=blockoffset+max_len;
+	size_t next=blockoffset-blockoffset%sector_size+sector_size;
+	unsigned char full_byte=is_set ? 0xFF : 0;
+	while(next<end)
+	{
+		if(next%(8*sector_size)==0
+			&& next+8*sector_size<=end
+			&& bitmap[next/sector_size/8]==full_byte)
+		{
+			next+=8*sector_size;
+		}
+		else if(isBitmapSet((unsigned int)next)==is_set)
+		{
+			next+=sector_size;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	return (std::min)(next, end)-blockoffset;
+}
+
 uint64 VHDFile::getSize(void)
 {
 	return dstsize-volume_offset;
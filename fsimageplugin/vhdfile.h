@@ -1,6 +1,8 @@
 #include "../Interface/Server.h"
 #include "../Interface/File.h"
 #include "IVHDFile.h"
+#include "IFSImageFactory.h"
+#include "../common/lrucache.h"
 
 #ifndef sun
 #pragma pack(push)
@@ -64,8 +66,10 @@ class CompressedFile;
 class VHDFile : public IVHDFile, public IFile
 {
 public:
-	VHDFile(const std::string &fn, bool pRead_only, uint64 pDstsize, unsigned int pBlocksize=2*1024*1024, bool fast_mode=false, bool compress=false);
-	VHDFile(const std::string &fn, const std::string &parent_fn, bool pRead_only, bool fast_mode=false, bool compress=false, uint64 pDstsize=0);
+	VHDFile(const std::string &fn, bool pRead_only, uint64 pDstsize, unsigned int pBlocksize=2*1024*1024, bool fast_mode=false,
+		IFSImageFactory::ImageFormat format=IFSImageFactory::ImageFormat_VHD);
+	VHDFile(const std::string &fn, const std::string &parent_fn, bool pRead_only, bool fast_mode=false,
+		IFSImageFactory::ImageFormat format=IFSImageFactory::ImageFormat_VHD, uint64 pDstsize=0);
 	~VHDFile();
 
 	virtual std::string Read(_u32 tr, bool *has_error=NULL);
@@ -141,6 +145,9 @@ private:
 	inline bool isBitmapSet(unsigned int offset);
 	inline bool setBitmapBit(unsigned int offset, bool v);
 	void switchBitmap(uint64 new_offset);
+	bool loadBitmap(unsigned int block, uint64 dataoffset);
+	void cacheBitmap(unsigned int block);
+	size_t bitmapRun(size_t blockoffset, size_t max_len, bool& is_set);
 
 	unsigned int calculate_chs(void);
 	unsigned int calculate_checksum(const unsigned char * data, size_t dsize);
@@ -182,6 +189,12 @@ private:
 	uint64 bitmap_offset;
 	bool bitmap_dirty;
 
+	//Bitmaps of read only files. Full and empty bitmaps are only
+	//stored as state, partial ones in a LRU cache of bitmap_cache slots
+	std::vector<char> bitmap_state;
+	common::lrucache<unsigned int, size_t> bitmap_cache_lru;
+	std::vector<unsigned char> bitmap_cache;
+
 	bool fast_mode;
 
 	_i64 volume_offset;
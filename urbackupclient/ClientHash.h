@@ -11,7 +11,7 @@ class ClientHash : public IHashOutput
 public:
 	ClientHash(IFile* index_hdat_file, bool own_hdat_file, int64 index_hdat_fs_block_size,
 		size_t* snapshot_sequence_id, size_t snapshot_sequence_id_reference);
-	~ClientHash();
+	virtual ~ClientHash();
 
 	bool getShaBinary(const std::string& fn, IHashFunc& hf, bool with_cbt);
 
@@ -285,6 +285,11 @@ void ClientConnector::CMD_START_INCR_FILEBACKUP(const std::string &cmd)
 		flags |= flag_with_proper_symlinks;
 	}
 
+	if(params.find("binary_filelist")!=params.end())
+	{
+		flags |= flag_binary_filelist;
+	}
+
 	if(end_to_end_file_backup_verification_enabled)
 	{
 		flags |= flag_end_to_end_verification;
@@ -459,6 +464,11 @@ void ClientConnector::CMD_START_FULL_FILEBACKUP(const std::string &cmd)
 		flags |= flag_with_proper_symlinks;
 	}
 
+	if(params.find("binary_filelist")!=params.end())
+	{
+		flags |= flag_binary_filelist;
+	}
+
 	if(end_to_end_file_backup_verification_enabled)
 	{
 		flags |= flag_end_to_end_verification;
@@ -1046,6 +1056,17 @@ void ClientConnector::CMD_STATUS_DETAIL(const std::string &cmd)
 
 	ret.set("internet_status", InternetClient::getStatusMsg());
 
+	IFileServ* filesrv = IndexThread::getFileSrv();
+	if (filesrv != NULL)
+	{
+		int64 zero_copy_bytes, buffered_bytes;
+		filesrv->getTransferStats(zero_copy_bytes, buffered_bytes);
+		JSON::Object transfer_stats;
+		transfer_stats.set("zero_copy_bytes", zero_copy_bytes);
+		transfer_stats.set("buffered_bytes", buffered_bytes);
+		ret.set("file_transfer_stats", transfer_stats);
+	}
+
 	IDatabase *db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_CLIENT);
 
 	ret.set("capability_bits", getCapabilities(db));
@@ -2513,7 +2534,7 @@ void ClientConnector::CMD_CAPA(const std::string &cmd)
 		last_metered = metered;
 	}
 
-	tcpstack.Send(pipe, "FILE=2&FILE2=1&IMAGE=1&UPDATE=1&MBR=1&FILESRV=3&SET_SETTINGS=1&IMAGE_VER=1&CLIENTUPDATE=2&ASYNC_INDEX=1"
+	tcpstack.Send(pipe, "FILE=2&FILE2=1&IMAGE=1&UPDATE=1&MBR=1&FILESRV=3&SET_SETTINGS=1&IMAGE_VER=1&CLIENTUPDATE=2&ASYNC_INDEX=1&BINARY_FILELIST=1"
 		"&CLIENT_VERSION_STR="+EscapeParamString((client_version_str))+"&OS_VERSION_STR="+EscapeParamString(os_version_str)+
 		"&ALL_VOLUMES="+EscapeParamString(win_volumes)+"&ETA=1&CDP=0&ALL_NONUSB_VOLUMES="+EscapeParamString(win_nonusb_volumes)+"&EFI=1"
 		"&FILE_META=1&SELECT_SHA=1&PHASH=1&RESTORE="+restore+"&CLIENT_BITMAP=1&CMD=1&SYMBIT=1&WTOKENS=1&OS_SIMPLE=windows"
@@ -2530,7 +2551,7 @@ void ClientConnector::CMD_CAPA(const std::string &cmd)
 
 
 	std::string os_version_str=get_lin_os_version();
-	tcpstack.Send(pipe, "FILE=2&FILE2=1&FILESRV=3&SET_SETTINGS=1&CLIENTUPDATE=2&ASYNC_INDEX=1"
+	tcpstack.Send(pipe, "FILE=2&FILE2=1&FILESRV=3&SET_SETTINGS=1&CLIENTUPDATE=2&ASYNC_INDEX=1&BINARY_FILELIST=1"
 		"&CLIENT_VERSION_STR="+EscapeParamString((client_version_str))+"&OS_VERSION_STR="+EscapeParamString(os_version_str)
 		+"&ETA=1&CPD=0&FILE_META=1&SELECT_SHA=1&PHASH=1&RESTORE="+restore+"&CMD=1&SYMBIT=1&WTOKENS=1&OS_SIMPLE="+os_simple
 		+"&clientuid=" + EscapeParamString(clientuid));
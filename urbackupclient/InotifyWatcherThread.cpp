@@ -0,0 +1,867 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#ifdef __linux__
+
+#include "InotifyWatcherThread.h"
+#include "../Interface/Server.h"
+#include "../stringtools.h"
+#include "../urbackupcommon/os_functions.h"
+#include "database.h"
+#include "clientdao.h"
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+
+IPipe *InotifyWatcherThread::pipe=NULL;
+IMutex *InotifyWatcherThread::update_mutex=NULL;
+ICondition *InotifyWatcherThread::update_cond=NULL;
+std::map<std::string, std::vector<std::string> > InotifyWatcherThread::tracked_roots;
+
+namespace
+{
+	const int64 max_change_ram_cache=10*60*1000;
+	const size_t max_change_ram_cache_entries=100000;
+	const size_t max_setup_dirs=1000;
+	const size_t event_buffer_size=64*1024;
+
+	const uint32_t watch_mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO
+		| IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_DONT_FOLLOW | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+	//File systems where inotify sees all changes
+	bool isLocalFilesystem(const std::string& fstype)
+	{
+		return fstype=="ext2" || fstype=="ext3" || fstype=="ext4"
+			|| fstype=="xfs" || fstype=="btrfs" || fstype=="zfs"
+			|| fstype=="f2fs" || fstype=="reiserfs" || fstype=="jfs"
+			|| fstype=="nilfs2" || fstype=="bcachefs" || fstype=="tmpfs";
+	}
+
+	std::string normalizePath(const std::string& path)
+	{
+		std::string ret;
+		ret.reserve(path.size());
+		for(size_t i=0;i<path.size();++i)
+		{
+			if(path[i]=='/' && !ret.empty() && ret[ret.size()-1]=='/')
+			{
+				continue;
+			}
+			ret+=path[i];
+		}
+		if(ret.size()>1 && ret[ret.size()-1]=='/')
+		{
+			ret.erase(ret.size()-1);
+		}
+		return ret;
+	}
+
+	//Mount points in /proc/self/mountinfo have space, tab, newline and backslash octal escaped
+	std::string unescapeMountPoint(const std::string& str)
+	{
+		std::string ret;
+		for(size_t i=0;i<str.size();++i)
+		{
+			if(str[i]=='\\' && i+3<str.size())
+			{
+				ret+=static_cast<char>((str[i+1]-'0')*64 + (str[i+2]-'0')*8 + (str[i+3]-'0'));
+				i+=3;
+			}
+			else
+			{
+				ret+=str[i];
+			}
+		}
+		return ret;
+	}
+
+	std::string parentKey(const std::string& key)
+	{
+		size_t pos=key.find_last_of('/', key.size()-2);
+		if(pos==std::string::npos)
+		{
+			return std::string();
+		}
+		return key.substr(0, pos+1);
+	}
+}
+
+InotifyWatcherThread::InotifyWatcherThread(const std::vector<std::string> &watchdirs)
+	: db(NULL), do_stop(false), frozen(false), q_add_dir(NULL), q_remove_changed_dirs(NULL),
+	inotify_fd(-1), event_buffer(event_buffer_size), watch_limit_reached(false)
+{
+	for(size_t i=0;i<watchdirs.size();++i)
+	{
+		SWatchRoot root;
+		root.key=getKey(watchdirs[i]);
+		root.tracked=false;
+		roots.push_back(root);
+	}
+}
+
+void InotifyWatcherThread::operator()(void)
+{
+	db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_CLIENT);
+
+	q_add_dir=db->Prepare("INSERT INTO mdirs (name) SELECT ? AS name WHERE NOT EXISTS (SELECT * FROM mdirs WHERE name=?)");
+	q_remove_changed_dirs = db->Prepare("DELETE FROM mdirs WHERE name GLOB ?");
+
+	inotify_fd=inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(inotify_fd==-1)
+	{
+		Server->Log("Error initializing inotify. Backup paths are scanned completely during each backup. Errno: "+convert(errno), LL_WARNING);
+	}
+	else
+	{
+		readMounts();
+		for(size_t i=0;i<roots.size();++i)
+		{
+			startSetup(roots[i]);
+		}
+	}
+
+	while(do_stop==false)
+	{
+		bool in_setup=false;
+		for(size_t i=0;i<roots.size();++i)
+		{
+			if(!roots[i].setup_pending.empty())
+			{
+				in_setup=true;
+			}
+		}
+
+		std::string msg;
+		pipe->Read(&msg, (in_setup && !frozen) ? 0 : 100);
+
+		if(inotify_fd!=-1 && !frozen)
+		{
+			readEvents();
+			processSetup();
+		}
+
+		if(msg.empty())
+		{
+			continue;
+		}
+
+		if( msg[0]=='A' )
+		{
+			std::string key=getKey(msg.substr(1));
+			bool w=false;
+			for(size_t i=0;i<roots.size();++i)
+			{
+				if(roots[i].key==key)
+				{
+					w=true;
+					break;
+				}
+			}
+			if(w==false)
+			{
+				SWatchRoot root;
+				root.key=key;
+				root.tracked=false;
+				roots.push_back(root);
+				//Settings changed. Try again even if the watch limit was reached before
+				watch_limit_reached=false;
+				if(inotify_fd!=-1)
+				{
+					startSetup(roots.back());
+				}
+			}
+		}
+		else if( msg[0]=='K' )
+		{
+			if(inotify_fd!=-1)
+			{
+				std::string new_mountinfo=getStreamFile("/proc/self/mountinfo");
+				if(new_mountinfo!=mountinfo)
+				{
+					std::map<std::string, std::string> old_mounts=mounts;
+					readMounts();
+					handleMountChanges(old_mounts);
+				}
+
+				if(watch_limit_reached
+					&& getStreamFile("/proc/sys/fs/inotify/max_user_watches")!=max_user_watches)
+				{
+					Server->Log("Maximum number of inotify watches changed. Setting up change tracking of backup paths again...", LL_INFO);
+					watch_limit_reached=false;
+				}
+
+				//Setting up the watches again would hit the same limit
+				if(!watch_limit_reached)
+				{
+					for(size_t i=0;i<roots.size();++i)
+					{
+						if(!roots[i].tracked
+							&& roots[i].setup_pending.empty())
+						{
+							startSetup(roots[i]);
+						}
+					}
+				}
+
+				readEvents();
+			}
+
+			frozen=true;
+
+			IScopedLock lock(update_mutex);
+			update_cond->notify_all();
+		}
+		else if( msg[0]=='H' )
+		{
+			frozen=false;
+
+			IScopedLock lock(update_mutex);
+			update_cond->notify_all();
+		}
+		else if (msg[0] == 'R')
+		{
+			std::string path = msg.substr(1);
+			std::string sep = os_file_sep();
+			if (path == "##-GAP-##"
+				|| path.empty())
+			{
+				sep = "";
+			}
+			q_remove_changed_dirs->Bind(ClientDAO::escapeGlob(path) + sep + "*");
+			q_remove_changed_dirs->Write();
+			q_remove_changed_dirs->Reset();
+			lastentries.clear();
+
+			IScopedLock lock(update_mutex);
+			update_cond->notify_all();
+		}
+	}
+
+	if(inotify_fd!=-1)
+	{
+		close(inotify_fd);
+	}
+
+	db->destroyAllQueries();
+}
+
+void InotifyWatcherThread::init_mutex(void)
+{
+	pipe=Server->createMemoryPipe();
+	update_mutex=Server->createMutex();
+	update_cond=Server->createCondition();
+}
+
+IPipe *InotifyWatcherThread::getPipe(void)
+{
+	return pipe;
+}
+
+void InotifyWatcherThread::stop(void)
+{
+	do_stop=true;
+	pipe->Write("Q");
+}
+
+void InotifyWatcherThread::freeze(void)
+{
+	IScopedLock lock(update_mutex);
+	pipe->Write("K");
+	update_cond->wait(&lock);
+}
+
+void InotifyWatcherThread::unfreeze(void)
+{
+	IScopedLock lock(update_mutex);
+	pipe->Write("H");
+	update_cond->wait(&lock);
+}
+
+void InotifyWatcherThread::reset_mdirs(const std::string& path)
+{
+	IScopedLock lock(update_mutex);
+	pipe->Write("R"+ path);
+	update_cond->wait(&lock);
+}
+
+bool InotifyWatcherThread::getTracked(const std::string& path, std::vector<std::string>& untracked_dirs)
+{
+	IScopedLock lock(update_mutex);
+
+	std::map<std::string, std::vector<std::string> >::iterator it = tracked_roots.find(getKey(path));
+	if(it==tracked_roots.end())
+	{
+		return false;
+	}
+
+	untracked_dirs=it->second;
+	return true;
+}
+
+std::string InotifyWatcherThread::getKey(const std::string& path)
+{
+	return path+os_file_sep();
+}
+
+void InotifyWatcherThread::startSetup(SWatchRoot& root)
+{
+	root.tracked=false;
+	root.untracked_dirs.clear();
+	root.setup_pending.clear();
+	publishRoot(root);
+
+	std::string path=normalizePath(root.key);
+	if(!os_directory_exists(path))
+	{
+		return;
+	}
+
+	std::string mount_point;
+	for(std::map<std::string, std::string>::iterator it=mounts.begin();it!=mounts.end();++it)
+	{
+		if( (path==it->first || next(path, 0, it->first=="/" ? it->first : it->first+"/"))
+			&& it->first.size()>=mount_point.size())
+		{
+			mount_point=it->first;
+		}
+	}
+
+	if(!mount_point.empty()
+		&& !isLocalFilesystem(mounts[mount_point]))
+	{
+		Server->Log("Not tracking changes in \""+path+"\". File system type \""+mounts[mount_point]+"\" is not supported.", LL_DEBUG);
+		return;
+	}
+
+	root.setup_pending.push_back(root.key);
+}
+
+void InotifyWatcherThread::processSetup(void)
+{
+	size_t n=0;
+	for(size_t i=0;i<roots.size() && n<max_setup_dirs;++i)
+	{
+		SWatchRoot& root=roots[i];
+		if(root.setup_pending.empty())
+		{
+			continue;
+		}
+
+		while(!root.setup_pending.empty() && n<max_setup_dirs)
+		{
+			std::string key=root.setup_pending.back();
+			root.setup_pending.pop_back();
+			++n;
+
+			if(!addWatch(key, false, root.setup_pending, root.untracked_dirs))
+			{
+				failAll();
+				return;
+			}
+		}
+
+		if(root.setup_pending.empty()
+			&& key_wds.find(root.key)!=key_wds.end())
+		{
+			//Changes before the watches were set up were not seen
+			OnDirMod("##-GAP-##"+root.key);
+			root.tracked=true;
+			publishRoot(root);
+
+			Server->Log("Tracking changes in \""+normalizePath(root.key)+"\" with "+convert(key_wds.size())+" inotify watches", LL_DEBUG);
+		}
+	}
+}
+
+bool InotifyWatcherThread::addWatch(const std::string& key, bool mark_changed, std::vector<std::string>& pending,
+	std::vector<std::string>& untracked_dirs)
+{
+	std::string path=key.substr(0, key.size()-1);
+	if(path.empty())
+	{
+		path="/";
+	}
+
+	if(key_wds.find(key)==key_wds.end())
+	{
+		int wd=inotify_add_watch(inotify_fd, path.c_str(), watch_mask);
+		if(wd==-1)
+		{
+			if(errno==ENOENT || errno==ENOTDIR)
+			{
+				//Deleted in the meantime. The parent directory got an event
+				return true;
+			}
+			else if(errno==ENOSPC)
+			{
+				Server->Log("Reached the maximum number of inotify watches (fs.inotify.max_user_watches) while watching \""+path+"\". "
+					"Backup paths are scanned completely during each backup till the limit or the backup paths change.", LL_WARNING);
+				watch_limit_reached=true;
+				max_user_watches=getStreamFile("/proc/sys/fs/inotify/max_user_watches");
+				return false;
+			}
+			else
+			{
+				Server->Log("Error adding inotify watch for \""+path+"\". Errno: "+convert(errno), LL_WARNING);
+				return false;
+			}
+		}
+
+		wd_keys[wd].push_back(key);
+		key_wds[key]=wd;
+	}
+
+	if(mark_changed)
+	{
+		OnDirMod(key);
+	}
+
+	DIR* dir=opendir(path.c_str());
+	if(dir==NULL)
+	{
+		if(errno!=ENOENT && errno!=ENOTDIR)
+		{
+			untracked_dirs.push_back(key);
+		}
+		return true;
+	}
+
+	dirent* entry;
+	while((entry=readdir(dir))!=NULL)
+	{
+		if(strcmp(entry->d_name, ".")==0
+			|| strcmp(entry->d_name, "..")==0)
+		{
+			continue;
+		}
+
+		bool isdir=entry->d_type==DT_DIR;
+		if(entry->d_type==DT_UNKNOWN)
+		{
+			struct stat buf;
+			isdir = lstat((key+entry->d_name).c_str(), &buf)==0
+				&& S_ISDIR(buf.st_mode);
+		}
+
+		if(isdir)
+		{
+			std::string child_key=key+entry->d_name+os_file_sep();
+			if(isForeignMount(child_key))
+			{
+				untracked_dirs.push_back(child_key);
+			}
+			else
+			{
+				pending.push_back(child_key);
+			}
+		}
+	}
+
+	closedir(dir);
+
+	return true;
+}
+
+void InotifyWatcherThread::addSubtree(const std::string& key)
+{
+	std::vector<std::string> pending;
+	std::vector<std::string> untracked_dirs;
+	pending.push_back(key);
+
+	while(!pending.empty())
+	{
+		std::string curr=pending.back();
+		pending.pop_back();
+
+		if(!addWatch(curr, true, pending, untracked_dirs))
+		{
+			failAll();
+			return;
+		}
+	}
+
+	for(size_t i=0;i<untracked_dirs.size();++i)
+	{
+		addUntrackedDir(untracked_dirs[i]);
+	}
+}
+
+void InotifyWatcherThread::addUntrackedDir(const std::string& key)
+{
+	for(size_t i=0;i<roots.size();++i)
+	{
+		if(roots[i].tracked
+			&& next(key, 0, roots[i].key)
+			&& std::find(roots[i].untracked_dirs.begin(), roots[i].untracked_dirs.end(), key)==roots[i].untracked_dirs.end())
+		{
+			roots[i].untracked_dirs.push_back(key);
+			publishRoot(roots[i]);
+		}
+	}
+}
+
+void InotifyWatcherThread::removeWatches(const std::string& key)
+{
+	for(size_t i=0;i<roots.size();++i)
+	{
+		if(next(roots[i].key, 0, key)
+			&& (roots[i].tracked || !roots[i].setup_pending.empty()))
+		{
+			roots[i].tracked=false;
+			roots[i].setup_pending.clear();
+			publishRoot(roots[i]);
+		}
+	}
+
+	std::map<std::string, int>::iterator it=key_wds.lower_bound(key);
+	while(it!=key_wds.end() && next(it->first, 0, key))
+	{
+		std::map<int, std::vector<std::string> >::iterator it_wd=wd_keys.find(it->second);
+		if(it_wd!=wd_keys.end())
+		{
+			std::vector<std::string>::iterator it_key=std::find(it_wd->second.begin(), it_wd->second.end(), it->first);
+			if(it_key!=it_wd->second.end())
+			{
+				it_wd->second.erase(it_key);
+			}
+			if(it_wd->second.empty())
+			{
+				inotify_rm_watch(inotify_fd, it_wd->first);
+				wd_keys.erase(it_wd);
+			}
+		}
+		key_wds.erase(it++);
+	}
+}
+
+void InotifyWatcherThread::removeWd(int wd)
+{
+	std::map<int, std::vector<std::string> >::iterator it_wd=wd_keys.find(wd);
+	if(it_wd==wd_keys.end())
+	{
+		return;
+	}
+
+	for(size_t i=0;i<it_wd->second.size();++i)
+	{
+		key_wds.erase(it_wd->second[i]);
+	}
+
+	wd_keys.erase(it_wd);
+}
+
+void InotifyWatcherThread::readEvents(void)
+{
+	while(true)
+	{
+		ssize_t rc=read(inotify_fd, &event_buffer[0], event_buffer.size());
+		if(rc<=0)
+		{
+			if(rc<0 && errno!=EAGAIN && errno!=EINTR)
+			{
+				Server->Log("Error reading inotify events. Errno: "+convert(errno), LL_ERROR);
+				failAll();
+			}
+			return;
+		}
+
+		for(char* ptr=&event_buffer[0];ptr<&event_buffer[0]+rc;)
+		{
+			const inotify_event* ev=reinterpret_cast<const inotify_event*>(ptr);
+			ptr+=sizeof(inotify_event)+ev->len;
+
+			if(ev->mask & IN_Q_OVERFLOW)
+			{
+				Server->Log("Inotify event queue overflow. Next backup scans backup paths completely.", LL_WARNING);
+				for(size_t i=0;i<roots.size();++i)
+				{
+					if(roots[i].tracked)
+					{
+						OnDirMod("##-GAP-##"+roots[i].key);
+					}
+				}
+				continue;
+			}
+
+			if(ev->mask & IN_IGNORED)
+			{
+				removeWd(ev->wd);
+				continue;
+			}
+
+			std::map<int, std::vector<std::string> >::iterator it_wd=wd_keys.find(ev->wd);
+			if(it_wd==wd_keys.end())
+			{
+				continue;
+			}
+
+			std::string name;
+			if(ev->len>0)
+			{
+				name=ev->name;
+			}
+
+			//handleEvent may change the watches
+			std::vector<std::string> keys=it_wd->second;
+			for(size_t i=0;i<keys.size();++i)
+			{
+				handleEvent(keys[i], ev->mask, name);
+			}
+		}
+	}
+}
+
+void InotifyWatcherThread::handleEvent(const std::string& key, unsigned int mask, const std::string& name)
+{
+	if(name.empty())
+	{
+		//Events of the directory itself. Apart from the backup paths
+		//they are also reported to the parent directory
+		if( (mask & (IN_DELETE_SELF|IN_MOVE_SELF))
+			&& isRootKey(key))
+		{
+			Server->Log("Backup path \""+normalizePath(key)+"\" was deleted or moved", LL_INFO);
+			removeWatches(key);
+		}
+		return;
+	}
+
+	OnDirMod(key);
+
+	if( (mask & (IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO))
+		&& !isRootKey(key))
+	{
+		//Modification time of the directory changed
+		OnDirMod(parentKey(key));
+	}
+
+	if(mask & IN_ISDIR)
+	{
+		std::string child_key=key+name+os_file_sep();
+
+		if(mask & (IN_DELETE|IN_MOVED_FROM))
+		{
+			removeWatches(child_key);
+		}
+
+		if(mask & (IN_CREATE|IN_MOVED_TO))
+		{
+			//All directories below need to be listed, as the files
+			//in the database might be of a previous directory with the same name
+			addSubtree(child_key);
+		}
+	}
+}
+
+void InotifyWatcherThread::readMounts(void)
+{
+	mountinfo=getStreamFile("/proc/self/mountinfo");
+	mounts.clear();
+
+	std::vector<std::string> lines;
+	Tokenize(mountinfo, lines, "\n");
+	for(size_t i=0;i<lines.size();++i)
+	{
+		std::vector<std::string> fields;
+		Tokenize(lines[i], fields, " ");
+
+		for(size_t j=5;j+1<fields.size();++j)
+		{
+			if(fields[j]=="-")
+			{
+				mounts[unescapeMountPoint(fields[4])]=fields[j+1];
+				break;
+			}
+		}
+	}
+}
+
+void InotifyWatcherThread::handleMountChanges(const std::map<std::string, std::string>& old_mounts)
+{
+	std::vector<std::string> changed;
+	for(std::map<std::string, std::string>::const_iterator it=old_mounts.begin();it!=old_mounts.end();++it)
+	{
+		std::map<std::string, std::string>::iterator it_new=mounts.find(it->first);
+		if(it_new==mounts.end() || it_new->second!=it->second)
+		{
+			changed.push_back(it->first);
+		}
+	}
+	for(std::map<std::string, std::string>::iterator it=mounts.begin();it!=mounts.end();++it)
+	{
+		if(old_mounts.find(it->first)==old_mounts.end())
+		{
+			changed.push_back(it->first);
+		}
+	}
+
+	//Mounts elsewhere (e.g. of containers) do not affect the backup paths
+	for(size_t i=0;i<changed.size();++i)
+	{
+		const std::string& mount_point=changed[i];
+
+		for(size_t j=0;j<roots.size();++j)
+		{
+			SWatchRoot& root=roots[j];
+			std::string path=normalizePath(root.key);
+			std::string path_prefix=path=="/" ? path : path+"/";
+			std::string mount_prefix=mount_point=="/" ? mount_point : mount_point+"/";
+
+			if(mount_point==path
+				|| next(path, 0, mount_prefix))
+			{
+				//File system of the whole backup path changed
+				Server->Log("Mount at \""+mount_point+"\" changed. Setting up change tracking of \""+path+"\" again...", LL_INFO);
+				removeWatches(root.key);
+				root.tracked=false;
+				root.untracked_dirs.clear();
+				publishRoot(root);
+				continue;
+			}
+
+			if(!next(mount_point, 0, path_prefix))
+			{
+				continue;
+			}
+
+			if(!root.tracked)
+			{
+				if(!root.setup_pending.empty())
+				{
+					//Setup might have already passed the mount point. Start over
+					removeWatches(root.key);
+				}
+				continue;
+			}
+
+			std::string key=root.key+mount_point.substr(path_prefix.size())+os_file_sep();
+			if(key_wds.find(parentKey(key))==key_wds.end())
+			{
+				//Below an untracked directory
+				continue;
+			}
+
+			Server->Log("Mount at \""+mount_point+"\" in backup path \""+path+"\" changed", LL_DEBUG);
+
+			removeWatches(key);
+
+			std::vector<std::string>::iterator it_untracked=std::find(root.untracked_dirs.begin(), root.untracked_dirs.end(), key);
+			if(it_untracked!=root.untracked_dirs.end())
+			{
+				root.untracked_dirs.erase(it_untracked);
+				publishRoot(root);
+			}
+
+			OnDirMod(parentKey(key));
+
+			if(isForeignMount(key))
+			{
+				addUntrackedDir(key);
+			}
+			else
+			{
+				//Unmounted or replaced with a local file system. Everything below may have changed
+				addSubtree(key);
+			}
+		}
+	}
+}
+
+bool InotifyWatcherThread::isForeignMount(const std::string& key)
+{
+	std::map<std::string, std::string>::iterator it=mounts.find(normalizePath(key));
+	return it!=mounts.end() && !isLocalFilesystem(it->second);
+}
+
+bool InotifyWatcherThread::isRootKey(const std::string& key)
+{
+	for(size_t i=0;i<roots.size();++i)
+	{
+		if(roots[i].key==key)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void InotifyWatcherThread::failAll(void)
+{
+	//Closing the file descriptor removes all watches and pending events
+	close(inotify_fd);
+	wd_keys.clear();
+	key_wds.clear();
+
+	for(size_t i=0;i<roots.size();++i)
+	{
+		roots[i].tracked=false;
+		roots[i].untracked_dirs.clear();
+		roots[i].setup_pending.clear();
+		publishRoot(roots[i]);
+	}
+
+	inotify_fd=inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(inotify_fd==-1)
+	{
+		Server->Log("Error initializing inotify. Errno: "+convert(errno), LL_ERROR);
+	}
+}
+
+void InotifyWatcherThread::publishRoot(const SWatchRoot& root)
+{
+	IScopedLock lock(update_mutex);
+
+	if(root.tracked)
+	{
+		tracked_roots[root.key]=root.untracked_dirs;
+	}
+	else
+	{
+		tracked_roots.erase(root.key);
+	}
+}
+
+void InotifyWatcherThread::OnDirMod(const std::string &dir)
+{
+	int64 currtime=Server->getTimeMS();
+
+	std::map<std::string, int64>::iterator it=lastentries.find(dir);
+	if(it!=lastentries.end()
+		&& currtime-it->second<max_change_ram_cache)
+	{
+		return;
+	}
+
+	q_add_dir->Bind(dir);
+	q_add_dir->Bind(dir);
+	q_add_dir->Write();
+	q_add_dir->Reset();
+
+	if(lastentries.size()>=max_change_ram_cache_entries)
+	{
+		lastentries.clear();
+	}
+
+	lastentries[dir]=currtime;
+}
+
+#endif //__linux__
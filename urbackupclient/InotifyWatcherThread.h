@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../Interface/Thread.h"
+#include "../Interface/Database.h"
+#include "../Interface/Query.h"
+#include "../Interface/Pipe.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+* Linux counterpart of DirectoryWatcherThread. Watches the backup paths
+* with inotify and records the changed directories in the same table
+* (mdirs), so the indexer only has to list the changed directories.
+*
+* Changes are only seen while the client runs. Once all watches of a
+* backup path are set up a gap (##-GAP-##<path>) is recorded, which causes
+* one full scan of the path. The same happens after an inotify queue
+* overflow or if the file system of a backup path is mounted over. Mounts
+* below a backup path are handled like directory changes. If a watch
+* cannot be added no path is tracked until the next retry. After
+* fs.inotify.max_user_watches is reached it is only retried once the
+* limit or the backup paths change. Mounts of file systems where inotify
+* does not see all changes (network and pseudo file systems) are
+* excluded from the tracking.
+*/
+class InotifyWatcherThread : public IThread
+{
+public:
+	InotifyWatcherThread(const std::vector<std::string> &watchdirs);
+	virtual ~InotifyWatcherThread() {}
+
+	static void init_mutex(void);
+
+	void operator()(void);
+
+	static IPipe *getPipe(void);
+
+	void stop(void);
+
+	//Records all pending changes, then stops recording till unfreeze()
+	static void freeze(void);
+	static void unfreeze(void);
+	static void reset_mdirs(const std::string& path);
+
+	//Returns true if changes in the backup path are tracked. Changes in
+	//untracked_dirs (and below) are not tracked
+	static bool getTracked(const std::string& path, std::vector<std::string>& untracked_dirs);
+
+	//Name of a directory in mdirs. Same as the path the indexer uses
+	static std::string getKey(const std::string& path);
+
+private:
+	struct SWatchRoot
+	{
+		std::string key;
+		bool tracked;
+		std::vector<std::string> untracked_dirs;
+		std::vector<std::string> setup_pending;
+	};
+
+	void startSetup(SWatchRoot& root);
+	void processSetup(void);
+	bool addWatch(const std::string& key, bool mark_changed, std::vector<std::string>& pending,
+		std::vector<std::string>& untracked_dirs);
+	void addSubtree(const std::string& key);
+	void addUntrackedDir(const std::string& key);
+	void removeWatches(const std::string& key);
+	void removeWd(int wd);
+	void readEvents(void);
+	void handleEvent(const std::string& key, unsigned int mask, const std::string& name);
+	void readMounts(void);
+	void handleMountChanges(const std::map<std::string, std::string>& old_mounts);
+	bool isForeignMount(const std::string& key);
+	bool isRootKey(const std::string& key);
+	void failAll(void);
+	void publishRoot(const SWatchRoot& root);
+
+	void OnDirMod(const std::string &dir);
+
+	static IPipe *pipe;
+	static IMutex *update_mutex;
+	static ICondition *update_cond;
+	static std::map<std::string, std::vector<std::string> > tracked_roots;
+
+	IDatabase *db;
+
+	volatile bool do_stop;
+	bool frozen;
+
+	IQuery* q_add_dir;
+	IQuery *q_remove_changed_dirs;
+
+	int inotify_fd;
+	std::vector<char> event_buffer;
+	std::vector<SWatchRoot> roots;
+	std::map<int, std::vector<std::string> > wd_keys;
+	std::map<std::string, int> key_wds;
+
+	std::string mountinfo;
+	//Mount point -> file system type
+	std::map<std::string, std::string> mounts;
+
+	bool watch_limit_reached;
+	//fs.inotify.max_user_watches when the limit was reached
+	std::string max_user_watches;
+
+	std::map<std::string, int64> lastentries;
+};
@@ -33,6 +33,7 @@
 #include "../urbackupcommon/InternetServicePipe2.h"
 #include "../urbackupcommon/internet_pipe_capabilities.h"
 #include "../urbackupcommon/CompressedPipe2.h"
+#include "../urbackupcommon/CompressedPipe3.h"
 
 #include "../stringtools.h"
 
@@ -555,6 +556,7 @@ void InternetClientThread::operator()(void)
 	unsigned int server_capa;
 	unsigned int capa=0;
 	int compression_level=6;
+	int compression_level_zstd=3;
 	unsigned int server_iterations;
 	std::string authkey;
 	std::string challenge_response;
@@ -607,6 +609,9 @@ void InternetClientThread::operator()(void)
 				goto cleanup;
 			}
 
+			//Only sent by servers which can offer zstd compression
+			rd.getInt(&compression_level_zstd);
+
 			if(challenge.size()<32)
 			{
 				std::string error = "Challenge not long enough -1";
@@ -742,8 +747,17 @@ void InternetClientThread::operator()(void)
 			capa|=IPC_ENCRYPTED;
 
 		if(server_settings.internet_compress && server_capa & IPC_COMPRESSED )
+		{
 			capa|=IPC_COMPRESSED;
 
+			switch(CompressedPipe3::getCodecFromCapabilities(server_capa))
+			{
+			case CompressedPipe3::ECodec_Zstd: capa|=IPC_COMPRESSED_ZSTD; break;
+			case CompressedPipe3::ECodec_Lz4: capa|=IPC_COMPRESSED_LZ4; break;
+			default: break;
+			}
+		}
+
 		data.addUInt(capa);
 
 		tcpstack.Send(ics_pipe, data);
@@ -758,7 +772,9 @@ void InternetClientThread::operator()(void)
 	}
 	if( capa & IPC_COMPRESSED )
 	{
-		comp_pipe=new CompressedPipe2(comm_pipe, compression_level);
+		CompressedPipe3::ECodec codec = CompressedPipe3::getCodecFromCapabilities(capa);
+		comp_pipe=new CompressedPipe3(comm_pipe, codec,
+			codec==CompressedPipe3::ECodec_Zstd ? compression_level_zstd : compression_level);
 		comm_pipe=comp_pipe;
 	}
 
@@ -911,7 +927,7 @@ void InternetClientThread::printInfo( IPipe * pipe )
 		Server->Log("Service finished. Transferred "+PrettyPrintBytes(transferred_bytes));
 
 		IPipe* back_pipe= pipe;
-		CompressedPipe2* comp_pipe = dynamic_cast<CompressedPipe2*>(pipe);
+		CompressedPipe3* comp_pipe = dynamic_cast<CompressedPipe3*>(pipe);
 
 		if(comp_pipe!=NULL)
 		{
@@ -931,6 +947,8 @@ void InternetClientThread::printInfo( IPipe * pipe )
 			int64 uncompr_transferred = comp_pipe->getUncompressedReceivedBytes()+comp_pipe->getUncompressedSentBytes();
 			Server->Log("Transferred uncompressed: "+PrettyPrintBytes(uncompr_transferred)+" (ratio: "+convert((float)uncompr_transferred/(transferred_bytes-enc_overhead))+")");
 			Server->Log("Average sent paket size: "+PrettyPrintBytes(comp_pipe->getUncompressedSentBytes()/comp_pipe->getSentFlushes()));
+			Server->Log("Compression ("+comp_pipe->getCodecName()+") CPU time: "+convert(comp_pipe->getCompressionCpuTime()/1000)+"ms, decompression: "
+				+convert(comp_pipe->getDecompressionCpuTime()/1000)+"ms");
 		}
 	}
 }
@@ -0,0 +1,163 @@
+#include "ParallelDirList.h"
+#include "../Interface/Server.h"
+#include <algorithm>
+
+namespace
+{
+	const size_t max_queued_dirs = 10000;
+	const size_t max_done_files = 100000;
+}
+
+ParallelDirList::ParallelDirList(size_t n_workers, bool ignore_other_fs)
+	: ignore_other_fs(ignore_other_fs), done_files(0), workers_quit(false),
+	mutex(Server->createMutex()), todo_cond(Server->createCondition()),
+	done_cond(Server->createCondition())
+{
+	for (size_t i = 0; i < n_workers; ++i)
+	{
+		workers.push_back(new ListWorker(*this));
+		worker_tickets.push_back(Server->getThreadPool()->execute(workers[i], "dir list worker"));
+	}
+}
+
+ParallelDirList::~ParallelDirList()
+{
+	{
+		IScopedLock lock(mutex.get());
+		workers_quit = true;
+		todo_cond->notify_all();
+	}
+
+	Server->getThreadPool()->waitFor(worker_tickets);
+
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		delete workers[i];
+	}
+
+	for (std::map<std::string, SDirJob*>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+	{
+		delete it->second;
+	}
+}
+
+void ParallelDirList::queueDirs(const std::vector<std::string>& paths)
+{
+	IScopedLock lock(mutex.get());
+
+	if (jobs.size() >= max_queued_dirs)
+	{
+		return;
+	}
+
+	size_t n_paths = (std::min)(paths.size(), max_queued_dirs - jobs.size());
+
+	for (size_t i = n_paths; i-- > 0;)
+	{
+		if (jobs.find(paths[i]) != jobs.end())
+		{
+			continue;
+		}
+
+		SDirJob* job = new SDirJob;
+		job->path = paths[i];
+		job->running = false;
+		job->done = false;
+		job->has_error = false;
+		job->err = 0;
+
+		jobs[paths[i]] = job;
+		todo.push_front(job);
+		todo_cond->notify_one();
+	}
+}
+
+std::vector<SFile> ParallelDirList::getFiles(const std::string& path, bool& has_error, int64& err)
+{
+	IScopedLock lock(mutex.get());
+
+	std::map<std::string, SDirJob*>::iterator it = jobs.find(path);
+	if (it == jobs.end())
+	{
+		lock.relock(NULL);
+		return listDir(path, ignore_other_fs, has_error, err);
+	}
+
+	SDirJob* job = it->second;
+
+	if (!job->running)
+	{
+		todo.erase(std::find(todo.begin(), todo.end(), job));
+		jobs.erase(it);
+		delete job;
+
+		lock.relock(NULL);
+		return listDir(path, ignore_other_fs, has_error, err);
+	}
+
+	while (!job->done)
+	{
+		done_cond->wait(&lock);
+	}
+
+	jobs.erase(path);
+	if (done_files >= max_done_files
+		&& done_files - job->files.size() < max_done_files)
+	{
+		todo_cond->notify_all();
+	}
+	done_files -= job->files.size();
+
+	std::vector<SFile> ret;
+	ret.swap(job->files);
+	has_error = job->has_error;
+	err = job->err;
+	delete job;
+
+	return ret;
+}
+
+std::vector<SFile> ParallelDirList::listDir(const std::string& path, bool ignore_other_fs, bool& has_error, int64& err)
+{
+	std::vector<SFile> ret = getFilesWin(path, &has_error, true, true, ignore_other_fs);
+	err = has_error ? os_last_error() : 0;
+	return ret;
+}
+
+void ParallelDirList::runWorker()
+{
+	IScopedLock lock(mutex.get());
+
+	while (true)
+	{
+		while ( (todo.empty() || done_files >= max_done_files)
+			&& !workers_quit)
+		{
+			todo_cond->wait(&lock);
+		}
+
+		if (workers_quit)
+		{
+			return;
+		}
+
+		SDirJob* job = todo.front();
+		todo.pop_front();
+		job->running = true;
+
+		lock.relock(NULL);
+
+		bool has_error;
+		int64 err;
+		std::vector<SFile> files = listDir(job->path, ignore_other_fs, has_error, err);
+
+		lock.relock(mutex.get());
+
+		job->files.swap(files);
+		job->has_error = has_error;
+		job->err = err;
+		job->done = true;
+		done_files += job->files.size();
+		done_cond->notify_all();
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../Interface/Thread.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include "../Interface/ThreadPool.h"
+#include "../urbackupcommon/os_functions.h"
+#include <memory>
+#include <deque>
+#include <map>
+#include <vector>
+
+/**
+* Lists directories on worker threads ahead of the indexer. The indexer
+* queues the sub-directories it is going to descend into and then gets
+* their listings in its own (depth first) order, so the file list and
+* the database stay exactly as with the sequential walk. Directories
+* queued last are listed first, as the indexer descends into them next.
+* A listing no worker has started on yet is taken over by the indexer.
+*/
+class ParallelDirList
+{
+public:
+	ParallelDirList(size_t n_workers, bool ignore_other_fs);
+	~ParallelDirList();
+
+	void queueDirs(const std::vector<std::string>& paths);
+
+	std::vector<SFile> getFiles(const std::string& path, bool& has_error, int64& err);
+
+	static std::vector<SFile> listDir(const std::string& path, bool ignore_other_fs, bool& has_error, int64& err);
+
+private:
+	struct SDirJob
+	{
+		std::string path;
+		bool running;
+		bool done;
+		std::vector<SFile> files;
+		bool has_error;
+		int64 err;
+	};
+
+	class ListWorker : public IThread
+	{
+	public:
+		ListWorker(ParallelDirList& dir_list)
+			: dir_list(dir_list)
+		{}
+
+		virtual ~ListWorker() {}
+
+		void operator()()
+		{
+			dir_list.runWorker();
+		}
+
+	private:
+		ParallelDirList& dir_list;
+	};
+
+	void runWorker();
+
+	bool ignore_other_fs;
+	std::map<std::string, SDirJob*> jobs;
+	std::deque<SDirJob*> todo;
+	size_t done_files;
+	bool workers_quit;
+	std::auto_ptr<IMutex> mutex;
+	std::auto_ptr<ICondition> todo_cond;
+	std::auto_ptr<ICondition> done_cond;
+	std::vector<ListWorker*> workers;
+	std::vector<THREADPOOL_TICKET> worker_tickets;
+};
@@ -10,14 +10,18 @@
 
 namespace
 {
-	const size_t max_modify_file_buffer_size = 2 * 1024 * 1024;
+	const size_t max_modify_file_buffer_size = 2 * 1024 * 1024;
 	const int64 file_buffer_commit_interval = 120 * 1000;
+	const size_t max_pending_jobs = 1000;
 }
 
-ParallelHash::ParallelHash(SQueueRef* phash_queue, int sha_version)
-	: do_quit(false), phash_queue(phash_queue), phash_queue_pos(0),
-	stdout_buf_size(0), stdout_buf_pos(0), mutex(Server->createMutex()),
-	last_file_buffer_commit_time(0), sha_version(sha_version), eof(false)
+ParallelHash::ParallelHash(SQueueRef* phash_queue, int sha_version, size_t n_workers)
+	: stdout_buf_pos(0), stdout_buf_size(0), do_quit(false), eof(false),
+	phash_queue_pos(0), phash_queue(phash_queue), mutex(Server->createMutex()),
+	sha_version(sha_version), n_workers((std::max)(static_cast<size_t>(1), n_workers)),
+	queue_finished(false), jobs_mutex(Server->createMutex()), jobs_cond(Server->createCondition()),
+	jobs_done_cond(Server->createCondition()), workers_quit(false),
+	modify_file_buffer_size(0), last_file_buffer_commit_time(0)
 {
 	stdout_buf.resize(4090);
 	ticket = Server->getThreadPool()->execute(this, "phash");
@@ -101,11 +105,17 @@ void ParallelHash::operator()()
 #endif
 	std::auto_ptr<IFile> phashf(Server->openFile(phash_queue->phash_queue->getFilename(), mode));
 
+	startWorkers();
+
+	int64 last_msg_time = Server->getTimeMS();
+
 	while (!do_quit
 		&& phashf.get()!=NULL)
 	{
 		bool had_msg = false;
-		if (phashf->Size() >= phash_queue_pos + static_cast<int64>(sizeof(_u32)))
+		if (!queue_finished
+			&& pending_jobs.size() < max_pending_jobs
+			&& phashf->Size() >= phash_queue_pos + static_cast<int64>(sizeof(_u32)))
 		{
 			_u32 msg_size;
 			if (phashf->Read(phash_queue_pos, reinterpret_cast<char*>(&msg_size), sizeof(msg_size))
@@ -116,28 +126,51 @@ void ParallelHash::operator()()
 					had_msg = true;
 
 					std::string msg = phashf->Read(phash_queue_pos + sizeof(_u32), msg_size);
-					CRData data(msg.data(), msg.size());
 					phash_queue_pos += sizeof(_u32) + msg_size;
 
-					hashFile(data, clientdao);
-
-					if (eof)
-					{
-						break;
-					}
+					queueMessage(msg, clientdao);
 				}
 			}
 		}
-		if (!had_msg)
+
+		if (writeFinishedJobs(clientdao, !had_msg))
 		{
-			Server->wait(1000);
-			CWData data;
-			data.addUShort(1);
-			data.addChar(0);
-			addToStdoutBuf(data.getDataPtr(), data.getDataSize());
+			had_msg = true;
+		}
+
+		if (eof)
+		{
+			break;
+		}
+
+		if (had_msg)
+		{
+			last_msg_time = Server->getTimeMS();
+		}
+		else
+		{
+			if (pending_jobs.empty())
+			{
+				Server->wait(1000);
+			}
+
+			//The wait for finished jobs also wakes up if a job which is
+			//not at the front of the queue is done. Only send a keep-alive
+			//if nothing was written for the whole timeout.
+			int64 ctime = Server->getTimeMS();
+			if (ctime - last_msg_time >= 1000)
+			{
+				CWData data;
+				data.addUShort(1);
+				data.addChar(0);
+				addToStdoutBuf(data.getDataPtr(), data.getDataSize());
+				last_msg_time = ctime;
+			}
 		}
 	}
 
+	stopWorkers();
+
 	commitModifyFileBuffer(clientdao);
 
 	if (phash_queue->deref())
@@ -147,7 +180,205 @@ void ParallelHash::operator()()
 	}
 }
 
-bool ParallelHash::hashFile(CRData & data, ClientDAO& clientdao)
+void ParallelHash::queueMessage(const std::string& msg, ClientDAO& clientdao)
+{
+	CRData data(msg.data(), msg.size());
+
+	char id;
+	if (!data.getChar(&id))
+		return;
+
+	if (id == ID_INIT_HASH
+		|| id == ID_CBT_DATA)
+	{
+		//Changes the hashing state of the workers. Let them finish first.
+		waitForJobs(clientdao);
+		processMessage(data, clientdao);
+		return;
+	}
+
+	std::auto_ptr<SHashJob> job(new SHashJob);
+	job->is_hash = false;
+	job->file_id = 0;
+	job->done = true;
+
+	if (id == ID_SET_CURR_DIRS)
+	{
+		std::string curr_dir;
+		int curr_tgroup;
+		if (data.getStr2(&curr_dir)
+			&& data.getInt(&curr_tgroup))
+		{
+			data.getStr2(&queue_snapshot_dir);
+		}
+	}
+	else if (id == ID_PHASH_FINISH)
+	{
+		queue_finished = true;
+	}
+	else if (id == ID_HASH_FILE)
+	{
+		if (!data.getVarInt(&job->file_id)
+			|| !data.getStr2(&job->fn))
+		{
+			return;
+		}
+
+		job->is_hash = true;
+		job->full_path = queue_snapshot_dir + os_file_sep() + job->fn;
+		job->done = false;
+	}
+
+	if (!job->is_hash)
+	{
+		job->msg = msg;
+	}
+
+	IScopedLock lock(jobs_mutex.get());
+	pending_jobs.push_back(job.get());
+	if (job->is_hash)
+	{
+		hash_todo.push_back(job.get());
+		jobs_cond->notify_one();
+	}
+	job.release();
+}
+
+bool ParallelHash::writeFinishedJobs(ClientDAO& clientdao, bool wait)
+{
+	std::vector<SHashJob*> finished;
+
+	{
+		IScopedLock lock(jobs_mutex.get());
+
+		if (wait
+			&& !pending_jobs.empty()
+			&& !pending_jobs.front()->done)
+		{
+			jobs_done_cond->wait(&lock, 1000);
+		}
+
+		while (!pending_jobs.empty()
+			&& pending_jobs.front()->done)
+		{
+			finished.push_back(pending_jobs.front());
+			pending_jobs.pop_front();
+		}
+	}
+
+	for (size_t i = 0; i < finished.size(); ++i)
+	{
+		if (finished[i]->is_hash)
+		{
+			addHashResult(*finished[i]);
+		}
+		else
+		{
+			CRData data(finished[i]->msg.data(), finished[i]->msg.size());
+			processMessage(data, clientdao);
+		}
+
+		delete finished[i];
+	}
+
+	return !finished.empty();
+}
+
+void ParallelHash::waitForJobs(ClientDAO& clientdao)
+{
+	while (!do_quit
+		&& !pending_jobs.empty())
+	{
+		writeFinishedJobs(clientdao, true);
+	}
+}
+
+void ParallelHash::startWorkers()
+{
+	worker_client_hashes.resize(n_workers, NULL);
+
+	for (size_t i = 0; i < n_workers; ++i)
+	{
+		workers.push_back(new HashWorker(*this, i));
+		worker_tickets.push_back(Server->getThreadPool()->execute(workers[i], "phash worker"));
+	}
+}
+
+void ParallelHash::stopWorkers()
+{
+	{
+		IScopedLock lock(jobs_mutex.get());
+		workers_quit = true;
+		jobs_cond->notify_all();
+	}
+
+	Server->getThreadPool()->waitFor(worker_tickets);
+
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		delete workers[i];
+		delete worker_client_hashes[i];
+	}
+	workers.clear();
+	worker_tickets.clear();
+	worker_client_hashes.clear();
+
+	for (size_t i = 0; i < pending_jobs.size(); ++i)
+	{
+		delete pending_jobs[i];
+	}
+	pending_jobs.clear();
+	hash_todo.clear();
+}
+
+void ParallelHash::runWorker(size_t worker_idx)
+{
+	IScopedLock lock(jobs_mutex.get());
+
+	while (true)
+	{
+		while (hash_todo.empty()
+			&& !workers_quit)
+		{
+			jobs_cond->wait(&lock);
+		}
+
+		if (workers_quit)
+		{
+			return;
+		}
+
+		SHashJob* job = hash_todo.front();
+		hash_todo.pop_front();
+		ClientHash* worker_client_hash = worker_client_hashes[worker_idx];
+
+		lock.relock(NULL);
+
+		std::string hash = hashFile(worker_client_hash, job->full_path);
+
+		lock.relock(jobs_mutex.get());
+
+		job->hash = hash;
+		job->done = true;
+		jobs_done_cond->notify_all();
+	}
+}
+
+void ParallelHash::resetClientHashes(IFile* index_hdat_file, int64 index_hdat_fs_block_size,
+	size_t* snapshot_sequence_id, size_t snapshot_sequence_id_reference)
+{
+	//Only called while no job is running. The workers share the change
+	//block tracking file owned by client_hash.
+	IScopedLock lock(jobs_mutex.get());
+	for (size_t i = 0; i < worker_client_hashes.size(); ++i)
+	{
+		delete worker_client_hashes[i];
+		worker_client_hashes[i] = new ClientHash(index_hdat_file, false, index_hdat_fs_block_size,
+			snapshot_sequence_id, snapshot_sequence_id_reference);
+	}
+}
+
+bool ParallelHash::processMessage(CRData & data, ClientDAO& clientdao)
 {
 	char id;
 	if (!data.getChar(&id))
@@ -224,6 +455,7 @@ bool ParallelHash::hashFile(CRData & data, ClientDAO& clientdao)
 	else if (id == ID_INIT_HASH)
 	{
 		client_hash.reset(new ClientHash(NULL, false, 0, NULL, 0));
+		resetClientHashes(NULL, 0, NULL, 0);
 		return true;
 	}
 	else if (id == ID_CBT_DATA)
@@ -242,6 +474,8 @@ bool ParallelHash::hashFile(CRData & data, ClientDAO& clientdao)
 
 		client_hash.reset(new ClientHash(index_hdat_file, true, index_hdat_fs_block_size,
 			snapshot_sequence_id, static_cast<size_t>(snapshot_sequence_id_reference)));
+		resetClientHashes(index_hdat_file, index_hdat_fs_block_size,
+			snapshot_sequence_id, static_cast<size_t>(snapshot_sequence_id_reference));
 		return true;
 	}
 	else if (id == ID_PHASH_FINISH)
@@ -250,56 +484,48 @@ bool ParallelHash::hashFile(CRData & data, ClientDAO& clientdao)
 		return true;
 	}
 
-	if (id != ID_HASH_FILE)
-	{
-		return false;
-	}
-
-	int64 file_id;
-	if (!data.getVarInt(&file_id))
-	{
-		return false;
-	}
+	return false;
+}
 
-	std::string fn;
-	if (!data.getStr2(&fn))
+std::string ParallelHash::hashFile(ClientHash* worker_client_hash, const std::string& full_path)
+{
+	if (worker_client_hash == NULL)
 	{
-		return false;
+		Server->Log("Hashing not initialized. Cannot hash " + full_path, LL_ERROR);
+		return std::string();
 	}
 
-	std::string full_path = curr_snapshot_dir + os_file_sep() + fn;
-
-	SFileAndHash fandhash;
-	if (sha_version == 256)
+	std::string hash;
+	if (sha_version == 256)
 	{
 		HashSha256 hash_256;
-		if (!client_hash->getShaBinary(full_path, hash_256, false))
+		if (!worker_client_hash->getShaBinary(full_path, hash_256, false))
 		{
 			Server->Log("Error hashing file (0) " + full_path + ". " + os_last_error_str(), LL_DEBUG);
 		}
 		else
 		{
-			fandhash.hash = hash_256.finalize();
+			hash = hash_256.finalize();
 		}
 	}
 	else if (sha_version == 528)
 	{
-		TreeHash treehash(client_hash->hasCbtFile() ? client_hash.get() : NULL);
-		if (!client_hash->getShaBinary(full_path, treehash, client_hash->hasCbtFile()))
+		TreeHash treehash(worker_client_hash->hasCbtFile() ? worker_client_hash : NULL);
+		if (!worker_client_hash->getShaBinary(full_path, treehash, worker_client_hash->hasCbtFile()))
 		{
 			Server->Log("Error hashing file (1) " + full_path+". "+os_last_error_str(), LL_DEBUG);
 		}
 		else
 		{
-			fandhash.hash = treehash.finalize();
+			hash = treehash.finalize();
 		}
 
 #ifdef HASH_CBT_CHECK
-		TreeHash treehash2(client_hash->hasCbtFile() ? client_hash.get() : NULL);
-		client_hash->getShaBinary(full_path, treehash2, false);
+		TreeHash treehash2(worker_client_hash->hasCbtFile() ? worker_client_hash : NULL);
+		worker_client_hash->getShaBinary(full_path, treehash2, false);
 		
 		std::string other_hash = treehash2.finalize();
-		if (other_hash != fandhash.hash)
+		if (other_hash != hash)
 		{
 			Server->Log("Treehash compare without CBT failed at file \"" + full_path 
 				+ "\". Real hash: "+ base64_encode_dash(other_hash), LL_ERROR);
@@ -309,30 +535,36 @@ bool ParallelHash::hashFile(CRData & data, ClientDAO& clientdao)
 	else
 	{
 		HashSha512 hash_512;
-		if (!client_hash->getShaBinary(full_path, hash_512, false))
+		if (!worker_client_hash->getShaBinary(full_path, hash_512, false))
 		{
 			Server->Log("Error hashing file (2) " + full_path + ". " + os_last_error_str(), LL_DEBUG);
 		}
 		else
 		{
-			fandhash.hash = hash_512.finalize();
+			hash = hash_512.finalize();
 		}
 	}
 
+	return hash;
+}
+
+void ParallelHash::addHashResult(const SHashJob& job)
+{
+	SFileAndHash fandhash;
+	fandhash.hash = job.hash;
+
 	CWData wdata;
 	wdata.addUShort(0);
 	wdata.addChar(1);
-	wdata.addVarInt(file_id);
+	wdata.addVarInt(job.file_id);
 	wdata.addString2(fandhash.hash);
-	fandhash.name = fn;
+	fandhash.name = job.fn;
 	*reinterpret_cast<_u16*>(wdata.getDataPtr()) = little_endian(static_cast<_u16>(wdata.getDataSize() - sizeof(_u16)));
 	curr_files.push_back(fandhash);
 
-	Server->Log("Parallel hash \"" + full_path + "\" id=" + convert(file_id) + " hash=" + base64_encode_dash(fandhash.hash), LL_DEBUG);
+	Server->Log("Parallel hash \"" + job.full_path + "\" id=" + convert(job.file_id) + " hash=" + base64_encode_dash(fandhash.hash), LL_DEBUG);
 
 	addToStdoutBuf(wdata.getDataPtr(), wdata.getDataSize());
-
-	return true;
 }
 
 void ParallelHash::addToStdoutBuf(const char * ptr, size_t size)
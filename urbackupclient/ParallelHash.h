@@ -4,10 +4,12 @@
 #include "../Interface/File.h"
 #include "../Interface/Thread.h"
 #include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
 #include "../common/data.h"
 #include "clientdao.h"
 #include "client.h"
 #include <memory>
+#include <deque>
 
 namespace
 {
@@ -24,7 +26,7 @@ class ClientHash;
 class ParallelHash : public IPipeFileExt, public IThread
 {
 public:
-	ParallelHash(SQueueRef* phash_queue, int sha_version);
+	ParallelHash(SQueueRef* phash_queue, int sha_version, size_t n_workers);
 
 	virtual bool getExitCode(int & exit_code);
 	virtual void forceExit();
@@ -35,7 +37,49 @@ public:
 	void operator()();
 
 private:
-	bool hashFile(CRData& data, ClientDAO& clientdao);
+	//Queue entry. Files are hashed by the workers, everything else
+	//is processed in queue order once all entries before it are done.
+	struct SHashJob
+	{
+		bool is_hash;
+		std::string msg;
+		int64 file_id;
+		std::string fn;
+		std::string full_path;
+		std::string hash;
+		bool done;
+	};
+
+	class HashWorker : public IThread
+	{
+	public:
+		HashWorker(ParallelHash& phash, size_t worker_idx)
+			: phash(phash), worker_idx(worker_idx)
+		{}
+
+		virtual ~HashWorker() {}
+
+		void operator()()
+		{
+			phash.runWorker(worker_idx);
+		}
+
+	private:
+		ParallelHash& phash;
+		size_t worker_idx;
+	};
+
+	void queueMessage(const std::string& msg, ClientDAO& clientdao);
+	bool writeFinishedJobs(ClientDAO& clientdao, bool wait);
+	void waitForJobs(ClientDAO& clientdao);
+	void startWorkers();
+	void stopWorkers();
+	void runWorker(size_t worker_idx);
+	void resetClientHashes(IFile* index_hdat_file, int64 index_hdat_fs_block_size,
+		size_t* snapshot_sequence_id, size_t snapshot_sequence_id_reference);
+	bool processMessage(CRData& data, ClientDAO& clientdao);
+	std::string hashFile(ClientHash* worker_client_hash, const std::string& full_path);
+	void addHashResult(const SHashJob& job);
 	void addToStdoutBuf(const char* ptr, size_t size);
 	void addModifyFileBuffer(ClientDAO& clientdao, const std::string& path, int tgroup, const std::vector<SFileAndHash>& files, int64 target_generation);
 	void commitModifyFileBuffer(ClientDAO& clientdao);
@@ -57,6 +101,19 @@ private:
 	int sha_version;
 	THREADPOOL_TICKET ticket;
 
+	size_t n_workers;
+	std::string queue_snapshot_dir;
+	bool queue_finished;
+	std::deque<SHashJob*> pending_jobs;
+	std::deque<SHashJob*> hash_todo;
+	std::auto_ptr<IMutex> jobs_mutex;
+	std::auto_ptr<ICondition> jobs_cond;
+	std::auto_ptr<ICondition> jobs_done_cond;
+	bool workers_quit;
+	std::vector<HashWorker*> workers;
+	std::vector<THREADPOOL_TICKET> worker_tickets;
+	std::vector<ClientHash*> worker_client_hashes;
+
 	struct SBufferItem
 	{
 		SBufferItem(std::string path, int tgroup, std::vector<SFileAndHash> files, int64 target_generation)
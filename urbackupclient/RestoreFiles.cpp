@@ -26,6 +26,7 @@
 #include "../Interface/Server.h"
 #include "../Interface/ThreadPool.h"
 #include "clientdao.h"
+#include "dir_cache_data.h"
 #include "../Interface/Server.h"
 #include <algorithm>
 #include <stack>
@@ -981,7 +982,7 @@ bool RestoreFiles::downloadFiles(FileClient& fc, int64 total_size, ScopedRestore
     THREADPOOL_TICKET restore_download_ticket = Server->getThreadPool()->execute(restore_download.get(), "file restore download");
 
 	std::string curr_files_dir;
-	std::vector<SFileAndHash> curr_files;
+	std::string curr_files_data;
 
 	size_t line=0;
 
@@ -1435,19 +1436,16 @@ bool RestoreFiles::downloadFiles(FileClient& fc, int64 total_size, ScopedRestore
 #endif
 
 							int64 generation;
-							if(!client_dao.getFiles(restore_path_lower + os_file_sep(), db_tgroup, curr_files, generation))
+							if(!client_dao.getFilesData(restore_path_lower + os_file_sep(), db_tgroup, curr_files_data, generation))
 							{
-								curr_files.clear();
+								curr_files_data.clear();
 							}
 						}
 
 						std::string shahash;
 
-						SFileAndHash search_file = {};
-						search_file.name = restore_name;
-
-						std::vector<SFileAndHash>::iterator it_file = std::lower_bound(curr_files.begin(), curr_files.end(), search_file);
-						if(it_file!=curr_files.end() && it_file->name == restore_name)
+						SFileAndHash db_file;
+						if(findDirCacheEntry(curr_files_data.data(), curr_files_data.size(), restore_name, db_file))
 						{
 							SFile metadata = getFileMetadataWin(local_fn, true);
 							if(!metadata.name.empty())
@@ -1458,11 +1456,11 @@ bool RestoreFiles::downloadFiles(FileClient& fc, int64 total_size, ScopedRestore
 									change_indicator = metadata.usn;
 								}
 								if(!metadata.isdir
-									&& metadata.size==it_file->size
-									&& change_indicator==it_file->change_indicator
-									&& !it_file->hash.empty())
+									&& metadata.size==db_file.size
+									&& change_indicator==db_file.change_indicator
+									&& !db_file.hash.empty())
 								{
-									shahash = it_file->hash;
+									shahash = db_file.hash;
 								}
 							}							
 						}
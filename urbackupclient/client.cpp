@@ -26,6 +26,9 @@
 #else
 #include <errno.h>
 #endif
+#ifdef __linux__
+#include "InotifyWatcherThread.h"
+#endif
 #include "../stringtools.h"
 #include "../common/data.h"
 #include "../md5.h"
@@ -401,7 +404,7 @@ std::string add_trailing_slash(const std::string &strDirName)
 
 IndexThread::IndexThread(void)
 	: index_error(false), last_filebackup_filetime(0), index_group(-1),
-	with_scripts(false), volumes_cache(NULL), phash_queue(NULL)
+	with_scripts(false), volumes_cache(NULL), binary_filelist(false), phash_queue(NULL)
 {
 	if(filelist_mutex==NULL)
 		filelist_mutex=Server->createMutex();
@@ -418,6 +421,8 @@ IndexThread::IndexThread(void)
 	contractor=NULL;
 
 	dwt=NULL;
+	iwt=NULL;
+	index_tracked_dir=NULL;
 
 	if(Server->getPlugin(Server->getThreadID(), filesrv_pluginid))
 	{
@@ -449,6 +454,14 @@ IndexThread::~IndexThread()
 		delete dwt;
 	}
 #endif
+#ifdef __linux__
+	if(iwt!=NULL)
+	{
+		iwt->stop();
+		Server->getThreadPool()->waitFor(iwt_ticket);
+		delete iwt;
+	}
+#endif
 
 	((IFileServFactory*)(Server->getPlugin(Server->getThreadID(), filesrv_pluginid)))->destroyFileServ(filesrv);
 	Server->destroy(filelist_mutex);
@@ -497,6 +510,29 @@ void IndexThread::updateDirs(void)
 			dwt->getPipe()->Write(msg);
 		}
 	}
+#elif defined(__linux__)
+	std::vector<std::string> watching;
+	for(size_t i=0;i<backup_dirs.size();++i)
+	{
+		if(!backup_dirs[i].symlinked)
+		{
+			watching.push_back(backup_dirs[i].path);
+		}
+	}
+
+	if(iwt==NULL)
+	{
+		iwt=new InotifyWatcherThread(watching);
+		iwt_ticket=Server->getThreadPool()->execute(iwt, "inotify watcher");
+	}
+	else
+	{
+		for(size_t i=0;i<watching.size();++i)
+		{
+			std::string msg="A"+watching[i];
+			iwt->getPipe()->Write(msg);
+		}
+	}
 #endif
 }
 
@@ -1412,6 +1448,52 @@ void IndexThread::indexDirs(bool full_backup, bool simultaneous_other)
 	}
 
 	_i64 last_filebackup_filetime_new = DirectoryWatcherThread::get_current_filetime();
+#elif defined(__linux__)
+	InotifyWatcherThread::freeze();
+
+	std::vector<std::string> gaps=cd->getChangedDirs("##-GAP-##", true);
+	InotifyWatcherThread::reset_mdirs("##-GAP-##");
+
+	changed_dirs.clear();
+	for(size_t i=0;i<selected_dirs.size();++i)
+	{
+		std::vector<std::string> acd=cd->getChangedDirs(selected_dirs[i], true);
+		changed_dirs.insert(changed_dirs.end(), acd.begin(), acd.end() );
+		InotifyWatcherThread::reset_mdirs(selected_dirs[i]);
+	}
+
+	tracked_backup_dirs.clear();
+	for(size_t i=0;i<backup_dirs.size();++i)
+	{
+		STrackedBackupDir tracked_dir;
+		if(backup_dirs[i].group!=index_group
+			|| !InotifyWatcherThread::getTracked(backup_dirs[i].path, tracked_dir.untracked_dirs))
+		{
+			continue;
+		}
+
+		tracked_dir.key=InotifyWatcherThread::getKey(backup_dirs[i].path);
+		tracked_dir.use_changed_dirs=true;
+
+		for(size_t j=0;j<gaps.size();++j)
+		{
+			std::string gap=gaps[j].substr(9);
+			if(next(tracked_dir.key, 0, gap)
+				|| next(gap, 0, tracked_dir.key))
+			{
+				tracked_dir.use_changed_dirs=false;
+			}
+		}
+
+		if(!tracked_dir.use_changed_dirs)
+		{
+			VSSLog("Changes in \""+backup_dirs[i].path+"\" were not tracked completely since the last backup. Scanning all directories.", LL_DEBUG);
+		}
+
+		tracked_backup_dirs.push_back(tracked_dir);
+	}
+
+	InotifyWatcherThread::unfreeze();
 #endif
 
 	bool has_stale_shadowcopy=false;
@@ -1674,14 +1756,32 @@ void IndexThread::indexDirs(bool full_backup, bool simultaneous_other)
 				{
 					index_root_path = os_file_sep();
 				}
+#endif
+				index_tracked_dir = NULL;
+#ifdef __linux__
+				for (size_t k = 0; k < tracked_backup_dirs.size(); ++k)
+				{
+					if (tracked_backup_dirs[k].key == InotifyWatcherThread::getKey(backup_dirs[i].path))
+					{
+						index_tracked_dir = &tracked_backup_dirs[k];
+					}
+				}
 #endif
 				if (!index_error)
 				{
 					openCbtHdatFile(scd->ref, backup_dirs[i].tname, volume);
 
+					size_t n_index_workers = getIndexWorkers();
+					if (n_index_workers > 1)
+					{
+						dir_list.reset(new ParallelDirList(n_index_workers, (backup_dirs[i].flags & EBackupDirFlag_OneFilesystem) > 0));
+					}
+
 					initialCheck(strlower(volume), vssvolume, backup_dirs[i].path, mod_path, backup_dirs[i].tname, outfile, true,
 						backup_dirs[i].flags, !full_backup, backup_dirs[i].symlinked, 0, true, true,
 						index_exclude_dirs, index_include_dirs);
+
+					dir_list.reset();
 				}
 
 				commitModifyFilesBuffer();
@@ -1804,7 +1904,22 @@ void IndexThread::indexDirs(bool full_backup, bool simultaneous_other)
 	open_files.clear();
 	changed_dirs.clear();
 	
+#elif defined(__linux__)
+	if(!has_stale_shadowcopy
+		&& !index_error)
+	{
+		VSSLog("Deleting backup of changed dirs...", LL_DEBUG);
+		cd->deleteSavedChangedDirs();
+	}
+	else
+	{
+		VSSLog("Did not delete backup of changed dirs because there was an error while indexing or a stale snapshot was used.", LL_INFO);
+	}
+
+	changed_dirs.clear();
 #endif
+	index_tracked_dir = NULL;
+	tracked_backup_dirs.clear();
 
 	if (last_filelist_f!=NULL)
 	{
@@ -1813,6 +1928,21 @@ void IndexThread::indexDirs(bool full_backup, bool simultaneous_other)
 		last_filelist.reset();
 	}
 
+	if (binary_filelist)
+	{
+		std::string filelist_bin_fn = "urbackup/data/filelist_new_" + convert(index_group) + "_bin.ub";
+		if (convertFileListToBinary(filelist_fn, filelist_bin_fn))
+		{
+			removeFile(filelist_fn);
+			filelist_fn = filelist_bin_fn;
+		}
+		else
+		{
+			VSSLog("Converting file list to binary format failed. Using text format.", LL_WARNING);
+			removeFile(filelist_bin_fn);
+		}
+	}
+
 	{
 		IScopedLock lock(filelist_mutex);
 		if(index_group==c_group_default)
@@ -1874,6 +2004,8 @@ void IndexThread::resetFileEntries(void)
 	cd->resetAllHardlinks();
 #ifdef _WIN32
 	DirectoryWatcherThread::reset_mdirs(std::string());
+#elif defined(__linux__)
+	InotifyWatcherThread::reset_mdirs(std::string());
 #endif
 }
 
@@ -2149,6 +2281,12 @@ bool IndexThread::initialCheck(const std::string& volume, const std::string& vss
 		addToPhashQueue(wdata);
 	}
 
+	if (dir_list.get() != NULL
+		&& dir_recurse)
+	{
+		queueDirLists(orig_dir, dir, named_path, files, use_db, include_exclude_dirs, exclude_dirs, include_dirs);
+	}
+
 	for(size_t i=0;dir_recurse && i<files.size();++i)
 	{
 		if( files[i].isdir )
@@ -2551,20 +2689,35 @@ std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::string &orig_pat
 	std::string path_lower=strlower(orig_path+os_file_sep());
 #endif
 
-	std::vector<std::string>::iterator it_dir=changed_dirs.end();
-#ifdef _WIN32
+	bool dir_changed=isDirChanged(path_lower, use_db);
 
-	bool dir_changed=std::binary_search(changed_dirs.begin(), changed_dirs.end(), path_lower);
-	
-	if(path_lower==strlower(Server->getServerWorkingDir())+os_file_sep()+"urbackup"+os_file_sep())
+	std::vector<SFileAndHash> fs_files;
+#ifndef _WIN32
+	if (use_db && !dir_changed)
 	{
-		use_db=false;
+		if (cd->getFiles(path_lower, get_db_tgroup(), fs_files, target_generation))
+		{
+			++index_c_db;
+
+			handleSymlinks(orig_path, named_path, exclude_dirs, include_dirs, fs_files);
+
+			if (calculate_filehashes_on_client)
+			{
+				if (addMissingHashes(&fs_files, NULL, orig_path, path, named_path,
+					exclude_dirs, include_dirs, phash_queue == NULL))
+				{
+					++index_c_db_update;
+					modifyFilesInt(path_lower, get_db_tgroup(), fs_files, target_generation);
+				}
+			}
+
+			return fs_files;
+		}
+
+		//Not in the database yet
+		dir_changed = true;
 	}
-#else
-	use_db=false;
-	bool dir_changed=true;
 #endif
-	std::vector<SFileAndHash> fs_files;
 	if (!use_db || dir_changed)
 	{
 		++index_c_fs;
@@ -2572,18 +2725,21 @@ std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::string &orig_pat
 		std::string tpath = os_file_prefix(path);
 
 		bool has_error;
-		std::vector<SFile> os_files = getFilesWin(tpath, &has_error, true, true, (index_flags & EBackupDirFlag_OneFilesystem) > 0);
+		int64 err;
+		std::vector<SFile> os_files;
+		if (dir_list.get() != NULL)
+		{
+			os_files = dir_list->getFiles(tpath, has_error, err);
+		}
+		else
+		{
+			os_files = ParallelDirList::listDir(tpath, (index_flags & EBackupDirFlag_OneFilesystem) > 0, has_error, err);
+		}
 		filterEncryptedFiles(path, orig_path, os_files);
 		fs_files = convertToFileAndHash(orig_path, named_path, exclude_dirs, include_dirs, os_files, fn_filter);
 
 		if (has_error)
 		{
-#ifdef _WIN32
-			int err = GetLastError();
-#else
-			int err = errno;
-#endif
-
 			bool root_exists = os_directory_exists(os_file_prefix(index_root_path)) ||
 				os_directory_exists(os_file_prefix(add_trailing_slash(index_root_path)));
 
@@ -2613,7 +2769,8 @@ std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::string &orig_pat
 		if (use_db_hashes)
 		{
 #ifndef _WIN32
-			if (calculate_filehashes_on_client)
+			if (calculate_filehashes_on_client
+				|| index_tracked_dir != NULL)
 			{
 #endif
 				has_files = cd->getFiles(path_lower, get_db_tgroup(), db_files, target_generation);
@@ -2689,8 +2846,9 @@ std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::string &orig_pat
 		else
 		{
 #ifndef _WIN32
-			if(calculate_filehashes_on_client
+			if( (calculate_filehashes_on_client
 				&& hasHash(fs_files) )
+				|| index_tracked_dir != NULL)
 			{
 #endif
 				addFilesInt(path_lower, get_db_tgroup(), fs_files);
@@ -2761,6 +2919,102 @@ std::vector<SFileAndHash> IndexThread::getFilesProxy(const std::string &orig_pat
 #endif
 }
 
+bool IndexThread::isDirChanged(const std::string& path_lower, bool& use_db)
+{
+#ifdef _WIN32
+	if(path_lower==strlower(Server->getServerWorkingDir())+os_file_sep()+"urbackup"+os_file_sep())
+	{
+		use_db=false;
+	}
+
+	return std::binary_search(changed_dirs.begin(), changed_dirs.end(), path_lower);
+#else
+	if(!isTrackedDir(path_lower))
+	{
+		use_db=false;
+		return true;
+	}
+
+	return std::binary_search(changed_dirs.begin(), changed_dirs.end(), path_lower);
+#endif
+}
+
+void IndexThread::queueDirLists(const std::string& orig_dir, const std::string& dir, const std::string& named_path, const std::vector<SFileAndHash>& files,
+	bool use_db, bool include_exclude_dirs, const std::vector<std::string>& exclude_dirs, const std::vector<SIndexInclude>& include_dirs)
+{
+	std::vector<std::string> paths;
+
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		if (!files[i].isdir
+			|| files[i].issym
+			|| files[i].isspecialf)
+		{
+			continue;
+		}
+
+		std::string orig_path = orig_dir + os_file_sep() + files[i].name;
+
+		if (include_exclude_dirs)
+		{
+			if (isExcluded(exclude_dirs, orig_path)
+				|| isExcluded(exclude_dirs, named_path + os_file_sep() + files[i].name))
+			{
+				continue;
+			}
+
+			bool adding_worthless1, adding_worthless2;
+			if (!isIncluded(include_dirs, orig_path, &adding_worthless1)
+				&& !isIncluded(include_dirs, named_path + os_file_sep() + files[i].name, &adding_worthless2)
+				&& adding_worthless1 && adding_worthless2)
+			{
+				continue;
+			}
+		}
+
+#ifndef _WIN32
+		std::string path_lower = orig_path + os_file_sep();
+#else
+		std::string path_lower = strlower(orig_path + os_file_sep());
+#endif
+
+		//Only directories getFilesProxy lists from the file system
+		bool dir_use_db = use_db;
+		if (!isDirChanged(path_lower, dir_use_db)
+			&& dir_use_db)
+		{
+			continue;
+		}
+
+		paths.push_back(os_file_prefix(dir + os_file_sep() + files[i].name));
+	}
+
+	if (!paths.empty())
+	{
+		dir_list->queueDirs(paths);
+	}
+}
+
+bool IndexThread::isTrackedDir(const std::string& path_lower)
+{
+	if (index_tracked_dir == NULL
+		|| !index_tracked_dir->use_changed_dirs
+		|| !next(path_lower, 0, index_tracked_dir->key))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < index_tracked_dir->untracked_dirs.size(); ++i)
+	{
+		if (next(path_lower, 0, index_tracked_dir->untracked_dirs[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 IPipe * IndexThread::getMsgPipe(void)
 {
 	return msgpipe;
@@ -6330,6 +6584,7 @@ void IndexThread::setFlags( unsigned int flags )
 	with_orig_path = (flags & flag_with_orig_path)>0;
 	with_sequence = (flags & flag_with_sequence)>0;
 	with_proper_symlinks = (flags & flag_with_proper_symlinks)>0;
+	binary_filelist = (flags & flag_binary_filelist)>0;
 }
 
 bool IndexThread::getAbsSymlinkTarget( const std::string& symlink, const std::string& orig_path,
@@ -7290,10 +7545,52 @@ void IndexThread::initParallelHashing(const std::string & async_ticket)
 	phash_queue_write_pos = 0;
 	os_create_dir(Server->getServerWorkingDir() + "urbackup" + os_file_sep() + "phash");
 	filesrv->shareDir("phash_{9c28ff72-5a74-487b-b5e1-8f1c96cd0cf4}", Server->getServerWorkingDir() + "/urbackup/phash", std::string(), true);
-	ParallelHash* phash = new ParallelHash(phash_queue->ref(), sha_version);
+	ParallelHash* phash = new ParallelHash(phash_queue->ref(), sha_version, getParallelHashWorkers());
 	filesrv->registerScriptPipeFile(fn, phash);
 }
 
+size_t IndexThread::getParallelHashWorkers()
+{
+	std::string settings_fn = "urbackup/data/settings.cfg";
+	if (!index_clientsubname.empty())
+	{
+		settings_fn = "urbackup/data/settings_" + conv_filename(index_clientsubname) + ".cfg";
+	}
+
+	std::auto_ptr<ISettingsReader> curr_settings(Server->createFileSettingsReader(settings_fn));
+
+	std::string val;
+	if (curr_settings.get() != NULL
+		&& (curr_settings->getValue("client_hash_threads", &val)
+			|| curr_settings->getValue("client_hash_threads_def", &val)))
+	{
+		return static_cast<size_t>((std::max)(1, watoi(val)));
+	}
+
+	return 2;
+}
+
+size_t IndexThread::getIndexWorkers()
+{
+	std::string settings_fn = "urbackup/data/settings.cfg";
+	if (!index_clientsubname.empty())
+	{
+		settings_fn = "urbackup/data/settings_" + conv_filename(index_clientsubname) + ".cfg";
+	}
+
+	std::auto_ptr<ISettingsReader> curr_settings(Server->createFileSettingsReader(settings_fn));
+
+	std::string val;
+	if (curr_settings.get() != NULL
+		&& (curr_settings->getValue("client_index_threads", &val)
+			|| curr_settings->getValue("client_index_threads_def", &val)))
+	{
+		return static_cast<size_t>((std::max)(1, watoi(val)));
+	}
+
+	return 4;
+}
+
 bool IndexThread::addToPhashQueue(CWData & data)
 {
 	_u32 msgsize = static_cast<_u32>(data.getDataSize());
@@ -11,6 +11,7 @@
 #include <map>
 #include "tokens.h"
 #include "ClientHash.h"
+#include "ParallelDirList.h"
 
 #ifdef _WIN32
 #ifndef VSS_XP
@@ -59,12 +60,14 @@ const unsigned int flag_calc_checksums = 8;
 const unsigned int flag_with_orig_path = 16;
 const unsigned int flag_with_sequence = 32;
 const unsigned int flag_with_proper_symlinks = 64;
+const unsigned int flag_binary_filelist = 128;
 
 const uint64 change_indicator_symlink_bit = 0x4000000000000000ULL;
 const uint64 change_indicator_special_bit = 0x2000000000000000ULL;
 const uint64 change_indicator_all_bits = change_indicator_symlink_bit | change_indicator_special_bit;
 
 class DirectoryWatcherThread;
+class InotifyWatcherThread;
 
 class IdleCheckerThread : public IThread
 {
@@ -240,6 +243,15 @@ struct SIndexInclude
 	std::string prefix;
 };
 
+struct STrackedBackupDir
+{
+	std::string key;
+	//false if there was a gap. Directories are listed, but the changes
+	//are recorded in the database
+	bool use_changed_dirs;
+	std::vector<std::string> untracked_dirs;
+};
+
 class IVssBackupComponents;
 
 struct SVssInstance
@@ -406,9 +418,16 @@ private:
 	static std::string sanitizePattern(const std::string &p);	
 
 	std::vector<SFileAndHash> getFilesProxy(const std::string &orig_path, std::string path, const std::string& named_path, bool use_db, const std::string& fn_filter, bool use_db_hashes,
-		const std::vector<std::string>& exclude_dirs,
+		const std::vector<std::string>& exclude_dirs,
 		const std::vector<SIndexInclude>& include_dirs, int64& target_generation);
 
+	bool isTrackedDir(const std::string& path_lower);
+
+	bool isDirChanged(const std::string& path_lower, bool& use_db);
+
+	void queueDirLists(const std::string& orig_dir, const std::string& dir, const std::string& named_path, const std::vector<SFileAndHash>& files,
+		bool use_db, bool include_exclude_dirs, const std::vector<std::string>& exclude_dirs, const std::vector<SIndexInclude>& include_dirs);
+
 	bool start_shadowcopy(SCDirs *dir, bool *onlyref=NULL, bool allow_restart=false, bool simultaneous_other=true, std::vector<SCRef*> no_restart_refs=std::vector<SCRef*>(),
 		bool for_imagebackup=false, bool *stale_shadowcopy=NULL, bool* not_configured=NULL, bool* has_active_transaction=NULL);
 
@@ -574,6 +593,10 @@ private:
 
 	void initParallelHashing(const std::string& async_ticket);
 
+	size_t getParallelHashWorkers();
+
+	size_t getIndexWorkers();
+
 	bool addToPhashQueue(CWData& data);
 
 	bool commitPhashQueue();
@@ -610,6 +633,11 @@ private:
 	DirectoryWatcherThread *dwt;
 	THREADPOOL_TICKET dwt_ticket;
 
+	InotifyWatcherThread *iwt;
+	THREADPOOL_TICKET iwt_ticket;
+	std::vector<STrackedBackupDir> tracked_backup_dirs;
+	const STrackedBackupDir* index_tracked_dir;
+
 	std::map<SCDirServerKey, std::map<std::string, SCDirs*> > scdirs;
 	std::vector<SCRef*> sc_refs;
 
@@ -665,6 +693,7 @@ private:
 	bool with_orig_path;
 	bool with_sequence;
 	bool with_proper_symlinks;
+	bool binary_filelist;
 
 	int64 last_tmp_update_time;
 
@@ -736,6 +765,8 @@ private:
 
 	std::auto_ptr<SLastFileList> last_filelist;
 
+	std::auto_ptr<ParallelDirList> dir_list;
+
 	std::vector<SReadError> read_errors;
 	IMutex* read_error_mutex;
 
@@ -17,6 +17,7 @@
 **************************************************************************/
 
 #include "clientdao.h"
+#include "dir_cache_data.h"
 #include "../stringtools.h"
 #include "../Interface/Server.h"
 #include <memory.h>
@@ -165,6 +166,22 @@ std::string ClientDAO::escapeGlob(const std::string& glob)
 }
 
 bool ClientDAO::getFiles(std::string path, int tgroup, std::vector<SFileAndHash> &data, int64& generation)
+{
+	std::string qdata;
+	if(!getFilesData(path, tgroup, qdata, generation))
+		return false;
+
+	if(!readDirCacheData(qdata.data(), qdata.size(), data))
+	{
+		Server->Log("Error reading cached file list of \""+path+"\"", LL_WARNING);
+		data.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool ClientDAO::getFilesData(std::string path, int tgroup, std::string &data, int64& generation)
 {
 	q_get_files->Bind(path);
 	q_get_files->Bind(tgroup);
@@ -175,141 +192,11 @@ bool ClientDAO::getFiles(std::string path, int tgroup, std::vector<SFileAndHash>
 
 	generation = watoi64(res[0]["generation"]);
 
-	std::string &qdata=res[0]["data"];
-
-	if(qdata.empty())
-		return true;
-
-	int num=watoi(res[0]["num"]);
-	char *ptr=(char*)&qdata[0];
-	while(ptr-(char*)&qdata[0]<num)
-	{
-		SFileAndHash f;
-		unsigned short ss;
-		memcpy(&ss, ptr, sizeof(unsigned short));
-		ptr+=sizeof(unsigned short);
-		std::string tmp;
-		tmp.resize(ss);
-		memcpy(&tmp[0], ptr, ss);
-		f.name=(tmp);
-		ptr+=ss;
-		memcpy(&f.size, ptr, sizeof(int64));
-		ptr+=sizeof(int64);
-		memcpy(&f.change_indicator, ptr, sizeof(uint64));
-		ptr+=sizeof(uint64);
-		char isdir=*ptr;
-		++ptr;
-		if(isdir==0)
-			f.isdir=false;
-		else
-			f.isdir=true;
-		
-		unsigned short hashsize;
-		memcpy(&hashsize, ptr, sizeof(unsigned short));
-		ptr+=sizeof(unsigned short);
-
-		f.hash.resize(hashsize);
-		if(hashsize>0)
-		{
-			memcpy(&f.hash[0], ptr, hashsize);
-		}
-
-		ptr+=hashsize;
-
-		char issym=*ptr;
-		++ptr;
-		f.issym=issym==0?false:true;
-
-		char isspecialf=*ptr;
-		++ptr;
-		f.isspecialf= isspecialf ==0?false:true;
-
+	data.swap(res[0]["data"]);
 
-		if(f.issym)
-		{
-			memcpy(&ss, ptr, sizeof(unsigned short));
-			ptr+=sizeof(unsigned short);
-			if(ss>0)
-			{
-				tmp.resize(ss);
-				memcpy(&tmp[0], ptr, ss);
-				f.symlink_target=(tmp);
-				ptr+=ss;
-			}			
-		}
-
-		data.push_back(f);
-	}
 	return true;
 }
 
-char * constructData(const std::vector<SFileAndHash> &data, size_t &datasize)
-{
-	datasize=0;
-	std::vector<std::string> utf;
-	utf.resize(data.size());
-	for(size_t i=0;i<data.size();++i)
-	{
-		utf[i]=(data[i].name);
-		datasize+=utf[i].size();
-		datasize+=sizeof(unsigned short);
-		datasize+=sizeof(int64)*2;
-		++datasize; //isdir
-		datasize+=sizeof(unsigned short);
-		datasize+=data[i].hash.size();
-		++datasize; //issym
-		++datasize; //isspecial
-		if(data[i].issym)
-		{
-			datasize+=sizeof(unsigned short);
-			datasize+=(data[i].symlink_target).size();
-		}
-	}
-	char *buffer=new char[datasize];
-	char *ptr=buffer;
-	for(size_t i=0;i<data.size();++i)
-	{
-		unsigned short ss=(unsigned short)utf[i].size();
-		memcpy(ptr, (char*)&ss, sizeof(unsigned short));
-		ptr+=sizeof(unsigned short);
-		memcpy(ptr, &utf[i][0], ss);
-		ptr+=ss;
-		memcpy(ptr, (char*)&data[i].size, sizeof(int64));
-		ptr+=sizeof(int64);
-		memcpy(ptr, (char*)&data[i].change_indicator, sizeof(uint64));
-		ptr+=sizeof(uint64);
-		char isdir=1;
-		if(!data[i].isdir)
-			isdir=0;
-		*ptr=isdir;
-		ptr+=sizeof(char);
-		unsigned short hashsize=static_cast<unsigned short>(data[i].hash.size());
-		memcpy(ptr, &hashsize, sizeof(hashsize));
-		ptr+=sizeof(hashsize);
-		memcpy(ptr, data[i].hash.data(), hashsize);
-		ptr+=hashsize;
-		char issym = data[i].issym?1:0;
-		*ptr=issym;
-		++ptr;
-		char isspecialf = data[i].isspecialf?1:0;
-		*ptr= isspecialf ?1:0;
-		++ptr;
-		if(data[i].issym)
-		{
-			std::string symlink_target = (data[i].symlink_target);
-			ss=(unsigned short)symlink_target.size();
-			memcpy(ptr, (char*)&ss, sizeof(unsigned short));
-			ptr+=sizeof(unsigned short);
-			if(ss>0)
-			{
-				memcpy(ptr, &symlink_target[0], ss);
-			}
-			ptr+=ss;
-		}
-	}
-	return buffer;
-}
-
 std::string guidToString( GUID guid )
 {
 	return bytesToHex(reinterpret_cast<unsigned char*>(&guid), sizeof(guid));
@@ -324,30 +211,26 @@ GUID randomGuid()
 
 void ClientDAO::addFiles(std::string path, int tgroup, const std::vector<SFileAndHash> &data)
 {
-	size_t ds;
-	char *buffer=constructData(data, ds);
+	std::string buffer=constructDirCacheData(data);
 	q_add_files->Bind(path);
 	q_add_files->Bind(tgroup);
-	q_add_files->Bind(ds);
-	q_add_files->Bind(buffer, (_u32)ds);
+	q_add_files->Bind(buffer.size());
+	q_add_files->Bind(buffer.data(), (_u32)buffer.size());
 	q_add_files->Write();
 	q_add_files->Reset();
-	delete []buffer;
 }
 
 void ClientDAO::modifyFiles(std::string path, int tgroup, const std::vector<SFileAndHash> &data, int64 target_generation)
 {
-	size_t ds;
-	char *buffer=constructData(data, ds);
-	q_modify_files->Bind(buffer, (_u32)ds);
-	q_modify_files->Bind(ds);
+	std::string buffer=constructDirCacheData(data);
+	q_modify_files->Bind(buffer.data(), (_u32)buffer.size());
+	q_modify_files->Bind(buffer.size());
 	q_modify_files->Bind(target_generation+1);
 	q_modify_files->Bind(path);
 	q_modify_files->Bind(tgroup);
 	q_modify_files->Bind(target_generation);
 	q_modify_files->Write();
 	q_modify_files->Reset();
-	delete []buffer;
 }
 
 bool ClientDAO::hasFiles(std::string path, int tgroup)
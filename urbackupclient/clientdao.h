@@ -121,6 +121,8 @@ public:
 	}
 
 	bool getFiles(std::string path, int tgroup, std::vector<SFileAndHash> &data, int64& generation);
+	//Undecoded listing. Single entries can be looked up with findDirCacheEntry
+	bool getFilesData(std::string path, int tgroup, std::string &data, int64& generation);
 
 	void addFiles(std::string path, int tgroup, const std::vector<SFileAndHash> &data);
 	void modifyFiles(std::string path, int tgroup, const std::vector<SFileAndHash> &data, int64 target_generation);
@@ -0,0 +1,508 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "dir_cache_data.h"
+#include "../common/data.h"
+#include <memory.h>
+#include <algorithm>
+
+namespace
+{
+	enum EColumn
+	{
+		EColumn_Flags = 0,
+		EColumn_Names = 1,
+		EColumn_Sizes = 2,
+		EColumn_ChangeIndicators = 3,
+		EColumn_Hashes = 4,
+		EColumn_SymlinkTargets = 5,
+		EColumn_BlockIndex = 6,
+		EColumn_Count = 7
+	};
+
+	//Columns with an offset per block in the block index
+	const size_t c_block_index_columns = 5;
+
+	struct SDirCacheHeader
+	{
+		char flags;
+		int64 num;
+		unsigned int offsets[EColumn_Count];
+	};
+
+	struct SDirCacheColumns
+	{
+		CRData flags;
+		CRData names;
+		CRData sizes;
+		CRData change_indicators;
+		CRData hashes;
+		CRData symlink_targets;
+	};
+
+	int64 zigzagEncode(int64 v)
+	{
+		return static_cast<int64>((static_cast<uint64>(v) << 1) ^ static_cast<uint64>(v >> 63));
+	}
+
+	int64 zigzagDecode(int64 v)
+	{
+		return static_cast<int64>(static_cast<uint64>(v) >> 1) ^ -(v & 1);
+	}
+
+	bool readHeader(const char* data, size_t data_size, SDirCacheHeader& header)
+	{
+		if (data_size < c_dir_cache_magic_size
+			|| memcmp(data, c_dir_cache_magic, c_dir_cache_magic_size) != 0)
+		{
+			return false;
+		}
+
+		CRData rdata(data + c_dir_cache_magic_size, data_size - c_dir_cache_magic_size);
+
+		if (!rdata.getChar(&header.flags)
+			|| !rdata.getVarInt(&header.num)
+			|| header.num < 0)
+		{
+			return false;
+		}
+
+		unsigned int last_offset = 0;
+		for (size_t i = 0; i < EColumn_Count; ++i)
+		{
+			if (!rdata.getUInt(&header.offsets[i])
+				|| header.offsets[i] < last_offset
+				|| header.offsets[i] > data_size)
+			{
+				return false;
+			}
+			last_offset = header.offsets[i];
+		}
+
+		return true;
+	}
+
+	void initColumns(const char* data, size_t data_size, const SDirCacheHeader& header, SDirCacheColumns& columns)
+	{
+		const unsigned int* offsets = header.offsets;
+		columns.flags.set(data + offsets[EColumn_Flags], offsets[EColumn_Names] - offsets[EColumn_Flags]);
+		columns.names.set(data + offsets[EColumn_Names], offsets[EColumn_Sizes] - offsets[EColumn_Names]);
+		columns.sizes.set(data + offsets[EColumn_Sizes], offsets[EColumn_ChangeIndicators] - offsets[EColumn_Sizes]);
+		columns.change_indicators.set(data + offsets[EColumn_ChangeIndicators], offsets[EColumn_Hashes] - offsets[EColumn_ChangeIndicators]);
+		columns.hashes.set(data + offsets[EColumn_Hashes], offsets[EColumn_SymlinkTargets] - offsets[EColumn_Hashes]);
+		columns.symlink_targets.set(data + offsets[EColumn_SymlinkTargets], offsets[EColumn_BlockIndex] - offsets[EColumn_SymlinkTargets]);
+	}
+
+	//Reads the next entry. file has to contain the previous entry, as names
+	//and change indicators are stored relative to it
+	bool readEntry(SDirCacheColumns& columns, bool block_start, SFileAndHash& file)
+	{
+		char flags;
+		int64 shared_prefix;
+		std::string suffix;
+		int64 change_indicator;
+
+		if (!columns.flags.getChar(&flags)
+			|| !columns.names.getVarInt(&shared_prefix)
+			|| shared_prefix < 0
+			|| static_cast<size_t>(shared_prefix) > file.name.size()
+			|| !columns.names.getStr2(&suffix)
+			|| !columns.sizes.getVarInt(&file.size)
+			|| !columns.change_indicators.getVarInt(&change_indicator)
+			|| !columns.hashes.getStr2(&file.hash))
+		{
+			return false;
+		}
+
+		file.name.resize(static_cast<size_t>(shared_prefix));
+		file.name += suffix;
+
+		uint64 change_indicator_diff = static_cast<uint64>(zigzagDecode(change_indicator));
+		if (block_start)
+		{
+			file.change_indicator = change_indicator_diff;
+		}
+		else
+		{
+			file.change_indicator += change_indicator_diff;
+		}
+
+		file.isdir = (flags & dir_cache_flag_dir) != 0;
+		file.issym = (flags & dir_cache_flag_sym) != 0;
+		file.isspecialf = (flags & dir_cache_flag_special) != 0;
+		file.nlinks = 0;
+
+		if (file.issym)
+		{
+			if (!columns.symlink_targets.getStr2(&file.symlink_target))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			file.symlink_target.clear();
+		}
+
+		return true;
+	}
+
+	//Positions the columns at the first entry of a block
+	bool seekBlock(const char* data, size_t data_size, const SDirCacheHeader& header, SDirCacheColumns& columns, size_t block)
+	{
+		CRData block_index(data + header.offsets[EColumn_BlockIndex], data_size - header.offsets[EColumn_BlockIndex]);
+		block_index.setStreampos(static_cast<unsigned int>(block*c_block_index_columns*sizeof(unsigned int)));
+
+		unsigned int offsets[c_block_index_columns];
+		for (size_t i = 0; i < c_block_index_columns; ++i)
+		{
+			if (!block_index.getUInt(&offsets[i]))
+			{
+				return false;
+			}
+		}
+
+		columns.flags.setStreampos(static_cast<unsigned int>(block*c_dir_cache_block_size));
+		columns.names.setStreampos(offsets[0]);
+		columns.sizes.setStreampos(offsets[1]);
+		columns.change_indicators.setStreampos(offsets[2]);
+		columns.hashes.setStreampos(offsets[3]);
+		columns.symlink_targets.setStreampos(offsets[4]);
+
+		return columns.flags.getStreampos() <= columns.flags.getSize()
+			&& offsets[0] <= columns.names.getSize()
+			&& offsets[1] <= columns.sizes.getSize()
+			&& offsets[2] <= columns.change_indicators.getSize()
+			&& offsets[3] <= columns.hashes.getSize()
+			&& offsets[4] <= columns.symlink_targets.getSize();
+	}
+
+	//Name of the first entry in a block
+	bool readBlockName(const char* data, size_t data_size, const SDirCacheHeader& header, size_t block, std::string& name)
+	{
+		CRData block_index(data + header.offsets[EColumn_BlockIndex], data_size - header.offsets[EColumn_BlockIndex]);
+		block_index.setStreampos(static_cast<unsigned int>(block*c_block_index_columns*sizeof(unsigned int)));
+
+		unsigned int names_offset;
+		if (!block_index.getUInt(&names_offset))
+		{
+			return false;
+		}
+
+		CRData names(data + header.offsets[EColumn_Names], header.offsets[EColumn_Sizes] - header.offsets[EColumn_Names]);
+		if (names_offset > names.getSize())
+		{
+			return false;
+		}
+		names.setStreampos(names_offset);
+
+		int64 shared_prefix;
+		return names.getVarInt(&shared_prefix)
+			&& shared_prefix == 0
+			&& names.getStr2(&name);
+	}
+
+	bool readLegacyDirCacheData(const char* data, size_t data_size, std::vector<SFileAndHash>& files)
+	{
+		const char* ptr = data;
+		const char* end = data + data_size;
+		while (ptr < end)
+		{
+			SFileAndHash f;
+			unsigned short ss;
+			if (static_cast<size_t>(end - ptr) < sizeof(unsigned short))
+				return false;
+			memcpy(&ss, ptr, sizeof(unsigned short));
+			ptr += sizeof(unsigned short);
+			if (static_cast<size_t>(end - ptr) < ss + sizeof(int64) + sizeof(uint64) + 1 + sizeof(unsigned short))
+				return false;
+			f.name.assign(ptr, ss);
+			ptr += ss;
+			memcpy(&f.size, ptr, sizeof(int64));
+			ptr += sizeof(int64);
+			memcpy(&f.change_indicator, ptr, sizeof(uint64));
+			ptr += sizeof(uint64);
+			f.isdir = *ptr != 0;
+			++ptr;
+
+			unsigned short hashsize;
+			memcpy(&hashsize, ptr, sizeof(unsigned short));
+			ptr += sizeof(unsigned short);
+
+			if (static_cast<size_t>(end - ptr) < hashsize + 2u)
+				return false;
+			f.hash.assign(ptr, hashsize);
+			ptr += hashsize;
+
+			f.issym = *ptr != 0;
+			++ptr;
+			f.isspecialf = *ptr != 0;
+			++ptr;
+			f.nlinks = 0;
+
+			if (f.issym)
+			{
+				if (static_cast<size_t>(end - ptr) < sizeof(unsigned short))
+					return false;
+				memcpy(&ss, ptr, sizeof(unsigned short));
+				ptr += sizeof(unsigned short);
+				if (static_cast<size_t>(end - ptr) < ss)
+					return false;
+				f.symlink_target.assign(ptr, ss);
+				ptr += ss;
+			}
+
+			files.push_back(f);
+		}
+		return true;
+	}
+}
+
+std::string constructDirCacheData(const std::vector<SFileAndHash>& data)
+{
+	if (data.empty())
+	{
+		return std::string();
+	}
+
+	CWData flags;
+	CWData names;
+	CWData sizes;
+	CWData change_indicators;
+	CWData hashes;
+	CWData symlink_targets;
+	CWData block_index;
+
+	bool sorted = true;
+
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		const SFileAndHash& f = data[i];
+		bool block_start = i%c_dir_cache_block_size == 0;
+
+		if (block_start)
+		{
+			block_index.addUInt(names.getDataSize());
+			block_index.addUInt(sizes.getDataSize());
+			block_index.addUInt(change_indicators.getDataSize());
+			block_index.addUInt(hashes.getDataSize());
+			block_index.addUInt(symlink_targets.getDataSize());
+		}
+
+		char fflags = 0;
+		if (f.isdir) fflags |= dir_cache_flag_dir;
+		if (f.issym) fflags |= dir_cache_flag_sym;
+		if (f.isspecialf) fflags |= dir_cache_flag_special;
+		flags.addChar(fflags);
+
+		size_t shared_prefix = 0;
+		if (i > 0)
+		{
+			const std::string& prev_name = data[i - 1].name;
+
+			if (f.name < prev_name)
+			{
+				sorted = false;
+			}
+
+			if (!block_start)
+			{
+				size_t max_prefix = (std::min)(prev_name.size(), f.name.size());
+				while (shared_prefix < max_prefix
+					&& prev_name[shared_prefix] == f.name[shared_prefix])
+				{
+					++shared_prefix;
+				}
+			}
+		}
+
+		names.addVarInt(shared_prefix);
+		names.addString2(f.name.substr(shared_prefix));
+
+		sizes.addVarInt(f.size);
+
+		uint64 change_indicator_diff = f.change_indicator;
+		if (!block_start)
+		{
+			change_indicator_diff -= data[i - 1].change_indicator;
+		}
+		change_indicators.addVarInt(zigzagEncode(static_cast<int64>(change_indicator_diff)));
+
+		hashes.addString2(f.hash);
+
+		if (f.issym)
+		{
+			symlink_targets.addString2(f.symlink_target);
+		}
+	}
+
+	CWData header;
+	header.addBuffer(c_dir_cache_magic, c_dir_cache_magic_size);
+	header.addChar(sorted ? dir_cache_sorted : 0);
+	header.addVarInt(data.size());
+
+	CWData* columns[] = { &flags, &names, &sizes, &change_indicators, &hashes, &symlink_targets, &block_index };
+
+	unsigned int offset = header.getDataSize() + EColumn_Count * sizeof(unsigned int);
+	for (size_t i = 0; i < EColumn_Count; ++i)
+	{
+		header.addUInt(offset);
+		offset += columns[i]->getDataSize();
+	}
+
+	std::string ret;
+	ret.reserve(offset);
+	ret.assign(header.getDataPtr(), header.getDataSize());
+	for (size_t i = 0; i < EColumn_Count; ++i)
+	{
+		ret.append(columns[i]->getDataPtr(), columns[i]->getDataSize());
+	}
+
+	return ret;
+}
+
+bool readDirCacheData(const char* data, size_t data_size, std::vector<SFileAndHash>& files)
+{
+	if (data_size == 0)
+	{
+		return true;
+	}
+
+	if (isLegacyDirCacheData(data, data_size))
+	{
+		return readLegacyDirCacheData(data, data_size, files);
+	}
+
+	SDirCacheHeader header;
+	if (!readHeader(data, data_size, header))
+	{
+		return false;
+	}
+
+	SDirCacheColumns columns;
+	initColumns(data, data_size, header, columns);
+
+	files.reserve(files.size() + static_cast<size_t>((std::min)(header.num, static_cast<int64>(data_size))));
+
+	SFileAndHash f;
+	for (int64 i = 0; i < header.num; ++i)
+	{
+		if (!readEntry(columns, i%c_dir_cache_block_size == 0, f))
+		{
+			return false;
+		}
+
+		files.push_back(f);
+	}
+
+	return true;
+}
+
+bool findDirCacheEntry(const char* data, size_t data_size, const std::string& name, SFileAndHash& file)
+{
+	SDirCacheHeader header;
+	if (isLegacyDirCacheData(data, data_size)
+		|| !readHeader(data, data_size, header)
+		|| !(header.flags & dir_cache_sorted))
+	{
+		std::vector<SFileAndHash> files;
+		if (!readDirCacheData(data, data_size, files))
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			if (files[i].name == name)
+			{
+				file = files[i];
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	size_t num = static_cast<size_t>(header.num);
+	size_t n_blocks = (num + c_dir_cache_block_size - 1) / c_dir_cache_block_size;
+
+	//Last block with a first name not larger than name
+	size_t lo = 0;
+	size_t hi = n_blocks;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		std::string block_name;
+		if (!readBlockName(data, data_size, header, mid, block_name))
+		{
+			return false;
+		}
+
+		if (name < block_name)
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid + 1;
+		}
+	}
+
+	if (lo == 0)
+	{
+		return false;
+	}
+
+	size_t block = lo - 1;
+
+	SDirCacheColumns columns;
+	initColumns(data, data_size, header, columns);
+	if (!seekBlock(data, data_size, header, columns, block))
+	{
+		return false;
+	}
+
+	SFileAndHash f;
+	size_t block_end = (std::min)(num, (block + 1)*c_dir_cache_block_size);
+	for (size_t i = block*c_dir_cache_block_size; i < block_end; ++i)
+	{
+		if (!readEntry(columns, i == block*c_dir_cache_block_size, f))
+		{
+			return false;
+		}
+
+		if (f.name == name)
+		{
+			file = f;
+			return true;
+		}
+		else if (name < f.name)
+		{
+			return false;
+		}
+	}
+
+	return false;
+}
+
+bool isLegacyDirCacheData(const char* data, size_t data_size)
+{
+	return data_size > 0
+		&& (data_size < 2
+			|| memcmp(data, c_dir_cache_magic, 2) != 0);
+}
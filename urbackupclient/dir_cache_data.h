@@ -0,0 +1,41 @@
+#pragma once
+
+#include "clientdao.h"
+#include <string>
+#include <vector>
+
+//Format of the directory listings in the files table (column data).
+//Header: c_dir_cache_magic (two bytes that cannot start a legacy listing,
+//   as that would be a 65535 byte file name, followed by the version), flags,
+//   varint number of entries, then _u32 offsets of the columns in the order below.
+//Columns, each entry in the order of the listing:
+//   flags: one byte per entry (dir_cache_flag_*)
+//   names: varint length of the prefix shared with the previous name, suffix as varint size and data
+//   sizes: varint
+//   change indicators: zig-zag encoded varint difference to the previous entry
+//   hashes: varint size and data
+//   symlink targets: varint size and data, only for symlinks
+//Block index: for every c_dir_cache_block_size entries the _u32 offsets of the first entry in the
+//   names, sizes, change indicator, hash and symlink target columns (relative to the column).
+//   The first entry of a block shares no prefix and has an absolute change indicator.
+//If the listing is sorted by name (dir_cache_sorted), entries can be found with a binary search
+//over the block index without decoding the listing. Fixed size integers are little endian.
+const char c_dir_cache_magic[] = "\xff\xff\x01";
+const size_t c_dir_cache_magic_size = 3;
+const size_t c_dir_cache_block_size = 16;
+
+const char dir_cache_sorted = 1;
+
+const char dir_cache_flag_dir = 1;
+const char dir_cache_flag_sym = 2;
+const char dir_cache_flag_special = 4;
+
+std::string constructDirCacheData(const std::vector<SFileAndHash>& data);
+
+//Reads the current and the legacy format
+bool readDirCacheData(const char* data, size_t data_size, std::vector<SFileAndHash>& files);
+
+//Finds a single entry without decoding the whole listing (if it is sorted)
+bool findDirCacheEntry(const char* data, size_t data_size, const std::string& name, SFileAndHash& file);
+
+bool isLegacyDirCacheData(const char* data, size_t data_size);
@@ -66,9 +66,13 @@ extern IServer* Server;
 #include "DirectoryWatcherThread.h"
 #include "win_sysvol.h"
 #endif
+#ifdef __linux__
+#include "InotifyWatcherThread.h"
+#endif
 #include "InternetClient.h"
 #include <stdlib.h>
 #include "file_permissions.h"
+#include "dir_cache_data.h"
 
 #include "../urbackupcommon/chunk_hasher.h"
 #include "../urbackupcommon/WalCheckpointThread.h"
@@ -229,6 +233,8 @@ DLLEXPORT void LoadActions(IServer* pServer)
 	ServerIdentityMgr::init_mutex();
 #ifdef _WIN32
 	DirectoryWatcherThread::init_mutex();
+#elif defined(__linux__)
+	InotifyWatcherThread::init_mutex();
 #endif
 
 	if(getFile(pw_file).size()<5)
@@ -252,6 +258,13 @@ DLLEXPORT void LoadActions(IServer* pServer)
 	str_map db_params;
 	db_params["wal_autocheckpoint"] = "0";
 
+	std::string sqlite_mmap = Server->getServerParameter("sqlite_mmap");
+	if (!sqlite_mmap.empty())
+	{
+		//Cached file lists are then read directly from the mapped database file
+		db_params["mmap_size"] = sqlite_mmap;
+	}
+
 	if(! Server->openDatabase("urbackup/backup_client.db", URBACKUPDB_CLIENT, db_params) )
 	{
 		Server->Log("Couldn't open Database backup_client.db", LL_ERROR);
@@ -620,6 +633,54 @@ void update_client26_27(IDatabase* db)
 	db->Write("ALTER TABLE files ADD generation INTEGER DEFAULT 0");
 }
 
+void update_client27_28(IDatabase* db)
+{
+	//Convert the cached file lists to the columnar format
+	IQuery* q_read = db->Prepare("SELECT rowid AS id, data FROM files WHERE rowid>? ORDER BY rowid ASC LIMIT 1000", false);
+	IQuery* q_update = db->Prepare("UPDATE files SET data=?, num=? WHERE rowid=?", false);
+	IQuery* q_delete = db->Prepare("DELETE FROM files WHERE rowid=?", false);
+
+	int64 last_id = 0;
+	db_results res;
+	do
+	{
+		q_read->Bind(last_id);
+		res = q_read->Read();
+		q_read->Reset();
+
+		for (size_t i = 0; i < res.size(); ++i)
+		{
+			last_id = watoi64(res[i]["id"]);
+			const std::string& data = res[i]["data"];
+
+			if (!isLegacyDirCacheData(data.data(), data.size()))
+			{
+				continue;
+			}
+
+			std::vector<SFileAndHash> files;
+			if (!readDirCacheData(data.data(), data.size(), files))
+			{
+				q_delete->Bind(last_id);
+				q_delete->Write();
+				q_delete->Reset();
+				continue;
+			}
+
+			std::string new_data = constructDirCacheData(files);
+			q_update->Bind(new_data.data(), static_cast<_u32>(new_data.size()));
+			q_update->Bind(new_data.size());
+			q_update->Bind(last_id);
+			q_update->Write();
+			q_update->Reset();
+		}
+	} while (!res.empty());
+
+	db->destroyQuery(q_read);
+	db->destroyQuery(q_update);
+	db->destroyQuery(q_delete);
+}
+
 bool upgrade_client(void)
 {
 	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_CLIENT);
@@ -631,7 +692,7 @@ bool upgrade_client(void)
 		return false;
 	int ver=watoi(res_v[0]["tvalue"]);
 	int old_v;
-	int max_v = 27;
+	int max_v = 28;
 
 	if (ver > max_v)
 	{
@@ -759,6 +820,10 @@ bool upgrade_client(void)
 				update_client26_27(db);
 				++ver;
 				break;
+			case 27:
+				update_client27_28(db);
+				++ver;
+				break;
 			default:
 				break;
 		}
@@ -0,0 +1,810 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "CompressedPipe3.h"
+#include "../Interface/Server.h"
+#include "../Interface/Mutex.h"
+#include "../stringtools.h"
+#include "InternetServicePipe2.h"
+#include "internet_pipe_capabilities.h"
+#include <memory.h>
+#include <string.h>
+#include <assert.h>
+#include <stdexcept>
+#include <algorithm>
+#include <zlib.h>
+#ifdef WITH_ZSTD_COMPRESSION
+#include <zstd.h>
+#endif
+#ifdef WITH_LZ4_COMPRESSION
+#include <lz4frame.h>
+#endif
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace
+{
+	const size_t max_send_size=20000;
+	const size_t output_incr_size=8192;
+	const size_t output_max_size=32*1024;
+
+	int64 getThreadCpuTime()
+	{
+#ifdef _WIN32
+		FILETIME creation_time, exit_time, kernel_time, user_time;
+		if(!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time))
+		{
+			return 0;
+		}
+		ULARGE_INTEGER kt, ut;
+		kt.LowPart=kernel_time.dwLowDateTime;
+		kt.HighPart=kernel_time.dwHighDateTime;
+		ut.LowPart=user_time.dwLowDateTime;
+		ut.HighPart=user_time.dwHighDateTime;
+		return static_cast<int64>((kt.QuadPart+ut.QuadPart)/10);
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+		timespec ts;
+		if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)!=0)
+		{
+			return 0;
+		}
+		return static_cast<int64>(ts.tv_sec)*1000000+ts.tv_nsec/1000;
+#else
+		return 0;
+#endif
+	}
+}
+
+class CompressedPipe3::ICodec
+{
+public:
+	virtual ~ICodec() {}
+
+	//Compresses from in to out and advances both. Returns 1 if it has to be
+	//called again with more output space, 0 if all input is consumed (and
+	//flushed, if flush is set) and -1 on error
+	virtual int compress(const char*& in, size_t& in_avail, char*& out, size_t& out_avail, bool flush)=0;
+
+	//Decompresses from in to out and advances both. Returns false on error
+	virtual bool decompress(const char*& in, size_t& in_avail, char*& out, size_t& out_avail)=0;
+};
+
+namespace
+{
+	class ZlibCodec : public CompressedPipe3::ICodec
+	{
+	public:
+		ZlibCodec(int compression_level)
+		{
+			memset(&inf_stream, 0, sizeof(z_stream));
+			memset(&def_stream, 0, sizeof(z_stream));
+
+			if(deflateInit(&def_stream, compression_level)!=Z_OK)
+			{
+				throw std::runtime_error("Error initializing compression stream");
+			}
+			if(inflateInit(&inf_stream)!=Z_OK)
+			{
+				deflateEnd(&def_stream);
+				throw std::runtime_error("Error initializing decompression stream");
+			}
+		}
+
+		~ZlibCodec()
+		{
+			deflateEnd(&def_stream);
+			inflateEnd(&inf_stream);
+		}
+
+		virtual int compress(const char*& in, size_t& in_avail, char*& out, size_t& out_avail, bool flush)
+		{
+			def_stream.next_in=const_cast<Bytef*>(reinterpret_cast<const Bytef*>(in));
+			def_stream.avail_in=static_cast<unsigned int>(in_avail);
+			def_stream.next_out=reinterpret_cast<Bytef*>(out);
+			def_stream.avail_out=static_cast<unsigned int>(out_avail);
+
+			int rc=deflate(&def_stream, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+
+			if(rc!=Z_OK && rc!=Z_STREAM_END && rc!=Z_BUF_ERROR)
+			{
+				Server->Log("Error compressing stream: "+convert(rc)
+					+ (def_stream.msg != NULL ? (" Err: " + std::string(def_stream.msg)) : ""), LL_ERROR);
+				return -1;
+			}
+
+			in+=in_avail-def_stream.avail_in;
+			in_avail=def_stream.avail_in;
+			out+=out_avail-def_stream.avail_out;
+			out_avail=def_stream.avail_out;
+
+			return out_avail==0 ? 1 : 0;
+		}
+
+		virtual bool decompress(const char*& in, size_t& in_avail, char*& out, size_t& out_avail)
+		{
+			inf_stream.next_in=const_cast<Bytef*>(reinterpret_cast<const Bytef*>(in));
+			inf_stream.avail_in=static_cast<unsigned int>(in_avail);
+			inf_stream.next_out=reinterpret_cast<Bytef*>(out);
+			inf_stream.avail_out=static_cast<unsigned int>(out_avail);
+
+			int rc=inflate(&inf_stream, Z_SYNC_FLUSH);
+
+			if(rc!=Z_OK && rc!=Z_STREAM_END && rc!=Z_BUF_ERROR /*Needs more input*/)
+			{
+				Server->Log("Error decompressing stream: " + convert(rc)
+					+ (inf_stream.msg != NULL ? (" Err: " + std::string(inf_stream.msg)) : ""), LL_ERROR);
+				return false;
+			}
+
+			in+=in_avail-inf_stream.avail_in;
+			in_avail=inf_stream.avail_in;
+			out+=out_avail-inf_stream.avail_out;
+			out_avail=inf_stream.avail_out;
+
+			return true;
+		}
+
+	private:
+		z_stream inf_stream;
+		z_stream def_stream;
+	};
+
+#ifdef WITH_ZSTD_COMPRESSION
+	class ZstdCodec : public CompressedPipe3::ICodec
+	{
+	public:
+		ZstdCodec(int compression_level)
+			: cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx())
+		{
+			if(cctx==NULL || dctx==NULL)
+			{
+				ZSTD_freeCCtx(cctx);
+				ZSTD_freeDCtx(dctx);
+				throw std::runtime_error("Error initializing zstd streams");
+			}
+
+			ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, compression_level);
+		}
+
+		~ZstdCodec()
+		{
+			ZSTD_freeCCtx(cctx);
+			ZSTD_freeDCtx(dctx);
+		}
+
+		virtual int compress(const char*& in, size_t& in_avail, char*& out, size_t& out_avail, bool flush)
+		{
+			ZSTD_inBuffer in_buf = { in, in_avail, 0 };
+			ZSTD_outBuffer out_buf = { out, out_avail, 0 };
+
+			size_t rc=ZSTD_compressStream2(cctx, &out_buf, &in_buf, flush ? ZSTD_e_flush : ZSTD_e_continue);
+
+			if(ZSTD_isError(rc))
+			{
+				Server->Log("Error compressing stream: "+std::string(ZSTD_getErrorName(rc)), LL_ERROR);
+				return -1;
+			}
+
+			in+=in_buf.pos;
+			in_avail-=in_buf.pos;
+			out+=out_buf.pos;
+			out_avail-=out_buf.pos;
+
+			if(flush)
+			{
+				//Number of bytes left to flush
+				return rc>0 ? 1 : 0;
+			}
+
+			return in_avail>0 ? 1 : 0;
+		}
+
+		virtual bool decompress(const char*& in, size_t& in_avail, char*& out, size_t& out_avail)
+		{
+			ZSTD_inBuffer in_buf = { in, in_avail, 0 };
+			ZSTD_outBuffer out_buf = { out, out_avail, 0 };
+
+			size_t rc=ZSTD_decompressStream(dctx, &out_buf, &in_buf);
+
+			if(ZSTD_isError(rc))
+			{
+				Server->Log("Error decompressing stream: "+std::string(ZSTD_getErrorName(rc)), LL_ERROR);
+				return false;
+			}
+
+			in+=in_buf.pos;
+			in_avail-=in_buf.pos;
+			out+=out_buf.pos;
+			out_avail-=out_buf.pos;
+
+			return true;
+		}
+
+	private:
+		ZSTD_CCtx* cctx;
+		ZSTD_DCtx* dctx;
+	};
+#endif //WITH_ZSTD_COMPRESSION
+
+#ifdef WITH_LZ4_COMPRESSION
+	class Lz4Codec : public CompressedPipe3::ICodec
+	{
+	public:
+		Lz4Codec()
+			: cctx(NULL), dctx(NULL), started(false), pending_pos(0), pending_size(0)
+		{
+			if(LZ4F_isError(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION))
+				|| LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION)))
+			{
+				LZ4F_freeCompressionContext(cctx);
+				LZ4F_freeDecompressionContext(dctx);
+				throw std::runtime_error("Error initializing lz4 streams");
+			}
+
+			memset(&prefs, 0, sizeof(prefs));
+		}
+
+		~Lz4Codec()
+		{
+			LZ4F_freeCompressionContext(cctx);
+			LZ4F_freeDecompressionContext(dctx);
+		}
+
+		virtual int compress(const char*& in, size_t& in_avail, char*& out, size_t& out_avail, bool flush)
+		{
+			if(!started)
+			{
+				pending.resize(LZ4F_HEADER_SIZE_MAX);
+				size_t rc=LZ4F_compressBegin(cctx, pending.data(), pending.size(), &prefs);
+				if(LZ4F_isError(rc))
+				{
+					Server->Log("Error starting lz4 frame: "+std::string(LZ4F_getErrorName(rc)), LL_ERROR);
+					return -1;
+				}
+				pending_size=rc;
+				started=true;
+			}
+
+			bool flushed=false;
+			while(true)
+			{
+				size_t tocopy=(std::min)(pending_size-pending_pos, out_avail);
+				memcpy(out, pending.data()+pending_pos, tocopy);
+				pending_pos+=tocopy;
+				out+=tocopy;
+				out_avail-=tocopy;
+
+				if(pending_pos<pending_size)
+				{
+					return 1;
+				}
+
+				pending_pos=0;
+				pending_size=0;
+
+				size_t rc;
+				if(in_avail>0)
+				{
+					size_t chunk=(std::min)(in_avail, max_send_size);
+					pending.resize((std::max)(pending.size(), LZ4F_compressBound(chunk, &prefs)));
+					rc=LZ4F_compressUpdate(cctx, pending.data(), pending.size(), in, chunk, NULL);
+					in+=chunk;
+					in_avail-=chunk;
+				}
+				else if(flush && !flushed)
+				{
+					pending.resize((std::max)(pending.size(), LZ4F_compressBound(0, &prefs)));
+					rc=LZ4F_flush(cctx, pending.data(), pending.size(), NULL);
+					flushed=true;
+				}
+				else
+				{
+					return 0;
+				}
+
+				if(LZ4F_isError(rc))
+				{
+					Server->Log("Error compressing stream: "+std::string(LZ4F_getErrorName(rc)), LL_ERROR);
+					return -1;
+				}
+
+				pending_size=rc;
+			}
+		}
+
+		virtual bool decompress(const char*& in, size_t& in_avail, char*& out, size_t& out_avail)
+		{
+			size_t src_size=in_avail;
+			size_t dst_size=out_avail;
+
+			size_t rc=LZ4F_decompress(dctx, out, &dst_size, in, &src_size, NULL);
+
+			if(LZ4F_isError(rc))
+			{
+				Server->Log("Error decompressing stream: "+std::string(LZ4F_getErrorName(rc)), LL_ERROR);
+				return false;
+			}
+
+			in+=src_size;
+			in_avail-=src_size;
+			out+=dst_size;
+			out_avail-=dst_size;
+
+			return true;
+		}
+
+	private:
+		LZ4F_compressionContext_t cctx;
+		LZ4F_decompressionContext_t dctx;
+		LZ4F_preferences_t prefs;
+		bool started;
+		std::vector<char> pending;
+		size_t pending_pos;
+		size_t pending_size;
+	};
+#endif //WITH_LZ4_COMPRESSION
+}
+
+CompressedPipe3::CompressedPipe3(IPipe *cs, ECodec codec_type, int compression_level)
+	: cs(cs), codec_type(codec_type),
+	input_buffer_pos(0), input_buffer_size(0), decompress_output_full(false),
+	uncompressed_sent_bytes(0), uncompressed_received_bytes(0),
+	compressed_sent_bytes(0), compressed_received_bytes(0), sent_flushes(0),
+	last_send_time(Server->getTimeMS()),
+	compression_cpu_time(0), decompression_cpu_time(0),
+	destroy_cs(false), has_error(false),
+	read_mutex(Server->createMutex()), write_mutex(Server->createMutex())
+{
+	comp_buffer.resize(4096);
+	input_buffer.resize(16384);
+
+	switch(codec_type)
+	{
+#ifdef WITH_ZSTD_COMPRESSION
+	case ECodec_Zstd:
+		codec.reset(new ZstdCodec(compression_level));
+		break;
+#endif
+#ifdef WITH_LZ4_COMPRESSION
+	case ECodec_Lz4:
+		//lz4 is used for speed. Its HC levels are too slow for a stream.
+		codec.reset(new Lz4Codec);
+		break;
+#endif
+	case ECodec_Zlib:
+		codec.reset(new ZlibCodec(compression_level));
+		break;
+	default:
+		throw std::runtime_error("Compression codec "+getCodecName(codec_type)+" not supported");
+	}
+}
+
+CompressedPipe3::~CompressedPipe3(void)
+{
+	if(uncompressed_sent_bytes+uncompressed_received_bytes>1*1024*1024)
+	{
+		Server->Log("Compressed pipe ("+getCodecName()+"): sent "+PrettyPrintBytes(uncompressed_sent_bytes)
+			+" as "+PrettyPrintBytes(compressed_sent_bytes)+" in "+convert(compression_cpu_time/1000)+"ms, received "
+			+PrettyPrintBytes(uncompressed_received_bytes)+" as "+PrettyPrintBytes(compressed_received_bytes)
+			+" in "+convert(decompression_cpu_time/1000)+"ms", LL_DEBUG);
+	}
+
+	if(destroy_cs)
+	{
+		Server->destroy(cs);
+	}
+}
+
+size_t CompressedPipe3::Read(char *buffer, size_t bsize, int timeoutms)
+{
+	IScopedLock lock(read_mutex.get());
+
+	return ReadInt(buffer, bsize, timeoutms);
+}
+
+size_t CompressedPipe3::ReadInt(char *buffer, size_t bsize, int timeoutms)
+{
+	int64 starttime=Server->getTimeMS();
+	while(true)
+	{
+		if(input_buffer_pos<input_buffer_size
+			|| decompress_output_full)
+		{
+			size_t produced;
+			if(!DecompressToBuffer(buffer, bsize, produced))
+			{
+				return 0;
+			}
+
+			if(produced>0)
+			{
+				return produced;
+			}
+		}
+
+		if(input_buffer_pos>0)
+		{
+			memmove(input_buffer.data(), input_buffer.data()+input_buffer_pos, input_buffer_size-input_buffer_pos);
+			input_buffer_size-=input_buffer_pos;
+			input_buffer_pos=0;
+		}
+
+		if(input_buffer_size==input_buffer.size())
+		{
+			input_buffer.resize(input_buffer.size()+output_incr_size);
+		}
+
+		//Block codecs (zstd, lz4) may need several reads until they
+		//produce output. Keep reading while data is available.
+		int left=timeoutms;
+		if(timeoutms>0)
+		{
+			left=(std::max)(0, timeoutms-static_cast<int>(Server->getTimeMS()-starttime));
+		}
+
+		size_t rc=cs->Read(input_buffer.data()+input_buffer_size, input_buffer.size()-input_buffer_size, left);
+		if(rc==0)
+		{
+			return 0;
+		}
+
+		if(has_error)
+		{
+			return 0;
+		}
+
+		input_buffer_size+=rc;
+		compressed_received_bytes+=rc;
+	}
+}
+
+bool CompressedPipe3::DecompressToBuffer(char *buffer, size_t bsize, size_t& produced)
+{
+	const char* in=input_buffer.data()+input_buffer_pos;
+	size_t in_avail=input_buffer_size-input_buffer_pos;
+	char* out=buffer;
+	size_t out_avail=bsize;
+
+	int64 cpu_starttime=getThreadCpuTime();
+	bool b=codec->decompress(in, in_avail, out, out_avail);
+	decompression_cpu_time+=getThreadCpuTime()-cpu_starttime;
+
+	if(!b)
+	{
+		has_error=true;
+		produced=0;
+		return false;
+	}
+
+	input_buffer_pos=input_buffer_size-in_avail;
+	if(input_buffer_pos==input_buffer_size)
+	{
+		input_buffer_pos=0;
+		input_buffer_size=0;
+	}
+
+	//The codec may have more output buffered
+	decompress_output_full=out_avail==0;
+
+	produced=bsize-out_avail;
+	uncompressed_received_bytes+=produced;
+	return true;
+}
+
+size_t CompressedPipe3::Read(std::string *ret, int timeoutms)
+{
+	IScopedLock lock(read_mutex.get());
+
+	ret->resize(output_incr_size);
+	size_t rc=ReadInt(&(*ret)[0], ret->size(), timeoutms);
+	size_t pos=rc;
+
+	while(rc>0 && pos<output_max_size
+		&& (input_buffer_pos<input_buffer_size || decompress_output_full) )
+	{
+		if(pos+output_incr_size>ret->size())
+		{
+			ret->resize(pos+output_incr_size);
+		}
+
+		if(!DecompressToBuffer(&(*ret)[pos], ret->size()-pos, rc))
+		{
+			break;
+		}
+
+		pos+=rc;
+	}
+
+	ret->resize(pos);
+	return pos;
+}
+
+bool CompressedPipe3::Write(const char *buffer, size_t bsize, int timeoutms, bool flush)
+{
+	IScopedLock lock(write_mutex.get());
+
+	assert(buffer != NULL || bsize == 0);
+	const char* ptr=buffer;
+	int64 starttime = Server->getTimeMS();
+	do
+	{
+		size_t cbsize=(std::min)(max_send_size, bsize);
+
+		bsize-=cbsize;
+		uncompressed_sent_bytes+=cbsize;
+
+		bool has_next = bsize>0;
+		bool curr_flush = has_next ? false : flush;
+
+		if (!curr_flush
+			&& Server->getTimeMS() - last_send_time > 1000)
+		{
+			curr_flush = true;
+		}
+
+		if(curr_flush)
+		{
+			++sent_flushes;
+		}
+
+		const char* in=ptr;
+		size_t in_avail=cbsize;
+		int rc;
+		do
+		{
+			char* out=comp_buffer.data();
+			size_t out_avail=comp_buffer.size();
+
+			int64 cpu_starttime=getThreadCpuTime();
+			rc=codec->compress(in, in_avail, out, out_avail, curr_flush);
+			compression_cpu_time+=getThreadCpuTime()-cpu_starttime;
+
+			if(rc<0)
+			{
+				has_error=true;
+				return false;
+			}
+
+			size_t used=comp_buffer.size()-out_avail;
+
+			int curr_timeout = timeoutms;
+
+			if(curr_timeout>0)
+			{
+				int64 time_elapsed = Server->getTimeMS()-starttime;
+				if(time_elapsed>curr_timeout)
+				{
+					return false;
+				}
+				else
+				{
+					curr_timeout-=static_cast<int>(time_elapsed);
+				}
+			}
+
+			if(used>0)
+			{
+				last_send_time = Server->getTimeMS();
+				compressed_sent_bytes+=used;
+
+				bool b=cs->Write(comp_buffer.data(), used, curr_timeout, curr_flush && rc==0);
+				if(!b)
+					return false;
+			}
+			else if(!has_next && flush && rc==0)
+			{
+				return cs->Flush(curr_timeout);
+			}
+
+		} while(rc>0);
+
+		ptr+=cbsize;
+
+	} while(bsize>0);
+
+	return true;
+}
+
+bool CompressedPipe3::Write(const std::string &str, int timeoutms, bool flush)
+{
+	return Write(str.c_str(), str.size(), timeoutms, flush);
+}
+
+bool CompressedPipe3::isWritable(int timeoutms)
+{
+	return cs->isWritable(timeoutms);
+}
+
+bool CompressedPipe3::isReadable(int timeoutms)
+{
+	if(input_buffer_size>0 || decompress_output_full)
+		return true;
+	else
+		return cs->isReadable(timeoutms);
+}
+
+bool CompressedPipe3::hasError(void)
+{
+	return cs->hasError() || has_error;
+}
+
+void CompressedPipe3::shutdown(void)
+{
+	cs->shutdown();
+}
+
+size_t CompressedPipe3::getNumElements(void)
+{
+	return cs->getNumElements();
+}
+
+void CompressedPipe3::destroyBackendPipeOnDelete(bool b)
+{
+	destroy_cs=b;
+}
+
+IPipe *CompressedPipe3::getRealPipe(void)
+{
+	return cs;
+}
+
+void CompressedPipe3::addThrottler(IPipeThrottler *throttler)
+{
+	cs->addThrottler(throttler);
+}
+
+void CompressedPipe3::addOutgoingThrottler(IPipeThrottler *throttler)
+{
+	cs->addOutgoingThrottler(throttler);
+}
+
+void CompressedPipe3::addIncomingThrottler(IPipeThrottler *throttler)
+{
+	cs->addIncomingThrottler(throttler);
+}
+
+_i64 CompressedPipe3::getTransferedBytes(void)
+{
+	return cs->getTransferedBytes();
+}
+
+void CompressedPipe3::resetTransferedBytes(void)
+{
+	cs->resetTransferedBytes();
+}
+
+bool CompressedPipe3::Flush( int timeoutms/*=-1 */ )
+{
+	return Write(NULL, 0, timeoutms, true);
+}
+
+int64 CompressedPipe3::getUncompressedSentBytes()
+{
+	return uncompressed_sent_bytes;
+}
+
+int64 CompressedPipe3::getUncompressedReceivedBytes()
+{
+	return uncompressed_received_bytes;
+}
+
+int64 CompressedPipe3::getCompressedSentBytes()
+{
+	return compressed_sent_bytes;
+}
+
+int64 CompressedPipe3::getCompressedReceivedBytes()
+{
+	return compressed_received_bytes;
+}
+
+int64 CompressedPipe3::getSentFlushes()
+{
+	return sent_flushes;
+}
+
+int64 CompressedPipe3::getCompressionCpuTime()
+{
+	return compression_cpu_time;
+}
+
+int64 CompressedPipe3::getDecompressionCpuTime()
+{
+	return decompression_cpu_time;
+}
+
+std::string CompressedPipe3::getCodecName()
+{
+	return getCodecName(codec_type);
+}
+
+_i64 CompressedPipe3::getRealTransferredBytes()
+{
+	int64 encryption_overhead=0;
+	InternetServicePipe2* isp2 = dynamic_cast<InternetServicePipe2*>(getRealPipe());
+	if(isp2!=NULL)
+	{
+		encryption_overhead=isp2->getEncryptionOverheadBytes();
+		Server->Log("Encryption overhead: "+PrettyPrintBytes(encryption_overhead));
+	}
+
+	return getUncompressedSentBytes()+getUncompressedReceivedBytes()-encryption_overhead;
+}
+
+unsigned int CompressedPipe3::getSupportedCapabilities()
+{
+	unsigned int capa=IPC_COMPRESSED;
+#ifdef WITH_LZ4_COMPRESSION
+	capa|=IPC_COMPRESSED_LZ4;
+#endif
+#ifdef WITH_ZSTD_COMPRESSION
+	capa|=IPC_COMPRESSED_ZSTD;
+#endif
+	return capa;
+}
+
+unsigned int CompressedPipe3::getCodecCapability(const std::string& codec_name)
+{
+	unsigned int capa;
+	if(codec_name=="zstd")
+	{
+		capa=IPC_COMPRESSED_ZSTD;
+	}
+	else if(codec_name=="lz4")
+	{
+		capa=IPC_COMPRESSED_LZ4;
+	}
+	else if(codec_name=="zlib")
+	{
+		capa=IPC_COMPRESSED;
+	}
+	else
+	{
+		return 0;
+	}
+
+	return capa & getSupportedCapabilities();
+}
+
+CompressedPipe3::ECodec CompressedPipe3::getCodecFromCapabilities(unsigned int capa)
+{
+	capa&=getSupportedCapabilities();
+	if(capa & IPC_COMPRESSED_ZSTD)
+	{
+		return ECodec_Zstd;
+	}
+	else if(capa & IPC_COMPRESSED_LZ4)
+	{
+		return ECodec_Lz4;
+	}
+	return ECodec_Zlib;
+}
+
+std::string CompressedPipe3::getCodecName(ECodec codec)
+{
+	switch(codec)
+	{
+	case ECodec_Zlib: return "zlib";
+	case ECodec_Lz4: return "lz4";
+	case ECodec_Zstd: return "zstd";
+	}
+	return "unknown";
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "CompressedPipe2.h"
+#include "../Interface/Pipe.h"
+#include "../Interface/Types.h"
+#include <vector>
+#include <memory>
+#include <string>
+
+#ifndef _WIN32
+#ifndef VERSION
+#include "../config.h"
+#endif
+#endif
+
+#if defined(HAVE_ZSTD_H) && defined(HAVE_LIBZSTD)
+#define WITH_ZSTD_COMPRESSION
+#endif
+
+#if defined(HAVE_LZ4FRAME_H) && defined(HAVE_LIBLZ4)
+#define WITH_LZ4_COMPRESSION
+#endif
+
+class IMutex;
+
+//Compressed stream with a codec negotiated via the internet pipe
+//capabilities. The zlib codec is compatible with CompressedPipe2.
+class CompressedPipe3 : public ICompressedPipe
+{
+public:
+	enum ECodec
+	{
+		ECodec_Zlib,
+		ECodec_Lz4,
+		ECodec_Zstd
+	};
+
+	CompressedPipe3(IPipe *cs, ECodec codec, int compression_level);
+	~CompressedPipe3(void);
+
+	virtual size_t Read(char *buffer, size_t bsize, int timeoutms=-1);
+	virtual bool Write(const char *buffer, size_t bsize, int timeoutms=-1, bool flush=true);
+	virtual size_t Read(std::string *ret, int timeoutms=-1);
+	virtual bool Write(const std::string &str, int timeoutms=-1, bool flush=true);
+
+	/**
+	* @param timeoutms -1 for blocking >=0 to block only for x ms. Default: nonblocking
+	*/
+	virtual bool isWritable(int timeoutms=0);
+	virtual bool isReadable(int timeoutms=0);
+
+	virtual bool hasError(void);
+
+	virtual void shutdown(void);
+
+	virtual size_t getNumElements(void);
+
+	virtual void destroyBackendPipeOnDelete(bool b);
+
+	virtual IPipe *getRealPipe(void);
+
+	virtual void addThrottler(IPipeThrottler *throttler);
+	virtual void addOutgoingThrottler(IPipeThrottler *throttler);
+	virtual void addIncomingThrottler(IPipeThrottler *throttler);
+
+	virtual _i64 getTransferedBytes(void);
+	virtual void resetTransferedBytes(void);
+
+	virtual bool Flush( int timeoutms=-1 );
+
+	int64 getUncompressedSentBytes();
+	int64 getUncompressedReceivedBytes();
+	int64 getCompressedSentBytes();
+	int64 getCompressedReceivedBytes();
+	int64 getSentFlushes();
+	//Thread CPU time spent in the codec in microseconds
+	int64 getCompressionCpuTime();
+	int64 getDecompressionCpuTime();
+
+	std::string getCodecName();
+
+	virtual _i64 getRealTransferredBytes();
+
+	//IPC_COMPRESSED* capability bits of the codecs this build supports
+	static unsigned int getSupportedCapabilities();
+	//Capability bit of a codec name (zlib, lz4, zstd). Zero if it is unknown
+	//or not supported by this build
+	static unsigned int getCodecCapability(const std::string& codec_name);
+	//Selects the best codec from the capability bits
+	static ECodec getCodecFromCapabilities(unsigned int capa);
+
+	static std::string getCodecName(ECodec codec);
+
+	class ICodec;
+
+private:
+	size_t ReadInt(char *buffer, size_t bsize, int timeoutms);
+	bool DecompressToBuffer(char *buffer, size_t bsize, size_t& produced);
+
+	IPipe *cs;
+	ECodec codec_type;
+	std::auto_ptr<ICodec> codec;
+
+	std::vector<char> comp_buffer;
+	std::vector<char> input_buffer;
+	size_t input_buffer_pos;
+	size_t input_buffer_size;
+	bool decompress_output_full;
+
+	int64 uncompressed_sent_bytes;
+	int64 uncompressed_received_bytes;
+	int64 compressed_sent_bytes;
+	int64 compressed_received_bytes;
+	int64 sent_flushes;
+	int64 last_send_time;
+	int64 compression_cpu_time;
+	int64 decompression_cpu_time;
+
+	bool destroy_cs;
+	bool has_error;
+
+	std::auto_ptr<IMutex> read_mutex;
+	std::auto_ptr<IMutex> write_mutex;
+};
@@ -100,7 +100,8 @@ FileClient::FileClient(bool enable_find_servers, std::string identity, int proto
 	identity(identity), received_data_bytes(0), queue_callback(NULL), dl_off(0),
 	last_transferred_bytes(0), last_progress_log(0), progress_log_callback(NULL), needs_flush(false),
 	real_transferred_bytes(0), is_downloading(false), sparse_extends_f(NULL), sparse_bytes(0),
-	reconnect_tries(50)
+	reconnect_tries(50), max_queued_files(maxQueuedFiles), queued_files_low(queuedFilesLow),
+	pipeline_depth_sum(0), pipeline_depth_samples(0), pipeline_depth_max(0)
 {
 	memset(buffer, 0, BUFFERSIZE_UDP);
 
@@ -606,6 +607,11 @@ void FileClient::addThrottler(IPipeThrottler *throttler)
 	}
 }
 
+std::vector<IPipeThrottler*> FileClient::getThrottlers()
+{
+	return throttlers;
+}
+
 _u32 FileClient::Connect(IPipe *cp)
 {
 	if( socket_open==true )
@@ -762,6 +768,7 @@ bool FileClient::Reconnect(void)
 	{
 		assert(queued.front().fn == remotefn);
 		assert(!queued.front().finish_script);
+		addPipelineDepthSample();
 		queued.pop_front();
 	}
 
@@ -1391,6 +1398,12 @@ void FileClient::setReconnectionTimeout(unsigned int t)
 	reconnection_timeout=t;
 }
 
+unsigned int FileClient::getReconnectionTimeout()
+{
+	IScopedLock lock(mutex);
+	return reconnection_timeout;
+}
+
 _i64 FileClient::getReceivedDataBytes( bool with_sparse )
 {
 	IScopedLock lock(mutex);
@@ -1421,6 +1434,33 @@ void FileClient::setQueueCallback( QueueCallback* cb )
 	queue_callback = cb;
 }
 
+void FileClient::setQueueWindow(size_t max_queued, size_t low)
+{
+	max_queued_files = (std::max)(max_queued, static_cast<size_t>(1));
+	queued_files_low = (std::min)(low, max_queued_files - 1);
+}
+
+void FileClient::addPipelineDepthSample()
+{
+	pipeline_depth_sum += queued.size();
+	++pipeline_depth_samples;
+	pipeline_depth_max = (std::max)(pipeline_depth_max, queued.size());
+}
+
+double FileClient::getAvgPipelineDepth()
+{
+	if (pipeline_depth_samples == 0)
+	{
+		return 0;
+	}
+	return static_cast<double>(pipeline_depth_sum) / pipeline_depth_samples;
+}
+
+size_t FileClient::getMaxPipelineDepth()
+{
+	return pipeline_depth_max;
+}
+
 void FileClient::fillQueue()
 {
 	if(queue_callback==NULL)
@@ -1434,7 +1474,7 @@ void FileClient::fillQueue()
 		return;
 	}
 
-	if(queued.size()>queuedFilesLow)
+	if(queued.size()>queued_files_low)
 	{
 		if (needs_flush)
 		{
@@ -1450,7 +1490,7 @@ void FileClient::fillQueue()
 	std::vector<SQueueItem> queued_files;
 	int64 queue_starttime = Server->getTimeMS();
 
-	while(queued.size()<maxQueuedFiles
+	while(queued.size()<max_queued_files
 		&& Server->getTimeMS()-queue_starttime<10000)
 	{
 		if(!tcpsock->isWritable())
@@ -1643,6 +1683,11 @@ void FileClient::setNoFreeSpaceCallback(FileClient::NoFreeSpaceCallback * cb)
 	nofreespace_callback = cb;
 }
 
+FileClient::NoFreeSpaceCallback* FileClient::getNoFreeSpaceCallback()
+{
+	return nofreespace_callback;
+}
+
 _u32 FileClient::GetFileHashAndMetadata( std::string remotefn, std::string& hash, std::string& permissions, int64& filesize, int64& created, int64& modified )
 {
 	if (tcpsock == NULL)
@@ -1665,6 +1710,7 @@ _u32 FileClient::GetFileHashAndMetadata( std::string remotefn, std::string& hash
 	{
 		assert(queued.front().fn == remotefn);
 		assert(!queued.front().finish_script);
+		addPipelineDepthSample();
 		queued.pop_front();
 	}
 
@@ -1966,6 +2012,7 @@ _u32 FileClient::FinishScript(std::string remotefn)
 	{
 		assert(queued.front().fn == remotefn);
 		assert(queued.front().finish_script);
+		addPipelineDepthSample();
 		queued.pop_front();
 	}
 
@@ -103,6 +103,8 @@ public:
 
 		void addThrottler(IPipeThrottler *throttler);
 
+		std::vector<IPipeThrottler*> getThrottlers();
+
 		_i64 getTransferredBytes(void);
 
 		_i64 getRealTransferredBytes();
@@ -115,14 +117,27 @@ public:
 
 		void setReconnectionTimeout(unsigned int t);
 
+		unsigned int getReconnectionTimeout();
+
 		void setQueueCallback(FileClient::QueueCallback* cb);
 
+		//Number of files requested ahead of the current download (window) and the
+		//number of outstanding requests below which the queue is filled up again
+		void setQueueWindow(size_t max_queued, size_t low);
+
+		//Number of outstanding requests when the response for a queued file is read
+		double getAvgPipelineDepth();
+
+		size_t getMaxPipelineDepth();
+
 		void setProgressLogCallback(FileClient::ProgressLogCallback* cb);
 
 		FileClient::ProgressLogCallback* getProgressLogCallback();
 
 		void setNoFreeSpaceCallback(FileClient::NoFreeSpaceCallback* cb);
 
+		FileClient::NoFreeSpaceCallback* getNoFreeSpaceCallback();
+
 		_u32 Flush();
 
 		bool Reconnect(void);
@@ -142,6 +157,8 @@ public:
 private:
 		int getReconnectTriesDecr();
 
+		void addPipelineDepthSample();
+
 		void bindToNewInterfaces();
 
 		void fillQueue();
@@ -233,6 +250,13 @@ private:
 		_i64 sparse_bytes;
 
 		int reconnect_tries;
+
+		size_t max_queued_files;
+		size_t queued_files_low;
+
+		int64 pipeline_depth_sum;
+		int64 pipeline_depth_samples;
+		size_t pipeline_depth_max;
 };
 
 const _u32 ERR_CONTINUE=0;
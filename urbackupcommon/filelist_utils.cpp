@@ -19,6 +19,102 @@
 #include "filelist_utils.h"
 #include "../Interface/Server.h"
 #include "../stringtools.h"
+#include <memory>
+#include <memory.h>
+#include <algorithm>
+
+namespace
+{
+	const size_t c_binary_writer_buffer_size = 64*1024;
+	const size_t c_filelist_reader_buffer_size = 512*1024;
+
+	void appendU32(std::string& buf, _u32 val)
+	{
+		val = little_endian(val);
+		buf.append(reinterpret_cast<char*>(&val), sizeof(val));
+	}
+
+	void appendI64(std::string& buf, int64 val)
+	{
+		val = little_endian(val);
+		buf.append(reinterpret_cast<char*>(&val), sizeof(val));
+	}
+
+	void appendVarint(std::string& buf, uint64 val)
+	{
+		while(val>=0x80)
+		{
+			buf+=static_cast<char>((val & 0x7F) | 0x80);
+			val>>=7;
+		}
+		buf+=static_cast<char>(val);
+	}
+
+	//Zig-zag encoding so that small negative values stay small
+	void appendVarintSigned(std::string& buf, int64 val)
+	{
+		appendVarint(buf, (static_cast<uint64>(val)<<1) ^ static_cast<uint64>(val>>63));
+	}
+
+	void appendString(std::string& buf, const std::string& str)
+	{
+		appendVarint(buf, str.size());
+		buf.append(str);
+	}
+
+	bool readVarint(const char*& p, const char* end, uint64& val)
+	{
+		val=0;
+		for(unsigned int shift=0;shift<64 && p<end;shift+=7)
+		{
+			unsigned char ch=static_cast<unsigned char>(*p);
+			++p;
+			val|=static_cast<uint64>(ch & 0x7F)<<shift;
+			if(!(ch & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool readVarintSigned(const char*& p, const char* end, int64& val)
+	{
+		uint64 uval;
+		if(!readVarint(p, end, uval))
+		{
+			return false;
+		}
+		val=static_cast<int64>(uval>>1) ^ -static_cast<int64>(uval & 1);
+		return true;
+	}
+
+	//Skips the string if str is NULL
+	bool readString(const char*& p, const char* end, std::string* str)
+	{
+		uint64 size;
+		if(!readVarint(p, end, size)
+			|| static_cast<uint64>(end-p)<size)
+		{
+			return false;
+		}
+		if(str!=NULL)
+		{
+			str->assign(p, size);
+		}
+		p+=size;
+		return true;
+	}
+
+	void dirIndexLittleEndian(SFileListDirIndex& idx)
+	{
+		idx.offset = little_endian(idx.offset);
+		idx.end_offset = little_endian(idx.end_offset);
+		idx.id = little_endian(idx.id);
+		idx.end_id = little_endian(idx.end_id);
+		idx.n_nodes = little_endian(idx.n_nodes);
+	}
+}
 
 void writeFileRepeat(IFile *f, const char *buf, size_t bsize)
 {
@@ -145,8 +241,14 @@ void writeFileItem(IFile* f, SFile cf, std::string extra)
 bool FileListParser::nextEntry( char ch, SFile &data, std::map<std::string, std::string>* extra )
 {
 	++pos;
+
 	switch(state)
 	{
+	case ParseState_BinaryMagic:
+	case ParseState_BinarySize:
+	case ParseState_BinaryRecord:
+	case ParseState_BinaryEnd:
+		return nextBinaryEntry(ch, data, extra);
 	case ParseState_Type:
 		if(ch=='f')
 		{
@@ -163,6 +265,10 @@ bool FileListParser::nextEntry( char ch, SFile &data, std::map<std::string, std:
 			data.isdir=true;
 			state=ParseState_TypeFinish;
 		}
+		else if(ch==c_binary_filelist_magic[0] && pos==1)
+		{
+			state=ParseState_BinaryMagic;
+		}
 		else
 		{
 			Server->Log("Error parsing file BackupServerGet::getNextEntry - 1. Unexpected char '"+std::string(1, ch)+"' at pos "+convert(pos-1)+". Expected 'f', 'd' or 'u'.", LL_ERROR);
@@ -324,7 +430,551 @@ void FileListParser::reset( void )
 }
 
 FileListParser::FileListParser()
-	: state(ParseState_Type), pos(0)
+	: state(ParseState_Type), pos(0), record_size(0)
 {
 
 }
+
+bool FileListParser::nextBinaryEntry( char ch, SFile &data, std::map<std::string, std::string>* extra )
+{
+	switch(state)
+	{
+	case ParseState_BinaryMagic:
+		if(ch!=c_binary_filelist_magic[pos-1])
+		{
+			Server->Log("Error parsing binary file list. Unknown version or corrupt header.", LL_ERROR);
+			state=ParseState_BinaryEnd;
+		}
+		else if(pos==c_binary_filelist_magic_size)
+		{
+			t_name.clear();
+			state=ParseState_BinarySize;
+		}
+		break;
+	case ParseState_BinarySize:
+		t_name+=ch;
+		if(!(ch & 0x80))
+		{
+			const char* p=t_name.data();
+			uint64 size;
+			readVarint(p, p+t_name.size(), size);
+			t_name.clear();
+			if(size==0)
+			{
+				//Directory index follows
+				state=ParseState_BinaryEnd;
+			}
+			else if(size>c_binary_filelist_max_record_size)
+			{
+				Server->Log("Error parsing binary file list. Record before pos "+convert(pos)+" is too large ("+convert(size)+" bytes).", LL_ERROR);
+				state=ParseState_BinaryEnd;
+			}
+			else
+			{
+				record_size=static_cast<_u32>(size);
+				state=ParseState_BinaryRecord;
+			}
+		}
+		else if(t_name.size()>=sizeof(_u32)+1)
+		{
+			Server->Log("Error parsing binary file list. Invalid record size before pos "+convert(pos)+".", LL_ERROR);
+			state=ParseState_BinaryEnd;
+		}
+		break;
+	case ParseState_BinaryRecord:
+		t_name+=ch;
+		if(t_name.size()==record_size)
+		{
+			state=ParseState_BinarySize;
+			bool ok=parseBinaryFileListRecord(t_name.data(), t_name.size(), data, extra);
+			t_name.clear();
+			if(!ok)
+			{
+				Server->Log("Error parsing binary file list. Invalid record before pos "+convert(pos)+".", LL_ERROR);
+				state=ParseState_BinaryEnd;
+				return false;
+			}
+			return true;
+		}
+		break;
+	default:
+		break;
+	}
+	return false;
+}
+
+bool isBinaryFileList(const char* buf, size_t bsize)
+{
+	return bsize>=c_binary_filelist_magic_size
+		&& memcmp(buf, c_binary_filelist_magic, c_binary_filelist_magic_size)==0;
+}
+
+bool parseBinaryFileListRecord(const char* rec, size_t rec_size, SFile &data, std::map<std::string, std::string>* extra)
+{
+	if(rec_size==0)
+	{
+		return false;
+	}
+
+	const char* end=rec+rec_size;
+	const char type=*rec;
+	const char* p=rec+1;
+
+	if(type=='u')
+	{
+		if(!readString(p, end, NULL))
+		{
+			return false;
+		}
+		data.name="..";
+	}
+	else if(type=='f' || type=='d')
+	{
+		if(!readString(p, end, &data.name))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		return false;
+	}
+
+	data.isdir = type!='f';
+
+	uint64 n_extra;
+	if(!readVarintSigned(p, end, data.size)
+		|| !readVarintSigned(p, end, data.last_modified)
+		|| !readVarint(p, end, n_extra) )
+	{
+		return false;
+	}
+
+	if(extra!=NULL)
+	{
+		extra->clear();
+	}
+
+	std::string key;
+	std::string value;
+	for(uint64 i=0;i<n_extra;++i)
+	{
+		if(!readString(p, end, extra!=NULL ? &key : NULL)
+			|| !readString(p, end, extra!=NULL ? &value : NULL) )
+		{
+			return false;
+		}
+
+		if(extra!=NULL)
+		{
+			extra->insert(std::make_pair(key, value));
+		}
+	}
+
+	return p==end;
+}
+
+BinaryFileListWriter::BinaryFileListWriter(IFile* f)
+	: f(f), buffer_offset(0), curr_id(0), n_nodes(0)
+{
+	buffer.reserve(c_binary_writer_buffer_size+4096);
+	buffer.assign(c_binary_filelist_magic, c_binary_filelist_magic_size);
+}
+
+void BinaryFileListWriter::writeItem(const SFile& cf, const std::map<std::string, std::string>* extra)
+{
+	if(cf.isdir && cf.name=="..")
+	{
+		addRecord('u', cf, extra);
+
+		if(!open_dirs.empty())
+		{
+			SFileListDirIndex& idx = dir_index[open_dirs.back().first];
+			idx.end_offset = getOffset();
+			idx.end_id = curr_id;
+			idx.n_nodes = n_nodes - open_dirs.back().second;
+			open_dirs.pop_back();
+		}
+	}
+	else if(cf.isdir)
+	{
+		SFileListDirIndex idx = { getOffset(), 0, curr_id, 0, 0 };
+
+		addRecord('d', cf, extra);
+		++n_nodes;
+
+		open_dirs.push_back(std::make_pair(dir_index.size(), n_nodes));
+		dir_index.push_back(idx);
+	}
+	else
+	{
+		addRecord('f', cf, extra);
+		++n_nodes;
+	}
+
+	if(buffer.size()>=c_binary_writer_buffer_size)
+	{
+		flushBuffer();
+	}
+}
+
+void BinaryFileListWriter::finish()
+{
+	int64 index_offset = getOffset();
+	appendVarint(buffer, 0);
+	appendU32(buffer, static_cast<_u32>(dir_index.size()));
+	for(size_t i=0;i<dir_index.size();++i)
+	{
+		SFileListDirIndex idx = dir_index[i];
+		dirIndexLittleEndian(idx);
+		buffer.append(reinterpret_cast<char*>(&idx), sizeof(idx));
+
+		if(buffer.size()>=c_binary_writer_buffer_size)
+		{
+			flushBuffer();
+		}
+	}
+	appendI64(buffer, index_offset);
+	buffer.append(c_binary_filelist_index_magic, c_binary_filelist_magic_size);
+	flushBuffer();
+}
+
+void BinaryFileListWriter::addRecord(char type, const SFile& cf, const std::map<std::string, std::string>* extra)
+{
+	record.clear();
+	record+=type;
+	if(type=='u')
+	{
+		appendVarint(record, 0);
+		appendVarint(record, 0);
+		appendVarint(record, 0);
+	}
+	else
+	{
+		appendString(record, cf.name);
+		appendVarintSigned(record, cf.size);
+		appendVarintSigned(record, cf.last_modified);
+	}
+
+	if(extra!=NULL)
+	{
+		appendVarint(record, extra->size());
+		for(std::map<std::string, std::string>::const_iterator it=extra->begin();it!=extra->end();++it)
+		{
+			appendString(record, it->first);
+			appendString(record, it->second);
+		}
+	}
+	else
+	{
+		appendVarint(record, 0);
+	}
+
+	appendVarint(buffer, record.size());
+	buffer+=record;
+
+	++curr_id;
+}
+
+int64 BinaryFileListWriter::getOffset()
+{
+	return buffer_offset+buffer.size();
+}
+
+void BinaryFileListWriter::flushBuffer()
+{
+	writeFileRepeat(f, buffer);
+	buffer_offset+=buffer.size();
+	buffer.clear();
+}
+
+bool convertFileListToBinary(const std::string& src_fn, const std::string& dst_fn)
+{
+	std::auto_ptr<IFile> src(Server->openFile(src_fn, MODE_READ_SEQUENTIAL));
+	if(src.get()==NULL)
+	{
+		Server->Log("Error opening file list \""+src_fn+"\". "+os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	std::auto_ptr<IFile> dst(Server->openFile(dst_fn, MODE_WRITE));
+	if(dst.get()==NULL)
+	{
+		Server->Log("Error opening binary file list \""+dst_fn+"\" for writing. "+os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	FileListReader reader(src.get());
+	BinaryFileListWriter writer(dst.get());
+
+	SFile data;
+	std::map<std::string, std::string> extra;
+	while(reader.nextEntry(data, &extra))
+	{
+		writer.writeItem(data, &extra);
+	}
+
+	if(reader.hasError())
+	{
+		return false;
+	}
+
+	writer.finish();
+	return true;
+}
+
+FileListReader::FileListReader(IFile* f)
+	: f(f), buffer(c_filelist_reader_buffer_size), buffer_pos(0), buffer_size(0),
+	buffer_offset(0), eof(false), has_error(false), binary(false), binary_end(false),
+	entry_offset(0), id(0)
+{
+	if(fill(c_binary_filelist_magic_size)
+		&& isBinaryFileList(&buffer[0], buffer_size))
+	{
+		binary=true;
+		buffer_pos=c_binary_filelist_magic_size;
+	}
+}
+
+bool FileListReader::nextEntry(SFile &data, std::map<std::string, std::string>* extra)
+{
+	if(has_error)
+	{
+		return false;
+	}
+
+	entry_offset=buffer_offset+buffer_pos;
+
+	if(binary)
+	{
+		if(binary_end)
+		{
+			return false;
+		}
+
+		size_t size_len=0;
+		do
+		{
+			if(!fill(size_len+1))
+			{
+				return false;
+			}
+			++size_len;
+		}
+		while((buffer[buffer_pos+size_len-1] & 0x80) && size_len<=sizeof(_u32));
+
+		const char* p=&buffer[buffer_pos];
+		uint64 record_size;
+		if(!readVarint(p, p+size_len, record_size))
+		{
+			Server->Log("Invalid record size at offset "+convert(entry_offset)+" of binary file list \""+f->getFilename()+"\"", LL_ERROR);
+			has_error=true;
+			return false;
+		}
+		buffer_pos+=size_len;
+
+		if(record_size==0)
+		{
+			binary_end=true;
+			return false;
+		}
+
+		if(record_size>c_binary_filelist_max_record_size)
+		{
+			Server->Log("Record at offset "+convert(entry_offset)+" of binary file list \""+f->getFilename()+"\" is too large ("+convert(record_size)+" bytes)", LL_ERROR);
+			has_error=true;
+			return false;
+		}
+
+		if(!fill(static_cast<size_t>(record_size)))
+		{
+			if(!has_error)
+			{
+				Server->Log("Unexpected end of binary file list \""+f->getFilename()+"\"", LL_ERROR);
+				has_error=true;
+			}
+			return false;
+		}
+
+		if(!parseBinaryFileListRecord(&buffer[buffer_pos], static_cast<size_t>(record_size), data, extra))
+		{
+			Server->Log("Invalid record at offset "+convert(entry_offset)+" of binary file list \""+f->getFilename()+"\"", LL_ERROR);
+			has_error=true;
+			return false;
+		}
+
+		buffer_pos+=static_cast<size_t>(record_size);
+		++id;
+		return true;
+	}
+
+	while(true)
+	{
+		if(buffer_pos>=buffer_size
+			&& !fill(1))
+		{
+			return false;
+		}
+
+		while(buffer_pos<buffer_size)
+		{
+			if(parser.nextEntry(buffer[buffer_pos++], data, extra))
+			{
+				++id;
+				return true;
+			}
+		}
+	}
+}
+
+bool FileListReader::hasError()
+{
+	return has_error;
+}
+
+bool FileListReader::isBinary()
+{
+	return binary;
+}
+
+int64 FileListReader::getEntryOffset()
+{
+	return entry_offset;
+}
+
+int64 FileListReader::getOffset()
+{
+	return buffer_offset+buffer_pos;
+}
+
+int64 FileListReader::getId()
+{
+	return id;
+}
+
+void FileListReader::seek(int64 offset, int64 pId)
+{
+	buffer_offset=offset;
+	buffer_pos=0;
+	buffer_size=0;
+	eof=false;
+	binary_end=false;
+	id=pId;
+	parser.reset();
+}
+
+bool FileListReader::readDirIndex(std::vector<SFileListDirIndex>& dir_index)
+{
+	if(!binary)
+	{
+		return false;
+	}
+
+	int64 fsize=f->Size();
+	if(fsize<static_cast<int64>(c_binary_filelist_magic_size+c_binary_filelist_trailer_size))
+	{
+		return false;
+	}
+
+	char trailer[c_binary_filelist_trailer_size];
+	if(f->Read(fsize-c_binary_filelist_trailer_size, trailer, c_binary_filelist_trailer_size)!=c_binary_filelist_trailer_size
+		|| memcmp(trailer+sizeof(int64), c_binary_filelist_index_magic, c_binary_filelist_magic_size)!=0)
+	{
+		return false;
+	}
+
+	int64 index_offset;
+	memcpy(&index_offset, trailer, sizeof(index_offset));
+	index_offset=little_endian(index_offset);
+
+	const int64 index_end=fsize-c_binary_filelist_trailer_size;
+	char index_header[1+sizeof(_u32)];
+	if(index_offset<static_cast<int64>(c_binary_filelist_magic_size)
+		|| index_offset+static_cast<int64>(sizeof(index_header))>index_end
+		|| f->Read(index_offset, index_header, sizeof(index_header))!=sizeof(index_header)
+		|| index_header[0]!=0)
+	{
+		Server->Log("Invalid directory index in binary file list \""+f->getFilename()+"\"", LL_WARNING);
+		return false;
+	}
+
+	_u32 n_dirs;
+	memcpy(&n_dirs, index_header+1, sizeof(n_dirs));
+	n_dirs=little_endian(n_dirs);
+	if(index_end-index_offset-static_cast<int64>(sizeof(index_header))!=static_cast<int64>(n_dirs*sizeof(SFileListDirIndex)))
+	{
+		Server->Log("Invalid directory index size in binary file list \""+f->getFilename()+"\"", LL_WARNING);
+		return false;
+	}
+
+	dir_index.resize(n_dirs);
+
+	const size_t max_read=(c_filelist_reader_buffer_size/sizeof(SFileListDirIndex))*sizeof(SFileListDirIndex);
+	size_t toread=n_dirs*sizeof(SFileListDirIndex);
+	char* dst=toread>0 ? reinterpret_cast<char*>(&dir_index[0]) : NULL;
+	int64 pos=index_offset+sizeof(index_header);
+	while(toread>0)
+	{
+		_u32 curr=static_cast<_u32>((std::min)(toread, max_read));
+		if(f->Read(pos, dst, curr)!=curr)
+		{
+			Server->Log("Error reading directory index of binary file list \""+f->getFilename()+"\". "+os_last_error_str(), LL_ERROR);
+			dir_index.clear();
+			return false;
+		}
+		dst+=curr;
+		pos+=curr;
+		toread-=curr;
+	}
+
+	for(size_t i=0;i<dir_index.size();++i)
+	{
+		dirIndexLittleEndian(dir_index[i]);
+	}
+
+	return true;
+}
+
+bool FileListReader::fill(size_t n)
+{
+	if(buffer_size-buffer_pos>=n)
+	{
+		return true;
+	}
+
+	if(buffer_pos>0)
+	{
+		memmove(&buffer[0], &buffer[buffer_pos], buffer_size-buffer_pos);
+		buffer_offset+=buffer_pos;
+		buffer_size-=buffer_pos;
+		buffer_pos=0;
+	}
+
+	if(n>buffer.size())
+	{
+		buffer.resize(n);
+	}
+
+	while(buffer_size<n && !eof)
+	{
+		bool read_error=false;
+		_u32 read=f->Read(buffer_offset+buffer_size, &buffer[buffer_size],
+			static_cast<_u32>(buffer.size()-buffer_size), &read_error);
+
+		if(read_error)
+		{
+			Server->Log("Error reading from file list \""+f->getFilename()+"\". "+os_last_error_str(), LL_ERROR);
+			has_error=true;
+			return false;
+		}
+
+		if(read==0)
+		{
+			eof=true;
+		}
+
+		buffer_size+=read;
+	}
+
+	return buffer_size>=n;
+}
@@ -3,6 +3,8 @@
 #include "../Interface/File.h"
 #include "../urbackupcommon/os_functions.h"
 #include "file_metadata.h"
+#include <vector>
+#include <map>
 
 void writeFileRepeat(IFile *f, const std::string &str);
 
@@ -11,6 +13,72 @@ std::string escapeListName( const std::string& listname );
 void writeFileItem(IFile* f, SFile cf, size_t* written=NULL, size_t* change_identicator_off=NULL);
 void writeFileItem(IFile* f, SFile cf, std::string extra);
 
+//Binary file list format. Sizes are varints, file size and last modified
+//time zig-zag encoded varints. Fixed size integers are little endian.
+//Header: c_binary_filelist_magic (includes the version)
+//Entries: record size (without the size field) followed by the record:
+//   char type ('f', 'd' or 'u'), name size, name, file size, last modified,
+//   number of extra parameters, then for each one key size, key, value size, value
+//Index: record size 0 (end of the entries), _u32 number of directories, SFileListDirIndex
+//   for each directory in the order of the 'd' records
+//Trailer: _i64 offset of the index record, c_binary_filelist_index_magic
+const char c_binary_filelist_magic[] = "URBFL\x01\r\n";
+const char c_binary_filelist_index_magic[] = "URBFLIDX";
+const size_t c_binary_filelist_magic_size = 8;
+const size_t c_binary_filelist_trailer_size = sizeof(_i64) + c_binary_filelist_magic_size;
+const _u32 c_binary_filelist_max_record_size = 64*1024*1024;
+
+#pragma pack(push, 1)
+struct SFileListDirIndex
+{
+	//Offset of the 'd' record
+	int64 offset;
+	//Offset after the matching 'u' record. 0 if the directory is not closed
+	int64 end_offset;
+	//Entry number of the 'd' record, same as the line in a text file list
+	int64 id;
+	//Entry number after the matching 'u' record
+	int64 end_id;
+	//Number of 'f' and 'd' records in the directory (recursively)
+	int64 n_nodes;
+};
+#pragma pack(pop)
+
+bool isBinaryFileList(const char* buf, size_t bsize);
+
+//Parses a binary file list record without the size field. Returns false if the record is invalid
+bool parseBinaryFileListRecord(const char* rec, size_t rec_size, SFile &data, std::map<std::string, std::string>* extra);
+
+class BinaryFileListWriter
+{
+public:
+	BinaryFileListWriter(IFile* f);
+
+	//Use name ".." for 'u' records like writeFileItem
+	void writeItem(const SFile& cf, const std::map<std::string, std::string>* extra);
+
+	//Writes the directory index and flushes the buffer
+	void finish();
+
+private:
+	void addRecord(char type, const SFile& cf, const std::map<std::string, std::string>* extra);
+	int64 getOffset();
+	void flushBuffer();
+
+	IFile* f;
+	std::string buffer;
+	std::string record;
+	int64 buffer_offset;
+	int64 curr_id;
+	int64 n_nodes;
+
+	std::vector<std::pair<size_t, int64> > open_dirs;
+	std::vector<SFileListDirIndex> dir_index;
+};
+
+//Converts a text file list to the binary format
+bool convertFileListToBinary(const std::string& src_fn, const std::string& dst_fn);
+
 
 class FileListParser
 {
@@ -19,6 +87,7 @@ public:
 
 	void reset(void);
 
+	//Accepts text and binary file lists
 	bool nextEntry(char ch, SFile &data, std::map<std::string, std::string>* extra);
 
 private:
@@ -33,10 +102,60 @@ private:
 		ParseState_NameFinish,
 		ParseState_Filesize,
 		ParseState_ModifiedTime,
-		ParseState_ExtraParams
+		ParseState_ExtraParams,
+		ParseState_BinaryMagic,
+		ParseState_BinarySize,
+		ParseState_BinaryRecord,
+		ParseState_BinaryEnd
 	};
 
+	bool nextBinaryEntry(char ch, SFile &data, std::map<std::string, std::string>* extra);
+
 	ParseState state;
 	std::string t_name;
 	int64 pos;
+	_u32 record_size;
+};
+
+//Reads file lists in the text or binary format from a file.
+//Binary file lists are parsed directly from the read buffer
+class FileListReader
+{
+public:
+	FileListReader(IFile* f);
+
+	//Returns false at the end of the file list or on error
+	bool nextEntry(SFile &data, std::map<std::string, std::string>* extra);
+
+	bool hasError();
+	bool isBinary();
+
+	//Offset of the entry last returned by nextEntry()
+	int64 getEntryOffset();
+	//Offset of the next entry
+	int64 getOffset();
+	//Number of entries read so far, same as the line in a text file list
+	int64 getId();
+
+	//Continues reading at offset, which has to be at the start of an entry
+	void seek(int64 offset, int64 id);
+
+	//Reads the directory index of a binary file list. Returns false if there is no index
+	bool readDirIndex(std::vector<SFileListDirIndex>& dir_index);
+
+private:
+	bool fill(size_t n);
+
+	IFile* f;
+	std::vector<char> buffer;
+	size_t buffer_pos;
+	size_t buffer_size;
+	int64 buffer_offset;
+	bool eof;
+	bool has_error;
+	bool binary;
+	bool binary_end;
+	int64 entry_offset;
+	int64 id;
+	FileListParser parser;
 };
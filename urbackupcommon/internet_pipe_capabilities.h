@@ -1,5 +1,7 @@
 enum InternetPipeCapabilities
 {
 	IPC_ENCRYPTED=1,
-	IPC_COMPRESSED=2
+	IPC_COMPRESSED=2,
+	IPC_COMPRESSED_LZ4=4,
+	IPC_COMPRESSED_ZSTD=8
 };
\ No newline at end of file
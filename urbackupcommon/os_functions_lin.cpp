@@ -57,6 +57,7 @@
 #define open64 open
 #define readdir64 readdir
 #define dirent64 dirent
+#define fstatat64 fstatat
 #define fsblkcnt64_t fsblkcnt_t
 #endif
 
@@ -109,6 +110,9 @@ std::vector<SFile> getFiles(const std::string &path, bool *has_error, bool ignor
 	
 	upath+=os_file_sep();
 
+	//Stat relative to the directory, so the path does not have to be resolved for each entry
+	int dfd = dirfd(dp);
+
     errno=0;
     while ((dirp = readdir64(dp)) != NULL)
 	{
@@ -120,7 +124,7 @@ std::vector<SFile> getFiles(const std::string &path, bool *has_error, bool ignor
 		f.isdir=(dirp->d_type==DT_DIR);
 		
 		struct stat64 f_info;
-		int rc=lstat64((upath+dirp->d_name).c_str(), &f_info);
+		int rc=fstatat64(dfd, dirp->d_name, &f_info, AT_SYMLINK_NOFOLLOW);
 		if(rc==0)
 		{	
 			f.isdir = S_ISDIR(f_info.st_mode);
@@ -136,7 +140,7 @@ std::vector<SFile> getFiles(const std::string &path, bool *has_error, bool ignor
 				f.issym=true;
 				f.isspecialf=true;
 				struct stat64 l_info;
-				int rc2 = stat64((upath+dirp->d_name).c_str(), &l_info);
+				int rc2 = fstatat64(dfd, dirp->d_name, &l_info, 0);
 				
 				if(rc2==0)
 				{
@@ -75,6 +75,8 @@ std::vector<std::string> getSettingsList(void)
 	ret.push_back("end_to_end_file_backup_verification");
 	ret.push_back("internet_calculate_filehashes_on_client");
 	ret.push_back("internet_parallel_file_hashing");
+	ret.push_back("client_hash_threads");
+	ret.push_back("client_index_threads");
 	ret.push_back("image_file_format");
 	ret.push_back("internet_connect_always");
 	ret.push_back("server_url");
@@ -117,6 +119,8 @@ std::vector<std::string> getOnlyServerClientSettingsList(void)
 	ret.push_back("end_to_end_file_backup_verification");
 	ret.push_back("internet_calculate_filehashes_on_client");
 	ret.push_back("internet_parallel_file_hashing");
+	ret.push_back("client_hash_threads");
+	ret.push_back("client_index_threads");
 	ret.push_back("image_file_format");
 	ret.push_back("verify_using_client_hashes");
 	ret.push_back("internet_readd_file_entries");
@@ -177,6 +181,7 @@ std::vector<std::string> getGlobalSettingsList(void)
 	ret.push_back("use_tmpfiles_images");
 	ret.push_back("tmpdir");
 	ret.push_back("update_stats_cachesize");
+	ret.push_back("file_hash_threads");
 	ret.push_back("global_soft_fs_quota");
 	ret.push_back("show_server_updates");
 	ret.push_back("server_url");
@@ -35,12 +35,22 @@
 #include <assert.h>	/* assert() */
 #include "sha2.h"
 
-#ifdef DO_NOT_USE_CRYPTOPP_SHA
+//Builds with CryptoPP SHA use this implementation for SHA-256 only if
+//the CPU has the SHA extensions (see sha256_init)
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) \
+	&& (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SHA2_X86_SHANI
+#define SHA2_TARGET(x) __attribute__((target(x)))
+#include <immintrin.h>
+#include <cpuid.h>
+#elif defined(_MSC_VER) && _MSC_VER >= 1900 && (defined(_M_X64) || defined(_M_IX86))
+#define SHA2_X86_SHANI
+#define SHA2_TARGET(x)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
 
 
-#ifdef __cplusplus
-extern "C" {
-#endif
 
 /*
 * ASSERT NOTE:
@@ -227,6 +237,7 @@ typedef u_int64_t sha2_word64;	/* Exactly 8 bytes */
 								*/
 void SHA512_Last(SHA512_CTX*);
 void SHA256_Transform(SHA256_CTX*, const sha2_word32*);
+static void SHA256_Transform_scalar(SHA256_CTX*, const sha2_word32*);
 void SHA512_Transform(SHA512_CTX*, const sha2_word64*);
 
 
@@ -385,7 +396,7 @@ void SHA256_Init(SHA256_CTX* context) {
 	(h) = T1 + Sigma0_256(a) + Maj((a), (b), (c)); \
 	j++
 
-void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+static void SHA256_Transform_scalar(SHA256_CTX* context, const sha2_word32* data) {
 	sha2_word32	a, b, c, d, e, f, g, h, s0, s1;
 	sha2_word32	T1, *W256;
 	int		j;
@@ -443,7 +454,7 @@ void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
 
 #else /* SHA2_UNROLL_TRANSFORM */
 
-void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+static void SHA256_Transform_scalar(SHA256_CTX* context, const sha2_word32* data) {
 	sha2_word32	a, b, c, d, e, f, g, h, s0, s1;
 	sha2_word32	T1, T2, *W256;
 	int		j;
@@ -523,6 +534,125 @@ void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
 
 #endif /* SHA2_UNROLL_TRANSFORM */
 
+#ifdef SHA2_X86_SHANI
+
+/* Four SHA-256 rounds with the Intel SHA extensions. Afterwards computes
+* the schedule vector for round i+16 (W[t+16..t+19] from W[t..t+15])
+* into w0, if it is needed. */
+#define SHANI_ROUNDS4(i, w0, w1, w2, w3) \
+	msg = _mm_add_epi32(w0, _mm_loadu_si128((const __m128i*)&K256[(i) * 4])); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+	msg = _mm_shuffle_epi32(msg, 0x0E); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+	if ((i) < 12) { \
+		tmp = _mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4)); \
+		w0 = _mm_sha256msg2_epu32(tmp, w3); \
+	}
+
+/* SHA-256 transform using the Intel SHA extensions. Keeps the state
+* as ABEF/CDGH pairs as required by sha256rnds2. */
+SHA2_TARGET("sha,sse4.1") static void SHA256_Transform_shani(SHA256_CTX* context, const sha2_word32* data) {
+	const __m128i shuf_mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, abef_save, cdgh_save, msg, tmp;
+	__m128i w0, w1, w2, w3;
+
+	tmp = _mm_loadu_si128((const __m128i*)&context->state[0]);
+	state1 = _mm_loadu_si128((const __m128i*)&context->state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xB1);          /* CDAB */
+	state1 = _mm_shuffle_epi32(state1, 0x1B);    /* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8);    /* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0); /* CDGH */
+
+	abef_save = state0;
+	cdgh_save = state1;
+
+	w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), shuf_mask);
+	w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 4)), shuf_mask);
+	w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 8)), shuf_mask);
+	w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 12)), shuf_mask);
+
+	SHANI_ROUNDS4(0, w0, w1, w2, w3);
+	SHANI_ROUNDS4(1, w1, w2, w3, w0);
+	SHANI_ROUNDS4(2, w2, w3, w0, w1);
+	SHANI_ROUNDS4(3, w3, w0, w1, w2);
+	SHANI_ROUNDS4(4, w0, w1, w2, w3);
+	SHANI_ROUNDS4(5, w1, w2, w3, w0);
+	SHANI_ROUNDS4(6, w2, w3, w0, w1);
+	SHANI_ROUNDS4(7, w3, w0, w1, w2);
+	SHANI_ROUNDS4(8, w0, w1, w2, w3);
+	SHANI_ROUNDS4(9, w1, w2, w3, w0);
+	SHANI_ROUNDS4(10, w2, w3, w0, w1);
+	SHANI_ROUNDS4(11, w3, w0, w1, w2);
+	SHANI_ROUNDS4(12, w0, w1, w2, w3);
+	SHANI_ROUNDS4(13, w1, w2, w3, w0);
+	SHANI_ROUNDS4(14, w2, w3, w0, w1);
+	SHANI_ROUNDS4(15, w3, w0, w1, w2);
+
+	state0 = _mm_add_epi32(state0, abef_save);
+	state1 = _mm_add_epi32(state1, cdgh_save);
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B);       /* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xB1);    /* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0); /* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8);    /* HGFE */
+
+	_mm_storeu_si128((__m128i*)&context->state[0], state0);
+	_mm_storeu_si128((__m128i*)&context->state[4], state1);
+}
+
+typedef enum {
+	ESha256Impl_Scalar = 0,
+	ESha256Impl_ShaNi
+} ESha256Impl;
+
+static ESha256Impl select_sha256_impl(void) {
+	int has_sse41, has_sha;
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return ESha256Impl_Scalar;
+	}
+	__cpuid(info, 1);
+	has_sse41 = (info[2] & (1 << 19)) != 0;
+	__cpuidex(info, 7, 0);
+	has_sha = (info[1] & (1 << 29)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid_max(0, 0) < 7) {
+		return ESha256Impl_Scalar;
+	}
+	__cpuid(1, eax, ebx, ecx, edx);
+	has_sse41 = (ecx & (1 << 19)) != 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	has_sha = (ebx & (1 << 29)) != 0;
+#endif
+	if (has_sha && has_sse41) {
+		return ESha256Impl_ShaNi;
+	}
+	return ESha256Impl_Scalar;
+}
+
+/* Zero initialized (scalar) till dynamic initialization has run */
+static ESha256Impl sha256_impl = select_sha256_impl();
+
+void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+	if (sha256_impl == ESha256Impl_ShaNi) {
+		SHA256_Transform_shani(context, data);
+	}
+	else {
+		SHA256_Transform_scalar(context, data);
+	}
+}
+
+#else /* SHA2_X86_SHANI */
+
+void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+	SHA256_Transform_scalar(context, data);
+}
+
+#endif /* SHA2_X86_SHANI */
+
 void SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
 	unsigned int	freespace, usedspace;
 
@@ -1078,9 +1208,17 @@ char* SHA384_Data(const sha2_byte* data, size_t len, char digest[SHA384_DIGEST_S
 	return SHA384_End(&context, digest);
 }
 
-#ifdef	__cplusplus
+
+static bool sha256_native_accelerated()
+{
+#ifdef SHA2_X86_SHANI
+	return sha256_impl == ESha256Impl_ShaNi;
+#else
+	return false;
+#endif
 }
-#endif /* __cplusplus */
+
+#ifdef DO_NOT_USE_CRYPTOPP_SHA
 
 void sha256_init(sha256_ctx * ctx)
 {
@@ -1101,7 +1239,11 @@ void sha256_final(sha256_ctx *ctx, unsigned char *digest)
 void sha256(const unsigned char *message, unsigned int len,
 	unsigned char *digest)
 {
-	SHA256_Data(message, len, reinterpret_cast<char*>(digest));
+	sha256_ctx ctx;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, message, len);
+	sha256_final(&ctx, digest);
 }
 
 void sha512_init(sha512_ctx *ctx)
@@ -1120,46 +1262,6 @@ void sha512_final(sha512_ctx *ctx, unsigned char *digest)
 	SHA512_Final(digest, ctx);
 }
 
-void sha512(const unsigned char *message, unsigned int len,
-	unsigned char *digest)
-{
-	SHA512_Data(message, len, reinterpret_cast<char*>(digest));
-}
-
-#else //!DO_NOT_USE_CRYPTOPP_SHA
-
-void sha256_init(sha256_ctx * ctx)
-{
-	ctx->sha.Restart();
-}
-
-void sha256_update(sha256_ctx *ctx, const unsigned char *message,
-	unsigned int len)
-{
-	ctx->sha.Update(message, len);
-}
-
-void sha256_final(sha256_ctx *ctx, unsigned char *digest)
-{
-	ctx->sha.Final(digest);
-}
-
-void sha512_init(sha512_ctx *ctx)
-{
-	ctx->sha.Restart();
-}
-
-void sha512_update(sha512_ctx *ctx, const unsigned char *message,
-	unsigned int len)
-{
-	ctx->sha.Update(message, len);
-}
-
-void sha512_final(sha512_ctx *ctx, unsigned char *digest)
-{
-	ctx->sha.Final(digest);
-}
-
 void sha512(const unsigned char *message, unsigned int len,
 	unsigned char *digest)
 {
@@ -1170,13 +1272,109 @@ void sha512(const unsigned char *message, unsigned int len,
 	sha512_final(&ctx, digest);
 }
 
-void sha256(const unsigned char *message, unsigned int len, unsigned char *digest)
+const char* sha256_impl_name()
 {
-	sha256_ctx ctx;
+	if (sha256_native_accelerated())
+	{
+		return "sha-ni";
+	}
+	return "scalar";
+}
 
-	sha256_init(&ctx);
-	sha256_update(&ctx, message, len);
-	sha256_final(&ctx, digest);
+const char* sha512_impl_name()
+{
+	return "scalar";
 }
 
-#endif //DO_NOT_USE_CRYPTOPP_SHA
\ No newline at end of file
+#else //!DO_NOT_USE_CRYPTOPP_SHA
+
+void sha256_init(sha256_ctx * ctx)
+{
+	//CryptoPP's SHA-256 is faster than the scalar implementation, but
+	//not than the SHA extensions
+	ctx->use_native = sha256_native_accelerated();
+	if (ctx->use_native)
+	{
+		SHA256_Init(&ctx->native);
+	}
+	else
+	{
+		ctx->sha.Restart();
+	}
+}
+
+void sha256_update(sha256_ctx *ctx, const unsigned char *message,
+	unsigned int len)
+{
+	if (ctx->use_native)
+	{
+		SHA256_Update(&ctx->native, message, len);
+	}
+	else
+	{
+		ctx->sha.Update(message, len);
+	}
+}
+
+void sha256_final(sha256_ctx *ctx, unsigned char *digest)
+{
+	if (ctx->use_native)
+	{
+		SHA256_Final(digest, &ctx->native);
+	}
+	else
+	{
+		ctx->sha.Final(digest);
+	}
+}
+
+void sha512_init(sha512_ctx *ctx)
+{
+	ctx->sha.Restart();
+}
+
+void sha512_update(sha512_ctx *ctx, const unsigned char *message,
+	unsigned int len)
+{
+	ctx->sha.Update(message, len);
+}
+
+void sha512_final(sha512_ctx *ctx, unsigned char *digest)
+{
+	ctx->sha.Final(digest);
+}
+
+void sha512(const unsigned char *message, unsigned int len,
+	unsigned char *digest)
+{
+	sha512_ctx ctx;
+
+	sha512_init(&ctx);
+	sha512_update(&ctx, message, len);
+	sha512_final(&ctx, digest);
+}
+
+void sha256(const unsigned char *message, unsigned int len, unsigned char *digest)
+{
+	sha256_ctx ctx;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, message, len);
+	sha256_final(&ctx, digest);
+}
+
+const char* sha256_impl_name()
+{
+	if (sha256_native_accelerated())
+	{
+		return "sha-ni";
+	}
+	return "cryptopp";
+}
+
+const char* sha512_impl_name()
+{
+	return "cryptopp";
+}
+
+#endif //DO_NOT_USE_CRYPTOPP_SHA
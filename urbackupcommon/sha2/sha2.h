@@ -35,13 +35,6 @@
 #ifndef __SHA2_H__
 #define __SHA2_H__
 
-#ifdef DO_NOT_USE_CRYPTOPP_SHA
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-
 	/*
 	* Import u_intXX_t size_t type definitions from system headers.  You
 	* may need to change this, or define these things yourself in this
@@ -197,9 +190,7 @@ extern "C" {
 
 #endif /* NOPROTO */
 
-#ifdef	__cplusplus
-}
-#endif /* __cplusplus */
+#ifdef DO_NOT_USE_CRYPTOPP_SHA
 
 typedef SHA256_CTX sha256_ctx;
 typedef SHA512_CTX sha512_ctx;
@@ -213,7 +204,11 @@ typedef SHA512_CTX sha512_ctx;
 #define CRYPTOPP_INCLUDE_SHA <CRYPTOPP_INCLUDE_PREFIX/sha.h>
 #include CRYPTOPP_INCLUDE_SHA
 #endif
+//SHA-256 uses the built-in implementation if the CPU has the SHA
+//extensions (checked at runtime), CryptoPP otherwise
 typedef struct {
+	bool use_native;
+	SHA256_CTX native;
 	CryptoPP::SHA256 sha;
 } sha256_ctx;
 
@@ -241,6 +236,12 @@ void sha512_final(sha512_ctx *ctx, unsigned char *digest);
 void sha512(const unsigned char *message, unsigned int len,
 	unsigned char *digest);
 
+//Name of the SHA-256 implementation in use (SHA-NI if the CPU supports it)
+const char* sha256_impl_name();
+
+//Name of the SHA-512 implementation in use
+const char* sha512_impl_name();
+
 
 typedef sha512_ctx sha_def_ctx;
 
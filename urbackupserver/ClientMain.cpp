@@ -84,6 +84,7 @@ const unsigned int c_sleeptime_failed_imagebackup=20*60;
 const unsigned int c_sleeptime_failed_filebackup=20*60;
 const unsigned int c_exponential_backoff_div=2;
 const unsigned int c_image_cowraw_bit=1024;
+const unsigned int c_image_blockstore_bit=2048;
 
 
 int ClientMain::running_backups=0;
@@ -319,9 +320,13 @@ void ClientMain::operator ()(void)
 	{
 		curr_image_version = curr_image_version & c_image_cowraw_bit;
 	}
+	else if(server_settings->getImageFileFormat()==image_file_format_blockstore)
+	{
+		curr_image_version = (curr_image_version & ~c_image_cowraw_bit) | c_image_blockstore_bit;
+	}
 	else
 	{
-		curr_image_version = curr_image_version & ~c_image_cowraw_bit;
+		curr_image_version = curr_image_version & ~c_image_cowraw_bit & ~c_image_blockstore_bit;
 	}
 
 	prepareSQL();
@@ -628,9 +633,13 @@ void ClientMain::operator ()(void)
 					{
 						curr_image_version = curr_image_version & c_image_cowraw_bit;
 					}
+					else if(server_settings->getImageFileFormat()==image_file_format_blockstore)
+					{
+						curr_image_version = (curr_image_version & ~c_image_cowraw_bit) | c_image_blockstore_bit;
+					}
 					else
 					{
-						curr_image_version = curr_image_version & ~c_image_cowraw_bit;
+						curr_image_version = curr_image_version & ~c_image_cowraw_bit & ~c_image_blockstore_bit;
 					}
 
 					updateVirtualClients();
@@ -1593,6 +1602,11 @@ bool ClientMain::updateCapabilities(bool* needs_restart)
 		{
 			protocol_versions.async_index_version = watoi(it->second);
 		}
+		it = params.find("BINARY_FILELIST");
+		if (it != params.end())
+		{
+			protocol_versions.binary_filelist_version = watoi(it->second);
+		}
 		it = params.find("SYMBIT");
 		if (it != params.end())
 		{
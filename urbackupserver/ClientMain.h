@@ -48,7 +48,7 @@ struct SProtocolVersions
 				client_bitmap_version(0), cmd_version(0),
 				symbit_version(0), phash_version(0),
 				wtokens_version(0), update_vols(0),
-				update_capa_interval(0)
+				update_capa_interval(0), binary_filelist_version(0)
 			{
 
 			}
@@ -72,6 +72,7 @@ struct SProtocolVersions
 	int wtokens_version;
 	int update_vols;
 	int update_capa_interval;
+	int binary_filelist_version;
 	std::string os_simple;
 };
 
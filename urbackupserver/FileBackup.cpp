@@ -35,11 +35,13 @@
 #include <stack>
 #include <limits.h>
 #include "FileMetadataDownloadThread.h"
+#include "ServerDownloadThread.h"
 #include "../utf8/utf8.h"
 #include "server.h"
 #include "../urbackupcommon/TreeHash.h"
 #include "../common/data.h"
 #include "PhashLoad.h"
+#include "server_hash_writer.h"
 
 #ifndef NAME_MAX
 #define NAME_MAX _POSIX_NAME_MAX
@@ -54,8 +56,7 @@ FileBackup::FileBackup( ClientMain* client_main, int clientid, std::string clien
 	:  Backup(client_main, clientid, clientname, clientsubname, log_action, true, is_incremental, server_token, details, scheduled),
 	group(group), use_tmpfiles(use_tmpfiles), tmpfile_path(tmpfile_path), use_reflink(use_reflink), use_snapshots(use_snapshots),
 	disk_error(false), with_hashes(false),
-	backupid(-1), hashpipe(NULL), hashpipe_prepare(NULL), bsh(NULL), bsh_prepare(NULL),
-	bsh_ticket(ILLEGAL_THREADPOOL_TICKET), bsh_prepare_ticket(ILLEGAL_THREADPOOL_TICKET), pingthread(NULL),
+	backupid(-1), hashpipe_prepare(NULL), bsh_writer(NULL), bsh_writer_ticket(ILLEGAL_THREADPOOL_TICKET), pingthread(NULL),
 	pingthread_ticket(ILLEGAL_THREADPOOL_TICKET), cdp_path(false), metadata_download_thread_ticket(ILLEGAL_THREADPOOL_TICKET),
 	last_speed_received_bytes(0), speed_set_time(0)
 {
@@ -198,6 +199,11 @@ bool FileBackup::request_filelist_construct(bool full, bool resume, int group,
 		start_backup_cmd += "&async=1";
 	}
 
+	if (client_main->getProtocolVersions().binary_filelist_version > 0)
+	{
+		start_backup_cmd += "&binary_filelist=1";
+	}
+
 	if(with_token)
 	{
 		start_backup_cmd+="#token="+server_token;
@@ -581,16 +587,41 @@ std::string FileBackup::clientlistName(int ref_backupid)
 
 void FileBackup::createHashThreads(bool use_reflink, bool ignore_hash_mismatches)
 {
-	assert(bsh==NULL);
-	assert(bsh_prepare==NULL);
+	assert(bsh.empty());
+	assert(bsh_prepare.empty());
+
+	size_t num_hash_threads = static_cast<size_t>((std::max)(1, (std::min)(64,
+		server_settings->getSettings()->file_hash_threads)));
 
-	hashpipe=Server->createMemoryPipe();
 	hashpipe_prepare=Server->createMemoryPipe();
+	hashpipe_prepare_mutex.reset(Server->createMutex());
 
-	bsh=new BackupServerHash(hashpipe, clientid, use_snapshots, use_reflink, use_tmpfiles, logid, use_snapshots, max_file_id);
-	bsh_prepare=new BackupServerPrepareHash(hashpipe_prepare, hashpipe, clientid, logid, ignore_hash_mismatches);
-	bsh_ticket = Server->getThreadPool()->execute(bsh, "fbackup write");
-	bsh_prepare_ticket = Server->getThreadPool()->execute(bsh_prepare, "fbackup hash");
+	if (num_hash_threads > 1)
+	{
+		ServerLogger::Log(logid, "Using " + convert(num_hash_threads) + " file hash threads", LL_DEBUG);
+
+		bsh_writer = new BackupServerHashWriter();
+		bsh_writer_ticket = Server->getThreadPool()->execute(bsh_writer, "fbackup db write");
+	}
+
+	for (size_t i = 0; i < num_hash_threads; ++i)
+	{
+		IPipe* hashpipe = Server->createMemoryPipe();
+		hashpipes.push_back(hashpipe);
+		bsh.push_back(new BackupServerHash(hashpipe, clientid, use_snapshots, use_reflink, use_tmpfiles, logid, use_snapshots, max_file_id, bsh_writer));
+	}
+
+	for (size_t i = 0; i < num_hash_threads; ++i)
+	{
+		bsh_prepare.push_back(new BackupServerPrepareHash(hashpipe_prepare, hashpipes, clientid, logid, ignore_hash_mismatches,
+			hashpipe_prepare_mutex.get(), &max_file_id));
+	}
+
+	for (size_t i = 0; i < num_hash_threads; ++i)
+	{
+		bsh_tickets.push_back(Server->getThreadPool()->execute(bsh[i], "fbackup write"));
+		bsh_prepare_tickets.push_back(Server->getThreadPool()->execute(bsh_prepare[i], "fbackup hash"));
+	}
 }
 
 
@@ -598,19 +629,82 @@ void FileBackup::destroyHashThreads()
 {
 	if (hashpipe_prepare != NULL)
 	{
-		assert(bsh_ticket != ILLEGAL_THREADPOOL_TICKET);
-		assert(bsh_prepare_ticket != ILLEGAL_THREADPOOL_TICKET);
-		hashpipe_prepare->Write("exit");
-		Server->getThreadPool()->waitFor(bsh_ticket);
-		Server->getThreadPool()->waitFor(bsh_prepare_ticket);
+		assert(!bsh_tickets.empty());
+		assert(!bsh_prepare_tickets.empty());
+
+		for (size_t i = 0; i < bsh_prepare_tickets.size(); ++i)
+		{
+			hashpipe_prepare->Write("exit");
+		}
+		Server->getThreadPool()->waitFor(bsh_prepare_tickets);
+		Server->destroy(hashpipe_prepare);
+
+		for (size_t i = 0; i < hashpipes.size(); ++i)
+		{
+			hashpipes[i]->Write("exit");
+		}
+		Server->getThreadPool()->waitFor(bsh_tickets);
+
+		if (bsh_writer != NULL)
+		{
+			bsh_writer->doExit();
+			Server->getThreadPool()->waitFor(bsh_writer_ticket);
+		}
 	}
 
-	bsh_ticket=ILLEGAL_THREADPOOL_TICKET;
-	bsh_prepare_ticket=ILLEGAL_THREADPOOL_TICKET;
-	hashpipe=NULL;
+	bsh_tickets.clear();
+	bsh_prepare_tickets.clear();
+	bsh_writer_ticket=ILLEGAL_THREADPOOL_TICKET;
+	hashpipes.clear();
 	hashpipe_prepare=NULL;
-	bsh=NULL;
-	bsh_prepare=NULL;
+	hashpipe_prepare_mutex.reset();
+	bsh.clear();
+	bsh_prepare.clear();
+	bsh_writer=NULL;
+}
+
+_u32 FileBackup::getHashQueuesize()
+{
+	size_t ret = 0;
+	for (size_t i = 0; i < hashpipes.size(); ++i)
+	{
+		ret += hashpipes[i]->getNumElements() + (bsh[i]->isWorking() ? 1 : 0);
+	}
+	if (bsh_writer != NULL)
+	{
+		ret += bsh_writer->getQueueSize() + (bsh_writer->isWorking() ? 1 : 0);
+	}
+	return static_cast<_u32>(ret);
+}
+
+_u32 FileBackup::getPrepareHashQueuesize()
+{
+	size_t ret = hashpipe_prepare->getNumElements();
+	for (size_t i = 0; i < bsh_prepare.size(); ++i)
+	{
+		ret += bsh_prepare[i]->isWorking() ? 1 : 0;
+	}
+	return static_cast<_u32>(ret);
+}
+
+bool FileBackup::hashThreadsHaveError()
+{
+	bool ret = false;
+	for (size_t i = 0; i < bsh.size(); ++i)
+	{
+		if (bsh[i]->hasError())
+		{
+			ret = true;
+		}
+	}
+	for (size_t i = 0; i < bsh_prepare.size(); ++i)
+	{
+		if (bsh_prepare[i]->hasError())
+		{
+			ret = true;
+		}
+	}
+	return ret;
 }
 
 _i64 FileBackup::getIncrementalSize(IFile *f, const std::vector<size_t> &diffs, bool& backup_with_components, bool all)
@@ -707,7 +801,7 @@ _i64 FileBackup::getIncrementalSize(IFile *f, const std::vector<size_t> &diffs,
 	return rsize;
 }
 
-void FileBackup::calculateDownloadSpeed(int64 ctime, FileClient & fc, FileClientChunked * fc_chunked)
+void FileBackup::calculateDownloadSpeed(int64 ctime, FileClient & fc, FileClientChunked * fc_chunked, ServerDownloadThread* server_download)
 {
 	if (speed_set_time == 0)
 	{
@@ -716,7 +810,8 @@ void FileBackup::calculateDownloadSpeed(int64 ctime, FileClient & fc, FileClient
 
 	if (ctime - speed_set_time>10000)
 	{
-		int64 received_data_bytes = fc.getTransferredBytes() + (fc_chunked != NULL ? fc_chunked->getTransferredBytes() : 0);
+		int64 received_data_bytes = fc.getTransferredBytes() + (fc_chunked != NULL ? fc_chunked->getTransferredBytes() : 0)
+			+ server_download->getStreamsTransferredBytes();
 
 		int64 new_bytes = received_data_bytes - last_speed_received_bytes;
 		int64 passed_time = ctime - speed_set_time;
@@ -739,11 +834,12 @@ void FileBackup::calculateDownloadSpeed(int64 ctime, FileClient & fc, FileClient
 }
 
 void FileBackup::calculateEtaFileBackup( int64 &last_eta_update, int64& eta_set_time, int64 ctime, FileClient &fc, FileClientChunked* fc_chunked,
-	int64 linked_bytes, int64 &last_eta_received_bytes, double &eta_estimated_speed, _i64 files_size )
+	ServerDownloadThread* server_download, int64 linked_bytes, int64 &last_eta_received_bytes, double &eta_estimated_speed, _i64 files_size )
 {
 	last_eta_update=ctime;
 
-	int64 received_data_bytes = fc.getReceivedDataBytes(true) + (fc_chunked?fc_chunked->getReceivedDataBytes(true):0) + linked_bytes;
+	int64 received_data_bytes = fc.getReceivedDataBytes(true) + (fc_chunked?fc_chunked->getReceivedDataBytes(true):0)
+		+ server_download->getStreamsReceivedDataBytes(true) + linked_bytes;
 
 	int64 new_bytes =  received_data_bytes - last_eta_received_bytes;
 	int64 passed_time = Server->getTimeMS() - eta_set_time;
@@ -1188,20 +1284,23 @@ void FileBackup::notifyClientBackupSuccessful(void)
 void FileBackup::waitForFileThreads(void)
 {
 	SStatus status=ServerStatus::getStatus(clientname);
-	hashpipe->Write("flush");
+	for(size_t i=0;i<hashpipes.size();++i)
+	{
+		hashpipes[i]->Write("flush");
+	}
 	hashpipe_prepare->Write("flush");
-	_u32 hashqueuesize=(_u32)hashpipe->getNumElements()+(bsh->isWorking()?1:0);
-	_u32 prepare_hashqueuesize=(_u32)hashpipe_prepare->getNumElements()+(bsh_prepare->isWorking()?1:0);
+	_u32 hashqueuesize=getHashQueuesize();
+	_u32 prepare_hashqueuesize=getPrepareHashQueuesize();
 	while(hashqueuesize>0 || prepare_hashqueuesize>0)
 	{
 		ServerStatus::setProcessQueuesize(clientname, status_id, prepare_hashqueuesize, hashqueuesize);
 		Server->wait(1000);
-		hashqueuesize=(_u32)hashpipe->getNumElements()+(bsh->isWorking()?1:0);
-		prepare_hashqueuesize=(_u32)hashpipe_prepare->getNumElements()+(bsh_prepare->isWorking()?1:0);
+		hashqueuesize=getHashQueuesize();
+		prepare_hashqueuesize=getPrepareHashQueuesize();
 	}
 	{
 		Server->wait(10);
-		while(bsh->isWorking()) Server->wait(1000);
+		while(getHashQueuesize()>0) Server->wait(1000);
 	}	
 
 	ServerStatus::setProcessQueuesize(clientname, status_id, 0, 0);
@@ -11,13 +11,17 @@
 #include "server_log.h"
 #include "FileMetadataDownloadThread.h"
 #include <set>
+#include <vector>
+#include <algorithm>
 
 class ClientMain;
 class BackupServerHash;
 class BackupServerPrepareHash;
+class BackupServerHashWriter;
 class ServerPingThread;
 class FileIndex;
 class PhashLoad;
+class ServerDownloadThread;
 
 namespace
 {
@@ -75,7 +79,7 @@ public:
 	MaxFileId()
 		: mutex(Server->createMutex()),
 		max_downloaded(std::string::npos), max_preprocessed(0),
-		min_downloaded(0)
+		min_downloaded(0), done_bound(0)
 	{}
 
 	void setMinDownloaded(size_t id)
@@ -85,13 +89,38 @@ public:
 		{
 			max_downloaded = id;
 		}
+		if (done_bound > id)
+		{
+			done_bound = id;
+		}
 		min_downloaded = id+1;
 	}
 
+	void addInFlight(size_t id)
+	{
+		IScopedLock lock(mutex.get());
+		in_flight.insert(id);
+	}
+
+	void removeInFlight(size_t id)
+	{
+		IScopedLock lock(mutex.get());
+		in_flight.erase(id);
+	}
+
 	void setMaxDownloaded(size_t id)
 	{
 		IScopedLock lock(mutex.get());
-		max_downloaded = id + 1;
+		in_flight.erase(id);
+		done_bound = (std::max)(done_bound, id + 1);
+		max_downloaded = done_bound;
+		//With multiple hash workers files can finish out of order.
+		//Files in flight in other workers are not downloaded yet.
+		if (!in_flight.empty()
+			&& *in_flight.begin() < max_downloaded)
+		{
+			max_downloaded = *in_flight.begin();
+		}
 		if (max_downloaded >= min_downloaded)
 		{
 			max_downloaded = std::string::npos;
@@ -120,6 +149,8 @@ private:
 	size_t max_downloaded;
 	size_t max_preprocessed;
 	size_t min_downloaded;
+	size_t done_bound;
+	std::set<size_t> in_flight;
 };
 
 class FileBackup : public Backup, public FileClient::ProgressLogCallback, public FileClient::NoFreeSpaceCallback,
@@ -170,10 +201,13 @@ protected:
 	std::string clientlistName(int ref_backupid);
 	void createHashThreads(bool use_reflink, bool ignore_hash_mismatches);
 	void destroyHashThreads();
+	_u32 getHashQueuesize();
+	_u32 getPrepareHashQueuesize();
+	bool hashThreadsHaveError();
 	_i64 getIncrementalSize(IFile *f, const std::vector<size_t> &diffs, bool& backup_with_components, bool all=false);
-	void calculateDownloadSpeed(int64 ctime, FileClient &fc, FileClientChunked* fc_chunked);
+	void calculateDownloadSpeed(int64 ctime, FileClient &fc, FileClientChunked* fc_chunked, ServerDownloadThread* server_download);
 	void calculateEtaFileBackup( int64 &last_eta_update, int64& eta_set_time, int64 ctime, FileClient &fc, FileClientChunked* fc_chunked,
-		int64 linked_bytes, int64 &last_eta_received_bytes, double &eta_estimated_speed, _i64 files_size );
+		ServerDownloadThread* server_download, int64 linked_bytes, int64 &last_eta_received_bytes, double &eta_estimated_speed, _i64 files_size );
 	bool hasChange(size_t line, const std::vector<size_t> &diffs);
 	bool link_file(const std::string &fn, const std::string &short_fn, const std::string &curr_path,
 		const std::string &os_path, const std::string& sha2, _i64 filesize, bool add_sql, FileMetadata& metadata);
@@ -215,12 +249,15 @@ protected:
 	std::string backuppath_hashes;
 	std::string backuppath_single;
 
-	IPipe *hashpipe;
+	std::vector<IPipe*> hashpipes;
 	IPipe *hashpipe_prepare;
-	BackupServerHash *bsh;
-	THREADPOOL_TICKET bsh_ticket;
-	BackupServerPrepareHash *bsh_prepare;
-	THREADPOOL_TICKET bsh_prepare_ticket;
+	std::auto_ptr<IMutex> hashpipe_prepare_mutex;
+	std::vector<BackupServerHash*> bsh;
+	std::vector<THREADPOOL_TICKET> bsh_tickets;
+	std::vector<BackupServerPrepareHash*> bsh_prepare;
+	std::vector<THREADPOOL_TICKET> bsh_prepare_tickets;
+	BackupServerHashWriter* bsh_writer;
+	THREADPOOL_TICKET bsh_writer_ticket;
 	std::auto_ptr<BackupServerHash> local_hash;
 
 	ServerPingThread* pingthread;
@@ -27,6 +27,7 @@ const unsigned int max_wait_time=1000;
 const unsigned int max_wait_time=30000;
 #endif
 const size_t min_size_no_wait=10000;
+const unsigned int max_wait_time_full=1000;
 
 std::map<FileIndex::SIndexKey, int64> FileIndex::cache_buffer_1;
 std::map<FileIndex::SIndexKey, int64> FileIndex::cache_buffer_2;
@@ -37,19 +38,24 @@ std::map<FileIndex::SIndexKey, int64>* FileIndex::other_cache_buffer=&cache_buff
 
 IMutex *FileIndex::mutex=NULL;
 ICondition *FileIndex::cond=NULL;
+ICondition *FileIndex::commit_cond=NULL;
 bool FileIndex::do_shutdown=false;
 bool FileIndex::do_flush=false;
 bool FileIndex::do_accept = true;
+int64 FileIndex::active_generation = 1;
+int64 FileIndex::committed_generation = 0;
 
 
 void FileIndex::operator()(void)
 {
 	mutex=Server->createMutex();
 	cond=Server->createCondition();
+	commit_cond=Server->createCondition();
 
 	while(true)
 	{
 		std::map<FileIndex::SIndexKey, int64>* local_buf;
+		int64 local_generation;
 
 		{
 			IScopedLock lock(mutex);
@@ -61,20 +67,32 @@ void FileIndex::operator()(void)
 				break;
 			}
 
-			while(active_cache_buffer->empty() && !do_shutdown)
+			//Group commit: Wait till enough changes accumulated or the
+			//oldest pending change is max_wait_time old
+			int64 starttime=Server->getTimeMS();
+			while(!do_shutdown && !do_flush
+				&& ( active_cache_buffer->empty()
+					|| (active_cache_buffer->size()<min_size_no_wait
+						&& Server->getTimeMS()-starttime<max_wait_time) ) )
 			{
-				do_flush=false;
-				int64 starttime=Server->getTimeMS();
-
-				while(active_cache_buffer->size()<min_size_no_wait
-					&& Server->getTimeMS()-starttime<max_wait_time
-					&& !do_shutdown && !do_flush)
+				if(active_cache_buffer->empty())
 				{
-					cond->wait(&lock, max_wait_time);
+					starttime=Server->getTimeMS();
 				}
-			}			
+
+				cond->wait(&lock, max_wait_time);
+			}
+
+			do_flush=false;
+
+			if(active_cache_buffer->empty())
+			{
+				continue;
+			}
 
 			local_buf=active_cache_buffer;
+			local_generation=active_generation;
+			++active_generation;
 			
 			if(active_cache_buffer==&cache_buffer_1)
 			{
@@ -88,6 +106,8 @@ void FileIndex::operator()(void)
 			}
 		}
 
+		int64 commit_starttime = Server->getTimeMS();
+
 		start_transaction();
 
 		for(std::map<FileIndex::SIndexKey, int64>::iterator it=local_buf->begin();
@@ -112,10 +132,14 @@ void FileIndex::operator()(void)
 
 		commit_transaction();
 
+		Server->Log("Committed "+convert(local_buf->size())+" file entry index changes in "
+			+ PrettyPrintTime(Server->getTimeMS()-commit_starttime), LL_DEBUG);
+
 		{
 			IScopedLock lock(mutex);
 			local_buf->clear();
-			do_flush=false;
+			committed_generation=local_generation;
+			commit_cond->notify_all();
 		}
 	}
 
@@ -128,13 +152,22 @@ void FileIndex::put_delayed(const SIndexKey& key, int64 value)
 
 	while(active_cache_buffer->size()>=max_buffer_size || !do_accept)
 	{
-		lock.relock(NULL);
-		Server->wait(10);
-		lock.relock(mutex);
+		if(do_accept)
+		{
+			do_flush=true;
+			cond->notify_all();
+		}
+		commit_cond->wait(&lock, max_wait_time_full);
 	}
 
+	//Changes to the same key are coalesced. Only wake up the writer if it has
+	//to start the wait timer or if the group commit size is reached
 	(*active_cache_buffer)[key]=value;
-	cond->notify_all();
+	if(active_cache_buffer->size()==1
+		|| active_cache_buffer->size()==min_size_no_wait)
+	{
+		cond->notify_all();
+	}
 }
 
 void FileIndex::del_delayed(const SIndexKey& key)
@@ -318,14 +351,15 @@ void FileIndex::flush()
 {
 	IScopedLock lock(mutex);
 
-	do_flush=true;
+	//Wait for the changes currently pending (in the active buffer) and
+	//the ones currently being committed
+	int64 flush_generation = active_cache_buffer->empty() ? (active_generation-1) : active_generation;
 
-	while(do_flush)
+	while(committed_generation<flush_generation)
 	{
+		do_flush=true;
 		cond->notify_all();
-		lock.relock(NULL);
-		Server->wait(100);
-		lock.relock(mutex);
+		commit_cond->wait(&lock, 1000);
 	}
 }
 
@@ -154,10 +154,12 @@ private:
 	static std::map<SIndexKey, int64> cache_buffer_2;
 	static std::map<SIndexKey, int64>* active_cache_buffer;
 	static std::map<SIndexKey, int64>* other_cache_buffer;
-	static std::map<SIndexKey, bool> del_buffer;
 	static IMutex *mutex;
 	static ICondition *cond;
+	static ICondition *commit_cond;
 	static bool do_shutdown;
+	static int64 active_generation;
+	static int64 committed_generation;
 
 	static bool do_flush;
 	static bool do_accept;
@@ -0,0 +1,406 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "FileIndexFilter.h"
+#include "../Interface/Server.h"
+#include "../Interface/File.h"
+#include "../common/data.h"
+#include "../urbackupcommon/os_functions.h"
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+	const size_t bits_per_entry = 10;
+	const size_t n_hashes = 7;
+	const char* filter_magic = "URBACKUP FILE INDEX FILTER";
+	const char filter_version = 1;
+	const _u32 io_block_size = 1024 * 1024;
+	//Rebuild the filter if the expected false positive rate gets
+	//above this (it is ~0.8% at capacity)
+	const double rebuild_fp_rate = 0.02;
+	//Wait this long before retrying a failed rebuild. Doubled
+	//with every further failure up to the maximum.
+	const int64 rebuild_retry_wait = 10 * 60 * 1000;
+	const int64 rebuild_retry_wait_max = 24 * 60 * 60 * 1000;
+
+	size_t bits_for_capacity(int64 capacity)
+	{
+		size_t ret = static_cast<size_t>(capacity)*bits_per_entry;
+		return ((ret + 7) / 8) * 8;
+	}
+
+	size_t count_bits(unsigned char b)
+	{
+		size_t ret = 0;
+		for (; b != 0; b &= b - 1)
+		{
+			++ret;
+		}
+		return ret;
+	}
+
+	uint64 read_uint64(const char* buf)
+	{
+		uint64 ret = 0;
+		for (size_t i = 0; i < sizeof(uint64); ++i)
+		{
+			ret = (ret << 8) | static_cast<unsigned char>(buf[i]);
+		}
+		return ret;
+	}
+}
+
+FileIndexFilter::FileIndexFilter(int64 capacity)
+	: mutex(Server->createMutex()), n_bits(bits_for_capacity(capacity)), capacity(capacity), n_set_bits(0),
+	rebuilding(false), rebuild_n_bits(0), rebuild_capacity(0), rebuild_n_set_bits(0),
+	rebuild_retry_time(0), rebuild_retry_wait_curr(rebuild_retry_wait),
+	n_negative(0), n_false_positive(0)
+{
+	bits.resize(n_bits / 8);
+}
+
+FileIndexFilter::FileIndexFilter(int64 capacity, size_t n_bits)
+	: mutex(Server->createMutex()), n_bits(n_bits), capacity(capacity), n_set_bits(0),
+	rebuilding(false), rebuild_n_bits(0), rebuild_capacity(0), rebuild_n_set_bits(0),
+	rebuild_retry_time(0), rebuild_retry_wait_curr(rebuild_retry_wait),
+	n_negative(0), n_false_positive(0)
+{
+	bits.resize(n_bits / 8);
+}
+
+FileIndexFilter* FileIndexFilter::load(const std::string& fn, int64 txnid)
+{
+	std::auto_ptr<IFile> f(Server->openFile(fn, MODE_READ));
+	if (f.get() == NULL)
+	{
+		return NULL;
+	}
+
+	std::string header = f->Read(static_cast<_u32>(512));
+	CRData data(header.data(), header.size());
+
+	std::string magic;
+	char version;
+	int64 f_txnid;
+	int64 f_capacity;
+	int64 f_n_bits;
+	int64 f_entries;
+	if (!data.getStr(&magic)
+		|| magic != filter_magic
+		|| !data.getChar(&version)
+		|| version != filter_version
+		|| !data.getInt64(&f_txnid)
+		|| !data.getInt64(&f_capacity)
+		|| !data.getInt64(&f_n_bits)
+		|| !data.getInt64(&f_entries)
+		|| f_n_bits<=0 || f_n_bits % 8 != 0)
+	{
+		Server->Log("File entry index filter at \"" + fn + "\" has unknown format", LL_WARNING);
+		return NULL;
+	}
+
+	if (f_txnid != txnid)
+	{
+		Server->Log("File entry index filter is not up to date (transaction " + convert(f_txnid) + " but index is at " + convert(txnid) + ")", LL_INFO);
+		return NULL;
+	}
+
+	if (f->Size() != static_cast<int64>(data.getStreampos()) + f_n_bits / 8)
+	{
+		Server->Log("File entry index filter at \"" + fn + "\" has wrong size", LL_WARNING);
+		return NULL;
+	}
+
+	std::auto_ptr<FileIndexFilter> ret(new FileIndexFilter(f_capacity, static_cast<size_t>(f_n_bits)));
+
+	int64 pos = data.getStreampos();
+	for (size_t i = 0; i < ret->bits.size();)
+	{
+		_u32 toread = static_cast<_u32>((std::min)(static_cast<size_t>(io_block_size), ret->bits.size() - i));
+		bool has_error = false;
+		_u32 read = f->Read(pos, reinterpret_cast<char*>(&ret->bits[i]), toread, &has_error);
+		if (read != toread || has_error)
+		{
+			Server->Log("Error reading file entry index filter. " + os_last_error_str(), LL_WARNING);
+			return NULL;
+		}
+		i += read;
+		pos += read;
+	}
+
+	for (size_t i = 0; i < ret->bits.size(); ++i)
+	{
+		ret->n_set_bits += count_bits(ret->bits[i]);
+	}
+
+	return ret.release();
+}
+
+bool FileIndexFilter::save(const std::string& fn, int64 txnid)
+{
+	IScopedLock lock(mutex.get());
+
+	std::auto_ptr<IFile> f(Server->openFile(fn + ".new", MODE_WRITE));
+	if (f.get() == NULL)
+	{
+		Server->Log("Error opening \"" + fn + ".new\" for writing. " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	CWData data;
+	data.addString(filter_magic);
+	data.addChar(filter_version);
+	data.addInt64(txnid);
+	data.addInt64(capacity);
+	data.addInt64(n_bits);
+	data.addInt64(static_cast<int64>(estimateEntries(n_set_bits, n_bits)));
+
+	bool has_error = false;
+	f->Write(data.getDataPtr(), data.getDataSize(), &has_error);
+
+	for (size_t i = 0; i < bits.size() && !has_error;)
+	{
+		_u32 towrite = static_cast<_u32>((std::min)(static_cast<size_t>(io_block_size), bits.size() - i));
+		_u32 written = f->Write(reinterpret_cast<const char*>(&bits[i]), towrite, &has_error);
+		if (written != towrite)
+		{
+			has_error = true;
+		}
+		i += written;
+	}
+
+	if (has_error
+		|| !f->Sync())
+	{
+		Server->Log("Error writing file entry index filter. " + os_last_error_str(), LL_ERROR);
+		f.reset();
+		Server->deleteFile(fn + ".new");
+		return false;
+	}
+
+	f.reset();
+
+	if (!os_rename_file(fn + ".new", fn))
+	{
+		Server->Log("Error renaming file entry index filter. " + os_last_error_str(), LL_ERROR);
+		return false;
+	}
+
+	return true;
+}
+
+void FileIndexFilter::getHashes(const FileIndex::SIndexKey& key, uint64& h1, uint64& h2)
+{
+	//The index hash is a prefix of a cryptographic hash, so parts of it
+	//can be used directly as independent hash values
+	h1 = read_uint64(key.getHash()) ^ (static_cast<uint64>(key.getFilesize())*0x9E3779B97F4A7C15ULL);
+	h2 = read_uint64(key.getHash() + sizeof(uint64)) | 1;
+}
+
+size_t FileIndexFilter::setBits(std::vector<unsigned char>& target_bits, size_t target_n_bits, uint64 h1, uint64 h2)
+{
+	size_t new_bits = 0;
+	for (size_t i = 0; i < n_hashes; ++i)
+	{
+		size_t bit = static_cast<size_t>((h1 + i*h2) % target_n_bits);
+		unsigned char mask = static_cast<unsigned char>(1 << (bit % 8));
+		if ((target_bits[bit / 8] & mask) == 0)
+		{
+			target_bits[bit / 8] |= mask;
+			++new_bits;
+		}
+	}
+	return new_bits;
+}
+
+double FileIndexFilter::estimateEntries(size_t set_bits, size_t total_bits)
+{
+	if (set_bits >= total_bits)
+	{
+		return static_cast<double>(capacity)*bits_per_entry;
+	}
+
+	return -static_cast<double>(total_bits) / n_hashes
+		* log(1.0 - static_cast<double>(set_bits) / total_bits);
+}
+
+void FileIndexFilter::add(const FileIndex::SIndexKey& key)
+{
+	uint64 h1, h2;
+	getHashes(key, h1, h2);
+
+	IScopedLock lock(mutex.get());
+
+	n_set_bits += setBits(bits, n_bits, h1, h2);
+
+	if (rebuilding)
+	{
+		rebuild_n_set_bits += setBits(rebuild_bits, rebuild_n_bits, h1, h2);
+	}
+}
+
+bool FileIndexFilter::needsRebuild()
+{
+	{
+		IScopedLock lock(mutex.get());
+		if (rebuilding
+			|| Server->getTimeMS() < rebuild_retry_time)
+		{
+			return false;
+		}
+	}
+
+	return getExpectedFalsePositiveRate() > rebuild_fp_rate;
+}
+
+bool FileIndexFilter::startRebuild(int64 new_capacity)
+{
+	IScopedLock lock(mutex.get());
+
+	if (rebuilding)
+	{
+		return false;
+	}
+
+	rebuild_capacity = new_capacity;
+	rebuild_n_bits = bits_for_capacity(new_capacity);
+	rebuild_bits.resize(rebuild_n_bits / 8);
+	rebuild_n_set_bits = 0;
+	rebuilding = true;
+	return true;
+}
+
+void FileIndexFilter::addRebuild(const FileIndex::SIndexKey& key)
+{
+	uint64 h1, h2;
+	getHashes(key, h1, h2);
+
+	IScopedLock lock(mutex.get());
+
+	if (rebuilding)
+	{
+		rebuild_n_set_bits += setBits(rebuild_bits, rebuild_n_bits, h1, h2);
+	}
+}
+
+void FileIndexFilter::finishRebuild()
+{
+	IScopedLock lock(mutex.get());
+
+	if (!rebuilding)
+	{
+		return;
+	}
+
+	bits.swap(rebuild_bits);
+	n_bits = rebuild_n_bits;
+	capacity = rebuild_capacity;
+	n_set_bits = rebuild_n_set_bits;
+	n_negative = 0;
+	n_false_positive = 0;
+	rebuild_retry_time = 0;
+	rebuild_retry_wait_curr = rebuild_retry_wait;
+
+	std::vector<unsigned char>().swap(rebuild_bits);
+	rebuilding = false;
+}
+
+void FileIndexFilter::abortRebuild()
+{
+	IScopedLock lock(mutex.get());
+	std::vector<unsigned char>().swap(rebuild_bits);
+	rebuilding = false;
+
+	rebuild_retry_time = Server->getTimeMS() + rebuild_retry_wait_curr;
+	Server->Log("Retrying file entry index filter rebuild in " + convert(rebuild_retry_wait_curr / 60000) + " minutes", LL_INFO);
+	rebuild_retry_wait_curr = (std::min)(rebuild_retry_wait_curr * 2, rebuild_retry_wait_max);
+}
+
+bool FileIndexFilter::isRebuilding()
+{
+	IScopedLock lock(mutex.get());
+	return rebuilding;
+}
+
+bool FileIndexFilter::mayContain(const FileIndex::SIndexKey& key)
+{
+	uint64 h1, h2;
+	getHashes(key, h1, h2);
+
+	IScopedLock lock(mutex.get());
+
+	for (size_t i = 0; i < n_hashes; ++i)
+	{
+		size_t bit = static_cast<size_t>((h1 + i*h2) % n_bits);
+		if ((bits[bit / 8] & (1 << (bit % 8))) == 0)
+		{
+			++n_negative;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void FileIndexFilter::addFalsePositive()
+{
+	IScopedLock lock(mutex.get());
+	++n_false_positive;
+}
+
+int64 FileIndexFilter::getCapacity()
+{
+	IScopedLock lock(mutex.get());
+	return capacity;
+}
+
+int64 FileIndexFilter::getEntries()
+{
+	IScopedLock lock(mutex.get());
+	return static_cast<int64>(estimateEntries(n_set_bits, n_bits));
+}
+
+size_t FileIndexFilter::getMemorySize()
+{
+	IScopedLock lock(mutex.get());
+	return bits.size() + rebuild_bits.size();
+}
+
+bool FileIndexFilter::isFull()
+{
+	IScopedLock lock(mutex.get());
+	return estimateEntries(n_set_bits, n_bits) > capacity;
+}
+
+double FileIndexFilter::getFalsePositiveRate()
+{
+	IScopedLock lock(mutex.get());
+	if (n_negative + n_false_positive == 0)
+	{
+		return 0;
+	}
+	return static_cast<double>(n_false_positive) / (n_negative + n_false_positive);
+}
+
+double FileIndexFilter::getExpectedFalsePositiveRate()
+{
+	IScopedLock lock(mutex.get());
+	//Equal to (1 - e^(-k*n/m))^k with n estimated from the set bits
+	return pow(static_cast<double>(n_set_bits) / n_bits, static_cast<double>(n_hashes));
+}
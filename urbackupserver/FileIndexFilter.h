@@ -0,0 +1,90 @@
+#pragma once
+
+#include "FileIndex.h"
+#include "../Interface/Mutex.h"
+#include <memory>
+#include <vector>
+#include <string>
+
+/**
+* Bloom filter over the (hash, filesize) part of the file entry index keys.
+* Lookups of files which are not in the index (most new unique files)
+* are answered from memory without touching the LMDB B-tree.
+* Deleted keys stay in the filter till it is rebuilt, so it can only
+* return false positives, never false negatives.
+* Once it is too full it is rebuilt with a larger capacity while it is
+* in use. During the rebuild new keys are added to both bit sets.
+*/
+class FileIndexFilter
+{
+public:
+	FileIndexFilter(int64 capacity);
+
+	static FileIndexFilter* load(const std::string& fn, int64 txnid);
+
+	bool save(const std::string& fn, int64 txnid);
+
+	void add(const FileIndex::SIndexKey& key);
+
+	bool mayContain(const FileIndex::SIndexKey& key);
+
+	void addFalsePositive();
+
+	int64 getCapacity();
+
+	int64 getEntries();
+
+	size_t getMemorySize();
+
+	bool isFull();
+
+	//Expected false positive rate is above the rebuild threshold
+	bool needsRebuild();
+
+	bool startRebuild(int64 new_capacity);
+
+	//Add key to the bit set being rebuilt only
+	void addRebuild(const FileIndex::SIndexKey& key);
+
+	void finishRebuild();
+
+	//Rebuild failed or was stopped. needsRebuild() returns false
+	//for a while afterwards.
+	void abortRebuild();
+
+	bool isRebuilding();
+
+	//False positives measured during lookups
+	double getFalsePositiveRate();
+
+	//False positive rate calculated from the number of entries
+	double getExpectedFalsePositiveRate();
+
+private:
+	FileIndexFilter(int64 capacity, size_t n_bits);
+
+	void getHashes(const FileIndex::SIndexKey& key, uint64& h1, uint64& h2);
+
+	static size_t setBits(std::vector<unsigned char>& target_bits, size_t target_n_bits, uint64 h1, uint64 h2);
+
+	double estimateEntries(size_t set_bits, size_t total_bits);
+
+	std::auto_ptr<IMutex> mutex;
+	std::vector<unsigned char> bits;
+	size_t n_bits;
+	int64 capacity;
+	//Entries are estimated from the number of set bits, so
+	//duplicate and re-added keys are not counted twice
+	size_t n_set_bits;
+
+	bool rebuilding;
+	std::vector<unsigned char> rebuild_bits;
+	size_t rebuild_n_bits;
+	int64 rebuild_capacity;
+	size_t rebuild_n_set_bits;
+	int64 rebuild_retry_time;
+	int64 rebuild_retry_wait_curr;
+
+	int64 n_negative;
+	int64 n_false_positive;
+};
@@ -304,22 +304,22 @@ bool FullFileBackup::doFileBackup()
 						}
 						else
 						{
-							int64 done_bytes = fc.getReceivedDataBytes(true) + linked_bytes;
+							int64 done_bytes = fc.getReceivedDataBytes(true) + server_download->getStreamsReceivedDataBytes(true) + linked_bytes;
 							ServerStatus::setProcessDoneBytes(clientname, status_id, done_bytes);
 							ServerStatus::setProcessPcDone(clientname, status_id,
 								(std::min)(100, (int)(((float)done_bytes) / ((float)files_size / 100.f) + 0.5f)));
 						}
 
 						ServerStatus::setProcessQueuesize(clientname, status_id,
-							(_u32)hashpipe->getNumElements(), (_u32)hashpipe_prepare->getNumElements());
+							getHashQueuesize(), getPrepareHashQueuesize());
 					}
 
 					if (ctime - last_eta_update > eta_update_intervall)
 					{
-						calculateEtaFileBackup(last_eta_update, eta_set_time, ctime, fc, NULL, linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
+						calculateEtaFileBackup(last_eta_update, eta_set_time, ctime, fc, NULL, server_download.get(), linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
 					}
 
-					calculateDownloadSpeed(ctime, fc, NULL);
+					calculateDownloadSpeed(ctime, fc, NULL, server_download.get());
 
 				} while (server_download->sleepQueue());
 
@@ -624,22 +624,22 @@ bool FullFileBackup::doFileBackup()
 		}
 		else
 		{
-			int64 done_bytes = fc.getReceivedDataBytes(true) + linked_bytes;
+			int64 done_bytes = fc.getReceivedDataBytes(true) + server_download->getStreamsReceivedDataBytes(true) + linked_bytes;
 			ServerStatus::setProcessDoneBytes(clientname, status_id, done_bytes);
 			ServerStatus::setProcessPcDone(clientname, status_id,
 				(std::min)(100,(int)(((float)done_bytes)/((float)files_size/100.f)+0.5f)));
 		}
 
 		ServerStatus::setProcessQueuesize(clientname, status_id,
-			(_u32)hashpipe->getNumElements(), (_u32)hashpipe_prepare->getNumElements());
+			getHashQueuesize(), getPrepareHashQueuesize());
 
 		int64 ctime = Server->getTimeMS();
 		if(ctime-last_eta_update>eta_update_intervall)
 		{
-			calculateEtaFileBackup(last_eta_update, eta_set_time, ctime, fc, NULL, linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
+			calculateEtaFileBackup(last_eta_update, eta_set_time, ctime, fc, NULL, server_download.get(), linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
 		}
 
-		calculateDownloadSpeed(ctime, fc, NULL);
+		calculateDownloadSpeed(ctime, fc, NULL, server_download.get());
 	}
 
 	ServerStatus::setProcessSpeed(clientname, status_id, 0);
@@ -863,7 +863,7 @@ bool FullFileBackup::doFileBackup()
 		}
 	}
 
-	if( bsh->hasError() || bsh_prepare->hasError() )
+	if( hashThreadsHaveError() )
 	{
 		disk_error=true;
 	}
@@ -946,8 +946,8 @@ bool FullFileBackup::doFileBackup()
 		}
 	}
 
-	_i64 transferred_bytes=fc.getTransferredBytes();
-	_i64 transferred_compressed=fc.getRealTransferredBytes();
+	_i64 transferred_bytes=fc.getTransferredBytes()+server_download->getStreamsTransferredBytes();
+	_i64 transferred_compressed=fc.getRealTransferredBytes()+server_download->getStreamsRealTransferredBytes();
 	int64 passed_time=transfer_stop_time-full_backup_starttime;
 	if(passed_time==0) passed_time=1;
 
@@ -1018,6 +1018,14 @@ bool ImageBackup::doImage(const std::string &pLetter, const std::string &pParent
 					{
 						image_format = IFSImageFactory::ImageFormat_RawCowFile;
 					}
+					else if(image_file_format == image_file_format_vhdz_zstd)
+					{
+						image_format = IFSImageFactory::ImageFormat_CompressedVHDZstd;
+					}
+					else if(image_file_format == image_file_format_blockstore)
+					{
+						image_format = IFSImageFactory::ImageFormat_BlockStore;
+					}
 					else //default
 					{
 						image_format = IFSImageFactory::ImageFormat_CompressedVHD;
@@ -1123,7 +1131,8 @@ bool ImageBackup::doImage(const std::string &pLetter, const std::string &pParent
 						}
 
 						if (vhd_size>0 && vhd_size >= 2040LL * 1024 * 1024 * 1024
-							&& image_file_format != image_file_format_cowraw)
+							&& image_file_format != image_file_format_cowraw
+							&& image_file_format != image_file_format_blockstore)
 						{
 							ServerLogger::Log(logid, "Data on volume is too large for VHD files with " + PrettyPrintBytes(vhd_size) +
 								". VHD files have a maximum size of 2040GB. Please use another image file format.", LL_ERROR);
@@ -1490,7 +1499,8 @@ bool ImageBackup::doImage(const std::string &pLetter, const std::string &pParent
 							if(vhdfile!=NULL)
 							{
 								if(!pParentvhd.empty() &&
-									image_file_format == image_file_format_cowraw)
+									(image_file_format == image_file_format_cowraw
+										|| image_file_format == image_file_format_blockstore) )
 								{
 									vhdfile->setDoTrim(true);
 								}
@@ -2043,6 +2053,10 @@ std::string ImageBackup::constructImagePath(const std::string &letter, std::stri
 	{
 		imgpath+=".vhd";
 	}
+	else if(image_file_format==image_file_format_blockstore)
+	{
+		imgpath+=".blocks";
+	}
 	else if(image_file_format==image_file_format_cowraw)
 	{
 		imgpath+=".raw";
@@ -726,6 +726,10 @@ void ImageMount::mount_image_thread(int backupid, int partition, std::string& er
 		{
 			vhdfile.reset(image_fak->createVHDFile(image_inf.path, true, 0, 2 * 1024 * 1024, false, IFSImageFactory::ImageFormat_RawCowFile));
 		}
+		else if (ext == "blocks")
+		{
+			vhdfile.reset(image_fak->createVHDFile(image_inf.path, true, 0, 2 * 1024 * 1024, false, IFSImageFactory::ImageFormat_BlockStore));
+		}
 		else
 		{
 			vhdfile.reset(image_fak->createVHDFile(image_inf.path, true, 0));
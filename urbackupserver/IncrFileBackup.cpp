@@ -673,7 +673,7 @@ bool IncrFileBackup::doFileBackup()
 						}
 						else
 						{
-							int64 done_bytes = fc.getReceivedDataBytes(true)
+							int64 done_bytes = fc.getReceivedDataBytes(true) + server_download->getStreamsReceivedDataBytes(true)
 								+ (fc_chunked.get() ? fc_chunked->getReceivedDataBytes(true) : 0) + linked_bytes;
 							ServerStatus::setProcessDoneBytes(clientname, status_id, done_bytes);
 							ServerStatus::setProcessPcDone(clientname, status_id,
@@ -681,15 +681,15 @@ bool IncrFileBackup::doFileBackup()
 						}
 
 						ServerStatus::setProcessQueuesize(clientname, status_id,
-							(_u32)hashpipe->getNumElements(), (_u32)hashpipe_prepare->getNumElements());
+							getHashQueuesize(), getPrepareHashQueuesize());
 					}
 
 					if (ctime - last_eta_update > eta_update_intervall)
 					{
-						calculateEtaFileBackup(last_eta_update, eta_set_time, ctime, fc, fc_chunked.get(), linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
+						calculateEtaFileBackup(last_eta_update, eta_set_time, ctime, fc, fc_chunked.get(), server_download.get(), linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
 					}
 
-					calculateDownloadSpeed(ctime, fc, fc_chunked.get());
+					calculateDownloadSpeed(ctime, fc, fc_chunked.get(), server_download.get());
 				} while (server_download->sleepQueue());
 
 				if(server_download->isOffline() && !r_offline)
@@ -1352,7 +1352,7 @@ bool IncrFileBackup::doFileBackup()
 		}
 		else
 		{
-			int64 done_bytes = fc.getReceivedDataBytes(true)
+			int64 done_bytes = fc.getReceivedDataBytes(true) + server_download->getStreamsReceivedDataBytes(true)
 				+ (fc_chunked.get() ? fc_chunked->getReceivedDataBytes(true) : 0) + linked_bytes;
 			ServerStatus::setProcessDoneBytes(clientname, status_id, done_bytes);
 			ServerStatus::setProcessPcDone(clientname, status_id,
@@ -1360,15 +1360,15 @@ bool IncrFileBackup::doFileBackup()
 		}
 
 		ServerStatus::setProcessQueuesize(clientname, status_id,
-			(_u32)hashpipe->getNumElements(), (_u32)hashpipe_prepare->getNumElements());
+			getHashQueuesize(), getPrepareHashQueuesize());
 
 		int64 ctime = Server->getTimeMS();
 		if(ctime-last_eta_update>eta_update_intervall)
 		{
-			calculateEtaFileBackup(last_eta_update, eta_set_time, ctime, fc, fc_chunked.get(), linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
+			calculateEtaFileBackup(last_eta_update, eta_set_time, ctime, fc, fc_chunked.get(), server_download.get(), linked_bytes, last_eta_received_bytes, eta_estimated_speed, files_size);
 		}
 
-		calculateDownloadSpeed(ctime, fc, fc_chunked.get());
+		calculateDownloadSpeed(ctime, fc, fc_chunked.get(), server_download.get());
 	}
 
 	ServerStatus::setProcessSpeed(clientname, status_id, 0);
@@ -1405,7 +1405,7 @@ bool IncrFileBackup::doFileBackup()
 
 	waitForFileThreads();
 
-	if( bsh->hasError() || bsh_prepare->hasError() )
+	if( hashThreadsHaveError() )
 	{
 		disk_error=true;
 	}
@@ -1755,8 +1755,8 @@ bool IncrFileBackup::doFileBackup()
 	running_updater->stop();
 	backup_dao->updateFileBackupRunning(backupid);
 
-	_i64 transferred_bytes=fc.getTransferredBytes()+(fc_chunked.get()?fc_chunked->getTransferredBytes():0);
-	_i64 transferred_compressed=fc.getRealTransferredBytes()+(fc_chunked.get()?fc_chunked->getRealTransferredBytes():0);
+	_i64 transferred_bytes=fc.getTransferredBytes()+(fc_chunked.get()?fc_chunked->getTransferredBytes():0)+server_download->getStreamsTransferredBytes();
+	_i64 transferred_compressed=fc.getRealTransferredBytes()+(fc_chunked.get()?fc_chunked->getRealTransferredBytes():0)+server_download->getStreamsRealTransferredBytes();
 	int64 passed_time=incr_backup_stoptime-incr_backup_starttime;
 	ServerLogger::Log(logid, "Transferred "+PrettyPrintBytes(transferred_bytes)+" - Average speed: "+PrettyPrintSpeed((size_t)((transferred_bytes*1000)/(passed_time)) ), LL_INFO );
 	if(transferred_compressed>0)
@@ -2079,7 +2079,9 @@ void IncrFileBackup::copyFile(size_t fileid, const std::string& source, const st
 	data.addString((hash_dest));
 	metadata.serialize(data);
 
-	hashpipe->Write(data.getDataPtr(), data.getDataSize());
+	max_file_id.addInFlight(fileid);
+
+	hashpipes[fileid % hashpipes.size()]->Write(data.getDataPtr(), data.getDataSize());
 }
 
 bool IncrFileBackup::doFullBackup()
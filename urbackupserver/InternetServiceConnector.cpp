@@ -25,6 +25,7 @@
 #include "../urbackupcommon/InternetServiceIDs.h"
 #include "../urbackupcommon/InternetServicePipe.h"
 #include "../urbackupcommon/CompressedPipe2.h"
+#include "../urbackupcommon/CompressedPipe3.h"
 #include "../urbackupcommon/CompressedPipe.h"
 #include "server_settings.h"
 #include "database.h"
@@ -124,8 +125,11 @@ void InternetServiceConnector::Init(THREAD_ID pTID, IPipe *pPipe, const std::str
 		SSettings *settings=server_settings.getSettings();
 		capa|=IPC_ENCRYPTED;
 		capa|=IPC_COMPRESSED;
+		//Offer the configured faster codec. Clients without support for it use zlib.
+		capa|=CompressedPipe3::getCodecCapability(settings->internet_compression_codec);
 
 		compression_level=settings->internet_compression_level;
+		compression_level_zstd=settings->internet_compression_level_zstd;
 		data.addUInt(capa);
 		data.addInt(compression_level);
 		data.addUInt((unsigned int)pbkdf2_iterations);
@@ -147,6 +151,7 @@ void InternetServiceConnector::Init(THREAD_ID pTID, IPipe *pPipe, const std::str
 		}
 
 		data.addString(ecdh_key_exchange->getPublicKey());
+		data.addInt(compression_level_zstd);
 
 		tcpstack.Send(cs, data);
 	}
@@ -465,7 +470,9 @@ void InternetServiceConnector::ReceivePackets(IRunOtherCallback* run_other)
 								}
 								else if(conn_version==2)
 								{
-									comp_pipe=new CompressedPipe2(comm_pipe, compression_level);
+									CompressedPipe3::ECodec codec = CompressedPipe3::getCodecFromCapabilities(capa);
+									comp_pipe=new CompressedPipe3(comm_pipe, codec,
+										codec==CompressedPipe3::ECodec_Zstd ? compression_level_zstd : compression_level);
 								}
 								else
 								{
@@ -476,7 +483,7 @@ void InternetServiceConnector::ReceivePackets(IRunOtherCallback* run_other)
 								comm_pipe=comp_pipe;
 
 								if (!capa_debug_str.empty()) capa_debug_str += ", ";
-								capa_debug_str += std::string("compressed-") + (conn_version == 2 ? "v2" : "v1");
+								capa_debug_str += std::string("compressed-") + (conn_version == 2 ? "v2-"+CompressedPipe3::getCodecName(CompressedPipe3::getCodecFromCapabilities(capa)) : "v1");
 							}
 
 
@@ -602,7 +609,7 @@ IPipe *InternetServiceConnector::getConnection(const std::string &clientname, ch
 				isc->freeConnection(); //deletes ics
 
 				CompressedPipe *comp_pipe=dynamic_cast<CompressedPipe*>(ret);
-				CompressedPipe2 *comp_pipe2=dynamic_cast<CompressedPipe2*>(ret);
+				CompressedPipe3 *comp_pipe2=dynamic_cast<CompressedPipe3*>(ret);
 				if(comp_pipe2!=NULL)
 				{
 					InternetServicePipe2 *isc_pipe2=dynamic_cast<InternetServicePipe2*>(comp_pipe2->getRealPipe());
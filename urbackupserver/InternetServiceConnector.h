@@ -131,6 +131,7 @@ private:
 	std::string authkey;
 
 	int compression_level;
+	int compression_level_zstd;
 
 	bool token_auth;
 
@@ -16,6 +16,7 @@
 *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 **************************************************************************/
 
+
 #include "LMDBFileIndex.h"
 #include "../Interface/Server.h"
 #include "../Interface/ThreadPool.h"
@@ -28,25 +29,148 @@
 #include "../Interface/Types.h"
 #include "../Interface/File.h"
 #include <memory>
+#include <algorithm>
 #include "../Interface/Server.h"
 #include "create_files_index.h"
+#include "FileIndexFilter.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include <deque>
 
-MDB_env *LMDBFileIndex::env=NULL;
-MDB_dbi LMDBFileIndex::dbi;
-ISharedMutex* LMDBFileIndex::mutex=NULL;
+std::vector<LMDBFileIndex::SShard> LMDBFileIndex::shards;
+size_t LMDBFileIndex::reshard_from = 0;
 LMDBFileIndex* LMDBFileIndex::fileindex=NULL;
 THREADPOOL_TICKET LMDBFileIndex::fileindex_ticket = ILLEGAL_THREADPOOL_TICKET;
+FileIndexFilter* LMDBFileIndex::filter = NULL;
+THREADPOOL_TICKET LMDBFileIndex::filter_rebuild_ticket = ILLEGAL_THREADPOOL_TICKET;
+volatile bool LMDBFileIndex::filter_rebuild_stop = false;
 
 
 const size_t c_initial_map_size=1*1024*1024;
 const size_t c_create_commit_n = 10000;
+const int64 c_min_filter_capacity = 1000000;
+const size_t c_filter_fill_chunk = 10000;
+const size_t c_default_shards = 4;
+const std::string c_fileindex_dir = "urbackup/fileindex";
+const std::string c_reshard_dir = "urbackup/fileindex_reshard";
 
+namespace
+{
+	class FileIndexFilterRebuild : public IThread
+	{
+	public:
+		virtual ~FileIndexFilterRebuild() {}
 
-bool LMDBFileIndex::initFileIndex()
+		void operator()()
+		{
+			LMDBFileIndex::rebuildFileIndexFilter();
+			delete this;
+		}
+	};
+}
+
+//A LMDB write transaction has to be used by the thread that started it.
+//Each shard therefore has its own thread running its write transactions.
+class LMDBFileIndex::ShardWriter : public IThread
 {
-	mutex = Server->createSharedMutex();
+public:
+	ShardWriter()
+		: mutex(Server->createMutex()), cond(Server->createCondition()),
+		n_queued(0), n_finished(0), do_quit(false)
+	{
+	}
+
+	virtual ~ShardWriter()
+	{
+		Server->destroy(mutex);
+		Server->destroy(cond);
+	}
+
+	void operator()()
+	{
+		IScopedLock lock(mutex);
+		while (true)
+		{
+			while (jobs.empty() && !do_quit)
+			{
+				cond->wait(&lock);
+			}
+
+			if (jobs.empty())
+			{
+				break;
+			}
+
+			SJob job = jobs.front();
 
+			lock.relock(NULL);
+			job.fileindex->run_shard_job(job.shard_idx, job.job);
+			lock.relock(mutex);
+
+			jobs.pop_front();
+			++n_finished;
+			cond->notify_all();
+		}
+	}
+
+	int64 add(LMDBFileIndex* fileindex, size_t shard_idx, EShardJob job)
+	{
+		IScopedLock lock(mutex);
+		SJob new_job = { fileindex, shard_idx, job };
+		jobs.push_back(new_job);
+		cond->notify_all();
+		return ++n_queued;
+	}
+
+	void wait(int64 ticket)
+	{
+		IScopedLock lock(mutex);
+		while (n_finished < ticket)
+		{
+			cond->wait(&lock);
+		}
+	}
+
+	void quit()
+	{
+		IScopedLock lock(mutex);
+		do_quit = true;
+		cond->notify_all();
+	}
+
+private:
+	struct SJob
+	{
+		LMDBFileIndex* fileindex;
+		size_t shard_idx;
+		EShardJob job;
+	};
+
+	IMutex* mutex;
+	ICondition* cond;
+	std::deque<SJob> jobs;
+	int64 n_queued;
+	int64 n_finished;
+	bool do_quit;
+};
+
+
+bool LMDBFileIndex::initFileIndex()
+{
 	fileindex=new LMDBFileIndex;
+
+	if (!fileindex->has_error()
+		&& reshard_from > 0)
+	{
+		fileindex->reshard();
+	}
+
+	if (!fileindex->has_error()
+		&& Server->getServerParameter("fileindex_filter") != "false")
+	{
+		initFileIndexFilter();
+	}
+
 	fileindex_ticket = Server->getThreadPool()->execute(fileindex, "fileindex writer");
 
 	return !fileindex->has_error();
@@ -57,54 +181,643 @@ void LMDBFileIndex::shutdownFileIndex()
 {
 	fileindex->shutdown();
 	Server->getThreadPool()->waitFor(fileindex_ticket);
+	shutdownShardWriters();
+}
+
+void LMDBFileIndex::shutdownShardWriters()
+{
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		if (shards[i].writer != NULL)
+		{
+			shards[i].writer->quit();
+			Server->getThreadPool()->waitFor(shards[i].writer_ticket);
+			delete shards[i].writer;
+			shards[i].writer = NULL;
+		}
+	}
+}
+
+void LMDBFileIndex::shutdownFileIndexFilter()
+{
+	filter_rebuild_stop = true;
+	if (filter_rebuild_ticket != ILLEGAL_THREADPOOL_TICKET)
+	{
+		Server->getThreadPool()->waitFor(filter_rebuild_ticket);
+	}
+
+	//Only place the filter is saved. It is only valid as long as the
+	//index is not changed afterwards.
+	saveFileIndexFilter();
+}
+
+std::string LMDBFileIndex::getFileIndexFilterFn()
+{
+	return "urbackup/fileindex/backup_server_files_index.filter";
+}
+
+void LMDBFileIndex::initFileIndexFilter()
+{
+	int64 txnid = get_last_txnid();
+
+	std::auto_ptr<FileIndexFilter> new_filter(FileIndexFilter::load(getFileIndexFilterFn(), txnid));
+
+	if (new_filter.get() != NULL
+		&& !new_filter->isFull())
+	{
+		Server->Log("Loaded file entry index filter (" + PrettyPrintBytes(new_filter->getMemorySize()) + ")", LL_INFO);
+		filter = new_filter.release();
+		return;
+	}
+
+	int64 n_entries = get_n_entries();
+	if (n_entries < 0)
+	{
+		return;
+	}
+
+	//Leave room for the index to grow. The filter is rebuilt in the
+	//background once it gets too full.
+	int64 capacity = (std::max)(n_entries * 2, c_min_filter_capacity);
+	new_filter.reset(new FileIndexFilter(capacity));
+
+	Server->Log("Creating file entry index filter for " + convert(n_entries) + " entries ("
+		+ PrettyPrintBytes(new_filter->getMemorySize()) + ")...", LL_INFO);
+
+	if (!fillFileIndexFilter(new_filter.get(), false))
+	{
+		return;
+	}
+
+	filter = new_filter.release();
+}
+
+void LMDBFileIndex::startFileIndexFilterRebuild()
+{
+	int64 n_entries = get_n_entries();
+	if (n_entries < 0)
+	{
+		return;
+	}
+
+	int64 capacity = (std::max)(n_entries * 2, c_min_filter_capacity);
+
+	//Keys put from now on are added to the new bit set as well,
+	//so the scan only has to cover the committed entries
+	if (!filter->startRebuild(capacity))
+	{
+		return;
+	}
+
+	Server->Log("File entry index filter is too full (expected false positive rate "
+		+ convert(filter->getExpectedFalsePositiveRate()*100) + "%). Rebuilding it for "
+		+ convert(n_entries) + " entries in the background...", LL_INFO);
+
+	filter_rebuild_ticket = Server->getThreadPool()->execute(new FileIndexFilterRebuild, "fileindex filter rebuild");
+}
+
+void LMDBFileIndex::rebuildFileIndexFilter()
+{
+	if (!fillFileIndexFilter(filter, true))
+	{
+		filter->abortRebuild();
+		return;
+	}
+
+	filter->finishRebuild();
+
+	Server->Log("Rebuilt file entry index filter (" + PrettyPrintBytes(filter->getMemorySize()) + ")", LL_INFO);
+}
+
+int64 LMDBFileIndex::get_n_entries()
+{
+	int64 n_entries = 0;
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		IScopedReadLock lock(shards[i].mutex);
+
+		MDB_stat stat;
+		int rc = mdb_env_stat(shards[i].env, &stat);
+		if (rc)
+		{
+			Server->Log("LMDB: Failed to get database statistics (" + (std::string)mdb_strerror(rc) + ")", LL_ERROR);
+			return -1;
+		}
+
+		n_entries += stat.ms_entries;
+	}
+
+	return n_entries;
+}
+
+bool LMDBFileIndex::fillFileIndexFilter(FileIndexFilter* target_filter, bool rebuild)
+{
+	size_t n_done = 0;
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		//Scan in chunks with a new read transaction each. Holding the shard
+		//lock for the whole scan would block the writer's map resize and
+		//keep the pages of the snapshot from being reused. Keys put between
+		//chunks are added to the filter by put() anyway.
+		SIndexKey last_key;
+		bool has_last_key = false;
+		int rc = 0;
+		while (rc == 0)
+		{
+			IScopedReadLock lock(shards[i].mutex);
+
+			MDB_txn* l_txn;
+			rc = mdb_txn_begin(shards[i].env, NULL, MDB_RDONLY, &l_txn);
+			if (rc)
+			{
+				Server->Log("LMDB: Failed to open transaction handle for filter creation (" + (std::string)mdb_strerror(rc) + ")", LL_ERROR);
+				return false;
+			}
+
+			MDB_cursor* cursor;
+			mdb_cursor_open(l_txn, shards[i].dbi, &cursor);
+
+			MDB_val mdb_tkey;
+			MDB_val mdb_tvalue;
+			if (!has_last_key)
+			{
+				rc = mdb_cursor_get(cursor, &mdb_tkey, &mdb_tvalue, MDB_FIRST);
+			}
+			else
+			{
+				mdb_tkey.mv_data = &last_key;
+				mdb_tkey.mv_size = sizeof(SIndexKey);
+				rc = mdb_cursor_get(cursor, &mdb_tkey, &mdb_tvalue, MDB_SET_RANGE);
+				if (rc == 0
+					&& memcmp(mdb_tkey.mv_data, &last_key, sizeof(SIndexKey)) == 0)
+				{
+					rc = mdb_cursor_get(cursor, &mdb_tkey, &mdb_tvalue, MDB_NEXT);
+				}
+			}
+
+			size_t n_chunk = 0;
+			while (rc == 0
+				&& n_chunk < c_filter_fill_chunk)
+			{
+				memcpy(&last_key, mdb_tkey.mv_data, sizeof(SIndexKey));
+				has_last_key = true;
+
+				if (rebuild)
+				{
+					target_filter->addRebuild(last_key);
+				}
+				else
+				{
+					target_filter->add(last_key);
+				}
+
+				++n_chunk;
+				++n_done;
+				if (n_done % 1000000 == 0)
+				{
+					Server->Log("File entry index filter contains " + convert(n_done) + " entries now.", LL_INFO);
+				}
+
+				rc = mdb_cursor_get(cursor, &mdb_tkey, &mdb_tvalue, MDB_NEXT);
+			}
+
+			mdb_cursor_close(cursor);
+			mdb_txn_abort(l_txn);
+
+			if (rebuild && filter_rebuild_stop)
+			{
+				Server->Log("Stopped rebuilding file entry index filter", LL_INFO);
+				return false;
+			}
+		}
+
+		if (rc != MDB_NOTFOUND)
+		{
+			Server->Log("LMDB: Failed to read during filter creation (" + (std::string)mdb_strerror(rc) + ")", LL_ERROR);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool LMDBFileIndex::saveFileIndexFilter()
+{
+	if (filter == NULL)
+	{
+		return true;
+	}
+
+	return filter->save(getFileIndexFilterFn(), get_last_txnid());
+}
+
+FileIndexFilter* LMDBFileIndex::getFileIndexFilter()
+{
+	return filter;
+}
+
+int64 LMDBFileIndex::get_last_txnid()
+{
+	//Every write transaction increases the transaction id of its shard,
+	//so the sum changes with every change to the index
+	int64 ret = 0;
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		IScopedReadLock lock(shards[i].mutex);
+
+		MDB_envinfo info;
+		int rc = mdb_env_info(shards[i].env, &info);
+		if (rc)
+		{
+			Server->Log("LMDB: Failed to get env info (" + (std::string)mdb_strerror(rc) + ")", LL_ERROR);
+			return -1;
+		}
+
+		ret += static_cast<int64>(info.me_last_txnid);
+	}
+
+	return ret;
+}
+
+bool LMDBFileIndex::filter_miss(const SIndexKey& key)
+{
+	return filter != NULL
+		&& !filter->mayContain(key);
+}
+
+std::string LMDBFileIndex::getShardFn(size_t shard_idx)
+{
+	return getShardFn(shard_idx, c_fileindex_dir);
+}
+
+std::string LMDBFileIndex::getShardFn(size_t shard_idx, const std::string& dir)
+{
+	if (shard_idx == 0)
+	{
+		return dir + "/backup_server_files_index.lmdb";
+	}
+	else
+	{
+		return dir + "/backup_server_files_index_" + convert(shard_idx) + ".lmdb";
+	}
+}
+
+std::string LMDBFileIndex::getReshardDir()
+{
+	return c_reshard_dir;
+}
+
+bool LMDBFileIndex::indexExists()
+{
+	//An interrupted re-shard is continued by init_shards
+	return FileExists(getShardFn(0))
+		|| FileExists(getShardFn(0, c_reshard_dir));
+}
+
+void LMDBFileIndex::init_shards()
+{
+	if (!shards.empty())
+	{
+		return;
+	}
+
+	std::string shards_param = Server->getServerParameter("fileindex_shards");
+	size_t n_shards = shards_param.empty() ? c_default_shards : static_cast<size_t>((std::max)(1, watoi(shards_param)));
+	if (n_shards > max_shards)
+	{
+		n_shards = max_shards;
+	}
+
+	std::string existing_dir;
+	if (FileExists(getShardFn(0, c_reshard_dir)))
+	{
+		Server->Log("Re-shard of file entry index was interrupted. Starting it over...", LL_WARNING);
+
+		for (size_t i = 0; i < max_shards; ++i)
+		{
+			Server->deleteFile(getShardFn(i));
+			Server->deleteFile(getShardFn(i) + "-lock");
+		}
+
+		existing_dir = c_reshard_dir;
+	}
+	else if (FileExists(getShardFn(0)))
+	{
+		existing_dir = c_fileindex_dir;
+	}
+
+	if (!existing_dir.empty())
+	{
+		size_t n_existing = 1;
+		while (n_existing < max_shards
+			&& FileExists(getShardFn(n_existing, existing_dir)))
+		{
+			++n_existing;
+		}
+
+		if (existing_dir == c_reshard_dir)
+		{
+			reshard_from = n_existing;
+		}
+		else if (n_existing != n_shards)
+		{
+			//Moving the whole directory is atomic. A crash during the re-shard
+			//therefore leaves the complete old index in c_reshard_dir.
+			if (!os_rename_file(c_fileindex_dir, c_reshard_dir))
+			{
+				Server->Log("Error moving file entry index to \"" + c_reshard_dir + "\" to change the number of shards from "
+					+ convert(n_existing) + " to " + convert(n_shards) + ". Keeping " + convert(n_existing) + " shard(s). "
+					+ os_last_error_str(), LL_ERROR);
+				n_shards = n_existing;
+			}
+			else
+			{
+				reshard_from = n_existing;
+			}
+		}
+	}
+
+	Server->Log("File entry index has " + convert(n_shards) + " shard(s)", LL_DEBUG);
+
+	shards.resize(n_shards);
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		shards[i].env = NULL;
+		shards[i].mutex = Server->createSharedMutex();
+		shards[i].map_size = c_initial_map_size;
+		shards[i].writer = new ShardWriter;
+		shards[i].writer_ticket = Server->getThreadPool()->execute(shards[i].writer, "fileindex shard writer");
+	}
+}
+
+bool LMDBFileIndex::reshard()
+{
+	Server->Log("Changing number of file entry index shards from " + convert(reshard_from)
+		+ " to " + convert(shards.size()) + "...", LL_INFO);
+
+	size_t n_done = 0;
+
+	start_transaction();
+
+	for (size_t i = 0; i < reshard_from && !_has_error; ++i)
+	{
+		MDB_env* old_env;
+		int rc = mdb_env_create(&old_env);
+		if (rc)
+		{
+			Server->Log("LMDB: Failed to create LMDB env for re-shard (" + (std::string)mdb_strerror(rc) + ")", LL_ERROR);
+			_has_error = true;
+			break;
+		}
+
+		//Without a map size LMDB uses the one of the existing database
+		rc = mdb_env_open(old_env, getShardFn(i, c_reshard_dir).c_str(), MDB_NOSUBDIR | MDB_RDONLY | MDB_NOLOCK, 0664);
+
+		MDB_txn* l_txn = NULL;
+		if (!rc)
+		{
+			rc = mdb_txn_begin(old_env, NULL, MDB_RDONLY, &l_txn);
+		}
+
+		MDB_dbi old_dbi;
+		if (!rc)
+		{
+			rc = mdb_dbi_open(l_txn, NULL, 0, &old_dbi);
+		}
+
+		MDB_cursor* cursor = NULL;
+		if (!rc)
+		{
+			rc = mdb_cursor_open(l_txn, old_dbi, &cursor);
+		}
+
+		if (rc)
+		{
+			Server->Log("LMDB: Failed to open shard " + convert(i) + " of the old file entry index (" + (std::string)mdb_strerror(rc) + ")", LL_ERROR);
+			_has_error = true;
+		}
+
+		MDB_val mdb_tkey;
+		MDB_val mdb_tvalue;
+		if (!rc)
+		{
+			rc = mdb_cursor_get(cursor, &mdb_tkey, &mdb_tvalue, MDB_FIRST);
+		}
+
+		while (rc == 0)
+		{
+			SIndexKey key;
+			memcpy(&key, mdb_tkey.mv_data, sizeof(SIndexKey));
+
+			int64 value;
+			CRData data((const char*)mdb_tvalue.mv_data, mdb_tvalue.mv_size);
+			data.getVarInt(&value);
+
+			//The keys of one old shard are sorted, so they arrive sorted in
+			//every new shard as well
+			put(key, value, reshard_from == 1 ? MDB_APPEND : 0);
+
+			++n_done;
+			if (n_done % c_create_commit_n == 0)
+			{
+				commit_transaction();
+
+				if (_has_error)
+				{
+					break;
+				}
+
+				if (n_done % 1000000 == 0)
+				{
+					Server->Log("Moved " + convert(n_done) + " file entry index entries.", LL_INFO);
+				}
+
+				start_transaction();
+			}
+
+			rc = mdb_cursor_get(cursor, &mdb_tkey, &mdb_tvalue, MDB_NEXT);
+		}
+
+		if (rc && rc != MDB_NOTFOUND && !_has_error)
+		{
+			Server->Log("LMDB: Failed to read shard " + convert(i) + " of the old file entry index (" + (std::string)mdb_strerror(rc) + ")", LL_ERROR);
+			_has_error = true;
+		}
+
+		if (cursor != NULL)
+		{
+			mdb_cursor_close(cursor);
+		}
+		if (l_txn != NULL)
+		{
+			mdb_txn_abort(l_txn);
+		}
+		mdb_env_close(old_env);
+	}
+
+	if (_has_error)
+	{
+		abort_transaction();
+		Server->Log("Changing number of file entry index shards failed. Retrying at next start.", LL_ERROR);
+		return false;
+	}
+
+	commit_transaction();
+
+	if (_has_error)
+	{
+		return false;
+	}
+
+	if (!os_remove_nonempty_dir(c_reshard_dir))
+	{
+		Server->Log("Error removing old file entry index at \"" + c_reshard_dir + "\". " + os_last_error_str(), LL_ERROR);
+	}
+
+	reshard_from = 0;
+
+	Server->Log("Changed number of file entry index shards. Moved " + convert(n_done) + " entries.", LL_INFO);
+
+	return true;
+}
+
+size_t LMDBFileIndex::get_shard(const SIndexKey& key)
+{
+	return static_cast<unsigned char>(key.getHash()[0]) % shards.size();
+}
+
+
+LMDBFileIndex::LMDBFileIndex(bool no_sync)
+	: in_write_transaction(false), _has_error(false), it_cursor(NULL), it_shard(0), no_sync(no_sync)
+{
+	init_shards();
+
+	shard_txns.resize(shards.size());
+	for (size_t i = 0; i < shard_txns.size(); ++i)
+	{
+		shard_txns[i].txn = NULL;
+		shard_txns[i].read_transaction_lock = NULL;
+	}
+
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		IScopedWriteLock lock(shards[i].mutex);
+
+		if (!create_env(i))
+		{
+			Server->Log("LMDB error creating env", LL_ERROR);
+			_has_error = true;
+		}
+	}
+}
+
+LMDBFileIndex::~LMDBFileIndex(void)
+{
+}
+
+
+bool LMDBFileIndex::has_error(void)
+{
+	if ((Server->getFailBits() & IServer::FAIL_DATABASE_CORRUPTED) ||
+		(Server->getFailBits() & IServer::FAIL_DATABASE_IOERR) ||
+		(Server->getFailBits() & IServer::FAIL_DATABASE_FULL))
+	{
+		return false;
+	}
+	return _has_error;
+}
+
+void LMDBFileIndex::begin_txn(size_t shard_idx, unsigned int flags)
+{
+	SShardTxn& shard_txn = shard_txns[shard_idx];
+
+	delete shard_txn.read_transaction_lock;
+	shard_txn.read_transaction_lock = new IScopedReadLock(shards[shard_idx].mutex);
+
+	int rc = mdb_txn_begin(shards[shard_idx].env, NULL, flags, &shard_txn.txn);
+
+	if(rc)
+	{
+		Server->Log("LMDB: Failed to open transaction handle ("+(std::string)mdb_strerror(rc)+")", LL_ERROR);
+		_has_error=true;
+		shard_txn.txn = NULL;
+		return;
+	}
 }
 
+MDB_txn* LMDBFileIndex::get_txn(size_t shard_idx)
+{
+	if (shard_txns[shard_idx].txn == NULL)
+	{
+		begin_txn(shard_idx, in_write_transaction ? 0 : MDB_RDONLY);
+	}
+
+	return shard_txns[shard_idx].txn;
+}
 
-LMDBFileIndex::LMDBFileIndex(bool no_sync)
-	: _has_error(false), txn(NULL), map_size(c_initial_map_size), it_cursor(NULL), no_sync(no_sync)
+void LMDBFileIndex::end_txn(size_t shard_idx)
 {
-	IScopedWriteLock lock(mutex);
+	SShardTxn& shard_txn = shard_txns[shard_idx];
 
-	if(!create_env())
+	if (shard_txn.txn != NULL)
 	{
-		Server->Log("LMDB error creating env", LL_ERROR);
-		_has_error=true;
+		mdb_txn_abort(shard_txn.txn);
+		shard_txn.txn = NULL;
 	}
+
+	delete shard_txn.read_transaction_lock;
+	shard_txn.read_transaction_lock = NULL;
+	shard_txn.transaction_log.clear();
 }
 
-LMDBFileIndex::~LMDBFileIndex(void)
+bool LMDBFileIndex::increase_map_size(size_t shard_idx, const std::string& on_what)
 {
-}
+	SShardTxn& shard_txn = shard_txns[shard_idx];
 
+	if (shard_txn.txn != NULL)
+	{
+		mdb_txn_abort(shard_txn.txn);
+		shard_txn.txn = NULL;
+	}
 
-bool LMDBFileIndex::has_error(void)
-{
-	if ((Server->getFailBits() & IServer::FAIL_DATABASE_CORRUPTED) ||
-		(Server->getFailBits() & IServer::FAIL_DATABASE_IOERR) ||
-		(Server->getFailBits() & IServer::FAIL_DATABASE_FULL))
+	if(_has_error)
 	{
+		Server->Log("LMDB had error during increase (on "+on_what+"). Aborting...", LL_ERROR);
+		begin_txn(shard_idx, 0);
 		return false;
 	}
-	return _has_error;
-}
 
-void LMDBFileIndex::begin_txn(unsigned int flags)
-{
-	read_transaction_lock.reset(new IScopedReadLock(mutex));
+	{
+		delete shard_txn.read_transaction_lock;
+		shard_txn.read_transaction_lock = NULL;
 
-	int rc = mdb_txn_begin(env, NULL, flags, &txn);
+		IScopedWriteLock lock(shards[shard_idx].mutex);
 
-	if(rc)
-	{
-		Server->Log("LMDB: Failed to open transaction handle ("+(std::string)mdb_strerror(rc)+")", LL_ERROR);
-		_has_error=true;
-		return;
+		destroy_env(shard_idx);
+
+		shards[shard_idx].map_size*=2;
+
+		Server->Log("Increased LMDB database size of shard "+convert(shard_idx)+" to "+PrettyPrintBytes(shards[shard_idx].map_size)+" (on "+on_what+")", LL_DEBUG);
+
+		if(!create_env(shard_idx))
+		{
+			Server->Log("Error creating env after database file size increase", LL_ERROR);
+			_has_error=true;
+			begin_txn(shard_idx, 0);
+			return false;
+		}
 	}
+
+	begin_txn(shard_idx, 0);
+
+	replay_transaction_log(shard_idx);
+
+	return true;
 }
 
 void LMDBFileIndex::create(get_data_callback_t get_data_callback, void *userdata)
 {
-	begin_txn(0);
+	start_transaction();
 
 	IDatabase *db=Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES_NEW);
 
@@ -177,9 +890,9 @@ void LMDBFileIndex::create(get_data_callback_t get_data_callback, void *userdata
 
 			if(n_done % 1000 == 0 && n_done>0)
 			{
-				if ((Server->getFailBits() & IServer::FAIL_DATABASE_CORRUPTED) ||
-					(Server->getFailBits() & IServer::FAIL_DATABASE_IOERR) ||
-					(Server->getFailBits() & IServer::FAIL_DATABASE_FULL))
+				if ((Server->getFailBits() & IServer::FAIL_DATABASE_CORRUPTED) ||
+					(Server->getFailBits() & IServer::FAIL_DATABASE_IOERR) ||
+					(Server->getFailBits() & IServer::FAIL_DATABASE_FULL))
 				{
 					Server->Log("Database error. Stopping.", LL_ERROR);
 					return;
@@ -190,7 +903,7 @@ void LMDBFileIndex::create(get_data_callback_t get_data_callback, void *userdata
 			if(n_done % c_create_commit_n == 0 && n_done>0)
 			{
 				commit_transaction();
-				begin_txn(0);
+				start_transaction();
 			}
 
 			++n_done;
@@ -203,11 +916,32 @@ void LMDBFileIndex::create(get_data_callback_t get_data_callback, void *userdata
 	while(!res.empty());
 
 	commit_transaction();
+
+	if (no_sync)
+	{
+		//Index creation commits without sync. Make the complete index durable.
+		std::vector<bool> shard_mask(shards.size(), true);
+		run_shard_jobs(EShardJob_Sync, shard_mask);
+	}
 }
 
 int64 LMDBFileIndex::get(const LMDBFileIndex::SIndexKey& key)
 {
-	begin_txn(MDB_RDONLY);
+	if (filter_miss(key))
+	{
+		return 0;
+	}
+
+	size_t shard_idx = get_shard(key);
+
+	begin_txn(shard_idx, MDB_RDONLY);
+
+	MDB_txn* txn = shard_txns[shard_idx].txn;
+	if (txn == NULL)
+	{
+		end_txn(shard_idx);
+		return 0;
+	}
 
 	MDB_val mdb_tkey;
 	mdb_tkey.mv_data=const_cast<void*>(static_cast<const void*>(&key));
@@ -215,12 +949,15 @@ int64 LMDBFileIndex::get(const LMDBFileIndex::SIndexKey& key)
 
 	MDB_val mdb_tvalue;
 
-	int rc=mdb_get(txn, dbi, &mdb_tkey, &mdb_tvalue);
+	int rc=mdb_get(txn, shards[shard_idx].dbi, &mdb_tkey, &mdb_tvalue);
 
 	int64 ret = 0;
 	if(rc==MDB_NOTFOUND)
 	{
-		
+		if (filter != NULL)
+		{
+			filter->addFalsePositive();
+		}
 	}
 	else if(rc)
 	{
@@ -230,25 +967,34 @@ int64 LMDBFileIndex::get(const LMDBFileIndex::SIndexKey& key)
 	else
 	{
 		CRData data((const char*)mdb_tvalue.mv_data, mdb_tvalue.mv_size);
-		
+
 		data.getVarInt(&ret);
 	}
 
-	abort_transaction();
+	end_txn(shard_idx);
 
 	return ret;
 }
 
 void LMDBFileIndex::start_transaction(void)
 {
-	begin_txn(0);
+	//Write transactions of the shards are started on first use
+	in_write_transaction=true;
 }
 
 void LMDBFileIndex::put_internal(const SIndexKey& key, int64 value, int flags, bool log, bool handle_enosp)
 {
+	size_t shard_idx = get_shard(key);
+
+	MDB_txn* txn = get_txn(shard_idx);
+	if (txn == NULL)
+	{
+		return;
+	}
+
 	CWData vdata;
 	vdata.addVarInt(value);
-			
+
 	MDB_val mdb_tkey;
 	mdb_tkey.mv_data=const_cast<void*>(static_cast<const void*>(&key));
 	mdb_tkey.mv_size=sizeof(SIndexKey);
@@ -257,61 +1003,33 @@ void LMDBFileIndex::put_internal(const SIndexKey& key, int64 value, int flags, b
 	mdb_tvalue.mv_data=vdata.getDataPtr();
 	mdb_tvalue.mv_size=vdata.getDataSize();
 
-	int rc = mdb_put(txn, dbi, &mdb_tkey, &mdb_tvalue, flags);
+	int rc = mdb_put(txn, shards[shard_idx].dbi, &mdb_tkey, &mdb_tvalue, flags);
 
 	if(rc==MDB_MAP_FULL && handle_enosp)
 	{
-		mdb_txn_abort(txn);
-
-		if(_has_error)
+		if (!increase_map_size(shard_idx, "put"))
 		{
-			Server->Log("LMDB had error during increase (on put). Aborting...", LL_ERROR);
-			start_transaction();
 			return;
 		}
 
-		{
-			read_transaction_lock.reset();
-
-			IScopedWriteLock lock(mutex);
-
-			destroy_env();
-
-			map_size*=2;
-
-			Server->Log("Increased LMDB database size to "+PrettyPrintBytes(map_size)+" (on put)", LL_DEBUG);
-
-			if(!create_env())
-			{
-				Server->Log("Error creating env after database file size increase", LL_ERROR);
-				_has_error=true;
-				start_transaction();
-				return;
-			}
-			
-		}
-
-		start_transaction();
-
-		replay_transaction_log();
-		
 		put_internal(key, value, flags, false, true);
 	}
 	else if(rc==MDB_BAD_TXN && handle_enosp)
 	{
 		mdb_txn_abort(txn);
-		
+		shard_txns[shard_idx].txn = NULL;
+
 		if(_has_error)
 		{
 			Server->Log("LMDB had error on BAD_TXN (on put). Aborting...", LL_ERROR);
-			start_transaction();
+			begin_txn(shard_idx, 0);
 			return;
 		}
-		
-		start_transaction();
-		
-		replay_transaction_log();
-		
+
+		begin_txn(shard_idx, 0);
+
+		replay_transaction_log(shard_idx);
+
 		put_internal(key, value, flags, false, false);
 	}
 	else if(rc)
@@ -323,7 +1041,7 @@ void LMDBFileIndex::put_internal(const SIndexKey& key, int64 value, int flags, b
 	if(!_has_error && log)
 	{
 		STransactionLogItem item = { key, value, flags};
-		transaction_log.push_back(item);
+		shard_txns[shard_idx].transaction_log.push_back(item);
 	}
 }
 
@@ -334,71 +1052,58 @@ void LMDBFileIndex::put( const SIndexKey& key, int64 value )
 
 void LMDBFileIndex::put( const SIndexKey& key, int64 value, int flags )
 {
-	put_internal(key, value, flags, true, true);
+	if (filter != NULL)
+	{
+		filter->add(key);
+	}
+
+	//Applied by the writer thread of the shard in commit_transaction
+	STransactionLogItem item = { key, value, flags };
+	shard_txns[get_shard(key)].pending.push_back(item);
 }
 
 void LMDBFileIndex::del_internal(const SIndexKey& key, bool log, bool handle_enosp)
-{		
+{
+	size_t shard_idx = get_shard(key);
+
+	MDB_txn* txn = get_txn(shard_idx);
+	if (txn == NULL)
+	{
+		return;
+	}
+
 	MDB_val mdb_tkey;
 	mdb_tkey.mv_data=const_cast<void*>(static_cast<const void*>(&key));
 	mdb_tkey.mv_size=sizeof(SIndexKey);
 
-	int rc = mdb_del(txn, dbi, &mdb_tkey, NULL);
+	int rc = mdb_del(txn, shards[shard_idx].dbi, &mdb_tkey, NULL);
 
 	if(rc==MDB_MAP_FULL && handle_enosp)
 	{
-		mdb_txn_abort(txn);
-
-		if(_has_error)
+		if (!increase_map_size(shard_idx, "delete"))
 		{
-			Server->Log("LMDB had error during increase (on del). Aborting...", LL_ERROR);
-			start_transaction();
 			return;
 		}
 
-		{
-			read_transaction_lock.reset();
-
-			IScopedWriteLock lock(mutex);
-
-			destroy_env();
-
-			map_size*=2;
-
-			Server->Log("Increased LMDB database size to "+PrettyPrintBytes(map_size)+" (on delete)", LL_DEBUG);
-
-			if(!create_env())
-			{
-				Server->Log("Error creating env after database file size increase", LL_ERROR);
-				_has_error=true;
-				start_transaction();
-				return;
-			}
-			
-		}
-
-		start_transaction();
-
-		replay_transaction_log();
-
-		del(key);
+		del_internal(key, false, true);
 	}
 	else if(rc==MDB_BAD_TXN && handle_enosp)
 	{
 		mdb_txn_abort(txn);
-		
+		shard_txns[shard_idx].txn = NULL;
+
 		if(_has_error)
 		{
 			Server->Log("LMDB had error on BAD_TXN (on del). Aborting...", LL_ERROR);
-			start_transaction();
+			begin_txn(shard_idx, 0);
 			return;
 		}
-		
-		start_transaction();
-		
-		replay_transaction_log();
-		
-		del_internal(key, true, false);
+
+		begin_txn(shard_idx, 0);
+
+		replay_transaction_log(shard_idx);
+
+		del_internal(key, false, false);
 	}
 	else if (rc == MDB_NOTFOUND)
 	{
@@ -413,70 +1118,143 @@ void LMDBFileIndex::del_internal(const SIndexKey& key, bool log, bool handle_eno
 	if(log)
 	{
 		STransactionLogItem item = { key, 0, 0 };
-		transaction_log.push_back(item);
-	}	
+		shard_txns[shard_idx].transaction_log.push_back(item);
+	}
 }
 
 void LMDBFileIndex::commit_transaction(void)
 {
-	commit_transaction_internal(true);
+	//The writer threads of the shards apply and commit the changes in
+	//parallel, so there is no atomicity across shards. A crash in between
+	//leaves some shards with and some without the changes of this
+	//transaction. Every key is in exactly one shard and the changes to
+	//different keys are independent, so this is the same as losing the not
+	//yet committed delayed changes, which a crash does anyway.
+	std::vector<bool> shard_mask(shards.size());
+	for (size_t i = 0; i < shard_txns.size(); ++i)
+	{
+		shard_mask[i] = !shard_txns[i].pending.empty();
+	}
+
+	run_shard_jobs(EShardJob_Commit, shard_mask);
+
+	//The shards are committed without sync. Make all of them durable at
+	//once here, so there is only one sync point per group commit.
+	if (!no_sync)
+	{
+		run_shard_jobs(EShardJob_Sync, shard_mask);
+	}
+
+	in_write_transaction=false;
+
+	if (filter != NULL
+		&& filter->needsRebuild())
+	{
+		startFileIndexFilterRebuild();
+	}
 }
 
-void LMDBFileIndex::commit_transaction_internal(bool handle_enosp)
+void LMDBFileIndex::run_shard_jobs(EShardJob job, const std::vector<bool>& shard_mask)
 {
-	int rc = mdb_txn_commit(txn);
-	
-	
-	if(rc==MDB_MAP_FULL && handle_enosp)
+	std::vector<int64> tickets(shards.size());
+	for (size_t i = 0; i < shards.size(); ++i)
 	{
-		if(_has_error)
+		if (shard_mask[i])
 		{
-			Server->Log("LMDB had error during increase (on commit). Aborting...", LL_ERROR);
-			start_transaction();
-			return;
+			tickets[i] = shards[i].writer->add(this, i, job);
 		}
+	}
 
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		if (shard_mask[i])
 		{
-			read_transaction_lock.reset();
+			shards[i].writer->wait(tickets[i]);
+		}
+	}
+}
 
-			IScopedWriteLock lock(mutex);
+void LMDBFileIndex::run_shard_job(size_t shard_idx, EShardJob job)
+{
+	if (job == EShardJob_Commit)
+	{
+		write_shard(shard_idx);
+	}
+	else if (job == EShardJob_Sync)
+	{
+		IScopedReadLock lock(shards[shard_idx].mutex);
 
-			destroy_env();
+		int rc = mdb_env_sync(shards[shard_idx].env, 1);
+		if (rc)
+		{
+			Server->Log("LMDB: Failed to sync shard " + convert(shard_idx) + " (" + (std::string)mdb_strerror(rc) + ")", LL_ERROR);
+			_has_error = true;
+		}
+	}
+}
 
-			map_size*=2;
+void LMDBFileIndex::write_shard(size_t shard_idx)
+{
+	SShardTxn& shard_txn = shard_txns[shard_idx];
 
-			Server->Log("Increased LMDB database size to "+PrettyPrintBytes(map_size)+" (on commit)", LL_DEBUG);
+	std::vector<STransactionLogItem> pending;
+	pending.swap(shard_txn.pending);
 
-			if(!create_env())
-			{
-				Server->Log("Error creating env after database file size increase", LL_ERROR);
-				_has_error=true;
-				start_transaction();
-				return;
-			}
-			
+	for (size_t i = 0; i < pending.size(); ++i)
+	{
+		if (pending[i].value != 0)
+		{
+			put_internal(pending[i].key, pending[i].value, pending[i].flags, true, true);
+		}
+		else
+		{
+			del_internal(pending[i].key, true, true);
 		}
+	}
+
+	if (shard_txn.txn != NULL)
+	{
+		commit_transaction_internal(shard_idx, true);
+	}
+	else
+	{
+		end_txn(shard_idx);
+	}
+}
+
+void LMDBFileIndex::commit_transaction_internal(size_t shard_idx, bool handle_enosp)
+{
+	SShardTxn& shard_txn = shard_txns[shard_idx];
 
-		start_transaction();
+	int rc = mdb_txn_commit(shard_txn.txn);
+	shard_txn.txn = NULL;
+
+	if(rc==MDB_MAP_FULL && handle_enosp)
+	{
+		if (!increase_map_size(shard_idx, "commit"))
+		{
+			end_txn(shard_idx);
+			return;
+		}
 
-		replay_transaction_log();
-		
-		commit_transaction_internal(false);
+		commit_transaction_internal(shard_idx, false);
+		return;
 	}
 	else if(rc==MDB_BAD_TXN && handle_enosp)
 	{
 		if(_has_error)
 		{
 			Server->Log("LMDB had error on BAD_TXN (on commit). Aborting...", LL_ERROR);
-			start_transaction();
+			end_txn(shard_idx);
 			return;
 		}
-		
-		start_transaction();
-		
-		replay_transaction_log();
-		
-		commit_transaction_internal(false);
+
+		begin_txn(shard_idx, 0);
+
+		replay_transaction_log(shard_idx);
+
+		commit_transaction_internal(shard_idx, false);
+		return;
 	}
 	else if(rc)
 	{
@@ -484,13 +1262,14 @@ void LMDBFileIndex::commit_transaction_internal(bool handle_enosp)
 		_has_error=true;
 	}
 
-	read_transaction_lock.reset();
-	transaction_log.clear();
+	end_txn(shard_idx);
 }
 
-bool LMDBFileIndex::create_env()
+bool LMDBFileIndex::create_env(size_t shard_idx)
 {
 	int rc;
+	MDB_env*& env = shards[shard_idx].env;
+	size_t& map_size = shards[shard_idx].map_size;
 	if(env==NULL)
 	{
 		rc = mdb_env_create(&env);
@@ -500,8 +1279,10 @@ bool LMDBFileIndex::create_env()
 			return false;
 		}
 
+		std::string fn = getShardFn(shard_idx);
+
 		{
-			std::auto_ptr<IFile> lmdb_f(Server->openFile("urbackup/fileindex/backup_server_files_index.lmdb", MODE_READ));
+			std::auto_ptr<IFile> lmdb_f(Server->openFile(fn, MODE_READ));
 			if(lmdb_f.get()!=NULL)
 			{
 				while(lmdb_f->Size()>static_cast<_i64>(map_size))
@@ -510,7 +1291,7 @@ bool LMDBFileIndex::create_env()
 				}
 			}
 		}
-		
+
 		rc = mdb_env_set_maxreaders(env, 4094);
 
 		if (rc)
@@ -529,12 +1310,9 @@ bool LMDBFileIndex::create_env()
 
 		os_create_dir("urbackup/fileindex");
 
-		unsigned int flags = MDB_NOSUBDIR|MDB_NOMETASYNC;
-		if(no_sync)
-		{
-			flags|=MDB_NOSYNC;
-		}
-		rc = mdb_env_open(env, "urbackup/fileindex/backup_server_files_index.lmdb", flags, 0664);
+		//Synced explicitly once per group commit (see commit_transaction)
+		unsigned int flags = MDB_NOSUBDIR|MDB_NOSYNC;
+		rc = mdb_env_open(env, fn.c_str(), flags, 0664);
 
 		if(rc)
 		{
@@ -551,7 +1329,7 @@ bool LMDBFileIndex::create_env()
 			return false;
 		}
 
-		rc = mdb_dbi_open(l_txn, NULL, 0, &dbi);
+		rc = mdb_dbi_open(l_txn, NULL, 0, &shards[shard_idx].dbi);
 
 		if (rc)
 		{
@@ -575,24 +1353,43 @@ bool LMDBFileIndex::create_env()
 	}
 }
 
-void LMDBFileIndex::destroy_env()
+void LMDBFileIndex::destroy_env(size_t shard_idx)
 {
-	mdb_env_close(env);
-	env=NULL;
+	mdb_env_close(shards[shard_idx].env);
+	shards[shard_idx].env=NULL;
 }
 
 size_t LMDBFileIndex::get_map_size()
 {
-	return map_size;
+	size_t ret = 0;
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		ret += shards[i].map_size;
+	}
+	return ret;
 }
 
 int64 LMDBFileIndex::get_any_client( const SIndexKey& key )
 {
-	begin_txn(MDB_RDONLY);
+	if (filter_miss(key))
+	{
+		return 0;
+	}
+
+	size_t shard_idx = get_shard(key);
+
+	begin_txn(shard_idx, MDB_RDONLY);
+
+	MDB_txn* txn = shard_txns[shard_idx].txn;
+	if (txn == NULL)
+	{
+		end_txn(shard_idx);
+		return 0;
+	}
 
 	MDB_cursor* cursor;
 
-	mdb_cursor_open(txn, dbi, &cursor);
+	mdb_cursor_open(txn, shards[shard_idx].dbi, &cursor);
 
 	SIndexKey orig_key = key;
 
@@ -608,9 +1405,12 @@ int64 LMDBFileIndex::get_any_client( const SIndexKey& key )
 
 	int64 ret = 0;
 	if(rc==MDB_NOTFOUND ||
-		!orig_key.isEqualWithoutClientid(orig_key) )
+		(rc==0 && !curr_key->isEqualWithoutClientid(orig_key)) )
 	{
-
+		if (filter != NULL)
+		{
+			filter->addFalsePositive();
+		}
 	}
 	else if(rc)
 	{
@@ -626,26 +1426,43 @@ int64 LMDBFileIndex::get_any_client( const SIndexKey& key )
 
 	mdb_cursor_close(cursor);
 
-	abort_transaction();
+	end_txn(shard_idx);
 
 	return ret;
 }
 
 void LMDBFileIndex::abort_transaction()
 {
-	mdb_txn_abort(txn);
+	for (size_t i = 0; i < shard_txns.size(); ++i)
+	{
+		end_txn(i);
+		shard_txns[i].pending.clear();
+	}
 
-	read_transaction_lock.reset();
-	transaction_log.clear();
+	in_write_transaction=false;
 }
 
 std::map<int, int64> LMDBFileIndex::get_all_clients( const SIndexKey& key )
 {
-	begin_txn(MDB_RDONLY);
+	if (filter_miss(key))
+	{
+		return std::map<int, int64>();
+	}
+
+	size_t shard_idx = get_shard(key);
+
+	begin_txn(shard_idx, MDB_RDONLY);
+
+	MDB_txn* txn = shard_txns[shard_idx].txn;
+	if (txn == NULL)
+	{
+		end_txn(shard_idx);
+		return std::map<int, int64>();
+	}
 
 	MDB_cursor* cursor;
 
-	mdb_cursor_open(txn, dbi, &cursor);
+	mdb_cursor_open(txn, shards[shard_idx].dbi, &cursor);
 
 	SIndexKey orig_key = key;
 
@@ -680,21 +1497,39 @@ std::map<int, int64> LMDBFileIndex::get_all_clients( const SIndexKey& key )
 		Server->Log("LMDB: Failed to read ("+(std::string)mdb_strerror(rc)+")", LL_ERROR);
 		_has_error=true;
 	}
+	else if (ret.empty() && filter != NULL)
+	{
+		filter->addFalsePositive();
+	}
 
 	mdb_cursor_close(cursor);
 
-	abort_transaction();
+	end_txn(shard_idx);
 
 	return ret;
 }
 
 int64 LMDBFileIndex::get_prefer_client( const SIndexKey& key )
 {
-	begin_txn(MDB_RDONLY);
+	if (filter_miss(key))
+	{
+		return 0;
+	}
+
+	size_t shard_idx = get_shard(key);
+
+	begin_txn(shard_idx, MDB_RDONLY);
+
+	MDB_txn* txn = shard_txns[shard_idx].txn;
+	if (txn == NULL)
+	{
+		end_txn(shard_idx);
+		return 0;
+	}
 
 	MDB_cursor* cursor;
 
-	mdb_cursor_open(txn, dbi, &cursor);
+	mdb_cursor_open(txn, shards[shard_idx].dbi, &cursor);
 
 	SIndexKey orig_key = key;
 
@@ -734,15 +1569,21 @@ int64 LMDBFileIndex::get_prefer_client( const SIndexKey& key )
 		}
 	}
 
+	if (ret == 0 && !_has_error && filter != NULL)
+	{
+		filter->addFalsePositive();
+	}
+
 	mdb_cursor_close(cursor);
 
-	abort_transaction();
+	end_txn(shard_idx);
 
 	return ret;
 }
 
-void LMDBFileIndex::replay_transaction_log()
+void LMDBFileIndex::replay_transaction_log(size_t shard_idx)
 {
+	std::vector<STransactionLogItem>& transaction_log = shard_txns[shard_idx].transaction_log;
 	for(size_t i=0;i<transaction_log.size();++i)
 	{
 		if(transaction_log[i].value!=0)
@@ -758,38 +1599,77 @@ void LMDBFileIndex::replay_transaction_log()
 
 void LMDBFileIndex::start_iteration()
 {
-	SIndexKey key;
-	
-	MDB_val mdb_tkey;
-	mdb_tkey.mv_data=const_cast<void*>(static_cast<const void*>(&key));
-	mdb_tkey.mv_size=sizeof(SIndexKey);
+	it_shard = 0;
+	it_cursor = NULL;
 
-	MDB_val mdb_tvalue;
+	open_iteration_cursor();
+}
+
+bool LMDBFileIndex::open_iteration_cursor()
+{
+	while (it_shard < shards.size())
+	{
+		begin_txn(it_shard, MDB_RDONLY);
+
+		MDB_txn* txn = shard_txns[it_shard].txn;
+		if (txn == NULL)
+		{
+			end_txn(it_shard);
+			return false;
+		}
 
-	mdb_cursor_open(txn, dbi, &it_cursor);
+		mdb_cursor_open(txn, shards[it_shard].dbi, &it_cursor);
 
-	int rc=mdb_cursor_get(it_cursor, &mdb_tkey, &mdb_tvalue, MDB_SET_RANGE);
+		MDB_val mdb_tkey;
+		MDB_val mdb_tvalue;
 
-	if(rc)
-	{
-		_has_error=true;
-		Server->Log("LMDB: Failed to read ("+(std::string)mdb_strerror(rc)+")", LL_ERROR);
-		return;
+		int rc = mdb_cursor_get(it_cursor, &mdb_tkey, &mdb_tvalue, MDB_FIRST);
+
+		if (rc == 0)
+		{
+			return true;
+		}
+
+		mdb_cursor_close(it_cursor);
+		it_cursor = NULL;
+
+		if (rc != MDB_NOTFOUND)
+		{
+			_has_error = true;
+			Server->Log("LMDB: Failed to read (" + (std::string)mdb_strerror(rc) + ")", LL_ERROR);
+			return false;
+		}
+
+		//Empty shard
+		end_txn(it_shard);
+		++it_shard;
 	}
+
+	return false;
+}
+
+bool LMDBFileIndex::iteration_next_shard()
+{
+	mdb_cursor_close(it_cursor);
+	it_cursor = NULL;
+
+	end_txn(it_shard);
+	++it_shard;
+
+	return open_iteration_cursor();
 }
 
 std::map<int, int64> LMDBFileIndex::get_next_entries_iteration(bool& has_next)
 {
-	SIndexKey key;
+	if (it_cursor == NULL)
+	{
+		has_next = false;
+		return std::map<int, int64>();
+	}
 
 	MDB_val mdb_tkey;
-	mdb_tkey.mv_data=const_cast<void*>(static_cast<const void*>(&key));
-	mdb_tkey.mv_size=sizeof(SIndexKey);
-
 	MDB_val mdb_tvalue;
 
-	SIndexKey* start_key;
-
 	int rc = mdb_cursor_get(it_cursor, &mdb_tkey, &mdb_tvalue, MDB_GET_CURRENT);
 
 	if(rc && rc!=MDB_NOTFOUND)
@@ -805,7 +1685,7 @@ std::map<int, int64> LMDBFileIndex::get_next_entries_iteration(bool& has_next)
 		return std::map<int, int64>();
 	}
 
-	start_key = reinterpret_cast<SIndexKey*>(mdb_tkey.mv_data);
+	SIndexKey start_key = *reinterpret_cast<SIndexKey*>(mdb_tkey.mv_data);
 
 	std::map<int, int64> ret;
 
@@ -814,11 +1694,11 @@ std::map<int, int64> LMDBFileIndex::get_next_entries_iteration(bool& has_next)
 		CRData data((const char*)mdb_tvalue.mv_data, mdb_tvalue.mv_size);
 		data.getVarInt(&entryid);
 
-		ret[start_key->getClientid()]=entryid;
+		ret[start_key.getClientid()]=entryid;
 	}
-	
 
-	do 
+
+	do
 	{
 		SIndexKey* key_curr;
 		rc = mdb_cursor_get(it_cursor, &mdb_tkey, &mdb_tvalue, MDB_NEXT);
@@ -832,13 +1712,14 @@ std::map<int, int64> LMDBFileIndex::get_next_entries_iteration(bool& has_next)
 		}
 		else if(rc==MDB_NOTFOUND)
 		{
-			has_next=false;
+			//Keys with the same hash are always in the same shard
+			has_next=iteration_next_shard();
 			return ret;
 		}
 
 		key_curr = reinterpret_cast<SIndexKey*>(mdb_tkey.mv_data);
 
-		if(!start_key->isEqualWithoutClientid(*key_curr))
+		if(!start_key.isEqualWithoutClientid(*key_curr))
 		{
 			return ret;
 		}
@@ -847,17 +1728,27 @@ std::map<int, int64> LMDBFileIndex::get_next_entries_iteration(bool& has_next)
 		CRData data((const char*)mdb_tvalue.mv_data, mdb_tvalue.mv_size);
 		data.getVarInt(&entryid);
 
-		ret[key.getClientid()]=entryid;
+		ret[key_curr->getClientid()]=entryid;
 
 	} while (true);
 }
 
 void LMDBFileIndex::stop_iteration()
 {
-	mdb_cursor_close(it_cursor);
+	if (it_cursor != NULL)
+	{
+		mdb_cursor_close(it_cursor);
+		it_cursor = NULL;
+	}
+
+	if (it_shard < shards.size())
+	{
+		end_txn(it_shard);
+	}
 }
 
 void LMDBFileIndex::del( const SIndexKey& key )
 {
-	del_internal(key, true, true);
+	STransactionLogItem item = { key, 0, 0 };
+	shard_txns[get_shard(key)].pending.push_back(item);
 }
@@ -3,19 +3,30 @@
 #include "lmdb/lmdb.h"
 #include "FileIndex.h"
 #include "../Interface/SharedMutex.h"
-#include <memory>
+#include <memory>
+
+class FileIndexFilter;
 
 class LMDBFileIndex : public FileIndex
 {
 public:
 	static bool initFileIndex();
 	static void shutdownFileIndex();
+	static void shutdownFileIndexFilter();
+	static FileIndexFilter* getFileIndexFilter();
+	static void rebuildFileIndexFilter();
+	static std::string getFileIndexFilterFn();
+
+	static const size_t max_shards = 64;
+	static std::string getShardFn(size_t shard_idx);
+	static std::string getReshardDir();
+	static bool indexExists();
 
 	LMDBFileIndex(bool no_sync=false);
 
-	bool create_env();
+	bool create_env(size_t shard_idx);
 
-	void destroy_env();
+	void destroy_env(size_t shard_idx);
 
 	~LMDBFileIndex(void);
 
@@ -52,39 +63,108 @@ public:
 	size_t get_map_size();
 private:
 
-	void begin_txn(unsigned int flags);
+	class ShardWriter;
+
+	//The index is partitioned by the first hash byte into independent
+	//LMDB environments. Each one has its own lock, map size and writer
+	//thread, so the shards are written in parallel and a map resize only
+	//blocks the writers and readers of one shard.
+	//There is no atomicity across shards (see commit_transaction).
+	struct SShard
+	{
+		MDB_env *env;
+		MDB_dbi dbi;
+		ISharedMutex* mutex;
+		size_t map_size;
+		ShardWriter* writer;
+		THREADPOOL_TICKET writer_ticket;
+	};
+
+	struct STransactionLogItem
+	{
+		SIndexKey key;
+		int64 value;
+		int flags;
+	};
+
+	struct SShardTxn
+	{
+		MDB_txn *txn;
+		IScopedReadLock* read_transaction_lock;
+		std::vector<STransactionLogItem> transaction_log;
+		std::vector<STransactionLogItem> pending;
+	};
+
+	enum EShardJob
+	{
+		EShardJob_Commit,
+		EShardJob_Sync
+	};
+
+	static void init_shards();
+
+	static std::string getShardFn(size_t shard_idx, const std::string& dir);
+
+	static void shutdownShardWriters();
+
+	bool reshard();
+
+	void run_shard_jobs(EShardJob job, const std::vector<bool>& shard_mask);
 
-	static MDB_env *env;
-	static MDB_dbi dbi;
-	size_t map_size;
+	void run_shard_job(size_t shard_idx, EShardJob job);
 
-	std::auto_ptr<IScopedReadLock> read_transaction_lock;
+	void write_shard(size_t shard_idx);
+
+	static size_t get_shard(const SIndexKey& key);
+
+	void begin_txn(size_t shard_idx, unsigned int flags);
+
+	MDB_txn* get_txn(size_t shard_idx);
+
+	void end_txn(size_t shard_idx);
+
+	bool increase_map_size(size_t shard_idx, const std::string& on_what);
+
+	static void initFileIndexFilter();
+
+	static void startFileIndexFilterRebuild();
+
+	static bool saveFileIndexFilter();
+
+	static bool fillFileIndexFilter(FileIndexFilter* target_filter, bool rebuild);
+
+	static int64 get_n_entries();
+
+	static int64 get_last_txnid();
+
+	bool filter_miss(const SIndexKey& key);
+
+	bool open_iteration_cursor();
+
+	bool iteration_next_shard();
+
+	static std::vector<SShard> shards;
+	static size_t reshard_from;
 
 	void put_internal(const SIndexKey& key, int64 value, int flags, bool log, bool handle_enosp);
 
 	void del_internal(const SIndexKey& key, bool log, bool handle_enosp);
 
-	void replay_transaction_log();
-	
-	void commit_transaction_internal(bool handle_enosp);
+	void replay_transaction_log(size_t shard_idx);
 
+	void commit_transaction_internal(size_t shard_idx, bool handle_enosp);
 
-	MDB_txn *txn;
+	std::vector<SShardTxn> shard_txns;
+	bool in_write_transaction;
 	bool _has_error;
 	MDB_cursor* it_cursor;
+	size_t it_shard;
 
-	struct STransactionLogItem
-	{
-		SIndexKey key;
-		int64 value;
-		int flags;
-	};
-
-	std::vector<STransactionLogItem> transaction_log;
-
-	static ISharedMutex* mutex;
 	static LMDBFileIndex* fileindex;
 	static THREADPOOL_TICKET fileindex_ticket;
+	static FileIndexFilter* filter;
+	static THREADPOOL_TICKET filter_rebuild_ticket;
+	static volatile bool filter_rebuild_stop;
 
 	bool no_sync;
-};
\ No newline at end of file
+};
@@ -40,6 +40,19 @@ namespace
 	const size_t queue_items_chunked = 4;
 
 	const char* tmpfile_dirname = ".b68xO+K9SCOF35cLk4Bf9Q";
+
+	//Maximum number of full file downloads handed to one additional stream at once
+	const size_t max_stream_jobs = 16;
+
+	void destroySparseExtentsFile(IFile* sparse_extents_f)
+	{
+		if (sparse_extents_f != NULL)
+		{
+			std::string tmpfn = sparse_extents_f->getFilename();
+			Server->destroy(sparse_extents_f);
+			Server->deleteFile(tmpfn);
+		}
+	}
 }
 
 ServerDownloadThread::ServerDownloadThread( FileClient& fc, FileClientChunked* fc_chunked, const std::string& backuppath, const std::string& backuppath_hashes, const std::string& last_backuppath, const std::string& last_backuppath_complete, bool hashed_transfer, bool save_incomplete_file, int clientid,
@@ -53,7 +66,7 @@ ServerDownloadThread::ServerDownloadThread( FileClient& fc, FileClientChunked* f
 	is_offline(false), client_main(client_main), filesrv_protocol_version(filesrv_protocol_version), skipping(false), queue_size(0),
 	all_downloads_ok(true), incremental_num(incremental_num), logid(logid), has_timeout(false), with_hashes(with_hashes), with_metadata(client_main->getProtocolVersions().file_meta>0), shares_without_snapshot(shares_without_snapshot),
 	with_sparse_hashing(with_sparse_hashing), exp_backoff(false), num_embedded_metadata_files(0), file_metadata_download(file_metadata_download), num_issues(0), last_snap_num_issues(0), has_disk_error(false), sc_failure_fatal(sc_failure_fatal),
-	tmpfile_num(0), filepath_corrections(filepath_corrections), max_file_id(max_file_id)
+	tmpfile_num(0), filepath_corrections(filepath_corrections), max_file_id(max_file_id), next_stream(0)
 {
 	mutex = Server->createMutex();
 	cond = Server->createCondition();
@@ -66,10 +79,17 @@ ServerDownloadThread::ServerDownloadThread( FileClient& fc, FileClientChunked* f
 	{
 		default_hashing_method = HASH_FUNC_SHA512;
 	}
+
+	initStreams();
 }
 
 ServerDownloadThread::~ServerDownloadThread()
 {
+	for (size_t i = 0; i < streams.size(); ++i)
+	{
+		delete streams[i];
+	}
+
 	Server->destroy(mutex);
 	Server->destroy(cond);
 }
@@ -84,17 +104,47 @@ void ServerDownloadThread::operator()( void )
 	if(filesrv_protocol_version>2)
 	{
 		fc.setQueueCallback(this);
+
+		std::string queue_window = Server->getServerParameter("fileclient_queue_window");
+		if (!queue_window.empty())
+		{
+			size_t window = static_cast<size_t>((std::max)(1, watoi(queue_window)));
+			fc.setQueueWindow(window, window / 30);
+			for (size_t i = 0; i < streams.size(); ++i)
+			{
+				streams[i]->getFileClient().setQueueWindow(window, window / 30);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < streams.size(); ++i)
+	{
+		stream_tickets.push_back(Server->getThreadPool()->execute(streams[i], "fbackup load stream"));
 	}
 
 	while(true)
 	{
+		if (!finishStreamJobs(false))
+		{
+			IScopedLock lock(mutex);
+			is_offline = true;
+		}
+
 		SQueueItem curr;
+		SStreamJob* stream_job = NULL;
 		{
 			IScopedLock lock(mutex);
-			while(dl_queue.empty())
+			while(dl_queue.empty()
+				&& !hasDoneStreamJob())
 			{
 				cond->wait(&lock);
 			}
+
+			if (dl_queue.empty())
+			{
+				continue;
+			}
+
 			curr = dl_queue.front();
 			dl_queue.pop_front();
 
@@ -108,6 +158,15 @@ void ServerDownloadThread::operator()( void )
 				{
 					queue_size-=queue_items_chunked;
 				}
+
+				if (curr.fileclient == EFileClient_Full
+					&& curr.stream > 0
+					&& !is_offline && !skipping)
+				{
+					stream_job = new SStreamJob(curr);
+					stream_jobs.push_back(stream_job);
+					streams[curr.stream - 1]->addJob(stream_job);
+				}
 			}			
 		}
 
@@ -191,6 +250,14 @@ void ServerDownloadThread::operator()( void )
 			continue;
 		}
 
+		if ( (curr.action == EQueueAction_StartShadowcopy
+				|| curr.action == EQueueAction_StopShadowcopy)
+			&& !finishStreamJobs(true) )
+		{
+			IScopedLock lock(mutex);
+			is_offline = true;
+		}
+
 		if(curr.action==EQueueAction_StartShadowcopy)
 		{
 			if (!start_shadowcopy(curr.fn))
@@ -218,6 +285,10 @@ void ServerDownloadThread::operator()( void )
 			{
 				fc.FinishScript(getDLPath(curr));
 			}
+			else if(stream_job!=NULL)
+			{
+				ret = startStreamJob(*stream_job);
+			}
 			else
 			{
 				ret = load_file(curr);
@@ -235,6 +306,21 @@ void ServerDownloadThread::operator()( void )
 		}
 	}
 
+	if (!finishStreamJobs(true))
+	{
+		IScopedLock lock(mutex);
+		is_offline = true;
+	}
+
+	{
+		IScopedLock lock(mutex);
+		for (size_t i = 0; i < streams.size(); ++i)
+		{
+			streams[i]->quit();
+		}
+	}
+	Server->getThreadPool()->waitFor(stream_tickets);
+
 	if(!is_offline && !skipping && client_main->getProtocolVersions().file_meta>0)
 	{
 		_u32 rc = fc.InformMetadataStreamEnd(server_token, 3);
@@ -245,6 +331,22 @@ void ServerDownloadThread::operator()( void )
 		}
 	}
 
+	if (fc.getMaxPipelineDepth() > 0)
+	{
+		ServerLogger::Log(logid, "Full file download pipeline depth: avg " + convert(fc.getAvgPipelineDepth())
+			+ ", max " + convert(fc.getMaxPipelineDepth()), LL_DEBUG);
+	}
+
+	for (size_t i = 0; i < streams.size(); ++i)
+	{
+		FileClient& stream_fc = streams[i]->getFileClient();
+		if (stream_fc.getMaxPipelineDepth() > 0)
+		{
+			ServerLogger::Log(logid, "Full file download pipeline depth of stream " + convert(i + 1) + ": avg " + convert(stream_fc.getAvgPipelineDepth())
+				+ ", max " + convert(stream_fc.getMaxPipelineDepth()), LL_DEBUG);
+		}
+	}
+
 	download_nok_ids.finalize();
 	download_partial_ids.finalize();
 }
@@ -279,6 +381,15 @@ void ServerDownloadThread::addToQueueFull(size_t id, const std::string &fn, cons
 		max_file_id.setMinDownloaded(id);
 	}
 
+	if (!streams.empty()
+		&& !is_script
+		&& !metadata_only
+		&& !at_front_postpone_quitstop)
+	{
+		ni.stream = next_stream;
+		next_stream = (next_stream + 1) % (streams.size() + 1);
+	}
+
 	if(is_script)
 	{
 		if (p_script_random != 0)
@@ -414,7 +525,8 @@ size_t ServerDownloadThread::insertFullQueueEarliest(const SQueueItem& ni, bool
 	for(std::deque<SQueueItem>::iterator it=dl_queue.begin();it!=dl_queue.end();++it)
 	{
 		if(it->action == EQueueAction_Fileclient
-			&& it->fileclient == EFileClient_Full)
+			&& it->fileclient == EFileClient_Full
+			&& it->stream == ni.stream)
 		{
 			if(!it->queued )
 			{
@@ -465,12 +577,13 @@ size_t ServerDownloadThread::insertFullQueueEarliest(const SQueueItem& ni, bool
 	}
 }
 
-bool ServerDownloadThread::hasFullQueuedAfter(std::deque<SQueueItem>::iterator it)
+bool ServerDownloadThread::hasFullQueuedAfter(std::deque<SQueueItem>::iterator it, size_t stream)
 {
 	for (; it != dl_queue.end(); ++it)
 	{
 		if (it->action == EQueueAction_Fileclient
-			&& it->fileclient == EFileClient_Full)
+			&& it->fileclient == EFileClient_Full
+			&& it->stream == stream)
 		{
 			if (it->queued)
 			{
@@ -498,11 +611,18 @@ bool ServerDownloadThread::load_file(SQueueItem todl)
 	}
 	
 
-	std::string cfn=getDLPath(todl);
-
 	int64 script_start_time = Server->getTimeSeconds()-60;
 
-    _u32 rc=fc.GetFile(cfn, fd, hashed_transfer, todl.metadata_only, todl.folder_items, todl.is_script, with_metadata ? (todl.id+1) : 0);
+	_u32 rc = download_file(fc, todl, fd);
+
+	return finish_load_file(todl, fd, rc, fc.releaseSparseExtendsFile(), script_start_time);
+}
+
+_u32 ServerDownloadThread::download_file(FileClient& curr_fc, const SQueueItem& todl, IFsFile* fd)
+{
+	std::string cfn=getDLPath(todl);
+
+    _u32 rc=curr_fc.GetFile(cfn, fd, hashed_transfer, todl.metadata_only, todl.folder_items, todl.is_script, with_metadata ? (todl.id+1) : 0);
 
 	int hash_retries=5;
 	while(rc==ERR_HASH && hash_retries>0)
@@ -510,10 +630,17 @@ bool ServerDownloadThread::load_file(SQueueItem todl)
 		ServerLogger::Log(logid, "Corrupted data while loading \"" + todl.fn + "\". Retrying...", LL_WARNING);
 
 		fd->Seek(0);
-        rc=fc.GetFile(cfn, fd, hashed_transfer, todl.metadata_only, todl.folder_items, todl.is_script, with_metadata ? (todl.id+1) : 0);
+        rc=curr_fc.GetFile(cfn, fd, hashed_transfer, todl.metadata_only, todl.folder_items, todl.is_script, with_metadata ? (todl.id+1) : 0);
 		--hash_retries;
 	}
 
+	return rc;
+}
+
+bool ServerDownloadThread::finish_load_file(SQueueItem todl, IFsFile* fd, _u32 rc, IFile* sparse_extents_f, int64 script_start_time)
+{
+	std::string cfn=getDLPath(todl);
+
 	bool ret = true;
 	bool hash_file = false;
 	bool script_ok = true;
@@ -527,7 +654,7 @@ bool ServerDownloadThread::load_file(SQueueItem todl)
 		{
 			ll = LL_WARNING;
 		}
-		ServerLogger::Log(logid, "Error getting complete file \""+cfn+"\" from "+clientname+". Errorcode: "+fc.getErrorString(rc)+" ("+convert(rc)+")", ll);
+		ServerLogger::Log(logid, "Error getting complete file \""+cfn+"\" from "+clientname+". Errorcode: "+FileClient::getErrorString(rc)+" ("+convert(rc)+")", ll);
 
 		{
 			IScopedLock lock(mutex);
@@ -639,7 +766,7 @@ bool ServerDownloadThread::load_file(SQueueItem todl)
 			Server->destroy(file_old);
 		}
 
-		hashFile(todl.id, dstpath, hashpath, fd, NULL, filepath_old, fd->Size(), todl.metadata, todl.is_script, todl.sha_dig, fc.releaseSparseExtendsFile(),
+		hashFile(todl.id, dstpath, hashpath, fd, NULL, filepath_old, fd->Size(), todl.metadata, todl.is_script, todl.sha_dig, sparse_extents_f,
 			todl.is_script ? HASH_FUNC_SHA512_NO_SPARSE : default_hashing_method, fileHasSnapshot(todl));
 	}
 	else
@@ -649,7 +776,7 @@ bool ServerDownloadThread::load_file(SQueueItem todl)
 			write_file_metadata(hashpath, client_main, todl.metadata, false);
 		}
 
-		fc.resetSparseExtentsFile();
+		destroySparseExtentsFile(sparse_extents_f);
 	}
 
 	if(todl.is_script && (rc!=ERR_SUCCESS || !script_ok) )
@@ -1055,9 +1182,34 @@ size_t ServerDownloadThread::getMaxOkId()
 }
 
 std::string ServerDownloadThread::getQueuedFileFull(FileClient::MetadataQueue& metadata, size_t& folder_items, bool& finish_script, int64& file_id)
+{
+	return getQueuedFileFull(0, metadata, folder_items, finish_script, file_id);
+}
+
+std::string ServerDownloadThread::getQueuedFileFull(size_t stream, FileClient::MetadataQueue& metadata, size_t& folder_items, bool& finish_script, int64& file_id)
 {
 	IScopedLock lock(mutex);
-	int max_prepare = 1;
+
+	if (stream > 0)
+	{
+		//Files handed to the stream come before the ones still in the download queue
+		std::deque<SStreamJob*>& jobs = streams[stream - 1]->getJobs();
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			SQueueItem& item = jobs[i]->item;
+			if (!item.queued)
+			{
+				item.queued = true;
+				file_id = with_metadata ? (item.id + 1) : 0;
+				metadata = FileClient::MetadataQueue_Data;
+				folder_items = item.folder_items;
+				finish_script = false;
+				return getDLPath(item);
+			}
+		}
+	}
+
+	int max_prepare = stream == 0 ? 1 : 0;
 	bool retry = true;
 	while (retry)
 	{
@@ -1084,7 +1236,7 @@ std::string ServerDownloadThread::getQueuedFileFull(FileClient::MetadataQueue& m
 					if (it->patch_dl_files.orig_file == NULL &&
 						full_dl)
 					{
-						if (hasFullQueuedAfter(it))
+						if (hasFullQueuedAfter(it, 0))
 						{
 							SQueueItem item = *it;
 							dl_queue.erase(it);
@@ -1107,7 +1259,8 @@ std::string ServerDownloadThread::getQueuedFileFull(FileClient::MetadataQueue& m
 			}
 
 			if (it->action == EQueueAction_Fileclient &&
-				!it->queued && it->fileclient == EFileClient_Full)
+				!it->queued && it->fileclient == EFileClient_Full
+				&& it->stream == stream)
 			{
 				it->queued = true;
 				file_id = with_metadata ? (it->id + 1) : 0;
@@ -1187,13 +1340,29 @@ std::string ServerDownloadThread::getDLPath( const SQueueItem& todl )
 }
 
 void ServerDownloadThread::resetQueueFull()
+{
+	resetQueueFull(0);
+}
+
+void ServerDownloadThread::resetQueueFull(size_t stream)
 {
 	IScopedLock lock(mutex);
+
+	if (stream > 0)
+	{
+		std::deque<SStreamJob*>& jobs = streams[stream - 1]->getJobs();
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			jobs[i]->item.queued = false;
+		}
+	}
+
 	for(std::deque<SQueueItem>::iterator it=dl_queue.begin();
 		it!=dl_queue.end();++it)
 	{
 		if(it->action==EQueueAction_Fileclient && 
-			it->fileclient==EFileClient_Full)
+			it->fileclient==EFileClient_Full
+			&& it->stream == stream)
 		{
 			it->queued=false;
 		}
@@ -1229,7 +1398,7 @@ bool ServerDownloadThread::getQueuedFileChunked( std::string& remotefn, IFile*&
 					if(it->patch_dl_files.orig_file==NULL &&
 						full_dl)
 					{
-						if (hasFullQueuedAfter(it))
+						if (hasFullQueuedAfter(it, 0))
 						{
 							SQueueItem item = *it;
 							dl_queue.erase(it);
@@ -1540,13 +1709,34 @@ void ServerDownloadThread::queueSkip()
 }
 
 void ServerDownloadThread::unqueueFileFull( const std::string& fn, bool finish_script)
+{
+	unqueueFileFull(0, fn, finish_script);
+}
+
+void ServerDownloadThread::unqueueFileFull(size_t stream, const std::string& fn, bool finish_script)
 {
 	IScopedLock lock(mutex);
+
+	if (stream > 0)
+	{
+		std::deque<SStreamJob*>& jobs = streams[stream - 1]->getJobs();
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			if (jobs[i]->item.queued
+				&& getDLPath(jobs[i]->item) == fn)
+			{
+				jobs[i]->item.queued = false;
+				return;
+			}
+		}
+	}
+
 	for(std::deque<SQueueItem>::iterator it=dl_queue.begin();
 		it!=dl_queue.end();++it)
 	{
 		if(it->action==EQueueAction_Fileclient && 
 			it->queued && it->fileclient==EFileClient_Full
+			&& it->stream == stream
 			&& it->script_end == finish_script
 			&& (getDLPath(*it)) == fn)
 		{
@@ -2017,3 +2207,291 @@ void ServerDownloadThread::base_dir_lost_hint()
 		"system snapshot it was backing up was deleted because it ran out of snapshot storage space. "
 		"See https://www.urbackup.org/faq.html#base_dir_lost for details and for how to fix this issue", LL_INFO);
 }
+
+void ServerDownloadThread::initStreams()
+{
+	if (filesrv_protocol_version <= 2)
+	{
+		return;
+	}
+
+	int n_streams = watoi(Server->getServerParameter("fileclient_streams"));
+
+	for (int i = 1; i < n_streams; ++i)
+	{
+		IPipe* cp = client_main->new_fileclient_connection();
+		if (cp == NULL)
+		{
+			ServerLogger::Log(logid, "Error connecting additional file download stream. Downloading over "
+				+ convert(streams.size() + 1) + " connection(s).", LL_WARNING);
+			break;
+		}
+
+		FileClient* stream_fc = new FileClient(false, client_main->getIdentity(), filesrv_protocol_version,
+			client_main->isOnInternetConnection(), client_main, fc.getNoFreeSpaceCallback());
+		stream_fc->Connect(cp);
+
+		std::vector<IPipeThrottler*> throttlers = fc.getThrottlers();
+		for (size_t j = 0; j < throttlers.size(); ++j)
+		{
+			stream_fc->addThrottler(throttlers[j]);
+		}
+
+		stream_fc->setReconnectionTimeout(fc.getReconnectionTimeout());
+
+		streams.push_back(new ServerDownloadStream(*this, streams.size() + 1, stream_fc, mutex));
+	}
+
+	if (!streams.empty())
+	{
+		ServerLogger::Log(logid, "Downloading full files over " + convert(streams.size() + 1) + " connections", LL_DEBUG);
+	}
+}
+
+bool ServerDownloadThread::startStreamJob(SStreamJob& job)
+{
+	ServerLogger::Log(logid, "Loading file \"" + job.item.fn + "\" (stream " + convert(job.item.stream) + ")", LL_DEBUG);
+
+	IFsFile* fd = getTempFile();
+
+	IScopedLock lock(mutex);
+
+	job.ready = true;
+	streams[job.item.stream - 1]->notifyJobs();
+
+	if (fd == NULL)
+	{
+		ServerLogger::Log(logid, "Error creating temporary file 'fd' in startStreamJob. " + os_last_error_str(), LL_ERROR);
+		//Going offline before the stream sees the job, as it cannot download any
+		//of the files it may have requested after this one
+		job.skipped = true;
+		is_offline = true;
+		return false;
+	}
+
+	job.fd = fd;
+
+	while (numRunningStreamJobs(job.item.stream) >= max_stream_jobs)
+	{
+		cond->wait(&lock);
+	}
+
+	return true;
+}
+
+size_t ServerDownloadThread::numRunningStreamJobs(size_t stream)
+{
+	size_t ret = 0;
+	for (size_t i = 0; i < stream_jobs.size(); ++i)
+	{
+		if (stream_jobs[i]->item.stream == stream
+			&& !stream_jobs[i]->done)
+		{
+			++ret;
+		}
+	}
+	return ret;
+}
+
+bool ServerDownloadThread::hasDoneStreamJob()
+{
+	for (size_t i = 0; i < stream_jobs.size(); ++i)
+	{
+		if (stream_jobs[i]->done)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ServerDownloadThread::finishStreamJobs(bool wait_all)
+{
+	bool ret = true;
+	while (!stream_jobs.empty())
+	{
+		std::vector<SStreamJob*> done_jobs;
+		{
+			IScopedLock lock(mutex);
+			while (wait_all
+				&& !hasDoneStreamJob())
+			{
+				cond->wait(&lock);
+			}
+
+			for (size_t i = 0; i < stream_jobs.size();)
+			{
+				if (stream_jobs[i]->done)
+				{
+					done_jobs.push_back(stream_jobs[i]);
+					stream_jobs.erase(stream_jobs.begin() + i);
+				}
+				else
+				{
+					++i;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < done_jobs.size(); ++i)
+		{
+			if (!finishStreamJob(*done_jobs[i]))
+			{
+				ret = false;
+			}
+			delete done_jobs[i];
+		}
+
+		if (!wait_all)
+		{
+			break;
+		}
+	}
+	return ret;
+}
+
+bool ServerDownloadThread::finishStreamJob(SStreamJob& job)
+{
+	if (job.skipped)
+	{
+		if (job.fd != NULL)
+		{
+			ClientMain::destroyTemporaryFile(job.fd);
+		}
+		download_nok_ids.add(job.item.id);
+
+		IScopedLock lock(mutex);
+		all_downloads_ok = false;
+		return true;
+	}
+
+	return finish_load_file(job.item, job.fd, job.rc, job.sparse_extents_f, 0);
+}
+
+void ServerDownloadThread::runStreamJob(FileClient& stream_fc, SStreamJob& job)
+{
+	if (job.skipped || isOffline())
+	{
+		job.skipped = true;
+	}
+	else
+	{
+		job.rc = download_file(stream_fc, job.item, job.fd);
+		job.sparse_extents_f = stream_fc.releaseSparseExtendsFile();
+	}
+
+	IScopedLock lock(mutex);
+	job.done = true;
+	cond->notify_all();
+}
+
+int64 ServerDownloadThread::getStreamsReceivedDataBytes(bool with_sparse)
+{
+	int64 ret = 0;
+	for (size_t i = 0; i < streams.size(); ++i)
+	{
+		ret += streams[i]->getFileClient().getReceivedDataBytes(with_sparse);
+	}
+	return ret;
+}
+
+int64 ServerDownloadThread::getStreamsTransferredBytes()
+{
+	int64 ret = 0;
+	for (size_t i = 0; i < streams.size(); ++i)
+	{
+		ret += streams[i]->getFileClient().getTransferredBytes();
+	}
+	return ret;
+}
+
+int64 ServerDownloadThread::getStreamsRealTransferredBytes()
+{
+	int64 ret = 0;
+	for (size_t i = 0; i < streams.size(); ++i)
+	{
+		ret += streams[i]->getFileClient().getRealTransferredBytes();
+	}
+	return ret;
+}
+
+ServerDownloadStream::ServerDownloadStream(ServerDownloadThread& download_thread, size_t stream, FileClient* fc, IMutex* mutex)
+	: download_thread(download_thread), stream(stream), fc(fc),
+	mutex(mutex), cond(Server->createCondition()), do_quit(false)
+{
+	fc->setQueueCallback(this);
+}
+
+ServerDownloadStream::~ServerDownloadStream()
+{
+}
+
+void ServerDownloadStream::operator()(void)
+{
+	IScopedLock lock(mutex);
+	while (true)
+	{
+		while ( (jobs.empty() || !jobs.front()->ready)
+			&& !do_quit)
+		{
+			cond->wait(&lock);
+		}
+
+		if (jobs.empty())
+		{
+			return;
+		}
+
+		SStreamJob* job = jobs.front();
+		jobs.pop_front();
+		//Requested by FileClient::GetFile now, if it was not queued already
+		job->item.queued = true;
+
+		lock.relock(NULL);
+
+		download_thread.runStreamJob(*fc, *job);
+
+		lock.relock(mutex);
+	}
+}
+
+void ServerDownloadStream::addJob(SStreamJob* job)
+{
+	jobs.push_back(job);
+}
+
+void ServerDownloadStream::notifyJobs()
+{
+	cond->notify_all();
+}
+
+void ServerDownloadStream::quit()
+{
+	do_quit = true;
+	cond->notify_all();
+}
+
+std::deque<SStreamJob*>& ServerDownloadStream::getJobs()
+{
+	return jobs;
+}
+
+FileClient& ServerDownloadStream::getFileClient()
+{
+	return *fc;
+}
+
+std::string ServerDownloadStream::getQueuedFileFull(FileClient::MetadataQueue& metadata, size_t& folder_items, bool& finish_script, int64& file_id)
+{
+	return download_thread.getQueuedFileFull(stream, metadata, folder_items, finish_script, file_id);
+}
+
+void ServerDownloadStream::unqueueFileFull(const std::string& fn, bool finish_script)
+{
+	download_thread.unqueueFileFull(stream, fn, finish_script);
+}
+
+void ServerDownloadStream::resetQueueFull()
+{
+	download_thread.resetQueueFull(stream);
+}
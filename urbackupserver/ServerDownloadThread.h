@@ -5,12 +5,15 @@
 #include <algorithm>
 #include <assert.h>
 #include <set>
+#include <memory>
+#include <vector>
 
 #include "../Interface/Mutex.h"
 #include "../Interface/Condition.h"
 #include "../Interface/Pipe.h"
 #include "../Interface/File.h"
 #include "../Interface/Thread.h"
+#include "../Interface/ThreadPool.h"
 #include "../urbackupcommon/fileclient/FileClient.h"
 #include "../urbackupcommon/fileclient/FileClientChunked.h"
 #include "ClientMain.h"
@@ -67,7 +70,8 @@ namespace
 			folder_items(0),
 			script_end(false),
 			switched(false),
-			write_metadata(false)
+			write_metadata(false),
+			stream(0)
 		{
 		}
 
@@ -91,6 +95,24 @@ namespace
 		std::string sha_dig;
 		unsigned int script_random;
 		bool switched;
+		size_t stream;
+	};
+
+	struct SStreamJob
+	{
+		SStreamJob(const SQueueItem& item)
+			: item(item), fd(NULL), rc(ERR_ERROR),
+			sparse_extents_f(NULL), ready(false), done(false), skipped(false)
+		{
+		}
+
+		SQueueItem item;
+		IFsFile* fd;
+		_u32 rc;
+		IFile* sparse_extents_f;
+		bool ready;
+		bool done;
+		bool skipped;
 	};
 	
 	
@@ -138,6 +160,50 @@ namespace
 }
 
 
+class ServerDownloadThread;
+
+/**
+* Additional connection to the client's file server. Full file downloads
+* assigned to this stream are requested (pipelined) and downloaded by it,
+* the results are completed by the ServerDownloadThread. The job queue is
+* protected by the mutex of the ServerDownloadThread, so files move from
+* its download queue to the stream without a gap the requests could miss.
+*/
+class ServerDownloadStream : public IThread, public FileClient::QueueCallback
+{
+public:
+	ServerDownloadStream(ServerDownloadThread& download_thread, size_t stream, FileClient* fc, IMutex* mutex);
+	virtual ~ServerDownloadStream();
+
+	void operator()(void);
+
+	//Following need the mutex to be locked
+	void addJob(SStreamJob* job);
+
+	void notifyJobs();
+
+	void quit();
+
+	std::deque<SStreamJob*>& getJobs();
+
+	FileClient& getFileClient();
+
+	virtual std::string getQueuedFileFull(FileClient::MetadataQueue& metadata, size_t& folder_items, bool& finish_script, int64& file_id);
+
+	virtual void unqueueFileFull(const std::string& fn, bool finish_script);
+
+	virtual void resetQueueFull();
+
+private:
+	ServerDownloadThread& download_thread;
+	size_t stream;
+	std::auto_ptr<FileClient> fc;
+
+	IMutex* mutex;
+	std::auto_ptr<ICondition> cond;
+	std::deque<SStreamJob*> jobs;
+	bool do_quit;
+};
 
 class ServerDownloadThread : public IThread, public FileClient::QueueCallback, public FileClientChunked::QueueCallback
 {
@@ -199,6 +265,20 @@ public:
 
 	virtual void unqueueFileChunked(const std::string& remotefn);
 
+	std::string getQueuedFileFull(size_t stream, FileClient::MetadataQueue& metadata, size_t& folder_items, bool& finish_script, int64& file_id);
+
+	void unqueueFileFull(size_t stream, const std::string& fn, bool finish_script);
+
+	void resetQueueFull(size_t stream);
+
+	void runStreamJob(FileClient& stream_fc, SStreamJob& job);
+
+	int64 getStreamsReceivedDataBytes(bool with_sparse);
+
+	int64 getStreamsTransferredBytes();
+
+	int64 getStreamsRealTransferredBytes();
+
 	virtual void resetQueueChunked();
 
 	bool hasTimeout();
@@ -230,8 +310,24 @@ private:
 	
 	bool link_or_copy_file(const SQueueItem& todl);
 
+	_u32 download_file(FileClient& curr_fc, const SQueueItem& todl, IFsFile* fd);
+
+	bool finish_load_file(SQueueItem todl, IFsFile* fd, _u32 rc, IFile* sparse_extents_f, int64 script_start_time);
+
+	void initStreams();
+
+	bool startStreamJob(SStreamJob& job);
+
+	size_t numRunningStreamJobs(size_t stream);
+
+	bool hasDoneStreamJob();
+
+	bool finishStreamJobs(bool wait_all);
+
+	bool finishStreamJob(SStreamJob& job);
+
 	size_t insertFullQueueEarliest(const SQueueItem& ni, bool after_switched);
-	bool hasFullQueuedAfter(std::deque<SQueueItem>::iterator it);
+	bool hasFullQueuedAfter(std::deque<SQueueItem>::iterator it, size_t stream);
 
 	void postponeQuitStop(size_t idx);
 
@@ -308,4 +404,9 @@ private:
 	size_t tmpfile_num;
 
 	MaxFileId& max_file_id;
+
+	std::vector<ServerDownloadStream*> streams;
+	std::vector<THREADPOOL_TICKET> stream_tickets;
+	std::vector<SStreamJob*> stream_jobs;
+	size_t next_stream;
 };
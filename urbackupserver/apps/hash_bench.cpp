@@ -0,0 +1,178 @@
+#include "../../Interface/Server.h"
+#include "../../stringtools.h"
+#include "../../common/adler32.h"
+#include "../../urbackupcommon/sha2/sha2.h"
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+
+namespace
+{
+	typedef unsigned int(*adler32_func_t)(unsigned int adler, const char *pbuf, unsigned int len);
+
+	void bench_adler32(const std::string& name, adler32_func_t adler32_func, const std::vector<char>& buf, size_t block_size, size_t rounds)
+	{
+		unsigned int adler = 0;
+		int64 starttime = Server->getTimeMS();
+		for (size_t r = 0; r < rounds; ++r)
+		{
+			for (size_t i = 0; i + block_size <= buf.size(); i += block_size)
+			{
+				adler ^= adler32_func(adler32_func(0, NULL, 0), &buf[i], static_cast<unsigned int>(block_size));
+			}
+		}
+		int64 passed = (std::max)(static_cast<int64>(1), Server->getTimeMS() - starttime);
+
+		Server->Log(name + " block size " + PrettyPrintBytes(block_size) + ": "
+			+ PrettyPrintBytes(static_cast<int64>(buf.size()*rounds) * 1000 / passed) + "/s (" + convert(adler) + ")", LL_INFO);
+	}
+
+	struct SKnownAnswer
+	{
+		const char* message;
+		size_t repeat;
+		const char* sha256;
+		const char* sha512;
+	};
+
+	//FIPS 180-2 test vectors
+	const SKnownAnswer known_answers[] = {
+		{ "abc", 1,
+		"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+		"ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f" },
+		{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+		"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+		"204a8fc6dda82f0a0ced7beb8e08a41657c16ef468b228a8279be331a703c33596fd15c13b1b07f9aa1d3bea57789ca031ad85c7a71dd70354ec631238ca3445" },
+		{ "a", 1000000,
+		"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+		"e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973ebde0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b" }
+	};
+
+	bool check_known_answers()
+	{
+		for (size_t i = 0; i < sizeof(known_answers) / sizeof(known_answers[0]); ++i)
+		{
+			const SKnownAnswer& ka = known_answers[i];
+			std::string message;
+			for (size_t j = 0; j < ka.repeat; ++j)
+			{
+				message += ka.message;
+			}
+
+			//Odd update sizes so partial blocks are buffered
+			const size_t update_size = 997;
+
+			sha256_ctx ctx256;
+			sha256_init(&ctx256);
+			sha512_ctx ctx512;
+			sha512_init(&ctx512);
+			for (size_t j = 0; j < message.size(); j += update_size)
+			{
+				unsigned int len = static_cast<unsigned int>((std::min)(update_size, message.size() - j));
+				sha256_update(&ctx256, reinterpret_cast<const unsigned char*>(&message[j]), len);
+				sha512_update(&ctx512, reinterpret_cast<const unsigned char*>(&message[j]), len);
+			}
+
+			unsigned char digest[SHA512_DIGEST_SIZE];
+			sha256_final(&ctx256, digest);
+			if (bytesToHex(digest, SHA256_DIGEST_SIZE) != ka.sha256)
+			{
+				Server->Log("SHA-256 implementation " + std::string(sha256_impl_name()) + " returns wrong result for test vector " + convert(i), LL_ERROR);
+				return false;
+			}
+
+			sha256(reinterpret_cast<const unsigned char*>(message.data()), static_cast<unsigned int>(message.size()), digest);
+			if (bytesToHex(digest, SHA256_DIGEST_SIZE) != ka.sha256)
+			{
+				Server->Log("SHA-256 implementation " + std::string(sha256_impl_name()) + " returns wrong result for test vector " + convert(i) + " in one call", LL_ERROR);
+				return false;
+			}
+
+			sha512_final(&ctx512, digest);
+			if (bytesToHex(digest, SHA512_DIGEST_SIZE) != ka.sha512)
+			{
+				Server->Log("SHA-512 implementation " + std::string(sha512_impl_name()) + " returns wrong result for test vector " + convert(i), LL_ERROR);
+				return false;
+			}
+
+			sha512(reinterpret_cast<const unsigned char*>(message.data()), static_cast<unsigned int>(message.size()), digest);
+			if (bytesToHex(digest, SHA512_DIGEST_SIZE) != ka.sha512)
+			{
+				Server->Log("SHA-512 implementation " + std::string(sha512_impl_name()) + " returns wrong result for test vector " + convert(i) + " in one call", LL_ERROR);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void log_speed(const std::string& name, const std::vector<char>& buf, size_t rounds, int64 starttime)
+	{
+		int64 passed = (std::max)(static_cast<int64>(1), Server->getTimeMS() - starttime);
+		Server->Log(name + ": " + PrettyPrintBytes(static_cast<int64>(buf.size()*rounds) * 1000 / passed) + "/s", LL_INFO);
+	}
+}
+
+int hash_bench()
+{
+	size_t bench_size = 64 * 1024 * 1024;
+	std::string bench_size_param = Server->getServerParameter("bench_size");
+	if (!bench_size_param.empty())
+	{
+		bench_size = static_cast<size_t>(watoi64(bench_size_param)) * 1024 * 1024;
+	}
+
+	size_t rounds = 10;
+	std::string rounds_param = Server->getServerParameter("bench_rounds");
+	if (!rounds_param.empty())
+	{
+		rounds = static_cast<size_t>(watoi(rounds_param));
+	}
+
+	std::vector<char> buf(bench_size);
+	for (size_t i = 0; i < buf.size(); ++i)
+	{
+		buf[i] = static_cast<char>(rand());
+	}
+
+	for (size_t i = 0; i + 4096 <= buf.size(); i += 4096)
+	{
+		if (urb_adler32(1, &buf[i], 4096) != urb_adler32_scalar(1, &buf[i], 4096))
+		{
+			Server->Log("Adler-32 implementation " + std::string(urb_adler32_impl_name()) + " returns wrong result", LL_ERROR);
+			return 1;
+		}
+	}
+
+	if (!check_known_answers())
+	{
+		return 1;
+	}
+
+	Server->Log("Benchmarking with " + PrettyPrintBytes(bench_size) + " x " + convert(rounds) + "...", LL_INFO);
+
+	//Small hash of chunk_hasher and block size of TreeHash
+	const size_t block_sizes[] = { 4096, 512 * 1024 / 12 };
+	for (size_t i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); ++i)
+	{
+		bench_adler32("adler32 scalar", urb_adler32_scalar, buf, block_sizes[i], rounds);
+		bench_adler32("adler32 " + std::string(urb_adler32_impl_name()), urb_adler32, buf, block_sizes[i], rounds);
+	}
+
+	unsigned char digest[SHA512_DIGEST_SIZE];
+	int64 starttime = Server->getTimeMS();
+	for (size_t r = 0; r < rounds; ++r)
+	{
+		sha256(reinterpret_cast<const unsigned char*>(&buf[0]), static_cast<unsigned int>(buf.size()), digest);
+	}
+	log_speed("sha256 " + std::string(sha256_impl_name()), buf, rounds, starttime);
+
+	starttime = Server->getTimeMS();
+	for (size_t r = 0; r < rounds; ++r)
+	{
+		sha512(reinterpret_cast<const unsigned char*>(&buf[0]), static_cast<unsigned int>(buf.size()), digest);
+	}
+	log_speed("sha512 " + std::string(sha512_impl_name()), buf, rounds, starttime);
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include "../../Interface/Server.h"
+#include "../../stringtools.h"
+#include "../treediff/TreeReader.h"
+#include "../treediff/TreeDiff.h"
+#include <fstream>
+#include <algorithm>
+
+namespace
+{
+	const size_t files_per_dir = 100;
+	const size_t dirs_per_dir = 10;
+
+	//Writes a file list with n_files files in a directory tree with
+	//files_per_dir files and dirs_per_dir sub-directories per directory.
+	//If modified is set every 1000th file gets a different modification time
+	void write_bench_list(std::fstream& out, size_t& n_files, size_t depth, bool modified)
+	{
+		for (size_t i = 0; i < files_per_dir && n_files>0; ++i, --n_files)
+		{
+			int64 last_mod = 1500000000;
+			if (modified && n_files % 1000 == 0)
+			{
+				++last_mod;
+			}
+			out << "f\"bench_file_" << i << ".dat\" " << (i * 4096) << " " << last_mod << "\n";
+		}
+
+		for (size_t i = 0; i < dirs_per_dir && n_files>0; ++i)
+		{
+			out << "d\"bench_dir_" << depth << "_" << i << "\" 0 1500000000\n";
+			write_bench_list(out, n_files, depth + 1, modified);
+			out << "u\n";
+		}
+	}
+
+	bool write_bench_list(const std::string& fn, size_t n_files, bool modified)
+	{
+		std::fstream out(fn.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+		{
+			Server->Log("Cannot open \"" + fn + "\" for writing", LL_ERROR);
+			return false;
+		}
+
+		out << "d\"bench\" 0 1500000000\n";
+		while (n_files > 0)
+		{
+			write_bench_list(out, n_files, 0, modified);
+		}
+		out << "u\n";
+
+		return out.good();
+	}
+}
+
+int treediff_bench()
+{
+	size_t n_files = 10000000;
+	std::string n_files_param = Server->getServerParameter("bench_files");
+	if (!n_files_param.empty())
+	{
+		n_files = static_cast<size_t>(watoi64(n_files_param));
+	}
+
+	std::string fn1 = "urbackup/treediff_bench_1.ub";
+	std::string fn2 = "urbackup/treediff_bench_2.ub";
+
+	Server->Log("Writing file lists with " + convert(n_files) + " files...", LL_INFO);
+
+	if (!write_bench_list(fn1, n_files, false)
+		|| !write_bench_list(fn2, n_files, true))
+	{
+		Server->deleteFile(fn1);
+		Server->deleteFile(fn2);
+		return 1;
+	}
+
+	int rc = 0;
+	{
+		int64 starttime = Server->getTimeMS();
+		TreeReader reader;
+		if (reader.readTree(fn1))
+		{
+			int64 passed = Server->getTimeMS() - starttime;
+			size_t n_nodes = reader.getNodes()->size();
+			Server->Log("Read " + convert(n_nodes) + " nodes in " + PrettyPrintTime(passed)
+				+ ". Node size: " + convert(sizeof(TreeNode)) + " bytes. Memory usage: "
+				+ PrettyPrintBytes(reader.getMemoryUsage()) + " ("
+				+ convert(static_cast<int64>(reader.getMemoryUsage() / (std::max)(static_cast<size_t>(1), n_nodes))) + " bytes per node)", LL_INFO);
+		}
+		else
+		{
+			Server->Log("Reading file list failed", LL_ERROR);
+			rc = 1;
+		}
+	}
+
+	if (rc == 0)
+	{
+		int64 starttime = Server->getTimeMS();
+		bool error = false;
+		std::vector<size_t> deleted_ids;
+		std::vector<size_t> large_unchanged_subtrees;
+		std::vector<size_t> modified_inplace_ids;
+		std::vector<size_t> dir_diffs;
+		std::vector<size_t> deleted_inplace_ids;
+		std::vector<size_t> diffs = TreeDiff::diffTrees(fn1, fn2, error, &deleted_ids,
+			&large_unchanged_subtrees, &modified_inplace_ids, dir_diffs, &deleted_inplace_ids, true, false);
+
+		if (!error)
+		{
+			Server->Log("Diffed file lists in " + PrettyPrintTime(Server->getTimeMS() - starttime)
+				+ ". " + convert(diffs.size()) + " changed files, " + convert(large_unchanged_subtrees.size()) + " large unchanged subtrees", LL_INFO);
+		}
+		else
+		{
+			Server->Log("Diffing file lists failed", LL_ERROR);
+			rc = 1;
+		}
+	}
+
+	Server->deleteFile(fn1);
+	Server->deleteFile(fn2);
+
+	return rc;
+}
@@ -801,6 +801,45 @@ int action_decompress_file(std::vector<std::string> args)
 	return run_real_main(real_args);
 }
 
+int action_recompress_file(std::vector<std::string> args)
+{
+	TCLAP::CmdLine cmd("Convert UrBackup compressed file to another compression method", ' ', cmdline_version);
+
+	TCLAP::ValueArg<std::string> file_arg("f", "file",
+		"File to recompress",
+		true, "", "path", cmd);
+
+	std::vector<std::string> compression_methods;
+	compression_methods.push_back("zstd");
+	compression_methods.push_back("zlib");
+	TCLAP::ValuesConstraint<std::string> compression_methods_constraint(compression_methods);
+
+	TCLAP::ValueArg<std::string> method_arg("m", "method",
+		"Compression method to convert the file to",
+		false, "zstd", &compression_methods_constraint, cmd);
+
+	TCLAP::ValueArg<std::string> user_arg("u", "user",
+		"Change process to run as specific user",
+		false, "urbackup", "user", cmd);
+
+	std::vector<std::string> real_args;
+	real_args.push_back(args[0]);
+
+	cmd.parse(args);
+
+	real_args.push_back("--no-server");
+	real_args.push_back("--user");
+	real_args.push_back(user_arg.getValue());
+	real_args.push_back("--loglevel");
+	real_args.push_back("debug");
+	real_args.push_back("--recompress");
+	real_args.push_back(make_absolute(file_arg.getValue()));
+	real_args.push_back("--compression_method");
+	real_args.push_back(method_arg.getValue());
+
+	return run_real_main(real_args);
+}
+
 #ifndef _WIN32
 int action_mount_vhd(std::vector<std::string> args)
 {
@@ -1043,6 +1082,9 @@ void action_help(std::string cmd)
 	std::cout << "\t" << cmd << " decompress-file" << std::endl;
 	std::cout << "\t\t" "Decompress UrBackup compressed file" << std::endl;
 	std::cout << std::endl;
+	std::cout << "\t" << cmd << " recompress-file" << std::endl;
+	std::cout << "\t\t" "Convert UrBackup compressed file to another compression method" << std::endl;
+	std::cout << std::endl;
 #if !defined(_WIN32) && defined(WITH_FUSEPLUGIN)
 	std::cout << "\t" << cmd << " mount-vhd" << std::endl;
 	std::cout << "\t\t" "Mount VHD file" << std::endl;
@@ -1081,6 +1123,8 @@ int main(int argc, char* argv[])
 	action_funs.push_back(action_export_auth_log);
 	actions.push_back("decompress-file");
 	action_funs.push_back(action_decompress_file);
+	actions.push_back("recompress-file");
+	action_funs.push_back(action_recompress_file);
 #if !defined(_WIN32) && defined(WITH_FUSEPLUGIN)
 	actions.push_back("mount-vhd");
 	action_funs.push_back(action_mount_vhd);
@@ -242,8 +242,16 @@ bool setup_lmdb_file_index(SStartupStatus& status)
 
 void delete_file_index(void)
 {
-	Server->deleteFile("urbackup/fileindex/backup_server_files_index.lmdb");
-	Server->deleteFile("urbackup/fileindex/backup_server_files_index.lmdb-lock");
+	for (size_t i = 0; i < LMDBFileIndex::max_shards; ++i)
+	{
+		Server->deleteFile(LMDBFileIndex::getShardFn(i));
+		Server->deleteFile(LMDBFileIndex::getShardFn(i) + "-lock");
+	}
+	Server->deleteFile(LMDBFileIndex::getFileIndexFilterFn());
+	if (os_directory_exists(LMDBFileIndex::getReshardDir()))
+	{
+		os_remove_nonempty_dir(LMDBFileIndex::getReshardDir());
+	}
 }
 
 bool create_files_index(SStartupStatus& status)
@@ -257,7 +265,7 @@ bool create_files_index(SStartupStatus& status)
 		creating_index = backupdao.getMiscValue("creating_file_entry_index").value == "true";
 	}
 
-	if(!FileExists("urbackup/fileindex/backup_server_files_index.lmdb") || creating_index)
+	if(!LMDBFileIndex::indexExists() || creating_index)
 	{
 		delete_file_index();
 
@@ -291,7 +299,7 @@ bool create_files_index(SStartupStatus& status)
 
 FileIndex* create_lmdb_files_index(void)
 {
-	if(!FileExists("urbackup/fileindex/backup_server_files_index.lmdb"))
+	if(!LMDBFileIndex::indexExists())
 	{
 		return NULL;
 	}
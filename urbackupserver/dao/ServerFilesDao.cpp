@@ -44,15 +44,27 @@ const int ServerFilesDao::c_direction_incoming = 0;
 const int ServerFilesDao::c_direction_outgoing = 1;
 const int ServerFilesDao::c_direction_outgoing_nobackupstat = 2;
 
+namespace
+{
+	//Rows per multi-row insert when flushing a file entry batch.
+	//12 variables per row stays below SQLite's limit of 999 variables
+	const size_t c_batch_insert_rows = 64;
+}
+
 ServerFilesDao::ServerFilesDao(IDatabase * db)
-	: db(db)
+	: q_getMaxFileEntryId(NULL), q_addFileEntryWithId(NULL), q_addFileEntriesWithId(NULL),
+	batch_active(false), batch_first_id(0), db(db)
 {
 	prepareQueries();
 }
 
 ServerFilesDao::~ServerFilesDao()
 {
+	assert(!batch_active);
 	destroyQueries();
+	db->destroyQuery(q_getMaxFileEntryId);
+	db->destroyQuery(q_addFileEntryWithId);
+	db->destroyQuery(q_addFileEntriesWithId);
 }
 
 int64 ServerFilesDao::getLastId()
@@ -744,6 +756,26 @@ void ServerFilesDao::destroyQueries()
 
 int64 ServerFilesDao::addFileEntryExternal(int backupid, const std::string& fullpath, const std::string& hashpath, const std::string& shahash, int64 filesize, int64 rsize, int clientid, int incremental, int64 next_entry, int64 prev_entry, int pointed_to)
 {
+	if (batch_active)
+	{
+		int64 id = batch_first_id + static_cast<int64>(batch_entries.size());
+
+		SFindFileEntry entry = { true, id, shahash, backupid, clientid, fullpath, hashpath, filesize, next_entry, prev_entry, rsize, incremental, pointed_to };
+		batch_entries.push_back(entry);
+
+		if (prev_entry != 0)
+		{
+			setNextEntryBatched(id, prev_entry);
+		}
+
+		if (next_entry != 0)
+		{
+			setPrevEntryBatched(id, next_entry);
+		}
+
+		return id;
+	}
+
 	addFileEntry(backupid, fullpath, hashpath, shahash, filesize, rsize, clientid, incremental, next_entry, prev_entry, pointed_to);
 
 	int64 id = db->getLastInsertID();
@@ -759,4 +791,227 @@ int64 ServerFilesDao::addFileEntryExternal(int backupid, const std::string& full
 	}
 
 	return id;
-}
\ No newline at end of file
+}
+
+void ServerFilesDao::beginFileEntryBatch()
+{
+	assert(!batch_active);
+
+	if (q_getMaxFileEntryId == NULL)
+	{
+		q_getMaxFileEntryId = db->Prepare("SELECT MAX(id) AS id FROM files", false);
+	}
+	db_results res = q_getMaxFileEntryId->Read();
+	q_getMaxFileEntryId->Reset();
+
+	//files.id is an INTEGER PRIMARY KEY without AUTOINCREMENT, so these are the ids
+	//SQLite would assign. The write transaction keeps other connections from using them.
+	batch_first_id = 1;
+	if (!res.empty())
+	{
+		batch_first_id = watoi64(res[0]["id"]) + 1;
+	}
+
+	batch_active = true;
+}
+
+void ServerFilesDao::flushFileEntryBatch()
+{
+	if (!batch_active)
+	{
+		return;
+	}
+
+	size_t i = 0;
+
+	if (batch_entries.size() >= c_batch_insert_rows
+		&& q_addFileEntriesWithId == NULL)
+	{
+		std::string values;
+		for (size_t j = 0; j < c_batch_insert_rows; ++j)
+		{
+			if (!values.empty())
+			{
+				values += ", ";
+			}
+			values += "(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+		}
+		q_addFileEntriesWithId = db->Prepare("INSERT INTO files (id, backupid, fullpath, hashpath, shahash, filesize, rsize, clientid, incremental, next_entry, prev_entry, pointed_to) VALUES " + values, false);
+	}
+
+	for (; i + c_batch_insert_rows <= batch_entries.size(); i += c_batch_insert_rows)
+	{
+		for (size_t j = 0; j < c_batch_insert_rows; ++j)
+		{
+			bindBatchEntry(q_addFileEntriesWithId, batch_entries[i + j]);
+		}
+		q_addFileEntriesWithId->Write();
+		q_addFileEntriesWithId->Reset();
+	}
+
+	if (i < batch_entries.size()
+		&& q_addFileEntryWithId == NULL)
+	{
+		q_addFileEntryWithId = db->Prepare("INSERT INTO files (id, backupid, fullpath, hashpath, shahash, filesize, rsize, clientid, incremental, next_entry, prev_entry, pointed_to) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)", false);
+	}
+
+	for (; i < batch_entries.size(); ++i)
+	{
+		bindBatchEntry(q_addFileEntryWithId, batch_entries[i]);
+		q_addFileEntryWithId->Write();
+		q_addFileEntryWithId->Reset();
+	}
+
+	for (std::map<int64, SBatchUpdate>::iterator it = batch_updates.begin(); it != batch_updates.end(); ++it)
+	{
+		if (it->second.has_next_entry)
+		{
+			setNextEntry(it->second.next_entry, it->first);
+		}
+		if (it->second.has_prev_entry)
+		{
+			setPrevEntry(it->second.prev_entry, it->first);
+		}
+		if (it->second.has_pointed_to)
+		{
+			setPointedTo(it->second.pointed_to, it->first);
+		}
+	}
+
+	batch_entries.clear();
+	batch_updates.clear();
+	batch_active = false;
+}
+
+ServerFilesDao::SFindFileEntry ServerFilesDao::getFileEntryBatched(int64 id)
+{
+	SFindFileEntry* entry = getBatchEntry(id);
+	if (entry != NULL)
+	{
+		return *entry;
+	}
+
+	SFindFileEntry ret = getFileEntry(id);
+
+	if (ret.exists && batch_active)
+	{
+		std::map<int64, SBatchUpdate>::iterator it = batch_updates.find(id);
+		if (it != batch_updates.end())
+		{
+			if (it->second.has_next_entry)
+			{
+				ret.next_entry = it->second.next_entry;
+			}
+			if (it->second.has_prev_entry)
+			{
+				ret.prev_entry = it->second.prev_entry;
+			}
+			if (it->second.has_pointed_to)
+			{
+				ret.pointed_to = static_cast<int>(it->second.pointed_to);
+			}
+		}
+	}
+
+	return ret;
+}
+
+ServerFilesDao::CondInt64 ServerFilesDao::getPointedToBatched(int64 id)
+{
+	SFindFileEntry* entry = getBatchEntry(id);
+	if (entry != NULL)
+	{
+		CondInt64 ret = { true, entry->pointed_to };
+		return ret;
+	}
+
+	CondInt64 ret = getPointedTo(id);
+
+	if (ret.exists && batch_active)
+	{
+		std::map<int64, SBatchUpdate>::iterator it = batch_updates.find(id);
+		if (it != batch_updates.end()
+			&& it->second.has_pointed_to)
+		{
+			ret.value = it->second.pointed_to;
+		}
+	}
+
+	return ret;
+}
+
+void ServerFilesDao::setPointedToBatched(int64 pointed_to, int64 id)
+{
+	if (!batch_active)
+	{
+		setPointedTo(pointed_to, id);
+		return;
+	}
+
+	SFindFileEntry* entry = getBatchEntry(id);
+	if (entry != NULL)
+	{
+		entry->pointed_to = static_cast<int>(pointed_to);
+		return;
+	}
+
+	SBatchUpdate& update = batch_updates[id];
+	update.has_pointed_to = true;
+	update.pointed_to = pointed_to;
+}
+
+ServerFilesDao::SFindFileEntry* ServerFilesDao::getBatchEntry(int64 id)
+{
+	if (!batch_active
+		|| id < batch_first_id
+		|| id - batch_first_id >= static_cast<int64>(batch_entries.size()))
+	{
+		return NULL;
+	}
+
+	return &batch_entries[static_cast<size_t>(id - batch_first_id)];
+}
+
+void ServerFilesDao::setNextEntryBatched(int64 next_entry, int64 id)
+{
+	SFindFileEntry* entry = getBatchEntry(id);
+	if (entry != NULL)
+	{
+		entry->next_entry = next_entry;
+		return;
+	}
+
+	SBatchUpdate& update = batch_updates[id];
+	update.has_next_entry = true;
+	update.next_entry = next_entry;
+}
+
+void ServerFilesDao::setPrevEntryBatched(int64 prev_entry, int64 id)
+{
+	SFindFileEntry* entry = getBatchEntry(id);
+	if (entry != NULL)
+	{
+		entry->prev_entry = prev_entry;
+		return;
+	}
+
+	SBatchUpdate& update = batch_updates[id];
+	update.has_prev_entry = true;
+	update.prev_entry = prev_entry;
+}
+
+void ServerFilesDao::bindBatchEntry(IQuery* q, const SFindFileEntry& entry)
+{
+	q->Bind(entry.id);
+	q->Bind(entry.backupid);
+	q->Bind(entry.fullpath);
+	q->Bind(entry.hashpath);
+	q->Bind(entry.shahash.c_str(), (_u32)entry.shahash.size());
+	q->Bind(entry.filesize);
+	q->Bind(entry.rsize);
+	q->Bind(entry.clientid);
+	q->Bind(entry.incremental);
+	q->Bind(entry.next_entry);
+	q->Bind(entry.prev_entry);
+	q->Bind(entry.pointed_to);
+}
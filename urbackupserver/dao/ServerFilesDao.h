@@ -1,5 +1,7 @@
 #pragma once
 #include "../../Interface/Database.h"
+#include <map>
+#include <vector>
 
 class ServerFilesDao
 {
@@ -110,6 +112,17 @@ public:
 
 	int64 addFileEntryExternal(int backupid, const std::string& fullpath, const std::string& hashpath, const std::string& shahash, int64 filesize, int64 rsize, int clientid, int incremental, int64 next_entry, int64 prev_entry, int pointed_to);
 
+	//Batch mode. Has to be started and flushed inside of a write transaction.
+	//addFileEntryExternal then reserves the ids of the new entries and keeps them
+	//in memory together with the next_entry/prev_entry/pointed_to updates.
+	//flushFileEntryBatch writes them with multi-row inserts.
+	//Use the *Batched functions to read/modify entries while a batch is active
+	void beginFileEntryBatch();
+	void flushFileEntryBatch();
+	SFindFileEntry getFileEntryBatched(int64 id);
+	CondInt64 getPointedToBatched(int64 id);
+	void setPointedToBatched(int64 pointed_to, int64 id);
+
 private:
 	ServerFilesDao(ServerFilesDao& other) {}
 	void operator=(ServerFilesDao& other) {}
@@ -117,6 +130,26 @@ private:
 	void prepareQueries();
 	void destroyQueries();
 
+	struct SBatchUpdate
+	{
+		SBatchUpdate()
+			: has_next_entry(false), next_entry(0),
+			has_prev_entry(false), prev_entry(0),
+			has_pointed_to(false), pointed_to(0) {}
+
+		bool has_next_entry;
+		int64 next_entry;
+		bool has_prev_entry;
+		int64 prev_entry;
+		bool has_pointed_to;
+		int64 pointed_to;
+	};
+
+	SFindFileEntry* getBatchEntry(int64 id);
+	void setNextEntryBatched(int64 next_entry, int64 id);
+	void setPrevEntryBatched(int64 prev_entry, int64 id);
+	void bindBatchEntry(IQuery* q, const SFindFileEntry& entry);
+
 	//@-SQLGenVariablesBegin
 	IQuery* q_setNextEntry;
 	IQuery* q_setPrevEntry;
@@ -148,5 +181,14 @@ private:
 	IQuery* q_getBackupIdMinMax;
 	//@-SQLGenVariablesEnd
 
+	IQuery* q_getMaxFileEntryId;
+	IQuery* q_addFileEntryWithId;
+	IQuery* q_addFileEntriesWithId;
+
+	bool batch_active;
+	int64 batch_first_id;
+	std::vector<SFindFileEntry> batch_entries;
+	std::map<int64, SBatchUpdate> batch_updates;
+
 	IDatabase *db;
 };
@@ -81,6 +81,7 @@ SStartupStatus startup_status;
 #include "apps/skiphash_copy.h"
 #include "apps/patch.h"
 #include "create_files_index.h"
+#include "LMDBFileIndex.h"
 #include "server_dir_links.h"
 #include "server_channel.h"
 #include "DataplanDb.h"
@@ -150,6 +151,8 @@ bool test_amatch(void);
 bool verify_hashes(std::string arg);
 void updateRights(int t_userid, std::string s_rights, IDatabase *db);
 int md5sum_check();
+int hash_bench();
+int treediff_bench();
 
 std::string lang="en";
 std::string time_format_str="%Y-%m-%d %H:%M";
@@ -504,6 +507,14 @@ DLLEXPORT void LoadActions(IServer* pServer)
 		{
 			rc = patch_hash();
 		}
+		else if (app == "hash_bench")
+		{
+			rc = hash_bench();
+		}
+		else if (app == "treediff_bench")
+		{
+			rc = treediff_bench();
+		}
 		else if (app == "hash")
 		{
 			std::auto_ptr<IFsFile> f(Server->openFile(Server->getServerParameter("hash_file"), MODE_READ_SEQUENTIAL));
@@ -520,7 +531,7 @@ DLLEXPORT void LoadActions(IServer* pServer)
 		else
 		{
 			rc=100;
-			Server->Log("App not found. Available apps: cleanup, remove_unknown, cleanup_database, repair_database, defrag_database, export_auth_log, check_fileindex, skiphash_copy, md5sum_check, hash");
+			Server->Log("App not found. Available apps: cleanup, remove_unknown, cleanup_database, repair_database, defrag_database, export_auth_log, check_fileindex, skiphash_copy, md5sum_check, hash, hash_bench, treediff_bench");
 		}
 		exit(rc);
 	}
@@ -978,6 +989,7 @@ DLLEXPORT void UnloadActions(void)
 	}
 	FileIndex::stop_accept();
 	FileIndex::flush();
+	LMDBFileIndex::shutdownFileIndexFilter();
 }
 
 #ifdef STATIC_PLUGIN
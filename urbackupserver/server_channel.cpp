@@ -1032,6 +1032,10 @@ void ServerChannelThread::DOWNLOAD_IMAGE(str_map& params)
 		{
 			vhdfile = image_fak->createVHDFile(res[0]["path"], true, 0, 2 * 1024 * 1024, false, IFSImageFactory::ImageFormat_RawCowFile); 
 		}
+		else if (file_extension == "blocks")
+		{
+			vhdfile = image_fak->createVHDFile(res[0]["path"], true, 0, 2 * 1024 * 1024, false, IFSImageFactory::ImageFormat_BlockStore);
+		}
 		else
 		{
 			vhdfile = image_fak->createVHDFile(res[0]["path"], true, 0);
@@ -45,6 +45,7 @@
 #include "copy_storage.h"
 #include <assert.h>
 #include <set>
+#include "../fsimageplugin/IFSImageFactory.h"
 
 IMutex *ServerCleanupThread::mutex=NULL;
 ICondition *ServerCleanupThread::cond=NULL;
@@ -57,10 +58,25 @@ std::map<int, size_t> ServerCleanupThread::locked_images;
 IMutex* ServerCleanupThread::cleanup_lock_mutex = NULL;
 bool ServerCleanupThread::allow_clientlist_deletion = true;
 
+extern IFSImageFactory *image_fak;
+
 void cleanupLastActs();
 
 const unsigned int min_cleanup_interval=12*60*60;
 
+namespace
+{
+	void removeImageBlockReferences(const std::string& path)
+	{
+		if (findextension(path) == "blocks"
+			&& image_fak != NULL
+			&& !image_fak->removeImageBlockReferences(path))
+		{
+			Server->Log("Error removing image block references of \"" + path + "\"", LL_WARNING);
+		}
+	}
+}
+
 void ServerCleanupThread::initMutex(void)
 {
 	mutex=Server->createMutex();
@@ -639,7 +655,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 					{
 						std::string extension = findextension(image_files[l].name);
 
-						if (extension != "vhd" && extension != "vhdz" && extension != "raw")
+						if (extension != "vhd" && extension != "vhdz" && extension != "raw" && extension != "blocks")
 							continue;
 
 						found_image = true;
@@ -665,6 +681,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 							}
 							else
 							{
+								removeImageBlockReferences(backupfolder + os_file_sep() + clientname + os_file_sep() + cf.name + os_file_sep() + image_files[l].name);
 								os_remove_nonempty_dir(os_file_prefix(backupfolder + os_file_sep() + clientname + os_file_sep() + cf.name));
 							}
 						}
@@ -694,7 +711,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 			{
 				std::string extension=findextension(cf.name);
 
-				if(extension!="vhd" && extension!="vhdz" && extension!="raw")
+				if(extension!="vhd" && extension!="vhdz" && extension!="raw" && extension!="blocks")
 					continue;
 
 				bool found=false;
@@ -712,6 +729,7 @@ void ServerCleanupThread::do_remove_unknown(void)
 				{
 					Server->Log("Image backup \""+cf.name+"\" of client \""+clientname+"\" not found in database. Deleting it.", LL_WARNING);
 					std::string rm_file=backupfolder+os_file_sep()+clientname+os_file_sep()+cf.name;
+					removeImageBlockReferences(rm_file);
 					if(!Server->deleteFile(rm_file))
 					{
 						Server->Log("Could not delete file \""+rm_file+"\"", LL_ERROR);
@@ -816,6 +834,8 @@ bool ServerCleanupThread::deleteImage(logid_t logid, std::string clientname, std
 
 	if (image_extension != "raw")
 	{
+		removeImageBlockReferences(path);
+
 		bool b = true;
 		if (!deleteAndTruncateFile(logid, path))
 		{
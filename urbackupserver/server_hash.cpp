@@ -33,6 +33,7 @@
 #include <memory.h>
 #include "../urbackupcommon/file_metadata.h"
 #include "FileBackup.h"
+#include "server_hash_writer.h"
 #include <assert.h>
 #ifdef _WIN32
 #include <Windows.h>
@@ -40,6 +41,7 @@
 
 const size_t freespace_mod=50*1024*1024; //50 MB
 const size_t BUFFER_SIZE=64*1024; //64KB
+const size_t max_pending_writes=10000;
 
 IMutex * delete_mutex=NULL;
 
@@ -54,9 +56,9 @@ void destroy_mutex1(void)
 }
 
 BackupServerHash::BackupServerHash(IPipe *pPipe, int pClientid, bool use_snapshots, bool use_reflink, bool use_tmpfiles, logid_t logid,
-	bool snapshot_file_inplace, MaxFileId& max_file_id)
+	bool snapshot_file_inplace, MaxFileId& max_file_id, BackupServerHashWriter* writer)
 	: use_snapshots(use_snapshots), use_reflink(use_reflink), use_tmpfiles(use_tmpfiles), filesdao(NULL), old_backupfolders_loaded(false),
-	  logid(logid), snapshot_file_inplace(snapshot_file_inplace), max_file_id(max_file_id)
+	  logid(logid), snapshot_file_inplace(snapshot_file_inplace), max_file_id(max_file_id), writer(writer)
 {
 	pipe=pPipe;
 	clientid=pClientid;
@@ -281,9 +283,50 @@ void BackupServerHash::operator()(void)
 
 void BackupServerHash::addFileSQL(int backupid, int clientid, int incremental, const std::string &fp, const std::string &hash_path, const std::string &shahash, _i64 filesize, _i64 rsize, int64 prev_entry, int64 prev_entry_clientid, int64 next_entry, bool update_fileindex)
 {
+	if(writer!=NULL)
+	{
+		int64 seq = writer->addFileSQL(backupid, clientid, incremental, fp, hash_path, shahash, filesize, rsize, prev_entry, prev_entry_clientid, next_entry, update_fileindex);
+		pending_writes[shahash.substr(0, bytes_in_index)] = seq;
+		return;
+	}
+
 	addFileSQL(*filesdao, *fileindex, backupid, clientid, incremental, fp, hash_path, shahash, filesize, rsize, prev_entry, prev_entry_clientid, next_entry, update_fileindex);
 }
 
+void BackupServerHash::waitForPendingWrite(const std::string& sha2)
+{
+	if(writer==NULL)
+	{
+		return;
+	}
+
+	//The file entry index and the entry list of this hash have to be up to date
+	//before looking for a file to link to
+	std::map<std::string, int64>::iterator it=pending_writes.find(sha2.substr(0, bytes_in_index));
+	if(it!=pending_writes.end())
+	{
+		writer->waitFor(it->second);
+		pending_writes.erase(it);
+	}
+
+	if(pending_writes.size()>max_pending_writes)
+	{
+		for(std::map<std::string, int64>::iterator it=pending_writes.begin();it!=pending_writes.end();)
+		{
+			if(writer->isCommitted(it->second))
+			{
+				std::map<std::string, int64>::iterator del_it=it;
+				++it;
+				pending_writes.erase(del_it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+}
+
 void BackupServerHash::addFileSQL(ServerFilesDao& filesdao, FileIndex& fileindex, int backupid, const int clientid, int incremental, const std::string &fp,
 	const std::string &hash_path, const std::string &shahash, _i64 filesize, _i64 rsize, int64 prev_entry, int64 prev_entry_clientid, int64 next_entry, bool update_fileindex)
 {
@@ -341,7 +384,7 @@ void BackupServerHash::addFileSQL(ServerFilesDao& filesdao, FileIndex& fileindex
 		}
 		else
 		{
-			ServerFilesDao::SFindFileEntry fentry = filesdao.getFileEntry(prev_entry);
+			ServerFilesDao::SFindFileEntry fentry = filesdao.getFileEntryBatched(prev_entry);
 			
 			if(fentry.exists)
 			{
@@ -364,18 +407,18 @@ void BackupServerHash::addFileSQL(ServerFilesDao& filesdao, FileIndex& fileindex
 		//and pointed_to does not need to be updated
 		if(prev_entry!=0)
 		{
-			ServerFilesDao::CondInt64 fentry = filesdao.getPointedTo(prev_entry);
+			ServerFilesDao::CondInt64 fentry = filesdao.getPointedToBatched(prev_entry);
 
 			if(fentry.exists && fentry.value!=0)
 			{
-				filesdao.setPointedTo(0, prev_entry);
+				filesdao.setPointedToBatched(0, prev_entry);
 			}
 			else
 			{
 				int64 client_entryid = fileindex.get_with_cache_exact(FileIndex::SIndexKey(shahash.c_str(), filesize, clientid));
 				if(client_entryid!=0)
 				{
-					filesdao.setPointedTo(0, client_entryid);
+					filesdao.setPointedToBatched(0, client_entryid);
 				}
 			}
 		}
@@ -861,6 +904,9 @@ void BackupServerHash::addFile(int backupid, int incremental, IFile *tf, const s
 	int entryclientid = 0;
 	int64 next_entryid = 0;
 	int64 rsize = 0;
+
+	waitForPendingWrite(sha2);
+
 	if(t_filesize>= link_file_min_size
 		&& (!snapshot_file_inplace || t_filesize<50*1024*1024 || tf->Size()>10*1024 || tf->Size()<=8)
 		&& findFileAndLink(tfn, tf, hash_fn, sha2, t_filesize,hashoutput_fn,
@@ -18,6 +18,7 @@
 
 class FileMetadata;
 class MaxFileId;
+class BackupServerHashWriter;
 
 const int64 link_file_min_size = 2048;
 
@@ -45,7 +46,7 @@ public:
 	};
 
 	BackupServerHash(IPipe *pPipe, int pClientid, bool use_snapshots, bool use_reflink,
-		bool use_tmpfiles, logid_t logid, bool snapshot_file_inplace, MaxFileId& max_file_id);
+		bool use_tmpfiles, logid_t logid, bool snapshot_file_inplace, MaxFileId& max_file_id, BackupServerHashWriter* writer=NULL);
 	~BackupServerHash(void);
 
 	void operator()(void);
@@ -135,6 +136,8 @@ private:
 
 	bool punchHoleOrZero(IFile *tf, int64 offset, int64 size);
 
+	void waitForPendingWrite(const std::string& sha2);
+
 	std::map<std::pair<std::string, _i64>, std::vector<STmpFile> > files_tmp;
 
 	ServerFilesDao* filesdao;
@@ -178,4 +181,7 @@ private:
 	bool snapshot_file_inplace;
 
 	MaxFileId& max_file_id;
+
+	BackupServerHashWriter* writer;
+	std::map<std::string, int64> pending_writes;
 };
@@ -0,0 +1,189 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "server_hash_writer.h"
+#include "server_hash.h"
+#include "database.h"
+#include "create_files_index.h"
+#include "../Interface/Server.h"
+#include "../stringtools.h"
+
+namespace
+{
+	const size_t max_batch_size = 1000;
+	const int64 max_batch_wait_ms = 1000;
+}
+
+BackupServerHashWriter::BackupServerHashWriter()
+	: mutex(Server->createMutex()), cond(Server->createCondition()),
+	commit_cond(Server->createCondition()), enqueued_seq(0), committed_seq(0),
+	waiters(0), do_exit(false), working(false)
+{
+}
+
+BackupServerHashWriter::~BackupServerHashWriter()
+{
+}
+
+void BackupServerHashWriter::operator()(void)
+{
+	IDatabase* db = Server->getDatabase(Server->getThreadID(), URBACKUPDB_SERVER_FILES);
+	std::auto_ptr<ServerFilesDao> filesdao(new ServerFilesDao(db));
+	std::auto_ptr<FileIndex> fileindex(create_lmdb_files_index());
+
+	std::vector<SFileSQL> batch;
+	while (true)
+	{
+		{
+			IScopedLock lock(mutex.get());
+			working = false;
+
+			while (queue.empty() && !do_exit)
+			{
+				cond->wait(&lock);
+			}
+
+			if (queue.empty() && do_exit)
+			{
+				break;
+			}
+
+			int64 starttime = Server->getTimeMS();
+			while (queue.size() < max_batch_size
+				&& waiters == 0 && !do_exit
+				&& Server->getTimeMS() - starttime < max_batch_wait_ms)
+			{
+				cond->wait(&lock, static_cast<int>(max_batch_wait_ms - (Server->getTimeMS() - starttime)));
+			}
+
+			working = true;
+
+			while (!queue.empty()
+				&& batch.size() < max_batch_size)
+			{
+				batch.push_back(queue.front());
+				queue.pop_front();
+			}
+		}
+
+		filesdao->BeginWriteTransaction();
+		filesdao->beginFileEntryBatch();
+
+		for (size_t i = 0; i < batch.size(); ++i)
+		{
+			SFileSQL& item = batch[i];
+			BackupServerHash::addFileSQL(*filesdao, *fileindex, item.backupid, item.clientid, item.incremental, item.fp,
+				item.hash_path, item.shahash, item.filesize, item.rsize, item.prev_entry, item.prev_entry_clientid,
+				item.next_entry, item.update_fileindex);
+		}
+
+		filesdao->flushFileEntryBatch();
+		filesdao->endTransaction();
+
+		{
+			IScopedLock lock(mutex.get());
+			committed_seq = batch.back().seq;
+			commit_cond->notify_all();
+		}
+
+		batch.clear();
+	}
+
+	fileindex.reset();
+	filesdao.reset();
+	db->freeMemory();
+	Server->destroyDatabases(Server->getThreadID());
+
+	Server->Log("server_hash_writer Thread finished - normal");
+	delete this;
+}
+
+int64 BackupServerHashWriter::addFileSQL(int backupid, int clientid, int incremental, const std::string & fp, const std::string & hash_path,
+	const std::string & shahash, _i64 filesize, _i64 rsize, int64 prev_entry, int64 prev_entry_clientid, int64 next_entry, bool update_fileindex)
+{
+	IScopedLock lock(mutex.get());
+
+	SFileSQL item;
+	item.seq = ++enqueued_seq;
+	item.backupid = backupid;
+	item.clientid = clientid;
+	item.incremental = incremental;
+	item.fp = fp;
+	item.hash_path = hash_path;
+	item.shahash = shahash;
+	item.filesize = filesize;
+	item.rsize = rsize;
+	item.prev_entry = prev_entry;
+	item.prev_entry_clientid = prev_entry_clientid;
+	item.next_entry = next_entry;
+	item.update_fileindex = update_fileindex;
+
+	queue.push_back(item);
+
+	if (queue.size() == 1
+		|| queue.size() >= max_batch_size)
+	{
+		cond->notify_all();
+	}
+
+	return item.seq;
+}
+
+void BackupServerHashWriter::waitFor(int64 seq)
+{
+	IScopedLock lock(mutex.get());
+
+	if (committed_seq >= seq)
+	{
+		return;
+	}
+
+	++waiters;
+	cond->notify_all();
+
+	while (committed_seq < seq)
+	{
+		commit_cond->wait(&lock);
+	}
+
+	--waiters;
+}
+
+bool BackupServerHashWriter::isCommitted(int64 seq)
+{
+	IScopedLock lock(mutex.get());
+	return committed_seq >= seq;
+}
+
+size_t BackupServerHashWriter::getQueueSize()
+{
+	IScopedLock lock(mutex.get());
+	return queue.size();
+}
+
+bool BackupServerHashWriter::isWorking()
+{
+	return working;
+}
+
+void BackupServerHashWriter::doExit()
+{
+	IScopedLock lock(mutex.get());
+	do_exit = true;
+	cond->notify_all();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../Interface/Thread.h"
+#include "../Interface/Mutex.h"
+#include "../Interface/Condition.h"
+#include "../Interface/Types.h"
+#include "server_log.h"
+#include <deque>
+#include <memory>
+#include <string>
+
+/**
+* Single writer for the file entry database used when a file backup
+* runs with more than one BackupServerHash worker. The workers only do
+* the file system work (linking, copying, patching) and queue their
+* file entries here. The entries are added in batches, each batch in one
+* write transaction. The file entries and their link updates are kept in
+* memory by ServerFilesDao during a batch and written with multi-row inserts.
+*/
+class BackupServerHashWriter : public IThread
+{
+public:
+	BackupServerHashWriter();
+	virtual ~BackupServerHashWriter();
+
+	void operator()(void);
+
+	int64 addFileSQL(int backupid, int clientid, int incremental, const std::string &fp, const std::string &hash_path,
+		const std::string &shahash, _i64 filesize, _i64 rsize, int64 prev_entry, int64 prev_entry_clientid, int64 next_entry, bool update_fileindex);
+
+	//Blocks till the entry with sequence number seq has been committed
+	void waitFor(int64 seq);
+
+	bool isCommitted(int64 seq);
+
+	size_t getQueueSize();
+
+	bool isWorking();
+
+	void doExit();
+
+private:
+	struct SFileSQL
+	{
+		int64 seq;
+		int backupid;
+		int clientid;
+		int incremental;
+		std::string fp;
+		std::string hash_path;
+		std::string shahash;
+		_i64 filesize;
+		_i64 rsize;
+		int64 prev_entry;
+		int64 prev_entry_clientid;
+		int64 next_entry;
+		bool update_fileindex;
+	};
+
+	std::auto_ptr<IMutex> mutex;
+	std::auto_ptr<ICondition> cond;
+	std::auto_ptr<ICondition> commit_cond;
+
+	std::deque<SFileSQL> queue;
+	int64 enqueued_seq;
+	int64 committed_seq;
+	size_t waiters;
+	bool do_exit;
+	volatile bool working;
+};
@@ -30,6 +30,7 @@
 #include <memory.h>
 #include "../common/adler32.h"
 #include "../urbackupcommon/file_metadata.h"
+#include "FileBackup.h"
 
 namespace
 {
@@ -49,12 +50,12 @@ namespace
 	const size_t hash_bsize = 512*1024;
 }
 
-BackupServerPrepareHash::BackupServerPrepareHash(IPipe *pPipe, IPipe *pOutput, int pClientid,
-	logid_t logid, bool ignore_hash_mismatch)
-	: logid(logid), ignore_hash_mismatch(ignore_hash_mismatch)
+BackupServerPrepareHash::BackupServerPrepareHash(IPipe *pPipe, const std::vector<IPipe*>& pOutputs, int pClientid,
+	logid_t logid, bool ignore_hash_mismatch, IMutex* read_mutex, MaxFileId* max_file_id)
+	: outputs(pOutputs), read_mutex(read_mutex), max_file_id(max_file_id),
+	  logid(logid), ignore_hash_mismatch(ignore_hash_mismatch)
 {
 	pipe=pPipe;
-	output=pOutput;
 	clientid=pClientid;
 	working=false;
 	chunk_patcher.setCallback(this);
@@ -64,7 +65,6 @@ BackupServerPrepareHash::BackupServerPrepareHash(IPipe *pPipe, IPipe *pOutput, i
 
 BackupServerPrepareHash::~BackupServerPrepareHash(void)
 {
-	Server->destroy(pipe);
 }
 
 void BackupServerPrepareHash::operator()(void)
@@ -73,10 +73,27 @@ void BackupServerPrepareHash::operator()(void)
 	{
 		working=false;
 		std::string data;
-		size_t rc=pipe->Read(&data);
+		size_t rc;
+		{
+			//Files have to be marked as in flight in the order they are read,
+			//otherwise a worker could finish a later file before an earlier one is marked
+			IScopedLock lock(read_mutex);
+			rc=pipe->Read(&data);
+
+			if(rc>0 && data!="exit" && data!="flush"
+				&& max_file_id!=NULL)
+			{
+				CRData rd(&data);
+				int64 fileid;
+				if(rd.getVarInt(&fileid))
+				{
+					max_file_id->addInFlight(fileid);
+				}
+			}
+		}
+
 		if(data=="exit")
 		{
-			output->Write("exit");
 			Server->Log("server_prepare_hash Thread finished (exit)");
 			delete this;
 			return;
@@ -151,6 +168,7 @@ void BackupServerPrepareHash::operator()(void)
 					ServerLogger::Log(logid, "Error opening file \""+old_file_fn+"\" for reading. File: old_file. "+os_last_error_str()+" Target path: \""+tfn+"\"", LL_ERROR);
 					has_error=true;
 					if(tf!=NULL) Server->destroy(tf);
+					if(max_file_id!=NULL) max_file_id->removeInFlight(fileid);
 					continue;
 				}
 			}
@@ -163,6 +181,10 @@ void BackupServerPrepareHash::operator()(void)
 				{
 					Server->destroy(old_file);
 				}
+				if(max_file_id!=NULL)
+				{
+					max_file_id->removeInFlight(fileid);
+				}
 			}
 			else
 			{
@@ -279,7 +301,7 @@ void BackupServerPrepareHash::operator()(void)
 				data.addString(sparse_extents_fn);
 				metadata.serialize(data);
 
-				output->Write(data.getDataPtr(), data.getDataSize() );
+				getOutput(h)->Write(data.getDataPtr(), data.getDataSize() );
 			}
 		}
 	}
@@ -509,4 +531,20 @@ bool BackupServerPrepareHash::hasError(void)
 	return has_error;
 }
 
+IPipe* BackupServerPrepareHash::getOutput(const std::string& sha_dig)
+{
+	if(outputs.size()==1
+		|| sha_dig.size()<2)
+	{
+		return outputs[0];
+	}
+
+	//Files with the same hash always go to the same worker,
+	//so the file entry list of a hash is only modified by one worker
+	size_t idx = static_cast<unsigned char>(sha_dig[0])
+		| (static_cast<size_t>(static_cast<unsigned char>(sha_dig[1])) << 8);
+
+	return outputs[idx % outputs.size()];
+}
+
 #endif //CLIENT_ONLY
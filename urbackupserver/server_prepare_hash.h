@@ -10,6 +10,10 @@
 #include "server_log.h"
 #include "../urbackupcommon/ExtentIterator.h"
 #include "../urbackupcommon/TreeHash.h"
+#include "../Interface/Mutex.h"
+#include <vector>
+
+class MaxFileId;
 
 const char HASH_FUNC_SHA512_NO_SPARSE = 0;
 const char HASH_FUNC_SHA512 = 1;
@@ -32,7 +36,8 @@ namespace
 class BackupServerPrepareHash : public IThread, public IChunkPatcherCallback
 {
 public:
-	BackupServerPrepareHash(IPipe *pPipe, IPipe *pOutput, int pClientid, logid_t logid, bool ignore_hash_mismatch);
+	BackupServerPrepareHash(IPipe *pPipe, const std::vector<IPipe*>& pOutputs, int pClientid, logid_t logid, bool ignore_hash_mismatch,
+		IMutex* read_mutex, MaxFileId* max_file_id);
 	~BackupServerPrepareHash(void);
 
 	void operator()(void);
@@ -66,8 +71,12 @@ private:
 
 	void addUnchangedHashes(int64 start, size_t size, bool* is_sparse);
 
+	IPipe* getOutput(const std::string& sha_dig);
+
 	IPipe *pipe;
-	IPipe *output;
+	std::vector<IPipe*> outputs;
+	IMutex* read_mutex;
+	MaxFileId* max_file_id;
 
 	int clientid;
 
@@ -375,6 +375,8 @@ void ServerSettings::readSettingsDefault(ISettingsReader* settings_default,
 	settings->internet_encrypt=(settings_default->getValue("internet_encrypt", "true")=="true");
 	settings->internet_compress=(settings_default->getValue("internet_compress", "true")=="true");
 	settings->internet_compression_level=atoi(settings_default->getValue("internet_compression_level", "6").c_str());
+	settings->internet_compression_codec=settings_default->getValue("internet_compression_codec", "zstd");
+	settings->internet_compression_level_zstd=atoi(settings_default->getValue("internet_compression_level_zstd", "3").c_str());
 	settings->internet_speed=settings_default->getValue("internet_speed", "-1");
 	settings->local_speed=settings_default->getValue("local_speed", "-1");
 	settings->global_internet_speed= settings_global->getValue("global_internet_speed", "-1");
@@ -391,11 +393,14 @@ void ServerSettings::readSettingsDefault(ISettingsReader* settings_default,
 	settings->local_image_transfer_mode=settings_default->getValue("local_image_transfer_mode", "hashed");
 	settings->internet_image_transfer_mode=settings_default->getValue("internet_image_transfer_mode", "raw");
 	settings->update_stats_cachesize=static_cast<size_t>(settings_global->getValue("update_stats_cachesize", 200*1024));
+	settings->file_hash_threads=settings_global->getValue("file_hash_threads", 1);
 	settings->global_soft_fs_quota= settings_global->getValue("global_soft_fs_quota", "95%");
 	settings->client_quota=settings_default->getValue("client_quota", "");
 	settings->end_to_end_file_backup_verification=(settings_default->getValue("end_to_end_file_backup_verification", "false")=="true");
 	settings->internet_calculate_filehashes_on_client=(settings_default->getValue("internet_calculate_filehashes_on_client", "true")=="true");
 	settings->internet_parallel_file_hashing = (settings_default->getValue("internet_parallel_file_hashing", "false") == "true");	
+	settings->client_hash_threads = atoi(settings_default->getValue("client_hash_threads", "2").c_str());
+	settings->client_index_threads = atoi(settings_default->getValue("client_index_threads", "4").c_str());
 	settings->use_incremental_symlinks=(settings_global->getValue("use_incremental_symlinks", "true")=="true");
 	settings->internet_connect_always=(settings_default->getValue("internet_connect_always", "false")=="true");
 	settings->show_server_updates=(settings_global->getValue("show_server_updates", "true")=="true");
@@ -569,6 +574,8 @@ void ServerSettings::readSettingsClient(ISettingsReader* settings_client)
 	readBoolClientSetting(settings_client, "end_to_end_file_backup_verification", &settings->end_to_end_file_backup_verification);
 	readBoolClientSetting(settings_client, "internet_calculate_filehashes_on_client", &settings->internet_calculate_filehashes_on_client);
 	readBoolClientSetting(settings_client, "internet_parallel_file_hashing", &settings->internet_parallel_file_hashing);	
+	readIntClientSetting(settings_client, "client_hash_threads", &settings->client_hash_threads);
+	readIntClientSetting(settings_client, "client_index_threads", &settings->client_index_threads);
 	readBoolClientSetting(settings_client, "silent_update", &settings->silent_update);
 
 	readBoolClientSetting(settings_client, "allow_config_paths", &settings->allow_config_paths);
@@ -11,7 +11,9 @@ namespace
 	const char* image_file_format_default = "default";
 	const char* image_file_format_vhd = "vhd";
 	const char* image_file_format_vhdz = "vhdz";
+	const char* image_file_format_vhdz_zstd = "vhdz_zstd";
 	const char* image_file_format_cowraw = "cowraw";
+	const char* image_file_format_blockstore = "blockstore";
 
 	const char* full_image_style_full = "full";
 	const char* full_image_style_synthetic = "synthetic";
@@ -84,6 +86,8 @@ struct SSettings
 	bool internet_encrypt;
 	bool internet_compress;
 	int internet_compression_level;
+	std::string internet_compression_codec;
+	int internet_compression_level_zstd;
 	std::string local_speed;
 	std::string internet_speed;
 	std::string global_internet_speed;
@@ -100,11 +104,14 @@ struct SSettings
 	std::string local_image_transfer_mode;
 	std::string internet_image_transfer_mode;
 	size_t update_stats_cachesize;
+	int file_hash_threads;
 	std::string global_soft_fs_quota;
 	std::string client_quota;
 	bool end_to_end_file_backup_verification;
 	bool internet_calculate_filehashes_on_client;
 	bool internet_parallel_file_hashing;
+	int client_hash_threads;
+	int client_index_threads;
 	bool use_incremental_symlinks;
 	std::string image_file_format;
 	bool internet_connect_always;
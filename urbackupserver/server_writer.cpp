@@ -32,12 +32,14 @@ extern IFSImageFactory *image_fak;
 const size_t free_space_lim=1000*1024*1024; //1000MB
 const uint64 filebuf_lim=1000*1024*1024; //1000MB
 const unsigned int sha_size=32;
+const unsigned int max_coalesce_size=2*1024*1024; //2MB
+const size_t max_write_batch=512;
 
 ServerVHDWriter::ServerVHDWriter(IVHDFile *pVHD, unsigned int blocksize, unsigned int nbufs,
 		int pClientid, bool use_tmpfiles, int64 mbr_offset, IFile* hashfile, int64 vhd_blocksize,
 	logid_t logid, int64 drivesize)
  : mbr_offset(mbr_offset), do_trim(false), hashfile(hashfile), vhd_blocksize(vhd_blocksize), do_make_full(false),
-   logid(logid), drivesize(drivesize)
+   logid(logid), drivesize(drivesize), coalesce_pos(0), coalesce_size(0)
 {
 	filebuffer=use_tmpfiles;
 
@@ -68,6 +70,8 @@ ServerVHDWriter::ServerVHDWriter(IVHDFile *pVHD, unsigned int blocksize, unsigne
 	exit_now=false;
 	has_error=false;
 	written=free_space_lim;
+
+	coalesce_buf.resize(max_coalesce_size);
 }
 
 ServerVHDWriter::~ServerVHDWriter(void)
@@ -88,10 +92,10 @@ ServerVHDWriter::~ServerVHDWriter(void)
 void ServerVHDWriter::operator()(void)
 {
 	{
+		std::vector<BufferVHDItem> items;
+		items.reserve(max_write_batch);
 		while(!exit_now)
 		{
-			BufferVHDItem item;
-			bool has_item=false;
 			bool do_exit;
 			{
 				IScopedLock lock(mutex);
@@ -100,20 +104,20 @@ void ServerVHDWriter::operator()(void)
 					cond->wait(&lock);
 				}
 				do_exit=exit;
-				if(!tqueue.empty())
+				while(!tqueue.empty() && items.size()<max_write_batch)
 				{
-					item=tqueue.front();
+					items.push_back(tqueue.front());
 					tqueue.pop();
-					has_item=true;
 				}
 			}
-			if(has_item)
+			for(size_t i=0;i<items.size();++i)
 			{
+				BufferVHDItem& item=items[i];
 				if(!has_error)
 				{
 					if(!filebuffer)
 					{
-						writeVHD(item.pos, item.buf, item.bsize);
+						writeVHDCoalesced(item.pos, item.buf, item.bsize);
 					}
 					else
 					{
@@ -155,17 +159,25 @@ void ServerVHDWriter::operator()(void)
 
 				freeBuffer(item.buf);
 			}
-			else if(do_exit)
+
+			if(items.empty() && do_exit)
 			{
 				break;
 			}
 
+			items.clear();
+
 			if(!filebuffer && written>=free_space_lim/2)
 			{
 				written=0;
 				checkFreeSpaceAndCleanup();
 			}
 		}
+
+		if(!filebuffer && !exit_now && !has_error)
+		{
+			flushCoalesced();
+		}
 	}
 	if(filebuffer)
 	{
@@ -351,6 +363,62 @@ bool ServerVHDWriter::writeVHD(uint64 pos, char *buf, unsigned int bsize)
 	return !has_error;
 }
 
+bool ServerVHDWriter::writeVHDCoalesced(uint64 pos, char *buf, unsigned int bsize)
+{
+	if (buf == NULL)
+	{
+		if (!flushCoalesced())
+		{
+			return false;
+		}
+		return writeVHD(pos, buf, bsize);
+	}
+
+	if (coalesce_size>0
+		&& (pos != coalesce_pos + coalesce_size
+			|| coalesce_size + bsize > coalesce_buf.size()))
+	{
+		if (!flushCoalesced())
+		{
+			return false;
+		}
+	}
+
+	if (bsize > coalesce_buf.size())
+	{
+		return writeVHD(pos, buf, bsize);
+	}
+
+	if (coalesce_size == 0)
+	{
+		coalesce_pos = pos;
+	}
+
+	memcpy(&coalesce_buf[coalesce_size], buf, bsize);
+	coalesce_size += bsize;
+
+	//Keep writes aligned to VHD/compressed file blocks
+	if ((coalesce_pos + coalesce_size) % max_coalesce_size == 0)
+	{
+		return flushCoalesced();
+	}
+
+	return true;
+}
+
+bool ServerVHDWriter::flushCoalesced(void)
+{
+	if (coalesce_size == 0)
+	{
+		return true;
+	}
+
+	unsigned int tw = coalesce_size;
+	coalesce_size = 0;
+
+	return writeVHD(coalesce_pos, coalesce_buf.data(), tw);
+}
+
 char *ServerVHDWriter::getBuffer(void)
 {
 	if(filebuffer)
@@ -630,7 +698,7 @@ void ServerFileBufferWriter::operator()(void)
 						FileBufferVHDItem *item=(FileBufferVHDItem*)blockbuf;
 						if(blockbuf_size-1==item->bsize+sizeof(FileBufferVHDItem) )
 						{
-							parent->writeVHD(item->pos, blockbuf+sizeof(FileBufferVHDItem), item->bsize);
+							parent->writeVHDCoalesced(item->pos, blockbuf+sizeof(FileBufferVHDItem), item->bsize);
 							written+=item->bsize;
 							tpos+=item->bsize+sizeof(FileBufferVHDItem);
 							next_type = blockbuf[blockbuf_size - 1];
@@ -655,7 +723,7 @@ void ServerFileBufferWriter::operator()(void)
 						tpos+=sizeof(FileBufferVHDItem);
 						if (item.type==1)
 						{
-							parent->writeVHD(item.pos, NULL, item.bsize);
+							parent->writeVHDCoalesced(item.pos, NULL, item.bsize);
 							next_type = -1;
 						}
 						else if(item.type==0)
@@ -692,7 +760,7 @@ void ServerFileBufferWriter::operator()(void)
 								next_type = -1;
 							}
 
-							parent->writeVHD(item.pos, blockbuf, tw);
+							parent->writeVHDCoalesced(item.pos, blockbuf, tw);
 							written += tw;
 							tpos += item.bsize;
 						}
@@ -716,6 +784,12 @@ void ServerFileBufferWriter::operator()(void)
 					break;
 				}
 			}
+
+			if(!exit_now && !parent->hasError())
+			{
+				parent->flushCoalesced();
+			}
+
 			parent->freeFile(tmp);
 		}
 		else if(do_exit)
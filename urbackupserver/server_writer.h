@@ -5,6 +5,7 @@
 #include "../fsimageplugin/IVHDFile.h"
 
 #include <queue>
+#include <vector>
 #include "server_log.h"
 
 class IVHDFile;
@@ -54,6 +55,9 @@ public:
 	size_t getQueueSize(void);
 
 	bool writeVHD(uint64 pos, char *buf, unsigned int bsize);
+	//Collects adjacent writes and writes them with one writeVHD call
+	bool writeVHDCoalesced(uint64 pos, char *buf, unsigned int bsize);
+	bool flushCoalesced(void);
 	void freeFile(IFile *buf);
 
 	void writeRetry(IFile *f, char *buf, unsigned int bsize);
@@ -105,6 +109,10 @@ private:
 	logid_t logid;
 
 	int64 drivesize;
+
+	std::vector<char> coalesce_buf;
+	uint64 coalesce_pos;
+	unsigned int coalesce_size;
 };
 
 class ServerFileBufferWriter : public IThread
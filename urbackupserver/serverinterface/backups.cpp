@@ -1003,6 +1003,10 @@ namespace backupaccess
 			{
 				vhdfile.reset(image_fak->createVHDFile(path, true, 0, 2*1024*1024, false, IFSImageFactory::ImageFormat_RawCowFile));
 			}
+			else if(extension=="blocks")
+			{
+				vhdfile.reset(image_fak->createVHDFile(path, true, 0, 2*1024*1024, false, IFSImageFactory::ImageFormat_BlockStore));
+			}
 			else
 			{
 				assert(false);
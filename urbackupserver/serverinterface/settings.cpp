@@ -179,6 +179,8 @@ JSON::Object getJSONClientSettings(ServerSettings &settings)
 	SET_SETTING(end_to_end_file_backup_verification);
 	SET_SETTING(internet_calculate_filehashes_on_client);
 	SET_SETTING(internet_parallel_file_hashing);
+	SET_SETTING(client_hash_threads);
+	SET_SETTING(client_index_threads);
 	ret.set("image_file_format", settings.getImageFileFormat());
 	SET_SETTING(internet_connect_always);
 	SET_SETTING(verify_using_client_hashes);
@@ -240,6 +242,7 @@ void getGeneralSettings(JSON::Object& obj, IDatabase *db, ServerSettings &settin
 	SET_SETTING(use_tmpfiles_images);
 	SET_SETTING(tmpdir);
 	SET_SETTING(update_stats_cachesize);
+	SET_SETTING(file_hash_threads);
 	SET_SETTING(use_incremental_symlinks);
 	SET_SETTING(show_server_updates);
 	SET_SETTING(server_url);
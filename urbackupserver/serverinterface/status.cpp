@@ -26,6 +26,8 @@
 #include "../server.h"
 #include "../ClientMain.h"
 #include "../dao/ServerBackupDao.h"
+#include "../LMDBFileIndex.h"
+#include "../FileIndexFilter.h"
 
 #include <algorithm>
 #include <memory>
@@ -559,6 +561,18 @@ ACTION_IMPL(status)
 		{
 			ret.set("admin", JSON::Value(true));
 			set_server_version_info(db, ret);
+
+			FileIndexFilter* fileindex_filter = LMDBFileIndex::getFileIndexFilter();
+			if (fileindex_filter != NULL)
+			{
+				JSON::Object filter_info;
+				filter_info.set("memory_size", fileindex_filter->getMemorySize());
+				filter_info.set("entries", fileindex_filter->getEntries());
+				filter_info.set("capacity", fileindex_filter->getCapacity());
+				filter_info.set("false_positive_rate", fileindex_filter->getFalsePositiveRate());
+				filter_info.set("expected_false_positive_rate", fileindex_filter->getExpectedFalsePositiveRate());
+				ret.set("fileindex_filter", filter_info);
+			}
 		}
 
 		if(is_big_endian())
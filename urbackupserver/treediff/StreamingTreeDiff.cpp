@@ -0,0 +1,672 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "StreamingTreeDiff.h"
+#include "TreeDiff.h"
+#include "../../Interface/Server.h"
+#include "../../Interface/Mutex.h"
+#include "../../Interface/Condition.h"
+#include "../../Interface/ThreadPool.h"
+#include "../../stringtools.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+//Directories with at least this many lines are diffed in parallel
+const size_t c_min_parallel_subtree_lines=10000;
+const size_t c_max_diff_threads=8;
+
+namespace
+{
+	size_t getDiffThreads()
+	{
+		std::string threads = Server->getServerParameter("treediff_threads");
+		if(!threads.empty())
+		{
+			return static_cast<size_t>((std::max)(1, watoi(threads)));
+		}
+
+#ifdef _WIN32
+		SYSTEM_INFO system_info;
+		GetSystemInfo(&system_info);
+		long ncpus = static_cast<long>(system_info.dwNumberOfProcessors);
+#else
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if(ncpus<1)
+		{
+			return 1;
+		}
+
+		return (std::min)(static_cast<size_t>(ncpus), c_max_diff_threads);
+	}
+
+	int entryCompare(const TreeStreamReader::SEntry& c1, const TreeStreamReader::SEntry& c2)
+	{
+		if (c1.type == 'f'
+			&& c2.type == 'd')
+		{
+			return -1;
+		}
+		else if (c1.type == 'd'
+			&& c2.type == 'f')
+		{
+			return 1;
+		}
+		else
+		{
+			return c1.nameCompare(c2);
+		}
+	}
+
+	void appendIds(std::vector<size_t>& target, const std::vector<size_t>& source)
+	{
+		target.insert(target.end(), source.begin(), source.end());
+	}
+}
+
+StreamingTreeDiff::StreamingTreeDiff(const std::string &t1, const std::string &t2, bool has_symbit, bool is_windows)
+	: t1(t1), t2(t2), has_symbit(has_symbit), is_windows(is_windows),
+	with_deleted_ids(false), with_modified_inplace_ids(false), with_deleted_inplace_ids(false),
+	mutex(Server->createMutex()), cond(Server->createCondition()), active_workers(0)
+{
+	index1.fn = t1;
+	index1.ok = false;
+	index2.fn = t2;
+	index2.ok = false;
+}
+
+StreamingTreeDiff::~StreamingTreeDiff()
+{
+	for(size_t i=0;i<units.size();++i)
+	{
+		delete units[i];
+	}
+}
+
+bool StreamingTreeDiff::diffTrees(std::vector<size_t>& diffs,
+	std::vector<size_t> *deleted_ids, std::vector<size_t>* large_unchanged_subtrees,
+	std::vector<size_t> *modified_inplace_ids, std::vector<size_t> &dir_diffs,
+	std::vector<size_t> *deleted_inplace_ids)
+{
+	with_deleted_ids = deleted_ids!=NULL;
+	with_modified_inplace_ids = modified_inplace_ids!=NULL;
+	with_deleted_inplace_ids = deleted_inplace_ids!=NULL;
+
+	IndexThread index_thread(index2);
+	THREADPOOL_TICKET index_ticket = Server->getThreadPool()->execute(&index_thread, "treediff index");
+	index1.ok = buildIndex(index1);
+	Server->getThreadPool()->waitFor(index_ticket);
+
+	if(!index1.ok || !index2.ok)
+	{
+		return false;
+	}
+
+	//Root entries may be unsorted. Same as TreeDiff::gatherDiffs with depth==0
+	std::vector<TreeStreamReader::SEntry>& root1 = index1.root;
+	std::vector<TreeStreamReader::SEntry>& root2 = index2.root;
+	std::vector<char> mapped1(root1.size(), 0);
+	SUnit root;
+	size_t i1=0;
+	for(size_t i2=0;i2<root2.size();)
+	{
+		const TreeStreamReader::SEntry& c2 = root2[i2];
+
+		int cmp = 1;
+		if(i1<root1.size())
+		{
+			cmp = entryCompare(root1[i1], c2);
+		}
+
+		if(cmp!=0)
+		{
+			for(size_t j=0;j<root1.size();++j)
+			{
+				if(c2.type==root1[j].type
+					&& c2.nameEquals(root1[j])
+					&& !mapped1[j])
+				{
+					cmp = 0;
+					i1 = j;
+					break;
+				}
+			}
+		}
+
+		if(cmp==0)
+		{
+			const TreeStreamReader::SEntry& c1 = root1[i1];
+
+			if(mapped1[i1])
+			{
+				Server->Log("Root entry \""+c1.name+"\" of file tree is used twice", LL_DEBUG);
+				return false;
+			}
+
+			bool equal_dir = (c1.type=='d' && c2.type=='d');
+			bool data_equals = c1.dataEquals(c2);
+
+			if(equal_dir && !data_equals)
+			{
+				root.dir_diffs.push_back(c2.id);
+			}
+
+			if( equal_dir
+				|| data_equals )
+			{
+				if(equal_dir)
+				{
+					SDeferred deferred;
+					deferred.unit = addUnit(c1, c2, false);
+					deferred.id = c2.id;
+					root.deferred.push_back(deferred);
+				}
+				mapped1[i1]=1;
+			}
+			else
+			{
+				if( with_modified_inplace_ids
+					&& c1.type == c2.type )
+				{
+					root.modified_inplace_ids.push_back(c2.id);
+				}
+
+				if (with_deleted_inplace_ids
+					&& c1.type == c2.type
+					&& isSymlink(c1) == isSymlink(c2) )
+				{
+					root.deleted_inplace_ids.push_back(c1.id);
+				}
+
+				root.diffs.push_back(c2.id);
+			}
+
+			++i1;
+			++i2;
+		}
+		else if(cmp<0)
+		{
+			++i1;
+		}
+		else
+		{
+			root.diffs.push_back(c2.id);
+			++i2;
+		}
+	}
+
+	if(with_deleted_ids)
+	{
+		for(size_t j=0;j<root1.size();++j)
+		{
+			if(!mapped1[j])
+			{
+				if(root1[j].type=='d')
+				{
+					addUnit(root1[j], root1[j], true);
+				}
+				else
+				{
+					root.deleted_ids.push_back(root1[j].id);
+				}
+			}
+		}
+	}
+
+	size_t n_threads = getDiffThreads();
+	std::vector<WorkerThread*> workers;
+	std::vector<THREADPOOL_TICKET> worker_tickets;
+	for(size_t i=1;i<n_threads;++i)
+	{
+		workers.push_back(new WorkerThread(*this));
+		worker_tickets.push_back(Server->getThreadPool()->execute(workers[workers.size()-1], "treediff worker"));
+	}
+
+	runWorker();
+
+	Server->getThreadPool()->waitFor(worker_tickets);
+
+	for(size_t i=0;i<workers.size();++i)
+	{
+		delete workers[i];
+	}
+
+	//Units are added after their parent, so the deferred directories
+	//of a unit are complete once we get to it
+	for(size_t i=units.size();i-->0;)
+	{
+		SUnit* unit = units[i];
+		if(unit->error)
+		{
+			return false;
+		}
+
+		for(size_t j=0;j<unit->deferred.size();++j)
+		{
+			finishDir(unit->dir, unit->deferred[j].unit->dir, unit->deferred[j].id);
+		}
+	}
+
+	for(size_t j=0;j<root.deferred.size();++j)
+	{
+		finishDir(root.dir, root.deferred[j].unit->dir, root.deferred[j].id);
+	}
+
+	std::vector<SUnit*> all_units = units;
+	all_units.push_back(&root);
+
+	for(size_t i=0;i<all_units.size();++i)
+	{
+		SUnit* unit = all_units[i];
+		appendIds(diffs, unit->diffs);
+		appendIds(dir_diffs, unit->dir_diffs);
+		if(deleted_ids!=NULL)
+		{
+			appendIds(*deleted_ids, unit->deleted_ids);
+		}
+		if(modified_inplace_ids!=NULL)
+		{
+			appendIds(*modified_inplace_ids, unit->modified_inplace_ids);
+		}
+		if(deleted_inplace_ids!=NULL)
+		{
+			appendIds(*deleted_inplace_ids, unit->deleted_inplace_ids);
+		}
+	}
+
+	if(large_unchanged_subtrees!=NULL)
+	{
+		appendIds(*large_unchanged_subtrees, root.dir.large_unchanged);
+	}
+
+	return true;
+}
+
+bool StreamingTreeDiff::buildIndex(SIndex& index)
+{
+	TreeStreamReader reader;
+	if(!reader.open(index.fn))
+	{
+		return false;
+	}
+
+	//With a directory index only the root entries have to be read
+	const std::vector<SFileListDirIndex>* dir_index = reader.getDirIndex();
+	if(dir_index!=NULL)
+	{
+		for(size_t i=0;i<dir_index->size();++i)
+		{
+			const SFileListDirIndex& idx = (*dir_index)[i];
+			if(idx.end_offset>idx.offset
+				&& idx.end_id-idx.id>=static_cast<int64>(c_min_parallel_subtree_lines))
+			{
+				SSubtree subtree;
+				subtree.end_offset = idx.end_offset;
+				subtree.end_line = static_cast<size_t>(idx.end_id);
+				index.large_dirs[idx.offset] = subtree;
+			}
+		}
+	}
+
+	std::vector<std::pair<int64, size_t> > parents;
+	TreeStreamReader::SEntry entry;
+	while(true)
+	{
+		if(!reader.next(entry))
+		{
+			return false;
+		}
+
+		if(entry.type=='u')
+		{
+			if(reader.isEof())
+			{
+				return true;
+			}
+
+			if(parents.empty())
+			{
+				Server->Log("Unexpected directory end at line "+convert(entry.id)+" of file tree \""+index.fn+"\"", LL_DEBUG);
+				return false;
+			}
+
+			if(reader.getLine()-parents.back().second>=c_min_parallel_subtree_lines)
+			{
+				SSubtree subtree;
+				subtree.end_offset = reader.getOffset();
+				subtree.end_line = reader.getLine();
+				index.large_dirs[parents.back().first] = subtree;
+			}
+
+			parents.pop_back();
+		}
+		else
+		{
+			if(parents.empty())
+			{
+				index.root.push_back(entry);
+			}
+
+			if(entry.type=='d')
+			{
+				if(dir_index!=NULL)
+				{
+					size_t n_nodes=0;
+					if(!reader.skipSubtree(NULL, n_nodes))
+					{
+						return false;
+					}
+				}
+				else
+				{
+					parents.push_back(std::make_pair(entry.offset, entry.id));
+				}
+			}
+		}
+	}
+}
+
+StreamingTreeDiff::SUnit* StreamingTreeDiff::addUnit(const TreeStreamReader::SEntry& d1, const TreeStreamReader::SEntry& d2, bool delete_only)
+{
+	SUnit* unit = new SUnit;
+	unit->d1 = d1;
+	unit->d2 = d2;
+	unit->delete_only = delete_only;
+
+	IScopedLock lock(mutex.get());
+	units.push_back(unit);
+	queue.push_back(unit);
+	cond->notify_one();
+
+	return unit;
+}
+
+void StreamingTreeDiff::runWorker()
+{
+	IScopedLock lock(mutex.get());
+	while(true)
+	{
+		if(!queue.empty())
+		{
+			SUnit* unit = queue.front();
+			queue.pop_front();
+			++active_workers;
+
+			lock.relock(NULL);
+			processUnit(*unit);
+			lock.relock(mutex.get());
+
+			--active_workers;
+			cond->notify_all();
+		}
+		else if(active_workers==0)
+		{
+			cond->notify_all();
+			return;
+		}
+		else
+		{
+			cond->wait(&lock);
+		}
+	}
+}
+
+void StreamingTreeDiff::processUnit(SUnit& unit)
+{
+	TreeStreamReader r1;
+	TreeStreamReader::SEntry d1;
+	if(!r1.open(t1)
+		|| !r1.seek(unit.d1.offset, unit.d1.id)
+		|| !r1.next(d1) )
+	{
+		unit.error=true;
+		return;
+	}
+
+	if(unit.delete_only)
+	{
+		if(!deleteSubtree(r1, d1, unit))
+		{
+			unit.error=true;
+		}
+		return;
+	}
+
+	TreeStreamReader r2;
+	TreeStreamReader::SEntry d2;
+	if(!r2.open(t2)
+		|| !r2.seek(unit.d2.offset, unit.d2.id)
+		|| !r2.next(d2) )
+	{
+		unit.error=true;
+		return;
+	}
+
+	if(!diffChildren(r1, r2, unit, unit.dir, true))
+	{
+		unit.error=true;
+	}
+}
+
+bool StreamingTreeDiff::diffChildren(TreeStreamReader& r1, TreeStreamReader& r2, SUnit& unit, SDirState& dir, bool unit_root)
+{
+	TreeStreamReader::SEntry c1;
+	TreeStreamReader::SEntry c2;
+	if(!r1.next(c1) || !r2.next(c2))
+	{
+		return false;
+	}
+
+	while(c2.type!='u')
+	{
+		int cmp = 1;
+		if(c1.type!='u')
+		{
+			cmp = entryCompare(c1, c2);
+		}
+
+		if(cmp==0)
+		{
+			bool equal_dir = (c1.type=='d' && c2.type=='d');
+			bool data_equals = c1.dataEquals(c2);
+
+			if(equal_dir && !data_equals)
+			{
+				unit.dir_diffs.push_back(c2.id);
+				dir.subtree_changed=true;
+			}
+
+			if( equal_dir
+				|| data_equals )
+			{
+				if(equal_dir)
+				{
+					std::map<int64, SSubtree>::iterator it1;
+					std::map<int64, SSubtree>::iterator it2;
+					if(unit_root
+						&& (it1=index1.large_dirs.find(c1.offset))!=index1.large_dirs.end()
+						&& (it2=index2.large_dirs.find(c2.offset))!=index2.large_dirs.end() )
+					{
+						SDeferred deferred;
+						deferred.unit = addUnit(c1, c2, false);
+						deferred.id = c2.id;
+						unit.deferred.push_back(deferred);
+
+						if(!r1.seek(it1->second.end_offset, it1->second.end_line)
+							|| !r2.seek(it2->second.end_offset, it2->second.end_line) )
+						{
+							return false;
+						}
+					}
+					else
+					{
+						SDirState child;
+						if(!diffChildren(r1, r2, unit, child, false))
+						{
+							return false;
+						}
+						finishDir(dir, child, c2.id);
+					}
+				}
+				else
+				{
+					++dir.treesize;
+				}
+			}
+			else
+			{
+				if( with_modified_inplace_ids
+					&& c1.type == c2.type )
+				{
+					unit.modified_inplace_ids.push_back(c2.id);
+				}
+
+				if (with_deleted_inplace_ids
+					&& c1.type == c2.type
+					&& isSymlink(c1) == isSymlink(c2) )
+				{
+					unit.deleted_inplace_ids.push_back(c1.id);
+				}
+
+				unit.diffs.push_back(c2.id);
+				dir.subtree_changed=true;
+
+				if(!deleteSubtree(r1, c1, unit))
+				{
+					return false;
+				}
+
+				size_t n_nodes=1;
+				if(c2.type=='d'
+					&& !r2.skipSubtree(NULL, n_nodes))
+				{
+					return false;
+				}
+				dir.treesize+=n_nodes;
+			}
+
+#ifndef _WIN32
+			//See TreeDiff::gatherDiffs
+			if (isSymlink(c2))
+			{
+				dir.subtree_changed=true;
+			}
+#endif
+
+			if(!r1.next(c1) || !r2.next(c2))
+			{
+				return false;
+			}
+		}
+		else if(cmp<0)
+		{
+			if(!deleteSubtree(r1, c1, unit))
+			{
+				return false;
+			}
+			dir.subtree_changed=true;
+
+			if(!r1.next(c1))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			unit.diffs.push_back(c2.id);
+			dir.subtree_changed=true;
+
+			size_t n_nodes=1;
+			if(c2.type=='d'
+				&& !r2.skipSubtree(NULL, n_nodes))
+			{
+				return false;
+			}
+			dir.treesize+=n_nodes;
+
+			if(!r2.next(c2))
+			{
+				return false;
+			}
+		}
+	}
+
+	while(c1.type!='u')
+	{
+		if(!deleteSubtree(r1, c1, unit))
+		{
+			return false;
+		}
+
+		if(!r1.next(c1))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool StreamingTreeDiff::deleteSubtree(TreeStreamReader& r1, const TreeStreamReader::SEntry& c1, SUnit& unit)
+{
+	std::vector<size_t>* deleted_ids = with_deleted_ids ? &unit.deleted_ids : NULL;
+	if(deleted_ids!=NULL)
+	{
+		deleted_ids->push_back(c1.id);
+	}
+
+	if(c1.type=='d')
+	{
+		size_t n_nodes=0;
+		return r1.skipSubtree(deleted_ids, n_nodes);
+	}
+
+	return true;
+}
+
+void StreamingTreeDiff::finishDir(SDirState& parent, SDirState& dir, size_t id)
+{
+	if(!dir.subtree_changed
+		&& dir.treesize>10)
+	{
+		parent.large_unchanged.push_back(id);
+	}
+	else
+	{
+		appendIds(parent.large_unchanged, dir.large_unchanged);
+	}
+
+	std::vector<size_t>().swap(dir.large_unchanged);
+
+	if(dir.subtree_changed)
+	{
+		parent.subtree_changed=true;
+	}
+
+	parent.treesize+=dir.treesize;
+}
+
+bool StreamingTreeDiff::isSymlink(const TreeStreamReader::SEntry& n)
+{
+	return TreeDiff::isSymlink(n.type, n.data, n.getDataSize(), has_symbit, is_windows);
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+
+#include "TreeStreamReader.h"
+#include "../../Interface/Thread.h"
+
+class IMutex;
+class ICondition;
+
+//Calculates the same diff as TreeDiff without loading the file lists
+//into memory. Both file lists are read in one pass each to find the
+//root entries and large directories. Large directories which are in
+//both lists are then diffed in parallel.
+class StreamingTreeDiff
+{
+public:
+	StreamingTreeDiff(const std::string &t1, const std::string &t2, bool has_symbit, bool is_windows);
+	~StreamingTreeDiff();
+
+	//Returns false if the file lists cannot be diffed in streaming mode.
+	//Outputs are only appended to on success
+	bool diffTrees(std::vector<size_t>& diffs,
+		std::vector<size_t> *deleted_ids, std::vector<size_t>* large_unchanged_subtrees,
+		std::vector<size_t> *modified_inplace_ids, std::vector<size_t> &dir_diffs,
+		std::vector<size_t> *deleted_inplace_ids);
+
+	void runWorker();
+
+private:
+	struct SSubtree
+	{
+		int64 end_offset;
+		size_t end_line;
+	};
+
+	struct SIndex
+	{
+		std::string fn;
+		std::vector<TreeStreamReader::SEntry> root;
+		std::map<int64, SSubtree> large_dirs;
+		bool ok;
+	};
+
+	class IndexThread : public IThread
+	{
+	public:
+		IndexThread(SIndex& index)
+			: index(index) {}
+
+		virtual ~IndexThread() {}
+
+		void operator()()
+		{
+			index.ok = buildIndex(index);
+		}
+
+	private:
+		SIndex& index;
+	};
+
+	class WorkerThread : public IThread
+	{
+	public:
+		WorkerThread(StreamingTreeDiff& tree_diff)
+			: tree_diff(tree_diff) {}
+
+		virtual ~WorkerThread() {}
+
+		void operator()()
+		{
+			tree_diff.runWorker();
+		}
+
+	private:
+		StreamingTreeDiff& tree_diff;
+	};
+
+	//State of a directory in t2 needed to find large unchanged subtrees
+	struct SDirState
+	{
+		SDirState()
+			: subtree_changed(false), treesize(1) {}
+
+		bool subtree_changed;
+		size_t treesize;
+		std::vector<size_t> large_unchanged;
+	};
+
+	struct SUnit;
+
+	struct SDeferred
+	{
+		SUnit* unit;
+		size_t id;
+	};
+
+	//Diff of the children of a directory which is in both file lists
+	//or list of all ids of a deleted root directory (delete_only)
+	struct SUnit
+	{
+		SUnit()
+			: delete_only(false), error(false) {}
+
+		bool delete_only;
+
+		TreeStreamReader::SEntry d1;
+		TreeStreamReader::SEntry d2;
+
+		SDirState dir;
+		std::vector<SDeferred> deferred;
+
+		std::vector<size_t> diffs;
+		std::vector<size_t> dir_diffs;
+		std::vector<size_t> deleted_ids;
+		std::vector<size_t> modified_inplace_ids;
+		std::vector<size_t> deleted_inplace_ids;
+		bool error;
+	};
+
+	static bool buildIndex(SIndex& index);
+
+	SUnit* addUnit(const TreeStreamReader::SEntry& d1, const TreeStreamReader::SEntry& d2, bool delete_only);
+	void processUnit(SUnit& unit);
+	bool diffChildren(TreeStreamReader& r1, TreeStreamReader& r2, SUnit& unit, SDirState& dir, bool unit_root);
+	bool deleteSubtree(TreeStreamReader& r1, const TreeStreamReader::SEntry& c1, SUnit& unit);
+	void finishDir(SDirState& parent, SDirState& dir, size_t id);
+
+	bool isSymlink(const TreeStreamReader::SEntry& n);
+
+	std::string t1;
+	std::string t2;
+	bool has_symbit;
+	bool is_windows;
+
+	SIndex index1;
+	SIndex index2;
+
+	bool with_deleted_ids;
+	bool with_modified_inplace_ids;
+	bool with_deleted_inplace_ids;
+
+	std::auto_ptr<IMutex> mutex;
+	std::auto_ptr<ICondition> cond;
+	std::vector<SUnit*> units;
+	std::deque<SUnit*> queue;
+	size_t active_workers;
+};
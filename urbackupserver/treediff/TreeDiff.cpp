@@ -18,9 +18,30 @@
 
 #include "TreeDiff.h"
 #include "TreeReader.h"
+#include "StreamingTreeDiff.h"
+#include "../../Interface/Server.h"
+#include "../../Interface/File.h"
 #include <algorithm>
+#include <memory>
 #include <memory.h>
 
+//File lists larger than this (combined) are diffed without loading them
+//into memory
+const int64 c_streaming_diff_min_size=256*1024*1024;
+
+namespace
+{
+	int64 getFileSize(const std::string& fn)
+	{
+		std::auto_ptr<IFile> f(Server->openFile(fn, MODE_READ));
+		if(f.get()==NULL)
+		{
+			return 0;
+		}
+		return f->Size();
+	}
+}
+
 std::vector<size_t> TreeDiff::diffTrees(const std::string &t1, const std::string &t2, bool &error,
 	std::vector<size_t> *deleted_ids, std::vector<size_t>* large_unchanged_subtrees,
 	std::vector<size_t> *modified_inplace_ids, std::vector<size_t> &dir_diffs,
@@ -28,30 +49,53 @@ std::vector<size_t> TreeDiff::diffTrees(const std::string &t1, const std::string
 {
 	std::vector<size_t> ret;
 
-	TreeReader r1;
-	if(!r1.readTree(t1))
+	bool streamed=false;
+	if(getFileSize(t1)+getFileSize(t2)>=c_streaming_diff_min_size)
 	{
-		error=true;
-		return ret;
+		StreamingTreeDiff streaming_diff(t1, t2, has_symbit, is_windows);
+		streamed = streaming_diff.diffTrees(ret, deleted_ids, large_unchanged_subtrees,
+			modified_inplace_ids, dir_diffs, deleted_inplace_ids);
+
+		if(!streamed)
+		{
+			Server->Log("Streaming tree diff failed. Loading file trees into memory.", LL_INFO);
+		}
 	}
 
-	TreeReader r2;
-	if(!r2.readTree(t2))
+	if(!streamed)
 	{
-		error=true;
-		return ret;
+		TreeReader r1;
+		if(!r1.readTree(t1))
+		{
+			error=true;
+			return ret;
+		}
+
+		TreeReader r2;
+		if(!r2.readTree(t2))
+		{
+			error=true;
+			return ret;
+		}
+
+		gatherDiffs(&(*r1.getNodes())[0], &(*r2.getNodes())[0], 0, ret, modified_inplace_ids, 
+			dir_diffs, deleted_inplace_ids, has_symbit, is_windows);
+		if(deleted_ids!=NULL)
+		{
+			gatherDeletes(&(*r1.getNodes())[0], *deleted_ids);
+		}
+		if(large_unchanged_subtrees!=NULL)
+		{
+			gatherLargeUnchangedSubtrees(&(*r2.getNodes())[0], *large_unchanged_subtrees);
+		}
 	}
 
-	gatherDiffs(&(*r1.getNodes())[0], &(*r2.getNodes())[0], 0, ret, modified_inplace_ids, 
-		dir_diffs, deleted_inplace_ids, has_symbit, is_windows);
 	if(deleted_ids!=NULL)
 	{
-		gatherDeletes(&(*r1.getNodes())[0], *deleted_ids);
 		std::sort(deleted_ids->begin(), deleted_ids->end());
 	}
 	if(large_unchanged_subtrees!=NULL)
 	{
-		gatherLargeUnchangedSubtrees(&(*r2.getNodes())[0], *large_unchanged_subtrees);
 		std::sort(large_unchanged_subtrees->begin(), large_unchanged_subtrees->end());
 	}
 
@@ -110,7 +154,7 @@ void TreeDiff::gatherDiffs(TreeNode *t1, TreeNode *t2, size_t depth, std::vector
 			{
 				if (c2->getType() == sn->getType()
 					&& c2->nameEquals(*sn)
-					&& sn->getMappedNode()==NULL)
+					&& !sn->isMapped())
 				{
 					cmp = 0;
 					c1 = sn;
@@ -136,8 +180,8 @@ void TreeDiff::gatherDiffs(TreeNode *t1, TreeNode *t2, size_t depth, std::vector
 			{
 				gatherDiffs(c1, c2, depth+1, diffs, modified_inplace_ids, 
 					dir_diffs, deleted_inplace_ids, has_symbit, is_windows);
-				c2->setMappedNode(c1);
-				c1->setMappedNode(c2);
+				c2->setMapped(true);
+				c1->setMapped(true);
 			}
 			else
 			{
@@ -196,7 +240,7 @@ void TreeDiff::gatherDeletes(TreeNode *t1, std::vector<size_t> &deleted_ids)
 	TreeNode *c1=t1->getFirstChild();
 	while(c1!=NULL)
 	{
-		if(c1->getMappedNode()==NULL)
+		if(!c1->isMapped())
 		{
 			deleted_ids.push_back(c1->getId());
 		}
@@ -233,7 +277,7 @@ void TreeDiff::gatherLargeUnchangedSubtrees( TreeNode *t2, std::vector<size_t> &
 	while(c2!=NULL)
 	{
 		if(!c2->getSubtreeChanged()
-			&& c2->getMappedNode()!=NULL
+			&& c2->isMapped()
 			&& getTreesize(c2,10)>10)
 		{
 			large_unchanged_subtrees.push_back(c2->getId());
@@ -263,17 +307,22 @@ size_t TreeDiff::getTreesize( TreeNode* t, size_t limit )
 }
 
 bool TreeDiff::isSymlink(TreeNode * n, bool has_symbit, bool is_windows)
+{
+	return isSymlink(n->getType(), n->getDataPtr(), n->getDataSize(), has_symbit, is_windows);
+}
+
+bool TreeDiff::isSymlink(char node_type, const char* data, size_t data_size, bool has_symbit, bool is_windows)
 {
 	uint64 change_indicator = 0;
-	if (n->getType() == 'd'
-		&& n->getDataSize() == sizeof(uint64))
+	if (node_type == 'd'
+		&& data_size == sizeof(uint64))
 	{
-		memcpy(&change_indicator, n->getDataPtr(), sizeof(uint64));
+		memcpy(&change_indicator, data, sizeof(uint64));
 	}
-	else if (n->getType() == 'f'
-		&& n->getDataSize() == 2 * sizeof(uint64))
+	else if (node_type == 'f'
+		&& data_size == 2 * sizeof(uint64))
 	{
-		memcpy(&change_indicator, n->getDataPtr()+sizeof(uint64), sizeof(uint64));
+		memcpy(&change_indicator, data+sizeof(uint64), sizeof(uint64));
 	}
 
 	if (has_symbit)
@@ -294,7 +343,7 @@ bool TreeDiff::isSymlink(TreeNode * n, bool has_symbit, bool is_windows)
 
 		if (is_windows)
 		{
-			if ((!(change_indicator & neg_bit) || n->getType() == 'd')
+			if ((!(change_indicator & neg_bit) || node_type == 'd')
 				&& (change_indicator & symlink_mask) > 0)
 			{
 				return true;
@@ -11,6 +11,8 @@ public:
 		std::vector<size_t> *modified_inplace_ids, std::vector<size_t> &dir_diffs,
 		std::vector<size_t> *deleted_inplace_ids, bool has_symbit, bool is_windows);
 
+	static bool isSymlink(char node_type, const char* data, size_t data_size, bool has_symbit, bool is_windows);
+
 private:
 	static void gatherDiffs(TreeNode *t1, TreeNode *t2, size_t depth, std::vector<size_t> &diffs,
 		std::vector<size_t> *modified_inplace_ids, std::vector<size_t> &dir_diffs,
@@ -21,15 +21,9 @@
 #include <memory.h>
 #include <string.h>
 
-TreeNode::TreeNode(const char* name, const char* data, TreeNode *parent, char node_type)
-	: name(name), data(data), parent(parent), num_children(0), nextSibling(NULL), mapped_node(NULL),
-	  subtree_changed(false), node_type(node_type), id(0)
-{
-}
-
 TreeNode::TreeNode(void)
-	: num_children(0), nextSibling(NULL), mapped_node(NULL), subtree_changed(false), parent(NULL),
-	name(NULL), data(NULL), node_type(0), id(0)
+	: name(NULL), next_sibling(0), parent(0), num_children(0), id(0),
+	data_offset(0), node_type(0), subtree_changed(false), mapped(false)
 {
 }
 
@@ -47,6 +41,7 @@ std::string TreeNode::getName()
 
 std::string TreeNode::getData()
 {
+	const char* data=getDataPtr();
 	if(data!=NULL)
 	{
 		return std::string(data, data+getDataSize());
@@ -59,7 +54,11 @@ std::string TreeNode::getData()
 
 const char * TreeNode::getDataPtr()
 {
-	return data;
+	if(data_offset==0)
+	{
+		return NULL;
+	}
+	return name+data_offset;
 }
 
 void TreeNode::setName(const char* pName)
@@ -69,7 +68,14 @@ void TreeNode::setName(const char* pName)
 
 void TreeNode::setData(const char* pData)
 {
-	data=pData;
+	if(pData==NULL)
+	{
+		data_offset=0;
+	}
+	else
+	{
+		data_offset=static_cast<_u32>(pData-name);
+	}
 }
 
 size_t TreeNode::getNumChildren()
@@ -91,7 +97,14 @@ TreeNode* TreeNode::getFirstChild(void)
 
 void TreeNode::setNextSibling(TreeNode *pNextSibling)
 {
-	nextSibling=pNextSibling;
+	if(pNextSibling==NULL)
+	{
+		next_sibling=0;
+	}
+	else
+	{
+		next_sibling=static_cast<_u32>(pNextSibling-this);
+	}
 }
 
 void TreeNode::incrementNumChildren(void)
@@ -101,7 +114,7 @@ void TreeNode::incrementNumChildren(void)
 
 void TreeNode::setId(size_t pId)
 {
-	id=pId;
+	id=static_cast<_u32>(pId);
 }
 
 size_t TreeNode::getId(void) const
@@ -111,7 +124,11 @@ size_t TreeNode::getId(void) const
 
 TreeNode *TreeNode::getNextSibling(void)
 {
-	return nextSibling;
+	if(next_sibling==0)
+	{
+		return NULL;
+	}
+	return this+next_sibling;
 }
 
 TreeNode* TreeNode::getChild(size_t n)
@@ -135,22 +152,33 @@ TreeNode* TreeNode::getChild(size_t n)
 
 void TreeNode::setParent(TreeNode *pParent)
 {
-	parent=pParent;
+	if(pParent==NULL)
+	{
+		parent=0;
+	}
+	else
+	{
+		parent=static_cast<_u32>(this-pParent);
+	}
 }
 
 TreeNode *TreeNode::getParent(void)
 {
-	return parent;
+	if(parent==0)
+	{
+		return NULL;
+	}
+	return this-parent;
 }
 
-TreeNode *TreeNode::getMappedNode()
+bool TreeNode::isMapped()
 {
-	return mapped_node;
+	return mapped;
 }
 
-void TreeNode::setMappedNode(TreeNode *pMappedNode)
+void TreeNode::setMapped(bool b)
 {
-	mapped_node=pMappedNode;
+	mapped=b;
 }
 
 void TreeNode::setSubtreeChanged( bool b )
@@ -205,13 +233,13 @@ bool TreeNode::dataEquals( const TreeNode& other )
 		return false;
 	}
 
-	if(data!=NULL && other.data!=NULL)
+	if(data_offset!=0 && other.data_offset!=0)
 	{
-		return memcmp(data, other.data, getDataSize())==0;
+		return memcmp(name+data_offset, other.name+other.data_offset, getDataSize())==0;
 	}
 	else
 	{
-		return data==other.data;
+		return data_offset==other.data_offset;
 	}
 }
 
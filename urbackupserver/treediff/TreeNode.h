@@ -9,13 +9,17 @@
 const size_t c_treenode_data_size_file=2*sizeof(int64);
 const size_t c_treenode_data_size_dir=sizeof(int64);
 
+//Node of a file list read by TreeReader. Nodes are stored in one
+//array in file list order and link to each other via 32-bit distances
+//to their array position. Name and data are stored consecutively in
+//the string pool of the TreeReader.
 class TreeNode
 {
 public:
-	TreeNode(const char* name, const char* data, TreeNode *parent, char node_type);
 	TreeNode(void);
 
 	void setName(const char* pName);
+	//Data has to follow the name in the string pool
 	void setData(const char* pData);
 
 	std::string getName();
@@ -42,8 +46,8 @@ public:
 	void setId(size_t pId);
 	size_t getId(void) const;
 
-	TreeNode *getMappedNode();
-	void setMappedNode(TreeNode *pMappedNode);
+	void setMapped(bool b);
+	bool isMapped();
 
 	void setSubtreeChanged(bool b);
 	bool getSubtreeChanged();
@@ -51,18 +55,20 @@ public:
 	size_t getDataSize();
 
 private:
-	char node_type;
-
 	const char* name;
-	const char* data;
 
-	TreeNode *nextSibling;
-	TreeNode *parent;
-	TreeNode *mapped_node;
-	size_t num_children;
-	bool subtree_changed;
+	//Distance to the next sibling/parent in the node array. Zero if
+	//there is none
+	_u32 next_sibling;
+	_u32 parent;
+	_u32 num_children;
+	_u32 id;
+	//Offset of the data after name. Zero if there is no data
+	_u32 data_offset;
 
-	size_t id;
+	char node_type;
+	bool subtree_changed;
+	bool mapped;
 };
 
 
@@ -24,7 +24,10 @@
 #include "../../stringtools.h"
 #include "../../urbackupcommon/os_functions.h"
 #include "../../Interface/Server.h"
+#include "../../urbackupcommon/filelist_utils.h"
 #include <assert.h>
+#include <limits.h>
+#include <memory>
 
 const size_t buffer_size=4096;
 
@@ -40,8 +43,19 @@ bool TreeReader::readTree(const std::string &fn)
 
 	size_t read;
 	char buffer[buffer_size];
+
+	in.read(buffer, c_binary_filelist_magic_size);
+	if(isBinaryFileList(buffer, (size_t)in.gcount()))
+	{
+		in.close();
+		return readBinaryTree(fn);
+	}
+	in.clear();
+	in.seekg(0, std::ios::beg);
+
 	int state=0;
 	size_t lines=0;
+	size_t all_lines=0;
 	size_t stringbuffer_size=0;
 	std::string name;
 	char ltype=0;
@@ -121,6 +135,7 @@ bool TreeReader::readTree(const std::string &fn)
 				if(ch=='\n')
 				{
 					state=0;
+					++all_lines;
 					if(ltype=='f')
 					{
 						stringbuffer_size+=2*sizeof(int64);
@@ -143,6 +158,12 @@ bool TreeReader::readTree(const std::string &fn)
 	}
 	while(read>0);
 
+	if(all_lines>=UINT_MAX)
+	{
+		Log("File tree \""+fn+"\" has too many lines ("+convert(all_lines)+")");
+		return false;
+	}
+
 	in.clear();
 	name.clear();
 	in.seekg(0, std::ios::beg);
@@ -362,6 +383,152 @@ bool TreeReader::readTree(const std::string &fn)
 	return true;
 }
 
+bool TreeReader::readBinaryTree(const std::string &fn)
+{
+	std::auto_ptr<IFile> file(Server->openFile(fn, MODE_READ_SEQUENTIAL));
+	if(file.get()==NULL)
+	{
+		Log("Cannot read file tree from file \"" + fn + "\"");
+		return false;
+	}
+
+	FileListReader reader(file.get());
+	SFile item;
+	size_t lines=0;
+	size_t stringbuffer_size=0;
+	while(reader.nextEntry(item, NULL))
+	{
+		if(item.isdir && item.name=="..")
+		{
+			continue;
+		}
+
+		++lines;
+		stringbuffer_size+=item.name.size()+1;
+		stringbuffer_size+=item.isdir ? c_treenode_data_size_dir : c_treenode_data_size_file;
+	}
+
+	if(reader.hasError())
+	{
+		Log("Error reading binary file tree \""+fn+"\"");
+		return false;
+	}
+
+	if(reader.getId()>=UINT_MAX)
+	{
+		Log("File tree \""+fn+"\" has too many lines ("+convert(reader.getId())+")");
+		return false;
+	}
+
+	reader.seek(c_binary_filelist_magic_size, 0);
+
+	size_t stringbuffer_pos=0;
+	stringbuffer.resize(stringbuffer_size+5);
+
+	std::stack<TreeNode*> parents;
+	std::stack<TreeNode*> lastNodes;
+	bool firstChild=true;
+
+	size_t idx=1;
+	nodes.resize(lines+1);
+
+	std::string root_str = "root";
+	memcpy(&stringbuffer[0], root_str.c_str(), root_str.size()+1);
+	stringbuffer_pos+=root_str.size()+1;
+
+	nodes[0].setName(&stringbuffer[0]);
+
+	parents.push(&nodes[0]);
+	lastNodes.push(&nodes[0]);
+
+	while(reader.nextEntry(item, NULL))
+	{
+		if(item.isdir && item.name=="..")
+		{
+			if(!parents.empty())
+			{
+				parents.pop();
+			}
+			else
+			{
+				Log("TreeReader: parents empty");
+				return false;
+			}
+			if(!firstChild)
+			{
+				if(lastNodes.empty())
+				{
+					Log("TreeReader: lastNodes empty");
+					return false;
+				}
+				lastNodes.top()->setNextSibling(NULL);
+				lastNodes.pop();
+			}
+			firstChild=false;
+			continue;
+		}
+
+		if(idx>=nodes.size())
+		{
+			Log("File tree \""+fn+"\" changed while reading");
+			return false;
+		}
+
+		memcpy(&stringbuffer[stringbuffer_pos], item.name.c_str(), item.name.size()+1);
+		nodes[idx].setName(&stringbuffer[stringbuffer_pos]);
+		stringbuffer_pos+=item.name.size()+1;
+		nodes[idx].setId(static_cast<size_t>(reader.getId()-1));
+		nodes[idx].setType(item.isdir ? 'd' : 'f');
+
+		char* ndata=&stringbuffer[stringbuffer_pos];
+		if(!item.isdir)
+		{
+			memcpy(&stringbuffer[stringbuffer_pos], &item.size, sizeof(_i64));
+			stringbuffer_pos+=sizeof(_i64);
+		}
+		memcpy(&stringbuffer[stringbuffer_pos], &item.last_modified, sizeof(_i64));
+		stringbuffer_pos+=sizeof(_i64);
+		nodes[idx].setData(ndata);
+
+		if(firstChild)
+		{
+			lastNodes.push(&nodes[idx]);
+			firstChild=false;
+		}
+		else
+		{
+			lastNodes.top()->setNextSibling(&nodes[idx]);
+			lastNodes.pop();
+			lastNodes.push(&nodes[idx]);
+		}
+
+		if(!parents.empty())
+		{
+			parents.top()->incrementNumChildren();
+			nodes[idx].setParent(parents.top());
+		}
+
+		if(item.isdir)
+		{
+			parents.push(&nodes[idx]);
+			firstChild=true;
+		}
+
+		++idx;
+	}
+
+	if(reader.hasError()
+		|| idx!=nodes.size())
+	{
+		Log("Error reading binary file tree \""+fn+"\"");
+		return false;
+	}
+
+	nodes[0].setNextSibling(NULL);
+
+	return true;
+}
+
 void TreeReader::Log(const std::string &str)
 {
 	Server->Log(str, LL_ERROR);
@@ -370,4 +537,9 @@ void TreeReader::Log(const std::string &str)
 std::vector<TreeNode> * TreeReader::getNodes(void)
 {
 	return &nodes;
-}
\ No newline at end of file
+}
+
+size_t TreeReader::getMemoryUsage(void)
+{
+	return nodes.capacity()*sizeof(TreeNode) + stringbuffer.capacity();
+}
\ No newline at end of file
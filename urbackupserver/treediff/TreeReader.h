@@ -6,7 +6,10 @@ public:
 	bool readTree(const std::string &fn);
 
 	std::vector<TreeNode> * getNodes(void);
+
+	size_t getMemoryUsage(void);
 private:
+	bool readBinaryTree(const std::string &fn);
 
 	void Log(const std::string &str);
 
@@ -0,0 +1,415 @@
+/*************************************************************************
+*    UrBackup - Client/Server backup system
+*    Copyright (C) 2011-2016 Martin Raiber
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU Affero General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#include "TreeStreamReader.h"
+#include <memory.h>
+#include <string.h>
+#include "../../stringtools.h"
+#include "../../urbackupcommon/os_functions.h"
+#include "../../Interface/Server.h"
+#include <algorithm>
+
+const size_t stream_buffer_size=64*1024;
+
+size_t TreeStreamReader::SEntry::getDataSize() const
+{
+	if(type=='d')
+	{
+		return c_treenode_data_size_dir;
+	}
+	else
+	{
+		return c_treenode_data_size_file;
+	}
+}
+
+bool TreeStreamReader::SEntry::dataEquals(const SEntry& other) const
+{
+	if(type!=other.type)
+	{
+		return false;
+	}
+
+	return memcmp(data, other.data, getDataSize())==0;
+}
+
+bool TreeStreamReader::SEntry::nameEquals(const SEntry& other) const
+{
+	return name==other.name;
+}
+
+int TreeStreamReader::SEntry::nameCompare(const SEntry& other) const
+{
+	return strcmp(name.c_str(), other.name.c_str());
+}
+
+TreeStreamReader::TreeStreamReader()
+	: buffer(stream_buffer_size), buffer_pos(0), buffer_size(0),
+	buffer_offset(0), line(0), eof(false), has_dir_index(false),
+	last_dir_offset(-1)
+{
+}
+
+namespace
+{
+	bool dirIndexOffsetLess(const SFileListDirIndex& idx, int64 offset)
+	{
+		return idx.offset<offset;
+	}
+}
+
+bool TreeStreamReader::open(const std::string& pFn)
+{
+	fn=pFn;
+	in.open(fn.c_str(), std::ios::in | std::ios::binary );
+	if (!in.is_open())
+	{
+		Log("Cannot read file tree from file \"" + fn + "\"");
+		return false;
+	}
+
+	char header[c_binary_filelist_magic_size];
+	in.read(header, c_binary_filelist_magic_size);
+	if(isBinaryFileList(header, (size_t)in.gcount()))
+	{
+		in.close();
+		binary_file.reset(Server->openFile(fn, MODE_READ));
+		if(binary_file.get()==NULL)
+		{
+			Log("Cannot read binary file tree from file \"" + fn + "\"");
+			return false;
+		}
+		binary_reader.reset(new FileListReader(binary_file.get()));
+		has_dir_index = binary_reader->readDirIndex(dir_index);
+		return true;
+	}
+
+	in.clear();
+	in.seekg(0, std::ios::beg);
+	return true;
+}
+
+bool TreeStreamReader::seek(int64 offset, size_t pLine)
+{
+	if(binary_reader.get()!=NULL)
+	{
+		binary_reader->seek(offset, pLine);
+		line=pLine;
+		eof=false;
+		return true;
+	}
+
+	in.clear();
+	in.seekg(offset, std::ios::beg);
+	if(!in.good())
+	{
+		Log("Error seeking to offset "+convert(offset)+" in file tree \""+fn+"\"");
+		return false;
+	}
+
+	buffer_offset=offset;
+	buffer_pos=0;
+	buffer_size=0;
+	line=pLine;
+	eof=false;
+	return true;
+}
+
+bool TreeStreamReader::nextChar(char& ch)
+{
+	if(buffer_pos>=buffer_size)
+	{
+		if(eof)
+		{
+			return false;
+		}
+
+		buffer_offset+=buffer_size;
+		buffer_pos=0;
+		in.read(buffer.data(), buffer.size());
+		buffer_size=(size_t)in.gcount();
+
+		if(buffer_size==0)
+		{
+			eof=true;
+			return false;
+		}
+	}
+
+	ch=buffer[buffer_pos++];
+	return true;
+}
+
+bool TreeStreamReader::next(SEntry& entry)
+{
+	if(binary_reader.get()!=NULL)
+	{
+		return nextBinary(entry);
+	}
+
+	entry.name.clear();
+	data.clear();
+	entry.offset=buffer_offset+buffer_pos;
+	entry.id=line;
+	entry.type='u';
+
+	char ch;
+	if(!nextChar(ch))
+	{
+		return true;
+	}
+
+	int state;
+	if(ch=='f' || ch=='d')
+	{
+		entry.type=ch;
+		state=1;
+	}
+	else if(ch=='u')
+	{
+		state=10;
+	}
+	else
+	{
+		Log("Error parsing file tree. Expected 'f', 'd', or 'u'. Got '"+std::string(1, ch)+"' at line "+convert(line)+" while reading "+fn);
+		return false;
+	}
+
+	while(nextChar(ch))
+	{
+		switch(state)
+		{
+		case 1:
+			//"
+			state=2;
+			break;
+		case 2:
+			if(ch=='"')
+			{
+				state=3;
+			}
+			else if(ch=='\\')
+			{
+				state=5;
+			}
+			else
+			{
+				entry.name+=ch;
+			}
+			break;
+		case 5:
+			if(ch!='\"' && ch!='\\')
+			{
+				entry.name+='\\';
+			}
+			entry.name+=ch;
+			state=2;
+			break;
+		case 3:
+			if(ch==' ')
+			{
+				state=4;
+				break;
+			}
+			else
+			{
+				state=10;
+			}
+		case 4:
+			if(state==4)
+			{
+				if(ch!='\n')
+				{
+					data+=ch;
+					break;
+				}
+			}
+		case 10:
+			if(ch=='\n')
+			{
+				++line;
+
+				if(entry.type=='d' && entry.name=="..")
+				{
+					//Same as TreeReader
+					entry.type='u';
+					entry.name.clear();
+				}
+				else if(entry.type=='d')
+				{
+					last_dir_offset=entry.offset;
+				}
+
+				if(entry.type=='f')
+				{
+					_i64 filesize=os_atoi64(getuntil(" ", data));
+					_i64 last_mod=os_atoi64(getafter(" ", data));
+					memcpy(entry.data, &filesize, sizeof(_i64));
+					memcpy(entry.data+sizeof(_i64), &last_mod, sizeof(_i64));
+				}
+				else if(entry.type=='d')
+				{
+					_i64 last_mod=os_atoi64(getafter(" ", data));
+					memcpy(entry.data, &last_mod, sizeof(_i64));
+				}
+
+				return true;
+			}
+		}
+	}
+
+	//Incomplete last line
+	entry.type='u';
+	return true;
+}
+
+bool TreeStreamReader::nextBinary(SEntry& entry)
+{
+	entry.id=line;
+
+	if(!binary_reader->nextEntry(binary_item, NULL))
+	{
+		entry.offset=binary_reader->getEntryOffset();
+		entry.type='u';
+		entry.name.clear();
+
+		if(binary_reader->hasError())
+		{
+			return false;
+		}
+
+		eof=true;
+		return true;
+	}
+
+	entry.offset=binary_reader->getEntryOffset();
+	++line;
+
+	if(!binary_item.isdir)
+	{
+		entry.type='f';
+		entry.name.swap(binary_item.name);
+		memcpy(entry.data, &binary_item.size, sizeof(_i64));
+		memcpy(entry.data+sizeof(_i64), &binary_item.last_modified, sizeof(_i64));
+	}
+	else if(binary_item.name=="..")
+	{
+		entry.type='u';
+		entry.name.clear();
+	}
+	else
+	{
+		entry.type='d';
+		entry.name.swap(binary_item.name);
+		memcpy(entry.data, &binary_item.last_modified, sizeof(_i64));
+		last_dir_offset=entry.offset;
+	}
+
+	return true;
+}
+
+bool TreeStreamReader::skipIndexedSubtree(size_t& n_nodes)
+{
+	std::vector<SFileListDirIndex>::const_iterator it =
+		std::lower_bound(dir_index.begin(), dir_index.end(), last_dir_offset, dirIndexOffsetLess);
+
+	if(it==dir_index.end()
+		|| it->offset!=last_dir_offset
+		|| it->end_offset<=it->offset)
+	{
+		return false;
+	}
+
+	n_nodes+=static_cast<size_t>(it->n_nodes);
+	return seek(it->end_offset, static_cast<size_t>(it->end_id));
+}
+
+const std::vector<SFileListDirIndex>* TreeStreamReader::getDirIndex()
+{
+	return has_dir_index ? &dir_index : NULL;
+}
+
+bool TreeStreamReader::skipSubtree(std::vector<size_t>* ids, size_t& n_nodes)
+{
+	if(ids==NULL
+		&& has_dir_index
+		&& skipIndexedSubtree(n_nodes))
+	{
+		return true;
+	}
+
+	SEntry entry;
+	size_t depth=1;
+	while(depth>0)
+	{
+		if(!next(entry))
+		{
+			return false;
+		}
+
+		if(entry.type=='u')
+		{
+			if(isEof())
+			{
+				return true;
+			}
+			--depth;
+		}
+		else
+		{
+			++n_nodes;
+			if(ids!=NULL)
+			{
+				ids->push_back(entry.id);
+			}
+			if(entry.type=='d')
+			{
+				++depth;
+			}
+		}
+	}
+	return true;
+}
+
+bool TreeStreamReader::isEof()
+{
+	if(binary_reader.get()!=NULL)
+	{
+		return eof;
+	}
+	return eof && buffer_pos>=buffer_size;
+}
+
+int64 TreeStreamReader::getOffset()
+{
+	if(binary_reader.get()!=NULL)
+	{
+		return binary_reader->getOffset();
+	}
+	return buffer_offset+buffer_pos;
+}
+
+size_t TreeStreamReader::getLine()
+{
+	return line;
+}
+
+void TreeStreamReader::Log(const std::string &str)
+{
+	Server->Log(str, LL_ERROR);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+
+#include "TreeNode.h"
+#include "../../urbackupcommon/filelist_utils.h"
+
+//Reads a file list one entry at a time instead of building all nodes
+//in memory like TreeReader. Binary file lists are read via FileListReader
+class TreeStreamReader
+{
+public:
+	struct SEntry
+	{
+		//'f', 'd' or 'u'. Also 'u' at the end of the file
+		char type;
+		std::string name;
+		char data[c_treenode_data_size_file];
+		//Line of the entry. Same as TreeNode::getId()
+		size_t id;
+		//File offset of the start of the line
+		int64 offset;
+
+		size_t getDataSize() const;
+		bool dataEquals(const SEntry& other) const;
+		bool nameEquals(const SEntry& other) const;
+		int nameCompare(const SEntry& other) const;
+	};
+
+	TreeStreamReader();
+
+	bool open(const std::string& fn);
+
+	//Continues reading at offset, which has to be at the start of line
+	bool seek(int64 offset, size_t line);
+
+	//Returns false on parse error
+	bool next(SEntry& entry);
+
+	//Skips the children of the directory entry last returned by next().
+	//Adds the ids of all skipped nodes to ids if it is not NULL.
+	//Uses the directory index of binary file lists if ids is NULL
+	bool skipSubtree(std::vector<size_t>* ids, size_t& n_nodes);
+
+	//Directory index of binary file lists. NULL if there is none
+	const std::vector<SFileListDirIndex>* getDirIndex();
+
+	bool isEof();
+
+	int64 getOffset();
+	size_t getLine();
+
+private:
+	bool nextChar(char& ch);
+	bool nextBinary(SEntry& entry);
+	bool skipIndexedSubtree(size_t& n_nodes);
+	void Log(const std::string &str);
+
+	std::string fn;
+	std::fstream in;
+	std::vector<char> buffer;
+	size_t buffer_pos;
+	size_t buffer_size;
+	int64 buffer_offset;
+	size_t line;
+	bool eof;
+
+	std::string data;
+
+	std::auto_ptr<IFile> binary_file;
+	std::auto_ptr<FileListReader> binary_reader;
+	SFile binary_item;
+	bool has_dir_index;
+	std::vector<SFileListDirIndex> dir_index;
+	int64 last_dir_offset;
+};
@@ -65,7 +65,7 @@
 (function(){dust.register("stat_general",body_0);function body_0(chk,ctx){return chk.w("<div class=\"panel panel-default\"><div class=\"panel-heading\">").f(ctx.get(["tStorage usage"], false),ctx,"h").w("</div><div class=\"panel-body\"><div id=\"usagegraph\"><img src=\"images/indicator.gif\" />").f(ctx.get(["tLoading"], false),ctx,"h").w("...</div><br/>&nbsp;<br/></div></div>").x(ctx.get(["maximized"], false),ctx,{"block":body_1},{}).w("<div class=\"panel panel-default\"><div class=\"panel-heading\">").f(ctx.get(["tBackup Statistics"], false),ctx,"h").w("</div><div class=\"panel-body\">").nx(ctx.get(["maximized"], false),ctx,{"block":body_2},{}).w("<table id=\"statistics_table\" class=\"table table-striped\"><thead><tr>\t\t\t<th>").f(ctx.get(["tComputer name"], false),ctx,"h").w("</th><th>").f(ctx.get(["tImages"], false),ctx,"h").w("</th><th>").f(ctx.get(["tFiles"], false),ctx,"h").w("</th><th>").f(ctx.get(["tAll"], false),ctx,"h").w("</th></tr></thead><tbody>").f(ctx.get(["rows"], false),ctx,"h",["s"]).w("</tbody></table><div class=\"panel panel-primary\"><div class=\"panel-heading\">").f(ctx.get(["tSum"], false),ctx,"h").w("</div><div class=\"panel-body\"><table class=\"table table-striped\"><tr><td>").f(ctx.get(["tImages"], false),ctx,"h").w("</td><td>").f(ctx.get(["images_total"], false),ctx,"h").w("</td></tr><tr><td>").f(ctx.get(["tFiles"], false),ctx,"h").w("</td><td>").f(ctx.get(["files_total"], false),ctx,"h").w("</td></tr><tr><td>").f(ctx.get(["tAll"], false),ctx,"h").w("</td><td>").f(ctx.get(["used_total"], false),ctx,"h").w("</td></tr></table><button class=\"btn btn-default\" onclick=\"recalculateStatistics()\">").f(ctx.get(["tRecalculate statistics"], false),ctx,"h").w("</button></div></div>").nx(ctx.get(["maximized"], false),ctx,{"block":body_3},{}).w("</div></div>").x(ctx.get(["maximized"], false),ctx,{"block":body_4},{}).w("<div class=\"panel panel-default\"><div class=\"panel-heading\">").f(ctx.get(["tStorage allocation"], false),ctx,"h").w("</div><div class=\"panel-body\"><div id=\"piegraph\"><img src=\"images/indicator.gif\" />").f(ctx.get(["tLoading"], false),ctx,"h").w("...</div></div></div>").x(ctx.get(["maximized"], false),ctx,{"block":body_5},{});}body_0.__dustBody=!0;function body_1(chk,ctx){return chk.w("<div class=\"row\"><div class=\"col-lg-6\">");}body_1.__dustBody=!0;function body_2(chk,ctx){return chk.w("<div class=\"row\"><div class=\"col-lg-8\">");}body_2.__dustBody=!0;function body_3(chk,ctx){return chk.w("</div></div>");}body_3.__dustBody=!0;function body_4(chk,ctx){return chk.w("</div><div class=\"col-lg-6\">");}body_4.__dustBody=!0;function body_5(chk,ctx){return chk.w("</div></div> <!-- row -->");}body_5.__dustBody=!0;return body_0;})();
 (function(){dust.register("stat_user",body_0);function body_0(chk,ctx){return chk.w("<div class=\"panel panel-default\"><div class=\"panel-heading\">").f(ctx.get(["tStorage usage of"], false),ctx,"h").w(" ").f(ctx.get(["clientname"], false),ctx,"h").w("</div><div class=\"panel-body\"><div id=\"usagegraph\"><img src=\"images/indicator.gif\" />").f(ctx.get(["tLoading"], false),ctx,"h").w("...</div><br/>&nbsp;<br/></div></div>");}body_0.__dustBody=!0;return body_0;})();
 (function(){dust.register("status_client_download",body_0);function body_0(chk,ctx){return chk.w("<select id=\"download_client_").f(ctx.get(["os"], false),ctx,"h").w("\" class=\"selectpicker\" data-live-search=\"true\" onChange=\"downloadClient(-1, null, '").f(ctx.get(["os"], false),ctx,"h").w("')\" data-title=\"").x(ctx.get(["os_windows"], false),ctx,{"block":body_1},{}).x(ctx.get(["os_mac"], false),ctx,{"block":body_2},{}).x(ctx.get(["os_linux"], false),ctx,{"block":body_3},{}).w("\" data-style=\"btn btn-sm btn-default\" data-width=\"15em\" data-container=\"body\">").f(ctx.get(["download_clients"], false),ctx,"h",["s"]).w("</select>");}body_0.__dustBody=!0;function body_1(chk,ctx){return chk.f(ctx.get(["tDownload client for Windows"], false),ctx,"h");}body_1.__dustBody=!0;function body_2(chk,ctx){return chk.f(ctx.get(["tDownload client for Mac OS X"], false),ctx,"h");}body_2.__dustBody=!0;function body_3(chk,ctx){return chk.f(ctx.get(["tDownload client for Linux"], false),ctx,"h");}body_3.__dustBody=!0;return body_0;})();
-(function(){dust.register("status_detail",body_0);function body_0(chk,ctx){return chk.w("<div class=\"alert alert-info\" id=\"new_version_available\" style=\"margin: 0; padding: 0; height: 0; visibility: hidden;\"></div><div class=\"alert alert-info\" id=\"has_ident_error_clients\" style=\"margin: 0; padding: 0; height: 0; visibility: hidden;\"></div><div class=\"panel panel-default\"><div class=\"panel-heading\">").f(ctx.get(["tBackup status"], false),ctx,"h").w("</div><div class=\"panel-body\">").f(ctx.get(["nospc_fatal"], false),ctx,"h",["s"]).f(ctx.get(["nospc_stalled"], false),ctx,"h",["s"]).f(ctx.get(["database_error"], false),ctx,"h",["s"]).f(ctx.get(["endian_info"], false),ctx,"h",["s"]).w("<span id=\"delayed_status_errors\"></span><table id=\"status_table\" class=\"table table-striped dt-responsive\" width=\"100%\"><thead><tr>").x(ctx.get(["show_select_box"], false),ctx,{"block":body_1},{}).w("<th>").f(ctx.get(["tComputer name"], false),ctx,"h").w("</th><th>").f(ctx.get(["tGroup name"], false),ctx,"h").w("</th><th>").f(ctx.get(["tOnline"], false),ctx,"h").w("</th><th>").f(ctx.get(["tStatus"], false),ctx,"h").w("</th><th>").f(ctx.get(["tLast seen"], false),ctx,"h").w("</th><th>").f(ctx.get(["tLast file backup"], false),ctx,"h").w("</th><th>").f(ctx.get(["tLast image backup"], false),ctx,"h").w("</th><th>").f(ctx.get(["tFile backup status"], false),ctx,"h").w("</th><th>").f(ctx.get(["tImage backup status"], false),ctx,"h").w("</th><th>").f(ctx.get(["tIP"], false),ctx,"h").w("</th><th>").f(ctx.get(["tClient version"], false),ctx,"h").w("</th><th>").f(ctx.get(["tOperating System"], false),ctx,"h").w("</th></tr></thead><tbody>").f(ctx.get(["rows"], false),ctx,"h",["s"]).w("</tbody></table><div class=\"btn-toolbar\">").x(ctx.get(["status_can_show_all"], false),ctx,{"block":body_2},{}).f(ctx.get(["modify_clients"], false),ctx,"h",["s"]).x(ctx.get(["has_client_download"], false),ctx,{"block":body_3},{}).x(ctx.get(["allow_add_client"], false),ctx,{"block":body_4},{}).w("</div>").x(ctx.get(["removed_clients_table"], false),ctx,{"block":body_5},{}).w("</div></div>").x(ctx.get(["status_extra_clients"], false),ctx,{"block":body_8},{}).w("</div>");}body_0.__dustBody=!0;function body_1(chk,ctx){return chk.w("<th><input type=\"checkbox\" id=\"status_selected_toggle\" onClick=\"selectClientsToggle()\"/><select onchange=\"startBackups(I('startbackup_toggle')[I('startbackup_toggle').selectedIndex].value)\" id=\"startbackup_toggle\"style=\"margin-left:5px; display:none;\" class=\"selectpicker\" data-width=\"20px\"  data-container=\"#data_f\" data-style=\"btn btn-xs\" title=\"\"><option value=\"incr_file\">").f(ctx.get(["tIncremental file backup"], false),ctx,"h").w("</option><option value=\"full_file\">").f(ctx.get(["tFull file backup"], false),ctx,"h").w("</option><option value=\"incr_image\">").f(ctx.get(["tIncremental image backup"], false),ctx,"h").w("</option><option value=\"full_image\">").f(ctx.get(["tFull image backup"], false),ctx,"h").w("</option><option value=\"remove\">").f(ctx.get(["tRemove client"], false),ctx,"h").w("</option></select></th>");}body_1.__dustBody=!0;function body_2(chk,ctx){return chk.w("<div class=\"btn-group\"><a class=\"btn btn-sm btn-default\" href=\"javascript: g.status_show_all=true; show_status1();\">").f(ctx.get(["tShow all clients"], false),ctx,"h").w("</a></div>");}body_2.__dustBody=!0;function body_3(chk,ctx){return chk.w("<div class=\"btn-group\">").f(ctx.get(["status_client_download_windows"], false),ctx,"h",["s"]).f(ctx.get(["status_client_download_mac"], false),ctx,"h",["s"]).f(ctx.get(["status_client_download_linux"], false),ctx,"h",["s"]).w("</div>");}body_3.__dustBody=!0;function body_4(chk,ctx){return chk.w("<div class=\"btn-group\"><a class=\"btn btn-sm btn-primary\" href=\"javascript: addNewClient1();\"><span class=\"glyphicon glyphicon-plus\" aria-hidden=\"true\"></span> ").f(ctx.get(["tAdd new client"], false),ctx,"h").w("</a></div>");}body_4.__dustBody=!0;function body_5(chk,ctx){return chk.w("<div style=\"margin-top: 20px\"><table id=\"status_table\" class=\"table table-striped\"><thead><tr><th>").f(ctx.get(["tComputer name"], false),ctx,"h").w("</th><th>&nbsp;</th></tr></thead><tbody>").s(ctx.get(["removed_clients"], false),ctx,{"block":body_6},{}).w("</tbody></table></div>");}body_5.__dustBody=!0;function body_6(chk,ctx){return chk.w("<tr><td>").f(ctx.get(["name"], false),ctx,"h").w("</td><td>").f(ctx.get(["tThis client is going to be removed. "], false),ctx,"h").w("&#32;").x(ctx.get(["remove_client"], false),ctx,{"block":body_7},{}).f(ctx.get(["tClients are removed during the cleanup in the cleanup time window. "], false),ctx,"h").w("</td></tr>");}body_6.__dustBody=!0;function body_7(chk,ctx){return chk.w("<a href=\"javascript: stopRemove(").f(ctx.get(["id"], false),ctx,"h").w(")\">").f(ctx.get(["tStop removing client"], false),ctx,"h").w("</a>.&#32;");}body_7.__dustBody=!0;function body_8(chk,ctx){return chk.w("<div class=\"panel panel-default\"><div class=\"panel-heading\">").f(ctx.get(["tClient discovery hints"], false),ctx,"h").w("</div><div class=\"panel-body\"><table class=\"table table-hover\"><thead><tr>\t\t\t<th>").f(ctx.get(["tHostname/IP"], false),ctx,"h").w("</th><th>").f(ctx.get(["tOnline"], false),ctx,"h").w("</th><th>").f(ctx.get(["tActions"], false),ctx,"h").w("</th></tr></thead><tbody>").f(ctx.get(["extra_clients_rows"], false),ctx,"h",["s"]).w("</tbody></table><form class=\"form\" action=\"#\" onsubmit=\"addExtraClient(); return false;\" role=\"form\"><div class=\"form-group\"><label for=\"hostname\">").f(ctx.get(["tAdd hostname/IP as client discovery hint"], false),ctx,"h").w(":</label><input type=\"text\" class=\"form-control\" id=\"hostname\" value=\"\" placeholder=\"").f(ctx.get(["tHostname/IP"], false),ctx,"h").w("\"/></div><input type=\"submit\" class=\"btn btn-default\" value=\"").f(ctx.get(["tAdd"], false),ctx,"h").w("\"/></form></div></div>");}body_8.__dustBody=!0;return body_0;})();
+(function(){dust.register("status_detail",body_0);function body_0(chk,ctx){return chk.w("<div class=\"alert alert-info\" id=\"new_version_available\" style=\"margin: 0; padding: 0; height: 0; visibility: hidden;\"></div><div class=\"alert alert-info\" id=\"has_ident_error_clients\" style=\"margin: 0; padding: 0; height: 0; visibility: hidden;\"></div><div class=\"panel panel-default\"><div class=\"panel-heading\">").f(ctx.get(["tBackup status"], false),ctx,"h").w("</div><div class=\"panel-body\">").f(ctx.get(["nospc_fatal"], false),ctx,"h",["s"]).f(ctx.get(["nospc_stalled"], false),ctx,"h",["s"]).f(ctx.get(["database_error"], false),ctx,"h",["s"]).f(ctx.get(["endian_info"], false),ctx,"h",["s"]).w("<span id=\"delayed_status_errors\"></span><table id=\"status_table\" class=\"table table-striped dt-responsive\" width=\"100%\"><thead><tr>").x(ctx.get(["show_select_box"], false),ctx,{"block":body_1},{}).w("<th>").f(ctx.get(["tComputer name"], false),ctx,"h").w("</th><th>").f(ctx.get(["tGroup name"], false),ctx,"h").w("</th><th>").f(ctx.get(["tOnline"], false),ctx,"h").w("</th><th>").f(ctx.get(["tStatus"], false),ctx,"h").w("</th><th>").f(ctx.get(["tLast seen"], false),ctx,"h").w("</th><th>").f(ctx.get(["tLast file backup"], false),ctx,"h").w("</th><th>").f(ctx.get(["tLast image backup"], false),ctx,"h").w("</th><th>").f(ctx.get(["tFile backup status"], false),ctx,"h").w("</th><th>").f(ctx.get(["tImage backup status"], false),ctx,"h").w("</th><th>").f(ctx.get(["tIP"], false),ctx,"h").w("</th><th>").f(ctx.get(["tClient version"], false),ctx,"h").w("</th><th>").f(ctx.get(["tOperating System"], false),ctx,"h").w("</th></tr></thead><tbody>").f(ctx.get(["rows"], false),ctx,"h",["s"]).w("</tbody></table><div class=\"btn-toolbar\">").x(ctx.get(["status_can_show_all"], false),ctx,{"block":body_2},{}).f(ctx.get(["modify_clients"], false),ctx,"h",["s"]).x(ctx.get(["has_client_download"], false),ctx,{"block":body_3},{}).x(ctx.get(["allow_add_client"], false),ctx,{"block":body_4},{}).w("</div>").x(ctx.get(["removed_clients_table"], false),ctx,{"block":body_5},{}).w("</div></div>").x(ctx.get(["fileindex_filter"], false),ctx,{"block":body_8},{}).x(ctx.get(["status_extra_clients"], false),ctx,{"block":body_9},{}).w("</div>");}body_0.__dustBody=!0;function body_1(chk,ctx){return chk.w("<th><input type=\"checkbox\" id=\"status_selected_toggle\" onClick=\"selectClientsToggle()\"/><select onchange=\"startBackups(I('startbackup_toggle')[I('startbackup_toggle').selectedIndex].value)\" id=\"startbackup_toggle\"style=\"margin-left:5px; display:none;\" class=\"selectpicker\" data-width=\"20px\"  data-container=\"#data_f\" data-style=\"btn btn-xs\" title=\"\"><option value=\"incr_file\">").f(ctx.get(["tIncremental file backup"], false),ctx,"h").w("</option><option value=\"full_file\">").f(ctx.get(["tFull file backup"], false),ctx,"h").w("</option><option value=\"incr_image\">").f(ctx.get(["tIncremental image backup"], false),ctx,"h").w("</option><option value=\"full_image\">").f(ctx.get(["tFull image backup"], false),ctx,"h").w("</option><option value=\"remove\">").f(ctx.get(["tRemove client"], false),ctx,"h").w("</option></select></th>");}body_1.__dustBody=!0;function body_2(chk,ctx){return chk.w("<div class=\"btn-group\"><a class=\"btn btn-sm btn-default\" href=\"javascript: g.status_show_all=true; show_status1();\">").f(ctx.get(["tShow all clients"], false),ctx,"h").w("</a></div>");}body_2.__dustBody=!0;function body_3(chk,ctx){return chk.w("<div class=\"btn-group\">").f(ctx.get(["status_client_download_windows"], false),ctx,"h",["s"]).f(ctx.get(["status_client_download_mac"], false),ctx,"h",["s"]).f(ctx.get(["status_client_download_linux"], false),ctx,"h",["s"]).w("</div>");}body_3.__dustBody=!0;function body_4(chk,ctx){return chk.w("<div class=\"btn-group\"><a class=\"btn btn-sm btn-primary\" href=\"javascript: addNewClient1();\"><span class=\"glyphicon glyphicon-plus\" aria-hidden=\"true\"></span> ").f(ctx.get(["tAdd new client"], false),ctx,"h").w("</a></div>");}body_4.__dustBody=!0;function body_5(chk,ctx){return chk.w("<div style=\"margin-top: 20px\"><table id=\"status_table\" class=\"table table-striped\"><thead><tr><th>").f(ctx.get(["tComputer name"], false),ctx,"h").w("</th><th>&nbsp;</th></tr></thead><tbody>").s(ctx.get(["removed_clients"], false),ctx,{"block":body_6},{}).w("</tbody></table></div>");}body_5.__dustBody=!0;function body_6(chk,ctx){return chk.w("<tr><td>").f(ctx.get(["name"], false),ctx,"h").w("</td><td>").f(ctx.get(["tThis client is going to be removed. "], false),ctx,"h").w("&#32;").x(ctx.get(["remove_client"], false),ctx,{"block":body_7},{}).f(ctx.get(["tClients are removed during the cleanup in the cleanup time window. "], false),ctx,"h").w("</td></tr>");}body_6.__dustBody=!0;function body_7(chk,ctx){return chk.w("<a href=\"javascript: stopRemove(").f(ctx.get(["id"], false),ctx,"h").w(")\">").f(ctx.get(["tStop removing client"], false),ctx,"h").w("</a>.&#32;");}body_7.__dustBody=!0;function body_8(chk,ctx){return chk.w("<div class=\"panel panel-default\"><div class=\"panel-heading\">").f(ctx.get(["tFile entry index filter"], false),ctx,"h").w("</div><div class=\"panel-body\"><table class=\"table table-condensed\"><tbody><tr><td>").f(ctx.get(["tEntries"], false),ctx,"h").w("</td><td>").f(ctx.get(["fileindex_filter.entries"], false),ctx,"h").w(" / ").f(ctx.get(["fileindex_filter.capacity"], false),ctx,"h").w("</td></tr><tr><td>").f(ctx.get(["tMemory usage"], false),ctx,"h").w("</td><td>").f(ctx.get(["fileindex_filter.memory_size"], false),ctx,"h").w("</td></tr><tr><td>").f(ctx.get(["tFalse positive rate"], false),ctx,"h").w("</td><td>").f(ctx.get(["fileindex_filter.false_positive_rate"], false),ctx,"h").w("</td></tr><tr><td>").f(ctx.get(["tExpected false positive rate"], false),ctx,"h").w("</td><td>").f(ctx.get(["fileindex_filter.expected_false_positive_rate"], false),ctx,"h").w("</td></tr></tbody></table></div></div>");}body_8.__dustBody=!0;function body_9(chk,ctx){return chk.w("<div class=\"panel panel-default\"><div class=\"panel-heading\">").f(ctx.get(["tClient discovery hints"], false),ctx,"h").w("</div><div class=\"panel-body\"><table class=\"table table-hover\"><thead><tr>\t\t\t<th>").f(ctx.get(["tHostname/IP"], false),ctx,"h").w("</th><th>").f(ctx.get(["tOnline"], false),ctx,"h").w("</th><th>").f(ctx.get(["tActions"], false),ctx,"h").w("</th></tr></thead><tbody>").f(ctx.get(["extra_clients_rows"], false),ctx,"h",["s"]).w("</tbody></table><form class=\"form\" action=\"#\" onsubmit=\"addExtraClient(); return false;\" role=\"form\"><div class=\"form-group\"><label for=\"hostname\">").f(ctx.get(["tAdd hostname/IP as client discovery hint"], false),ctx,"h").w(":</label><input type=\"text\" class=\"form-control\" id=\"hostname\" value=\"\" placeholder=\"").f(ctx.get(["tHostname/IP"], false),ctx,"h").w("\"/></div><input type=\"submit\" class=\"btn btn-default\" value=\"").f(ctx.get(["tAdd"], false),ctx,"h").w("\"/></form></div></div>");}body_9.__dustBody=!0;return body_0;})();
 (function(){dust.register("status_detail_extra_row",body_0);function body_0(chk,ctx){return chk.w("<tr><td>").f(ctx.get(["hostname"], false),ctx,"h").w("</td><td>").f(ctx.get(["online"], false),ctx,"h").w("</td><td><input type=\"button\" class=\"btn btn-default\" value=\"").f(ctx.get(["tRemove"], false),ctx,"h").w("\" onClick=\"removeExtraClient(").f(ctx.get(["id"], false),ctx,"h").w(")\"></td></tr>");}body_0.__dustBody=!0;return body_0;})();
 (function(){dust.register("status_detail_row",body_0);function body_0(chk,ctx){return chk.w("<tr>").x(ctx.get(["show_select_box"], false),ctx,{"block":body_1},{}).w("<td>").f(ctx.get(["name"], false),ctx,"h").w("</td><td>").f(ctx.get(["groupname"], false),ctx,"h").w("</td><td>").f(ctx.get(["online"], false),ctx,"h").w("</td><td>").f(ctx.get(["status"], false),ctx,"h",["s"]).w("</td><td>").f(ctx.get(["lastseen"], false),ctx,"h").w("</td><td>").f(ctx.get(["lastbackup"], false),ctx,"h").f(ctx.get(["start_file_backup"], false),ctx,"h",["s"]).w("</td><td>").f(ctx.get(["lastbackup_image"], false),ctx,"h").f(ctx.get(["start_image_backup"], false),ctx,"h",["s"]).w("</td><td class=\"").f(ctx.get(["file_style"], false),ctx,"h").w("\">").f(ctx.get(["file_ok_t"], false),ctx,"h").w("</td><td class=\"").f(ctx.get(["image_style"], false),ctx,"h").w("\">").f(ctx.get(["image_ok_t"], false),ctx,"h").w("</td><td>").f(ctx.get(["ip"], false),ctx,"h").w("</td><td>").f(ctx.get(["client_version_string"], false),ctx,"h").w("</td><td>").f(ctx.get(["os_version_string"], false),ctx,"h").w("</td></tr>");}body_0.__dustBody=!0;function body_1(chk,ctx){return chk.w("<td><input type=\"checkbox\" name=\"status_selected\" value=\"").f(ctx.get(["id"], false),ctx,"h").w("\" /><select onchange=\"startBackups(I('startbackup_").f(ctx.get(["id"], false),ctx,"h").w("')[I('startbackup_").f(ctx.get(["id"], false),ctx,"h").w("').selectedIndex].value, ").f(ctx.get(["id"], false),ctx,"h").w(")\" id=\"startbackup_").f(ctx.get(["id"], false),ctx,"h").w("\" style=\"margin-left:5px; display:none; line-height: 14px;\" class=\"selectpicker\" data-width=\"20px\"  data-container=\"#data_f\" data-style=\"btn btn-xs\" title=\"\"><option value=\"incr_file\">").f(ctx.get(["tIncremental file backup"], false),ctx,"h").w("</option><option value=\"full_file\">").f(ctx.get(["tFull file backup"], false),ctx,"h").w("</option><option value=\"incr_image\">").f(ctx.get(["tIncremental image backup"], false),ctx,"h").w("</option><option value=\"full_image\">").f(ctx.get(["tFull image backup"], false),ctx,"h").w("</option><option value=\"remove\">").f(ctx.get(["tRemove client"], false),ctx,"h").w("</option></select></td>");}body_1.__dustBody=!0;return body_0;})();
 (function(){dust.register("status_modify_clients",body_0);function body_0(chk,ctx){return chk.w("<div class=\"btn-group\"><a class=\"btn btn-sm btn-default\" href=\"javascript: selectAllClients()\">").f(ctx.get(["tSelect all"], false),ctx,"h").w("</a><a class=\"btn btn-sm btn-default\" href=\"javascript: selectNoClients()\">").f(ctx.get(["tSelect none"], false),ctx,"h").w("</a>").f(ctx.get(["rem_start"], false),ctx,"h",["s"]).w("<a class=\"btn btn-sm btn-default\" href=\"javascript: removeClients()\">").f(ctx.get(["tRemove selected"], false),ctx,"h").w("</a>").f(ctx.get(["rem_stop"], false),ctx,"h",["s"]).w("<div class=\"btn-group dropup\"><button type=\"button\" class=\"btn btn-sm btn-default dropdown-toggle\" data-toggle=\"dropdown\">").f(ctx.get(["tWith Selected"], false),ctx,"h").w(" <span class=\"caret\"></span></button><ul class=\"dropdown-menu\" role=\"menu\">").f(ctx.get(["no_file_backups_start"], false),ctx,"h",["s"]).w("<li><a href=\"javascript: startBackups('incr_file')\">").f(ctx.get(["tIncremental file backup"], false),ctx,"h").w("</a></li><li><a href=\"javascript: startBackups('full_file')\">").f(ctx.get(["tFull file backup"], false),ctx,"h").w("</a></li>").f(ctx.get(["no_file_backups_stop"], false),ctx,"h",["s"]).f(ctx.get(["no_images_start"], false),ctx,"h",["s"]).w("<li><a href=\"javascript: startBackups('incr_image')\">").f(ctx.get(["tIncremental image backup"], false),ctx,"h").w("</a></li><li><a href=\"javascript: startBackups('full_image')\">").f(ctx.get(["tFull image backup"], false),ctx,"h").w("</a></li>").f(ctx.get(["no_images_stop"], false),ctx,"h",["s"]).w("</ul></div></div>");}body_0.__dustBody=!0;return body_0;})();
@@ -1478,6 +1478,18 @@ function show_status2(data)
 		has_client_download=true;
 	}
 	
+	var fileindex_filter=false;
+	if(data.fileindex_filter)
+	{
+		fileindex_filter={
+			entries: data.fileindex_filter.entries,
+			capacity: data.fileindex_filter.capacity,
+			memory_size: format_size(data.fileindex_filter.memory_size),
+			false_positive_rate: (data.fileindex_filter.false_positive_rate*100).toFixed(2)+"%",
+			expected_false_positive_rate: (data.fileindex_filter.expected_false_positive_rate*100).toFixed(2)+"%"
+		};
+	}
+
 	g.server_identity = data.server_identity;
 	
 	ndata=dustRender("status_detail", {rows: rows, ses: g.session,
@@ -1488,7 +1500,7 @@ function show_status2(data)
 		dlt_mod_start: dlt_mod_start, dlt_mod_end: dlt_mod_end, internet_client_added: data.added_new_client, new_authkey: data.new_authkey, new_clientname: data.new_clientname,
 		status_client_download_windows: status_client_download_windows, status_client_download_linux: status_client_download_linux, status_client_download_mac: status_client_download_mac,
 		database_error: database_error, removed_clients_table: removed_clients.length>0, removed_clients: removed_clients,
-		has_client_download: has_client_download, allow_add_client:allow_add_client});
+		has_client_download: has_client_download, allow_add_client:allow_add_client, fileindex_filter: fileindex_filter});
 	
 	if(g.data_f!=ndata)
 	{